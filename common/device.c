@@ -38,7 +38,19 @@
  *
  * The ball device code is also responsible for determining when
  * end-of-ball occurs, and keeps track of the total number of balls
- * in play at all times.
+ * in play at all times.  Each device adds its own share of the
+ * global counts, and adjusts it whenever its count or the number of
+ * balls that it locks changes, so that nothing needs to walk all of
+ * the devices.
+ *
+ * Kicks from all devices go through a common scheduler.  During a
+ * multiball, several devices often want to kick at once; they are
+ * granted in the order that they asked, except that the trough goes
+ * after any playfield device, since balls held there stop the timers.
+ * Kicks are spaced at least DEVICE_KICK_GAP apart, and no more than
+ * DEVICE_KICKS_IN_FLIGHT may be waiting to be seen leaving their
+ * devices.  The time from the first attempt at a kick to the recount
+ * that confirms it is kept in the audits for each device.
  */
 
 #include <freewpc.h>
@@ -85,6 +97,18 @@ U8 held_balls;
 useful */
 U8 kickout_locks;
 
+/** The devices that are ready to kick and waiting for their turn */
+U8 device_kicks_waiting;
+
+/** The devices that have kicked and not yet rechecked their count */
+U8 device_kicks_in_flight;
+
+/** The ticket that will be given to the next device to wait */
+U8 device_next_ticket;
+
+/** The time of the most recent kick from any device */
+U16 device_last_kick_time;
+
 /** The number of times in a row that game start was tried,
 but failed due to missing balls.  After so many errors, the
 game is allowed to start anyway. */
@@ -137,6 +161,10 @@ void device_clear (device_t *dev)
 	dev->state = DEV_STATE_IDLE;
 	dev->props = NULL;
 	dev->virtual_count = 0;
+	dev->counted_share = 0;
+	dev->held_share = 0;
+	dev->kick_ticket = 0;
+	dev->kick_time = 0;
 }
 
 
@@ -184,10 +212,29 @@ U8 device_recount (device_t *dev)
 	count += dev->virtual_count;
 
 	dev->actual_count = count;
+	device_account (dev);
 	return (count);
 }
 
 
+/** Bring this device's share of the global ball counts up to date.
+ * This must be called whenever its actual_count or max_count changes. */
+void device_account (device_t *dev)
+{
+	U8 held = 0;
+
+	counted_balls += dev->actual_count - dev->counted_share;
+	dev->counted_share = dev->actual_count;
+
+	/* Balls beyond those that are locked here are held temporarily.
+	The trough never holds balls in this sense. */
+	if (!trough_dev_p (dev) && dev->actual_count > dev->max_count)
+		held = dev->actual_count - dev->max_count;
+	held_balls += held - dev->held_share;
+	dev->held_share = held;
+}
+
+
 /** Gets the current task's GID and makes sure (optionally) that it is
  * in the range of valid GIDs for devices. */
 static inline U8 device_getgid (void)
@@ -216,6 +263,80 @@ bool device_kicks_pending (void)
 }
 
 
+/** Returns TRUE if a device that is ready to kick may do so now. */
+static bool device_kick_granted (device_t *dev)
+{
+	devicenum_t devno;
+	U8 in_flight = 0;
+	U16 since = get_sys_time () - device_last_kick_time;
+
+	/* A kick whose device was stopped before it could recount would
+	otherwise stay in flight forever. */
+	if (since >= DEVICE_KICK_TIMEOUT)
+		device_kicks_in_flight = 0;
+	else if (since < DEVICE_KICK_GAP)
+		return FALSE;
+
+	for (devno = 0; devno < NUM_DEVICES; devno++)
+	{
+		device_t *other = device_entry (devno);
+
+		if (device_kicks_in_flight & other->devno_mask)
+			in_flight++;
+
+		/* See if another device is ahead of this one.  Ignore devices
+		that stopped while waiting; they keep their ticket for when they
+		start again. */
+		if (other == dev
+			|| !(device_kicks_waiting & other->devno_mask)
+			|| !task_find_gid (DEVICE_GID (devno)))
+			continue;
+		if (trough_dev_p (dev) != trough_dev_p (other))
+		{
+			if (trough_dev_p (dev))
+				return FALSE;
+		}
+		else if ((S8)(other->kick_ticket - dev->kick_ticket) < 0)
+			return FALSE;
+	}
+	return (in_flight < DEVICE_KICKS_IN_FLIGHT);
+}
+
+
+/** Wait until the scheduler allows a device to kick.  The caller
+ * kicks as soon as this returns. */
+static void device_kick_wait (device_t *dev)
+{
+	if (!(device_kicks_waiting & dev->devno_mask))
+	{
+		dev->kick_ticket = device_next_ticket++;
+		device_kicks_waiting |= dev->devno_mask;
+	}
+
+	while (!device_kick_granted (dev))
+		task_sleep (TIME_16MS);
+
+	device_kicks_waiting &= ~dev->devno_mask;
+	device_kicks_in_flight |= dev->devno_mask;
+	device_last_kick_time = get_sys_time ();
+}
+
+
+/** Record the time taken by a confirmed kick, in milliseconds. */
+static void device_kick_audit (device_t *dev)
+{
+	U8 devno = dev->devno;
+	U16 ticks = get_sys_time () - dev->kick_time;
+
+	if (ticks > TIME_1S * 30)
+		ticks = TIME_1S * 30;
+
+	audit_average (&system_audits.device_kicks[devno],
+		&system_audits.device_kick_avg[devno],
+		&system_audits.device_kick_max[devno], ticks * 16);
+}
+
+
 /** The core function for handling a device.
  * This function is invoked (within its own task context) whenever
  * a switch closure occurs on a device, or when a request is made to
@@ -247,6 +368,10 @@ start_update:
 	 * switches and recount */
 	device_recount (dev);
 
+	/* This recount has told whether any kick that was made worked,
+	so it is no longer in flight */
+	device_kicks_in_flight &= ~dev->devno_mask;
+
 	device_update_globals ();
 	device_debug (dev);
 
@@ -348,6 +473,8 @@ start_update:
 				kicked_balls = dev->kicks_needed;
 			}
 
+			device_kick_audit (dev);
+
 			/* Throw a kick success event for each ball that was kicked */
 			while (kicked_balls > 0)
 			{
@@ -410,20 +537,19 @@ start_update:
 			cancel) the kick. */
 			goto start_update;
 		}
-			/* TODO - if multiple devices want to kick at the same time,
-			 * they should be staggered a bit.  Another case should be
-			 * added here. */
 		else
 		{
-			/* The container is ready to kick */
+			/* The container is ready to kick.  Wait for its turn
+			among the other devices that want to kick. */
+			device_kick_wait (dev);
 
-			/* Mark state as releasing if still idle */
+			/* Mark state as releasing if still idle.  Retries of a
+			failed kick keep the time of the first attempt. */
 			if (dev->state == DEV_STATE_IDLE)
+			{
 				dev->state = DEV_STATE_RELEASING;
-
-			/* TODO - keep track of all pending kick attempts.  Use a
-			bit variable per device.  If other devices are in the
-			process of kicking, wait */
+				dev->kick_time = get_sys_time ();
+			}
 
 			/* Generate events that a kick attempt is coming */
 			callset_invoke (any_kick_attempt);
@@ -515,6 +641,7 @@ void device_request_empty (device_t *dev)
 
 	/* Reset count of locked balls */
 	dev->max_count = dev->props->init_max_count;
+	device_account (dev);
 	if (gid != task_getgid ())
 		task_recreate_gid_while (gid, device_update, TASK_DURATION_INF);
 }
@@ -524,30 +651,10 @@ void device_request_empty (device_t *dev)
  * anytime a change happens locally within a particular device. */
 void device_update_globals (void)
 {
-	devicenum_t devno;
-	U8 held_balls_now = 0;
+	/* counted_balls and held_balls are kept up to date by
+	device_account() as each device changes.
 
-	/* TODO - mostly this is called from the context of a single device.
-	Could simplify all the recounting of other devices... */
-
-	/* Recount the total number of balls that are held,
-	excluding those that are locked and those in the trough. */
-	counted_balls = 0;
-	held_balls_now = 0;
-	for (devno = 0; devno < NUM_DEVICES; devno++)
-	{
-		device_t *dev = device_entry (devno);
-		counted_balls += dev->actual_count;
-
-		if (!trough_dev_p (dev))
-			if (dev->actual_count > dev->max_count)
-				held_balls_now += dev->actual_count - dev->max_count;
-	}
-
-	/* Update held_balls atomically */
-	held_balls = held_balls_now;
-
-	/* Update count of how many balls are missing */
+	Update count of how many balls are missing */
 	missing_balls = max_balls - counted_balls;
 
 	/* If 'missing' went negative, this means there are more
@@ -624,11 +731,14 @@ probe_from_beginning:
 		dev->kicks_needed = 0;
 		dev->kick_errors = 0;
 		task_kill_gid (DEVICE_GID(devno));
+		device_kicks_waiting &= ~dev->devno_mask;
+		device_kicks_in_flight &= ~dev->devno_mask;
 
 		/* If there are more balls in the device than ought to be,
 		 * schedule the extras to be emptied.   Then rescan from
 		 * the beginning again. */
 		dev->max_count = dev->props->init_max_count;
+		device_account (dev);
 		if (dev->actual_count > dev->max_count)
 		{
 			kicks++;
@@ -798,6 +908,7 @@ void device_remove_virtual (device_t *dev)
 		dev->virtual_count--;
 		dev->actual_count--;
 		dev->previous_count--;
+		device_account (dev);
 
 		/* Throw the usual events on releases */
 		device_update_globals ();
@@ -955,11 +1066,15 @@ void device_init (void)
 	U8 i;
 
 	max_balls = MACHINE_MAX_BALLS;
-	counted_balls = MACHINE_TROUGH_SIZE;
+	counted_balls = 0;
 	missing_balls = 0;
 	live_balls = 0;
 	kickout_unlock_all ();
 	held_balls = 0;
+	device_kicks_waiting = 0;
+	device_kicks_in_flight = 0;
+	device_next_ticket = 0;
+	device_last_kick_time = 0;
 	device_game_start_errors = 0;
 
 	for (i=0; i < NUM_DEVICES; i++)
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief Build a 4-color frame from a base image and layers on top of it.
+ *
+ * A deff that shows text or an overlay on top of a changing image used
+ * to copy the old frame with dmd_dup_mapped(), then OR the overlay onto
+ * each plane in turn: four passes over a page, plus one more for each
+ * extra layer.  Instead, say what the frame is made of:
+ *
+ *    dmd_compose_begin (wpc_dmd_get_mapped ());
+ *    dmd_compose_layer (DMD_OVERLAY_PAGE, DMD_LAYER_MONO);
+ *    dmd_compose ();
+ *    dmd_show2 ();
+ *
+ * dmd_compose() allocates a new pair and writes each output plane from
+ * the base and all of the layers together.  Where the platform can
+ * address every page at once, that is a single pass per plane.  On WPC,
+ * only two pages can be mapped at a time, so each layer still takes a
+ * pass of its own, but the copy of the base is no more expensive than
+ * with dmd_dup_mapped().
+ *
+ * A frame that will be shown with dmd_show_low() only needs its first
+ * plane; dmd_compose_low() writes just that one.
+ *
+ * Layers are applied in the order they were given:
+ *
+ *    DMD_LAYER_COLOR    a page pair, each ORed onto its own plane
+ *    DMD_LAYER_MONO     one page, ORed onto both planes
+ *    DMD_LAYER_OUTLINE  one page, ORed onto both planes after clearing
+ *                       the pixels that are clear in the following page;
+ *                       see dmd_text_outline()
+ */
+
+#include <freewpc.h>
+
+struct dmd_layer
+{
+	dmd_pagenum_t page;
+	U8 mode;
+};
+
+/** The image that the layers are drawn on top of */
+static dmd_pagepair_t dmd_compose_base;
+
+/** The layers of the next frame */
+static struct dmd_layer dmd_layers[DMD_MAX_LAYERS];
+
+static U8 dmd_layer_count;
+
+
+/**
+ * Start describing a new frame.  BASE is the pair to draw on top of;
+ * it is not changed.
+ */
+void dmd_compose_begin (dmd_pagepair_t base)
+{
+	dmd_compose_base = base;
+	dmd_layer_count = 0;
+}
+
+
+/**
+ * Add a layer on top of those given so far.
+ */
+void dmd_compose_layer (dmd_pagenum_t page, U8 mode)
+{
+	if (dmd_layer_count < DMD_MAX_LAYERS)
+	{
+		dmd_layers[dmd_layer_count].page = page;
+		dmd_layers[dmd_layer_count].mode = mode;
+		dmd_layer_count++;
+	}
+}
+
+
+#ifdef HAVE_PINIO_DMD_PAGE_PTR
+
+/** A mask that keeps every pixel, for layers that have none */
+static const U8 dmd_compose_keep[DMD_PAGE_SIZE] = {
+	[0 ... DMD_PAGE_SIZE-1] = 0xFF
+};
+
+/** Write one plane of the output in a single pass over all of the
+pages involved. */
+static void dmd_compose_plane (U8 plane, dmd_pagenum_t out_page)
+{
+	const U8 *src[DMD_MAX_LAYERS];
+	const U8 *mask[DMD_MAX_LAYERS];
+	const U8 *base;
+	U8 *out;
+	U8 count = dmd_layer_count;
+	U8 n, val;
+	U16 off;
+
+	base = pinio_dmd_page_ptr (plane ? dmd_compose_base.u.second
+		: dmd_compose_base.u.first);
+	out = pinio_dmd_page_ptr (out_page + plane);
+	for (n = 0; n < count; n++)
+	{
+		const struct dmd_layer *layer = &dmd_layers[n];
+		if (layer->mode == DMD_LAYER_COLOR)
+			src[n] = pinio_dmd_page_ptr (layer->page + plane);
+		else
+			src[n] = pinio_dmd_page_ptr (layer->page);
+		if (layer->mode == DMD_LAYER_OUTLINE)
+			mask[n] = pinio_dmd_page_ptr (layer->page + 1);
+		else
+			mask[n] = dmd_compose_keep;
+	}
+
+	for (off = 0; off < DMD_PAGE_SIZE; off++)
+	{
+		val = base[off];
+		for (n = 0; n < count; n++)
+			val = (val & mask[n][off]) | src[n][off];
+		out[off] = val;
+	}
+	dmd_count_pass ();
+}
+
+#else
+
+/** Write one plane of the output, with the output mapped low and each
+of the other pages mapped high in turn. */
+static void dmd_compose_plane (U8 plane, dmd_pagenum_t out_page)
+{
+	const struct dmd_layer *layer;
+	U8 n;
+
+	pinio_dmd_window_set (PINIO_DMD_WINDOW_0, out_page + plane);
+	pinio_dmd_window_set (PINIO_DMD_WINDOW_1,
+		plane ? dmd_compose_base.u.second : dmd_compose_base.u.first);
+	dmd_copy_page (dmd_low_buffer, dmd_high_buffer);
+
+	for (n = 0, layer = dmd_layers; n < dmd_layer_count; n++, layer++)
+	{
+		if (layer->mode == DMD_LAYER_OUTLINE)
+		{
+			pinio_dmd_window_set (PINIO_DMD_WINDOW_1, layer->page + 1);
+			dmd_and_page ();
+		}
+		if (layer->mode == DMD_LAYER_COLOR)
+			pinio_dmd_window_set (PINIO_DMD_WINDOW_1, layer->page + plane);
+		else
+			pinio_dmd_window_set (PINIO_DMD_WINDOW_1, layer->page);
+		dmd_or_page ();
+	}
+}
+
+#endif /* HAVE_PINIO_DMD_PAGE_PTR */
+
+
+/**
+ * Allocate a new pair and draw the frame that was described into it.
+ * The new pair is left mapped, so that more can be drawn on top before
+ * it is shown.
+ */
+void dmd_compose (void)
+{
+	dmd_pagenum_t out_page;
+
+	dmd_alloc_pair ();
+	out_page = dmd_low_page;
+	dmd_compose_plane (0, out_page);
+	dmd_compose_plane (1, out_page);
+	dmd_map_low_high (out_page);
+}
+
+
+/**
+ * Like dmd_compose(), but for a mono frame: only the low page of the
+ * new pair is drawn.
+ */
+void dmd_compose_low (void)
+{
+	dmd_pagenum_t out_page;
+
+	dmd_alloc_low ();
+	out_page = dmd_low_page;
+	dmd_compose_plane (0, out_page);
+	dmd_map_low_high (out_page);
+}
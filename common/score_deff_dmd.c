@@ -337,15 +337,15 @@ void ll_score_strobe_valid (void)
 #endif
 
 #ifdef CONFIG_SCORES_COLOR
-	//dmd_map_overlay ();
-	dmd_dup_mapped ();
-	dmd_overlay_onto_color ();
+	dmd_compose_begin (wpc_dmd_get_mapped ());
+	dmd_compose_layer (DMD_OVERLAY_PAGE, DMD_LAYER_MONO);
+	dmd_compose ();
 	callset_invoke (score_overlay);
 	dmd_show2 ();
 #else
 	dmd_map_overlay ();
-	dmd_dup_mapped ();
-	dmd_overlay ();
+	dmd_compose_begin (wpc_dmd_get_mapped ());
+	dmd_compose_low ();
 	callset_invoke (score_overlay);
 	dmd_show_low ();
 #endif
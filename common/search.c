@@ -36,6 +36,19 @@
  * legitimiately free the ball.  This logic avoids drives attached
  * to flashers or to any game-defined devices that should be avoided,
  * like the knocker or device kickout coils.
+ *
+ * The coils are not fired in a fixed order.  Whenever a switch closes
+ * just after a ball search pulse, that coil is remembered along with
+ * the last playfield switch seen before the ball went missing.  The
+ * next search fires the coils that freed a ball stuck near the same
+ * switch first, then the kickout of an empty device if that switch
+ * belongs to it, then any other coils that have freed a ball before,
+ * and then everything else.  The first search only tries these likely
+ * coils when there are any; later searches fire every coil, and from
+ * the fourth search each coil is pulsed twice.
+ *
+ * The time from the start of the first search to the switch closure
+ * that ended it is audited.
  */
 
 
@@ -48,6 +61,38 @@ U8 ball_search_timeout;
 
 U8 ball_search_count;
 
+/** The last playfield switch seen */
+U8 ball_search_last_sw;
+
+/** The last playfield switch seen before the current search began */
+U8 ball_search_lost_sw;
+
+/** The coil that ball search pulsed most recently, and when */
+U8 ball_search_last_sol;
+U16 ball_search_last_sol_time;
+
+/** The time at which the first of the current ball searches began */
+U16 ball_search_start_time;
+
+/** True while the monitor is searching for a lost ball */
+bool ball_search_active;
+
+/** True if the coil that freed the last ball was fired early because
+of the history */
+bool ball_search_last_sol_likely;
+
+/** The coils that have freed a stuck ball, paired with the switch seen
+last before it was lost.  The most recent is first.  An unused entry
+has a coil of 0xFF. */
+struct ball_search_history
+{
+	U8 sw;
+	U8 sol;
+} ball_search_history[BS_HISTORY_SIZE];
+
+/** The coils that the current search has already fired */
+U8 ball_search_fired[(NUM_POWER_DRIVES + 7) / 8];
+
 /** The amount of time in seconds that this ball has lasted */
 U16 ball_time;
 
@@ -142,12 +187,122 @@ void ball_search_timer_reset (void)
 }
 
 
+/** Remember that the coil SOL freed a ball lost near the switch SW. */
+static void ball_search_learn (U8 sw, U8 sol)
+{
+	U8 i;
+
+	/* Move the pair to the front of the history, dropping the
+	oldest entry if it was not there already. */
+	for (i = 0; i < BS_HISTORY_SIZE - 1; i++)
+		if (ball_search_history[i].sw == sw && ball_search_history[i].sol == sol)
+			break;
+	for (; i > 0; i--)
+		ball_search_history[i] = ball_search_history[i-1];
+	ball_search_history[0].sw = sw;
+	ball_search_history[0].sol = sol;
+}
+
+
+/** Called when a switch ends a ball search.  Audit the time taken,
+and if a coil was pulsed just before, credit it with freeing the ball. */
+static void ball_search_recovered (void)
+{
+	U16 secs;
+
+	ball_search_active = FALSE;
+
+	secs = (get_sys_time () - ball_search_start_time) / TIME_1S;
+	audit_average (&system_audits.search_recoveries,
+		&system_audits.search_recovery_avg,
+		&system_audits.search_recovery_max, secs);
+
+	if (ball_search_last_sol != 0xFF
+		&& (U16)(get_sys_time () - ball_search_last_sol_time) < TIME_1S)
+	{
+		dbprintf ("Ball freed by sol %d\n", ball_search_last_sol);
+		if (ball_search_last_sol_likely)
+			audit_increment (&system_audits.search_learned);
+		ball_search_learn (ball_search_lost_sw, ball_search_last_sol);
+	}
+}
+
+
+/** Called when a playfield switch closes during a game. */
+void ball_search_pf_switch (U8 sw)
+{
+	ball_search_last_sw = sw;
+	if (ball_search_active && ball_search_count > 0)
+		ball_search_recovered ();
+	ball_search_timer_reset ();
+}
+
+
 bool ball_search_timed_out (void)
 {
 	return (ball_search_timer >= ball_search_timeout);
 }
 
 
+/** Pulse one solenoid during a ball search, unless it has already
+been fired in this search or should not be fired at all.  LIKELY says
+that it was chosen from the history. */
+static void ball_search_pulse (U8 sol, bool likely)
+{
+	if (sol >= NUM_POWER_DRIVES
+		|| bitarray_test (ball_search_fired, sol)
+		|| !ball_search_solenoid_ok (sol))
+		return;
+
+	bitarray_set (ball_search_fired, sol);
+	ball_search_last_sol = sol;
+	ball_search_last_sol_likely = likely;
+	ball_search_last_sol_time = get_sys_time ();
+	sol_request_queue (sol, SOL_PRI_SEARCH, TIME_1S);
+	task_sleep (TIME_200MS);
+
+	/* Later searches hit each coil twice, in case the first pulse
+	only moved the ball. */
+	if (ball_search_count >= BS_REPEAT_COUNT && ball_search_timer != 0)
+	{
+		ball_search_last_sol_time = get_sys_time ();
+		sol_request_queue (sol, SOL_PRI_SEARCH, TIME_1S);
+		task_sleep (TIME_200MS);
+	}
+}
+
+
+/** Pulse the coils most likely to free a ball that was lost near
+the switch SW. */
+static void ball_search_run_likely (U8 sw)
+{
+	U8 i;
+
+	/* Coils that freed a ball near the same switch before */
+	for (i = 0; i < BS_HISTORY_SIZE && ball_search_timer != 0; i++)
+		if (ball_search_history[i].sw == sw)
+			ball_search_pulse (ball_search_history[i].sol, TRUE);
+
+	/* If the switch is part of a device that does not count any balls,
+	the ball may be stuck at its entrance */
+	if (sw < NUM_SWITCHES && ball_search_timer != 0)
+	{
+		const switch_info_t *swinfo = switch_lookup (sw);
+		if (SW_HAS_DEVICE (swinfo))
+		{
+			device_t *dev = device_entry (SW_GET_DEVICE (swinfo));
+			if (dev->actual_count == 0)
+				ball_search_pulse (dev->props->sol, TRUE);
+		}
+	}
+
+	/* Coils that freed a ball anywhere else */
+	for (i = 0; i < BS_HISTORY_SIZE && ball_search_timer != 0; i++)
+		if (ball_search_history[i].sol != 0xFF)
+			ball_search_pulse (ball_search_history[i].sol, TRUE);
+}
+
+
 /** Run through all solenoids to try to find a ball. */
 void ball_search_run (void)
 {
@@ -155,6 +310,8 @@ void ball_search_run (void)
 
 	ball_search_count++;
 	dbprintf ("Ball search %d\n", ball_search_count);
+	memset (ball_search_fired, 0, sizeof (ball_search_fired));
+	ball_search_last_sol = 0xFF;
 
 	/* Fire all solenoids.  Skip over solenoids known not to be
 	pertinent to ball search.  Before starting, throw an event
@@ -162,18 +319,15 @@ void ball_search_run (void)
 	callset_invoke (ball_search);
 	task_sleep (TIME_200MS);
 
-	for (sol = 0; sol < NUM_POWER_DRIVES; sol++)
-	{
-		if (ball_search_solenoid_ok (sol))
-		{
-			sol_request_async (sol);
-			task_sleep (TIME_200MS);
-		}
+	/* Try the coils most likely to free the ball first.  If a switch
+	triggers, stop the ball search immediately. */
+	ball_search_run_likely (ball_search_lost_sw);
+
+	/* The first search tries only the likely coils, if it has any */
+	if (ball_search_count > 1 || ball_search_last_sol == 0xFF)
+		for (sol = 0; sol < NUM_POWER_DRIVES && ball_search_timer != 0; sol++)
+			ball_search_pulse (sol, FALSE);
 
-		/* If a switch triggered, stop the ball search immediately */
-		if (ball_search_timer == 0)
-			break;
-	}
 	callset_invoke (ball_search_end);
 }
 
@@ -234,6 +388,9 @@ void ball_search_monitor_task (void)
 			if (ball_search_timed_out ())
 			{
 				ball_search_count = 0;
+				ball_search_lost_sw = ball_search_last_sw;
+				ball_search_start_time = get_sys_time ();
+				ball_search_active = TRUE;
 				while (ball_search_timer != 0)
 				{
 					if ((ball_search_count >= 5) && chase_ball_enabled ())
@@ -280,6 +437,7 @@ void ball_search_monitor_task (void)
 				/* A ball was seen -- clear the counter and exit.  Also refresh devices
 				right away */
 				ball_search_count = 0;
+				ball_search_active = FALSE;
 				callset_invoke (device_update);
 			}
 		}
@@ -303,7 +461,16 @@ void ball_search_monitor_stop (void)
 
 CALLSET_ENTRY (ball_search, init)
 {
+	U8 i;
+
 	ball_search_timeout_set (BS_TIMEOUT_DEFAULT);
+	ball_search_last_sw = ball_search_lost_sw = NUM_SWITCHES;
+	ball_search_active = FALSE;
+	for (i = 0; i < BS_HISTORY_SIZE; i++)
+	{
+		ball_search_history[i].sw = NUM_SWITCHES;
+		ball_search_history[i].sol = 0xFF;
+	}
 }
 
 /*
@@ -322,6 +489,7 @@ CALLSET_ENTRY (ball_search, start_player)
 CALLSET_ENTRY (ball_search, start_ball)
 {
 	ball_time = 0;
+	ball_search_active = FALSE;
 }
 
 /*
@@ -96,7 +96,7 @@ static void launch_ball_task (void)
 		task_sleep (TIME_500MS);
 
 	do {
-		sol_request_async (MACHINE_LAUNCH_SOLENOID);
+		sol_request_queue (MACHINE_LAUNCH_SOLENOID, SOL_PRI_DEVICE, 0);
 		task_sleep (LAUNCH_DELAY);
 	} while (switch_poll_logical (MACHINE_SHOOTER_SWITCH));
 #endif
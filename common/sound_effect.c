@@ -208,8 +208,9 @@ void sound_start1 (U8 channels, sound_code_t code)
 			/* Cancel any sound running on the channel now */
 			//sound_write (SND_INIT_CH0 + chid);
 
-			/* Write to the sound board and return */
-			sound_write (code);
+			/* Write to the sound board and return.  The priority
+			decides which calls are kept if the board falls behind. */
+			sound_write_prio (code, sound_start_prio);
 			return;
 		}
 	}
@@ -87,6 +87,7 @@ CALLSET_ENTRY (tilt, sw_tilt)
 		callset_invoke (tilt);
 		task_remove_duration (TASK_DURATION_LIVE);
 		task_duration_expire (TASK_DURATION_LIVE);
+		timer_duration_expire (TASK_DURATION_LIVE);
 		audit_increment (&system_audits.tilts);
 		audit_increment (&system_audits.plumb_bob_tilts);
 	}
@@ -21,118 +21,68 @@
 #include <freewpc.h>
 
 /* Design:
- * We use the block allocator provided by task.c to provide us with chunks
- * of memory of size 'sizeof (task_t)', which must be at least 41 bytes.
- * 1 byte of this is reserved for task 'state', here it means that the
- * dispatcher should skip those blocks that are being used for dynamic memory.
+ * Dynamic memory comes from a heap which is reserved for it at build
+ * time, apart from the task blocks, so that a burst of allocations can
+ * never use up the blocks needed to start tasks (or vice versa).
  *
- * The raw allocator then reserves the first 4 bytes of any such chunk
- * for its own housekeeping.  See malloc_chunk_header_t.  The chunk header
- * contains next/prev pointers for maintaining a linked list of chunks.
+ * The heap is divided into slabs, one per size class: 8, 16, 32 and 64
+ * bytes.  Each slab is an array of equal sized slots, and each class
+ * has a bitmap of which of its slots are free.  A request is served
+ * from the smallest class that fits; if that class is full, the next
+ * larger one is tried.  The number of slots in each class is set in
+ * include/system/malloc.h and can be changed per machine.
  *
- * The remaining bytes of the chunk are subdivided into smaller blocks
- * that are actually handed out to callers of malloc().  These are called
- * userblocks.  The number of userblocks per chunk depends on the size.
- * Chunks are dedicated to a certain size userblock once created; this
- * is implied by which freelist they are on:
- * - 1 userblock/chunk @ 32 bytes each
- * - 2 userblocks/chunk @ 16 bytes each
- * - 4 userblocks/chunk @ 8 bytes each
+ * Allocation finds the first set bit in at most two bitmap bytes.
+ * Free works out the class and slot from the address alone, since
+ * each slab occupies a known range of the heap, so no per-allocation
+ * header is needed.  Both are constant time, and since nothing is
+ * left half-used, no garbage collection is needed either.
  *
- * Each userblock has a 1-byte header that is used during free to
- * figure out which chunk the block is part of.
+ * With MALLOC_TRACE defined, every call is logged to the debug port,
+ * on a line starting with "mtrace" so that it cannot be mistaken for
+ * the diagnostics below.
+ * tools/mallocreplay replays such a log against this same code, to see
+ * how a machine's allocation pattern fits a given set of slab sizes.
  */
 
-#define ONES_MASK(n) ((1UL << (n)) - 1)
-
 //#define MALLOC_TEST
+//#define MALLOC_TRACE
+
+#if (MALLOC_SLOTS_8 > MALLOC_MAX_SLOTS) || (MALLOC_SLOTS_16 > MALLOC_MAX_SLOTS) \
+	|| (MALLOC_SLOTS_32 > MALLOC_MAX_SLOTS) || (MALLOC_SLOTS_64 > MALLOC_MAX_SLOTS)
+#error "too many malloc slots in a size class"
+#endif
+
 
-enum chunk_type
+/** Describes one size class */
+struct malloc_class
 {
-	CHUNK_TYPE_LEN8 = 0,
-	CHUNK_TYPE_LEN16,
-	CHUNK_TYPE_LEN32,
+	/** The offset of the first slot in the heap */
+	U16 base;
+
+	/** The number of slots */
+	U8 slots;
+
+	/** The slot size, as a power of 2 */
+	U8 shift;
 };
 
-#define NUM_CHUNK_TYPES 3
+static const struct malloc_class malloc_classes[MALLOC_CLASSES] = {
+	{ 0, MALLOC_SLOTS_8, 3 },
+	{ MALLOC_SLOTS_8 * 8, MALLOC_SLOTS_16, 4 },
+	{ MALLOC_SLOTS_8 * 8 + MALLOC_SLOTS_16 * 16, MALLOC_SLOTS_32, 5 },
+	{ MALLOC_SLOTS_8 * 8 + MALLOC_SLOTS_16 * 16 + MALLOC_SLOTS_32 * 32,
+		MALLOC_SLOTS_64, 6 },
+};
 
 
-/** A per-allocation header that precedes the returned buffer pointer,
- * that is used to free it properly. */
-typedef struct _user_header
-{
-	/* Not used.  Keep the reserved bits at the top, as GCC
-	puts earlier fields into the high order bits, which is the
-	least efficient place for them. */
-	U8 reserved : 3;
-
-	/* type says which size chunk this is.  This is written
-	during chunk allocation and remains constant thereafter. */
-	U8 type : 2;
-
-	/* blocknum says which block within the chunk this is.
-	This is written during chunk allocation and remains
-	constant thereafter. */
-	U8 blocknum : 3;
-} user_header_t;
-
-#define NUM_8BYTE_BLOCKS 4
-#define NUM_16BYTE_BLOCKS 2
-#define NUM_32BYTE_BLOCKS 1
-
-
-/** A view of the block structure as it is used for dynamic memory.
- * The size of this structure should be the same as that of the
- * task_struct.  A single chunk corresponds to one or more
- * dynamic memory allocations. */
-typedef struct _malloc_chunk
-{
-	/** Indicates the type of block and whether it is used or not.
-	 * The task_struct has the same field in the same position.
-	 * When used for malloc(), the block always has the bit
-	 * TASK_MALLOC set. */
-	U8 state;
-
-	/** Pointer to the next block in the same list */
-	struct _malloc_chunk *next;
-
-	/** Pointer to the previous  block in the same list */
-	struct _malloc_chunk *prev;
-
-	/** A bitmap that says which userblocks in the chunk
-	are available */
-	U8 available;
-
-	/** A union of the actual data allocations provided to
-	 * the callers of malloc().  Allocations are rounded
-	 * up to the next 8, 16, or 32 byte boundary.
-	 * For each case, there is an element of the union
-	 * that says how those buffers are arranged and tracked. */
-	union {
-		struct {
-			struct userblock8 {
-				user_header_t flags;
-				U8 data[8];
-			} blocks[NUM_8BYTE_BLOCKS];
-		} len8;
-		struct {
-			struct userblock16 {
-				user_header_t flags;
-				U8 data[16];
-			} blocks[NUM_16BYTE_BLOCKS];
-		} len16;
-		struct {
-			struct userblock32 {
-				user_header_t flags;
-				U8 data[32];
-			} blocks[NUM_32BYTE_BLOCKS];
-		} len32;
-	} u;
-} malloc_chunk_t;
-
-
-/** An array of free lists of chunks, indexed by chunk type */
-malloc_chunk_t *chunk_lists[NUM_CHUNK_TYPES];
+/** The heap */
+U8 malloc_heap[MALLOC_HEAP_SIZE];
+
+/** The free slot bitmaps.  A 1 bit means that the slot is free. */
+U8 malloc_free_map[MALLOC_CLASSES][MALLOC_MAX_SLOTS / 8];
+
+struct malloc_stats malloc_stats[MALLOC_CLASSES];
 
 
 /** A lookup table for computing 1^N efficiently */
@@ -168,16 +118,19 @@ static const U8 first_one_table[16] = {
 };
 
 
-static inline enum chunk_type get_chunk_type_for_size (U8 size)
+/** Return the smallest size class that can hold SIZE bytes. */
+static inline U8 malloc_class_for_size (U8 size)
 {
 	/* Note, we favor smaller allocations by checking
 	the sizes in increasing order. */
 	if (size <= 8)
-		return CHUNK_TYPE_LEN8;
+		return 0;
 	else if (size <= 16)
-		return CHUNK_TYPE_LEN16;
+		return 1;
 	else if (size <= 32)
-		return CHUNK_TYPE_LEN32;
+		return 2;
+	else if (size <= 64)
+		return 3;
 	else
 	{
 		dbprintf ("attempt to malloc too much\n");
@@ -186,12 +139,6 @@ static inline enum chunk_type get_chunk_type_for_size (U8 size)
 }
 
 
-static inline malloc_chunk_t **get_chunks_for_type (enum chunk_type type)
-{
-	return &chunk_lists[type];
-}
-
-
 /** Given a bitmask in 'bits', find the first bit position that is
 nonzero.  It is assumed that 'bits' is nonzero.  This function is
 optimized using a lookup table to scan each nibble fast. */
@@ -209,346 +156,117 @@ U8 find_first_one (U8 bits)
 }
 
 
-#if 0
-/** Dump a userblock's status */
-void userblock_dump (enum chunk_type type, U8 blocknum, user_header_t *flags)
+/** Return the slot size of a class, in bytes */
+U8 malloc_class_size (U8 class)
 {
-	if (blocknum != flags->blocknum)
-	{
-		dbprintf ("?B%d/%d", blocknum, flags->blocknum);
-	}
-	else if (type != flags->type)
-	{
-		dbprintf ("?T%d/%d", type, flags->type);
-	}
-	else if (flags->allocated == 0)
-	{
-		dbprintf (".");
-	}
-	else
-	{
-		dbprintf ("X");
-	}
+	return 1 << malloc_classes[class].shift;
 }
-#endif
 
 
-/* Dump the structure of a task block that is used for malloc(). */
-void malloc_chunk_dump (task_t *task)
+/** Return the number of slots in a class */
+U8 malloc_class_slots (U8 class)
 {
-	malloc_chunk_t *chunk = (malloc_chunk_t *)task;
-	enum chunk_type type = chunk->u.len8.blocks[0].flags.type;
-	U8 block, blocks;
-
-	dbprintf ("nx=%p  pv=%p  ", chunk->next, chunk->prev);
+	return malloc_classes[class].slots;
+}
 
-	if (chunk == chunk_lists[type])
-		dbprintf ("HEAD   ");
-	else
-		dbprintf ("       ");
 
-	switch (type)
-	{
-		case CHUNK_TYPE_LEN8:
-			dbprintf ("MEM(8)  ");
-			blocks = NUM_8BYTE_BLOCKS;
-			break;
-		case CHUNK_TYPE_LEN16:
-			dbprintf ("MEM(16) ");
-			blocks = NUM_16BYTE_BLOCKS;
-			break;
-		case CHUNK_TYPE_LEN32:
-			dbprintf ("MEM(32) ");
-			blocks = NUM_32BYTE_BLOCKS;
-			break;
-		default:
-			blocks = 0;
-			break;
-	}
-
-	for (block = 0; block < blocks; block++)
-	{
-		if (chunk->available & (1 << block))
-		{
-			dbprintf (".");
-		}
-		else
-		{
-			dbprintf ("X");
-		}
-	}
-
-	dbprintf ("  %02X\n", chunk->available);
+/** Print the state of each size class. */
+void malloc_dump (void)
+{
+	U8 class;
+	for (class = 0; class < MALLOC_CLASSES; class++)
+		dbprintf ("MEM(%d): %d/%d used, high %d, fail %d, allocs %ld\n",
+			malloc_class_size (class), malloc_stats[class].used,
+			malloc_class_slots (class), malloc_stats[class].high_water,
+			malloc_stats[class].failures, malloc_stats[class].allocs);
 }
 
 
-/** Allocate and initialize a new chunk of memory.  This is used
-internally. */
-malloc_chunk_t *chunk_allocate (enum chunk_type type)
+/** Take a free slot from a class.  Returns NULL if the class is
+full. */
+static void *malloc_class_alloc (U8 class)
 {
-	task_t *task = block_allocate ();
-	malloc_chunk_t *chunk;
-	U8 block;
+	const struct malloc_class *mc = &malloc_classes[class];
+	U8 *map = malloc_free_map[class];
+	struct malloc_stats *st = &malloc_stats[class];
+	U8 slot;
 
-	dbprintf ("allocating chunk for type %d\n", type);
-
-	if (!task)
+	if (map[0])
 	{
-		dbprintf ("block_allocate failed\n");
-		fatal (ERR_MALLOC);
+		slot = find_first_one (map[0]);
+		map[0] &= clear_bit_mask[slot];
 	}
-
-	task->state |= BLOCK_MALLOC;
-	chunk = (malloc_chunk_t *)task;
-
-	/* Initialize each of the user blocks in the chunk */
-	switch (type)
+	else if (map[1])
 	{
-		case CHUNK_TYPE_LEN8:
-			chunk->available = ONES_MASK(NUM_8BYTE_BLOCKS);
-			for (block = 0; block < NUM_8BYTE_BLOCKS; block++)
-			{
-				struct userblock8 *ub = &chunk->u.len8.blocks[block];
-				ub->flags.reserved = 0;
-				ub->flags.type = CHUNK_TYPE_LEN8;
-				ub->flags.blocknum = block;
-			}
-			break;
-		case CHUNK_TYPE_LEN16:
-			chunk->available = ONES_MASK(NUM_16BYTE_BLOCKS);
-			for (block = 0; block < NUM_16BYTE_BLOCKS; block++)
-			{
-				struct userblock16 *ub = &chunk->u.len16.blocks[block];
-				ub->flags.reserved = 0;
-				ub->flags.type = CHUNK_TYPE_LEN16;
-				ub->flags.blocknum = block;
-			}
-			break;
-		case CHUNK_TYPE_LEN32:
-			chunk->available = ONES_MASK(NUM_32BYTE_BLOCKS);
-			for (block = 0; block < NUM_32BYTE_BLOCKS; block++)
-			{
-				struct userblock32 *ub = &chunk->u.len32.blocks[block];
-				ub->flags.reserved = 0;
-				ub->flags.type = CHUNK_TYPE_LEN32;
-				ub->flags.blocknum = block;
-			}
-			break;
-
-		default:
-			dbprintf ("invalid type %d in chunk alloc\n", type);
-			fatal (ERR_MALLOC);
+		slot = find_first_one (map[1]);
+		map[1] &= clear_bit_mask[slot];
+		slot += 8;
 	}
+	else
+		return NULL;
 
-	return chunk;
+	st->allocs++;
+	if (++st->used > st->high_water)
+		st->high_water = st->used;
+	return malloc_heap + mc->base + ((U16)slot << mc->shift);
 }
 
 
 /** Allocate a block of dynamic memory. */
 void *malloc (U8 size)
 {
-	malloc_chunk_t *chunk, *first, **chunkptr;
-	U8 blocknum;
-	enum chunk_type type;
+	U8 class;
 	void *ptr;
 
-	/* Find the first free chunk that can satisfy a request of
-	this size. */
-	type = get_chunk_type_for_size (size);
-	chunkptr = get_chunks_for_type (type);
-
-	if (*chunkptr)
+	for (class = malloc_class_for_size (size); class < MALLOC_CLASSES; class++)
 	{
-		chunk = *chunkptr;
-	}
-	else
-	{
-		/* No chunks of this size are free now.  We need to create
-		a new chunk.  Make it the head of its free list. */
-		chunk = *chunkptr = chunk_allocate (type);
-		chunk->next = chunk->prev = chunk;
-	}
-
-find_free:
-	/* OK, we have at least 1 chunk on the free list, and 'chunk'
-	points to its head.  Find the first free userblock within the
-	chunk.  If the entire block is used up, then move to the next
-	block on the same list.  Note that the lists are doubly-linked,
-	and cyclic, so end-of-list is detected as the pointer wrapping
-	back to the front. */
-	first = chunk;
-	do {
-		if (chunk->available)
+		ptr = malloc_class_alloc (class);
+		if (ptr)
 		{
-			/* There's at least 1 free block here... take the first one */
-			blocknum = find_first_one (chunk->available);
-			chunk->available &= clear_bit_mask[blocknum];
-
-			switch (type)
-			{
-				case CHUNK_TYPE_LEN8:
-				{
-					struct userblock8 *ub = &chunk->u.len8.blocks[blocknum];
-					ptr = ub->data;
-					break;
-				}
-				case CHUNK_TYPE_LEN16:
-				{
-					struct userblock16 *ub = &chunk->u.len16.blocks[blocknum];
-					ptr = ub->data;
-					break;
-				}
-				case CHUNK_TYPE_LEN32:
-				{
-					struct userblock32 *ub = &chunk->u.len32.blocks[blocknum];
-					ptr = ub->data;
-					break;
-				}
-				default:
-					dbprintf ("invalid type %d in find_free\n", type);
-					fatal (ERR_MALLOC);
-			}
+#ifdef MALLOC_TRACE
+			dbprintf ("mtrace malloc %d %p\n", size, ptr);
+#endif
 			return ptr;
 		}
-		else
-		{
-			chunk = chunk->next;
-		}
-	} while (chunk != first);
-
-	/* There are no free blocks on any of the already allocated
-	chunks.  Need to allocate a new chunk then, and add it to
-	the head of the list. */
-	chunk = *chunkptr = chunk_allocate (type);
-	if (chunk == NULL)
-	{
-		/* OK, we couldn't even allocate a block -- this is serious! */
-		fatal (ERR_NO_FREE_TASKS);
+		malloc_stats[class].failures++;
 	}
 
-	chunk->next = first;
-	chunk->prev = first->prev;
-	first->prev->next = chunk;
-	first->prev = chunk;
-	goto find_free;
+	/* Every class that could hold it is full -- this is serious! */
+	dbprintf ("malloc %d failed\n", size);
+	malloc_dump ();
+	fatal (ERR_MALLOC);
 }
 
 
 /** Free a block of dynamically allocated memory. */
 void free (void *ptr)
 {
-	enum chunk_type type;
-	user_header_t *flags;
-	U8 blocknum;
-	malloc_chunk_t *chunk;
-
-	/* Get the chunk type and block number */
-	flags = (user_header_t *)(ptr - 1);
-	type = flags->type;
-	blocknum = flags->blocknum;
-
-	/* Get a pointer to the first userblock for this chunk */
-	switch (type)
+	const struct malloc_class *mc;
+	U16 offset = (U8 *)ptr - malloc_heap;
+	U8 class, slot;
+
+	/* Find the slab that holds the pointer.  The slabs are in order,
+	so it is the last one that starts at or before it. */
+	class = MALLOC_CLASSES-1;
+	while (class > 0 && offset < malloc_classes[class].base)
+		class--;
+	mc = &malloc_classes[class];
+
+	offset -= mc->base;
+	slot = offset >> mc->shift;
+	if ((U16)slot << mc->shift != offset || slot >= mc->slots
+		|| (malloc_free_map[class][slot / 8] & set_bit_mask[slot % 8]))
 	{
-		case CHUNK_TYPE_LEN8:
-			ptr = flags - sizeof (struct userblock8) * blocknum;
-			break;
-
-		case CHUNK_TYPE_LEN16:
-			ptr = flags - sizeof (struct userblock16) * blocknum;
-			break;
-
-		case CHUNK_TYPE_LEN32:
-			ptr = flags - sizeof (struct userblock32) * blocknum;
-			break;
-	}
-
-	/* Back up to the beginning of the chunk */
-	chunk = (malloc_chunk_t *)(ptr - 6);
-
-	/* Mark the block as available again */
-	chunk->available |= set_bit_mask[blocknum];
-
-	/* Note, it is possible that userblocks in this chunk are
-	now free, but the block is still kept by the mallocator
-	and not available for other uses.  In the background,
-	garbage collector will find and free these up. */
-}
-
-
-
-void malloc_collect_task (void)
-{
-	/* Scan all chunks that are not being used at all.
-	Return these back to the block allocator.
-	When to call this is still debatable... */
-	malloc_chunk_t *chunk, *first;
-	U8 type;
-	U8 res;
-
-	for (type = 0; type < NUM_CHUNK_TYPES; type++)
-	{
-restart:
-		first = chunk = chunk_lists[type];
-		if (first)
-		{
-			do {
-				if (chunk->state == BLOCK_MALLOC+BLOCK_USED)
-				{
-					switch (type)
-					{
-						default:
-						case CHUNK_TYPE_LEN8:
-							res = (chunk->available == ONES_MASK(NUM_8BYTE_BLOCKS));
-							break;
-		
-						case CHUNK_TYPE_LEN16:
-							res = (chunk->available == ONES_MASK(NUM_16BYTE_BLOCKS));
-							break;
-		
-						case CHUNK_TYPE_LEN32:
-							res = (chunk->available == ONES_MASK(NUM_32BYTE_BLOCKS));
-							break;
-					}
-	
-					if (res)
-					{
-						dbprintf ("freeing chunk %p\n", chunk);
-						chunk->prev->next = chunk->next;
-						chunk->next->prev = chunk->prev;
-						if (chunk == first)
-						{
-							if (chunk == chunk->next)
-								chunk_lists[type] = NULL;
-							else
-								chunk_lists[type] = chunk->next;
-						}
-						block_free ((task_t *)chunk);
-						goto restart;
-					}
-				}
-				chunk = chunk->next;
-			} while (chunk != first);
-		}
-		task_sleep_sec (1);
+		dbprintf ("bad free %p\n", ptr);
+		fatal (ERR_MALLOC);
 	}
-	task_exit ();
-}
-
 
-CALLSET_ENTRY (malloc, start_game)
-{
-	task_create_anon (malloc_collect_task);
-}
-
-CALLSET_ENTRY (malloc, amode_start)
-{
-	task_create_anon (malloc_collect_task);
-}
-
-CALLSET_ENTRY (malloc, minute_elapsed)
-{
-	task_create_anon (malloc_collect_task);
+	/* Mark the slot as available again */
+	malloc_free_map[class][slot / 8] |= set_bit_mask[slot % 8];
+	malloc_stats[class].used--;
+#ifdef MALLOC_TRACE
+	dbprintf ("mtrace free %p\n", ptr);
+#endif
 }
 
 
@@ -563,8 +281,8 @@ void prealloc (U8 size, U8 count)
 
 #ifdef MALLOC_TEST
 
-#define MAX_USERBLOCK 32
-#define MAX_POINTERS 32
+#define MAX_USERBLOCK 64
+#define MAX_POINTERS 24
 
 U8 *ptrs[MAX_POINTERS];
 
@@ -620,18 +338,17 @@ void malloc_test_thread (void)
 /** Initialize the malloc subsystem */
 CALLSET_ENTRY (malloc, init)
 {
-	/* Make sure malloc_chunk fits into a task_t */
-	dbprintf ("malloc chunk size: %ld\n", sizeof (malloc_chunk_t));
-	dbprintf ("task_t size: %ld\n", sizeof (task_t));
-	if (sizeof (malloc_chunk_t) > sizeof (task_t))
+	U8 class, slot;
+
+	for (class = 0; class < MALLOC_CLASSES; class++)
 	{
-		fatal (ERR_MALLOC);
+		malloc_free_map[class][0] = malloc_free_map[class][1] = 0;
+		for (slot = 0; slot < malloc_classes[class].slots; slot++)
+			malloc_free_map[class][slot / 8] |= set_bit_mask[slot % 8];
 	}
-
-	memset (chunk_lists, 0, sizeof (chunk_lists));
+	memset (malloc_stats, 0, sizeof (malloc_stats));
 
 #ifdef MALLOC_TEST
 	task_create_anon (malloc_test_thread);
 #endif
 } 
-
@@ -42,6 +42,13 @@
  * and the register save/restore routines are written in lots of
  * assembler, though.
  *
+ * Every task other than the current one is on one of two queues, linked
+ * through the 'chain' field: the run queue, of tasks that are ready to
+ * run, in order; or the sleep list, sorted by wakeup time.  On each
+ * 16ms tick, the tasks at the front of the sleep list whose time has
+ * come are moved to the run queue.  So the dispatcher only looks at
+ * tasks that are ready, no matter how many are sleeping.
+ *
  * Caveats:
  * 1) Inside functions that use a lot of assembly, we expect register
  * X to be preserved across calls (e.g. task_save -> task_dispatcher).
@@ -74,6 +81,16 @@ __fastram__ U16 task_save_U, task_save_X;
 /** The static array of task structures */
 task_t task_buffer[NUM_TASKS];
 
+/** Marks the end of a queue */
+#define TASK_NONE -1
+
+/** The first and last tasks on the run queue */
+S8 task_run_head;
+S8 task_run_tail;
+
+/** The first task on the sleep list, which is the next to wake up */
+S8 task_sleep_head;
+
 /** A flag that indicates that dispatching is working as expected.
  * This is set to 1 everytime we dispatch correctly, and to 0
  * periodically from the IRQ.  If the IRQ finds it at 0, that
@@ -221,12 +238,6 @@ void task_dump (void)
 				dbprintf ("  ST %02X", tp->stack_size);
 				dbprintf ("  ARG %04X\n", tp->arg);
 			}
-#ifdef CONFIG_MALLOC
-			else if (tp->state & BLOCK_MALLOC)
-			{
-				malloc_chunk_dump (tp);
-			}
-#endif
 #ifdef CONFIG_EXPAND_STACK
 			else if (tp->state & BLOCK_STACK)
 			{
@@ -240,6 +251,9 @@ void task_dump (void)
 		}
 	}
 	dbprintf ("task_tail = %p\n\n", task_tail);
+#ifdef CONFIG_MALLOC
+	malloc_dump ();
+#endif
 #endif
 }
 
@@ -264,6 +278,7 @@ task_t *block_allocate (void)
 		{
 success:
 			tp->state = BLOCK_USED;
+			tp->index = t;
 #ifdef CONFIG_EXPAND_STACK
 			tp->aux_stack_block = t;
 #endif
@@ -332,20 +347,83 @@ CALLSET_ENTRY (task_chunk, amode_start, end_ball)
 
 
 /** Free a dynamic block of memory. */
-#ifndef CONFIG_MALLOC
-static
-#endif
-void block_free (task_t *tp)
+static void block_free (task_t *tp)
 {
 	tp->state = BLOCK_FREE;
 }
 
 
+/** Add a task to the end of the run queue. */
+static void task_run_append (task_t *tp)
+{
+	tp->chain = TASK_NONE;
+	if (task_run_head == TASK_NONE)
+		task_run_head = tp->index;
+	else
+		task_buffer[task_run_tail].chain = tp->index;
+	task_run_tail = tp->index;
+}
+
+
+/** Add a task to the sleep list, after any tasks which are to
+ * wake up at the same time or earlier. */
+static void task_sleep_insert (task_t *tp)
+{
+	S8 *linkp = &task_sleep_head;
+
+	while (*linkp != TASK_NONE &&
+		!((tp->wakeup - task_buffer[*linkp].wakeup) & 0x8000UL))
+		linkp = &task_buffer[*linkp].chain;
+	tp->chain = *linkp;
+	*linkp = tp->index;
+}
+
+
+/** Remove a task which is not running from the queue that it is on.
+ * This walks the queue, but is only needed when a task is killed. */
+static void task_unlink (task_t *tp)
+{
+	S8 *linkp;
+	S8 prev = TASK_NONE;
+
+	linkp = (tp->state & TASK_BLOCKED) ? &task_sleep_head : &task_run_head;
+	while (*linkp != tp->index)
+	{
+		if (*linkp == TASK_NONE)
+			return;
+		prev = *linkp;
+		linkp = &task_buffer[*linkp].chain;
+	}
+	*linkp = tp->chain;
+	if (!(tp->state & TASK_BLOCKED) && task_run_tail == tp->index)
+		task_run_tail = prev;
+}
+
+
+/** Move the tasks whose wakeup time has been reached from the
+ * sleep list to the run queue.  The list is sorted, so this stops
+ * at the first task that must sleep longer. */
+static void task_wake_expired (void)
+{
+	task_t *tp;
+
+	while (task_sleep_head != TASK_NONE)
+	{
+		tp = &task_buffer[task_sleep_head];
+		if (!time_reached_p (tp->wakeup))
+			break;
+		task_sleep_head = tp->chain;
+		tp->state &= ~TASK_BLOCKED;
+		task_run_append (tp);
+	}
+}
+
+
 /**
  * Allocate a block for a new task.  Failure to allocate a block
  * is considered fatal.  If successfully allocated, the block
  * is initialized to indicate that it is being used for
- * a task.
+ * a task, and it is put on the run queue.
  */
 task_t *task_allocate (void)
 {
@@ -358,6 +436,7 @@ task_t *task_allocate (void)
 		tp->aux_stack_block = -1;
 #endif
 		tp->duration = TASK_DURATION_BALL;
+		task_run_append (tp);
 		return tp;
 	}
 	else
@@ -560,6 +639,7 @@ void task_kill_pid (task_t *tp)
 	if (tp == task_current)
 		fatal (ERR_TASK_KILL_CURRENT);
 
+	task_unlink (tp);
 	task_free (tp);
 	tp->gid = 0;
 #ifdef CONFIG_DEBUG_TASKCOUNT
@@ -676,20 +756,21 @@ void task_set_pointer_arg (task_t *tp, void *arg)
  *
  * This is called from two places: when a task exits, or when a
  * task sleeps/yields.  The parameter 'tp' points to
- * the previous task's task structure pointer.  The search for a new
- * task to run starts with the next task in the table.  Code then
- * jumps back to the first candidate that is eligible, via
- * the task_restore() assembly language routine.
+ * the previous task's task structure.  If it is sleeping, it goes onto
+ * the sleep list.  Then the first task on the run queue is started,
+ * via the task_restore() assembly language routine.
  *
- * After the last entry in the task table is scanned, we execute all of the
+ * Once the run queue is empty, we execute all of the
  * periodic functions.  These functions do not run in task context and cannot
  * sleep.  They are for fixed system components that always need to be
  * scheduled.
  *
  * After the periodic functions finish, we ensure that the system time
- * (in 16ms units) has advanced at least 1 tick before dispatching again from
- * the top of the task table.  This ensures that the periodic functions do
- * not run more often than once per 16ms.
+ * (in 16ms units) has advanced at least 1 tick before waking the
+ * sleeping tasks whose time has come and dispatching again.  This
+ * ensures that the periodic functions do not run more often than once
+ * per 16ms, and that a task which yields does not run again in the
+ * same pass.
  *
  * Historical note: in earlier versions of FreeWPC, periodic functions were
  * called "idle functions", and they would only run if no tasks were queued.
@@ -703,54 +784,44 @@ void task_dispatcher (task_t *tp)
 	task_dispatching_ok = TRUE;
 	task_current = 0;
 
-	/* Go into an infinite loop looking for a task ready to run.
-	Start with the task after the one that was just saved. */
-	for (tp++; ; tp++)
+	/* A task which exited has already been freed.  Any other task
+	that gets here is sleeping. */
+	if (tp->state & BLOCK_TASK)
 	{
-		/* When we reach the end of the task table, call the
-		periodic functions. */
-		if (unlikely (tp == task_tail))
-		{
-			/* Call the debugger.  This is not implemented as a true
-			'idle' event below because it should _always_ be called,
-			even when 'periodic_ok' is not true.  This lets us
-			debug very early initialization. */
-			db_periodic ();
-
-			/* If the system is fully initialized, run the periodic functions. */
-			if (likely (periodic_ok))
-				do_periodic ();
-
-			/* Wait for time to change before continuing.  This ensures that
-			the task table+periodic functions are not scanned/called more
-			frequently than once per 16ms. */
-			while (likely (last_dispatch_time == get_sys_time ()))
-				cpu_idle ();
-			last_dispatch_time = get_sys_time ();
-			task_dispatching_ok = TRUE;
-			
-			/* Reset to the beginning of the task table */
-			tp = &task_buffer[0];
-		}
+		tp->state |= TASK_BLOCKED;
+		task_sleep_insert (tp);
+	}
 
-		/* Only scan blocks that are currently used by a task.  This skips free blocks
-		and blocks used for other purposes. */
-		if (tp->state & (BLOCK_USED | BLOCK_TASK))
+	for (;;)
+	{
+		/* Run the next ready task, if any */
+		if (task_run_head != TASK_NONE)
 		{
-			/* See if the task is asleep and should be enabled again.
-			Compare the time at which it wants to wake up with the current time.
-			The subtraction should yield a negative value when it is ready.  If
-			still not ready, then move on to the next task. */
-			if (tp->state & TASK_BLOCKED)
-			{
-				if (time_reached_p (tp->wakeup))
-					tp->state &= ~TASK_BLOCKED;
-				else
-					continue;
-			}
-
+			tp = &task_buffer[task_run_head];
+			task_run_head = tp->chain;
 			task_restore (tp);
 		}
+
+		/* Call the debugger.  This is not implemented as a true
+		'idle' event below because it should _always_ be called,
+		even when 'periodic_ok' is not true.  This lets us
+		debug very early initialization. */
+		db_periodic ();
+
+		/* If the system is fully initialized, run the periodic functions. */
+		if (likely (periodic_ok))
+			do_periodic ();
+
+		/* Wait for time to change before continuing.  This ensures that
+		the periodic functions are not called more frequently than
+		once per 16ms. */
+		while (likely (last_dispatch_time == get_sys_time ()))
+			cpu_idle ();
+		last_dispatch_time = get_sys_time ();
+		task_dispatching_ok = TRUE;
+
+		/* Queue the tasks that are done sleeping */
+		task_wake_expired ();
 	}
 }
 
@@ -793,8 +864,11 @@ void task_init (void)
 
 	/* Allocate a task for the first (current) thread of execution.
 	 * The calling routine can then sleep and/or create new tasks
-	 * after this point. */
+	 * after this point.  It is already running, so it is not left on
+	 * the run queue. */
+	task_run_head = task_run_tail = task_sleep_head = TASK_NONE;
 	task_current = task_allocate ();
+	task_run_head = TASK_NONE;
 	task_current->gid = GID_FIRST_TASK;
 	task_current->arg.u16 = 0;
 }
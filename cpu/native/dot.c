@@ -25,6 +25,7 @@ void dmd_or_page (void)
 	int n;
 	for (n = 0; n < DMD_PAGE_SIZE; n++)
 		dmd_low_buffer[n] |= dmd_high_buffer[n];
+	dmd_count_pass ();
 }
 
 void dmd_and_page (void)
@@ -32,6 +33,7 @@ void dmd_and_page (void)
 	int n;
 	for (n = 0; n < DMD_PAGE_SIZE; n++)
 		dmd_low_buffer[n] &= dmd_high_buffer[n];
+	dmd_count_pass ();
 }
 
 void dmd_xor_page (void)
@@ -39,5 +41,6 @@ void dmd_xor_page (void)
 	int n;
 	for (n = 0; n < DMD_PAGE_SIZE; n++)
 		dmd_low_buffer[n] ^= dmd_high_buffer[n];
+	dmd_count_pass ();
 }
 
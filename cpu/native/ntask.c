@@ -86,7 +86,11 @@ task_pid_t aux_task_create (task_pid_t pid, task_gid_t gid)
 		auxp->gid = gid;
 		auxp->arg.u16 = 0;
 		auxp->duration = TASK_DURATION_BALL;
+		task_count++;
+		if (task_count > task_max_count)
+			task_max_count = task_count;
 		ui_write_task (auxp - task_data_table, gid);
+		log_event (SEV_DEBUG, MOD_TASK, EV_TASK_START, gid);
 #ifdef CONFIG_DEBUG_TASK
 		printf ("aux_task_create auxp=%p, pid=%p\n", auxp, pid);
 #endif
@@ -104,7 +108,12 @@ void aux_task_delete (task_pid_t pid)
 #endif
 	if (auxp)
 	{
+		if (pid == task_getpid ())
+			log_event (SEV_DEBUG, MOD_TASK, EV_TASK_EXIT, auxp->gid);
+		else
+			log_event (SEV_DEBUG, MOD_TASK, EV_TASK_KILL, auxp->gid);
 		auxp->pid = 0;
+		task_count--;
 		ui_write_task (auxp - task_data_table, 0);
 	}
 	else
@@ -291,6 +300,38 @@ task_gid_t task_getgid (void)
 }
 
 
+/**
+ * Return the name of a group ID, such as "GID_DEFF".  The names are
+ * read from the generated include/gendefine_gid.h, so this only works
+ * when run from the top of the build tree; otherwise it returns "gid<n>".
+ */
+const char *task_gid_name (task_gid_t gid)
+{
+	static char *names[256];
+	static int loaded;
+	static char buf[16];
+	char line[256], name[128];
+	unsigned int val;
+	FILE *fp;
+
+	if (!loaded)
+	{
+		loaded = 1;
+		fp = fopen ("include/gendefine_gid.h", "r");
+		while (fp && fgets (line, sizeof (line), fp))
+			if (sscanf (line, "#define %127s %u", name, &val) == 2 && val < 256
+				&& !strncmp (name, "GID_", 4) && !names[val])
+				names[val] = strdup (name);
+		if (fp)
+			fclose (fp);
+	}
+	if (gid < 256 && names[gid])
+		return names[gid];
+	snprintf (buf, sizeof (buf), "gid%d", gid);
+	return buf;
+}
+
+
 
 void *task_get_class_data (task_pid_t pid)
 {
@@ -0,0 +1,448 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief A crash-safe disk image of protected memory.
+ *
+ * The image file is mapped into memory, but the program never writes to
+ * it directly; it works on its own copy in RAM, as it would on real
+ * hardware.  Changed regions of RAM are written to the image in
+ * transactions:
+ *
+ * 1. The regions, with their new contents, are written to the journal
+ *    file along with a checksum and a commit marker, and the journal
+ *    is synced.
+ * 2. The same regions are copied into the image, which is then synced.
+ *
+ * A crash during step 1 leaves a journal with a bad checksum, which is
+ * ignored; the image still holds the previous transaction.  A crash
+ * during step 2 leaves a good journal, which is replayed at the next
+ * startup.  Either way, every transaction is applied entirely or not
+ * at all.  Replaying a journal that was already applied is harmless,
+ * so the journal is not erased after each commit, only at a clean exit.
+ *
+ * Journal layout (native byte order):
+ *   header:  magic, sequence number, range count, length of ranges
+ *   ranges:  offset, length, followed by that many bytes of data
+ *   trailer: checksum of the header and ranges, commit marker
+ *
+ * This file does not depend on the rest of the system, so that
+ * tools/nvstress can test it on its own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef CONFIG_PTHREADS
+#include <pthread.h>
+#endif
+#include <native/nvjournal.h>
+
+#define NVJ_MAGIC 0x4C4A564EUL   /* "NVJL" */
+#define NVJ_COMMIT 0x54494D43UL  /* "CMIT" */
+
+/** The most regions that can be pending at once.  If more are added,
+they are merged into one that covers them all. */
+#define NVJ_MAX_RANGES 16
+
+/** Changes closer together than this are merged by nvj_add_changes() */
+#define NVJ_MERGE_GAP 16
+
+struct nvj_header
+{
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t count;
+	uint32_t length;
+};
+
+struct nvj_range
+{
+	uint32_t offset;
+	uint32_t len;
+};
+
+struct nvj_trailer
+{
+	uint32_t csum;
+	uint32_t commit;
+};
+
+struct nvj_stats nvj_stats;
+
+/** If set, this is called at each step of a commit.  It is used by
+tools/nvstress to crash the program at those points. */
+void (*nvj_fault_hook) (enum nvj_fault_point point);
+
+static unsigned char *nvj_ram;
+static unsigned int nvj_size;
+static unsigned char *nvj_image;
+static int nvj_fd = -1;
+static int nvj_jfd = -1;
+static uint32_t nvj_seq;
+static struct nvj_range nvj_pending[NVJ_MAX_RANGES];
+static unsigned int nvj_pending_count;
+static unsigned char *nvj_buf;
+
+#ifdef CONFIG_PTHREADS
+static pthread_mutex_t nvj_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define nvj_lock() pthread_mutex_lock (&nvj_mutex)
+#define nvj_unlock() pthread_mutex_unlock (&nvj_mutex)
+#else
+#define nvj_lock()
+#define nvj_unlock()
+#endif
+
+#define nvj_fault(point) \
+	do { if (nvj_fault_hook) nvj_fault_hook (point); } while (0)
+
+
+/** Compute a 32-bit FNV-1a hash */
+static uint32_t nvj_checksum (const unsigned char *p, unsigned int len)
+{
+	uint32_t h = 2166136261UL;
+	while (len-- > 0)
+	{
+		h ^= *p++;
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+
+static int nvj_write (int fd, const void *buf, size_t len, off_t off)
+{
+	const unsigned char *p = buf;
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = pwrite (fd, p, len, off);
+		if (n <= 0)
+			return -1;
+		p += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+
+/**
+ * Replay the journal into the image, if it holds a complete transaction.
+ */
+static void nvj_recover (void)
+{
+	struct stat st;
+	struct nvj_header hdr;
+	struct nvj_trailer trailer;
+	struct nvj_range range;
+	unsigned char *buf;
+	unsigned int pos, n;
+
+	if (fstat (nvj_jfd, &st) < 0
+		|| st.st_size < (off_t)(sizeof (hdr) + sizeof (trailer)))
+		return;
+
+	buf = malloc (st.st_size);
+	if (pread (nvj_jfd, buf, st.st_size, 0) != st.st_size)
+		goto discard;
+
+	memcpy (&hdr, buf, sizeof (hdr));
+	if (hdr.magic != NVJ_MAGIC || hdr.count > NVJ_MAX_RANGES
+		|| hdr.length > st.st_size - sizeof (hdr) - sizeof (trailer))
+		goto discard;
+	memcpy (&trailer, buf + sizeof (hdr) + hdr.length, sizeof (trailer));
+	if (trailer.commit != NVJ_COMMIT
+		|| trailer.csum != nvj_checksum (buf, sizeof (hdr) + hdr.length))
+		goto discard;
+
+	/* Check every range before applying any of them */
+	for (pos = sizeof (hdr), n = 0; n < hdr.count; n++)
+	{
+		memcpy (&range, buf + pos, sizeof (range));
+		pos += sizeof (range);
+		if (range.offset + range.len > nvj_size || range.offset + range.len < range.offset
+			|| pos + range.len > sizeof (hdr) + hdr.length)
+			goto discard;
+		pos += range.len;
+	}
+
+	for (pos = sizeof (hdr), n = 0; n < hdr.count; n++)
+	{
+		memcpy (&range, buf + pos, sizeof (range));
+		pos += sizeof (range);
+		memcpy (nvj_image + range.offset, buf + pos, range.len);
+		pos += range.len;
+	}
+	msync (nvj_image, nvj_size, MS_SYNC);
+	nvj_seq = hdr.seq;
+	nvj_stats.recovered++;
+	free (buf);
+	return;
+
+discard:
+	nvj_stats.discarded++;
+	free (buf);
+}
+
+
+/**
+ * Unmap the image and close the files.
+ */
+static void nvj_release (void)
+{
+	if (nvj_image)
+	{
+		msync (nvj_image, nvj_size, MS_SYNC);
+		munmap (nvj_image, nvj_size);
+		nvj_image = NULL;
+	}
+	if (nvj_jfd >= 0)
+		close (nvj_jfd);
+	if (nvj_fd >= 0)
+		close (nvj_fd);
+	nvj_jfd = nvj_fd = -1;
+	free (nvj_buf);
+	nvj_buf = NULL;
+}
+
+
+/**
+ * Open the image and journal files, recover from any crash, and load
+ * the image into RAM.  SIZE bytes at RAM are the protected memory.
+ * Returns zero on success.
+ */
+int nvj_open (const char *image_file, const char *journal_file,
+	unsigned char *ram, unsigned int size)
+{
+	struct stat st;
+
+	nvj_ram = ram;
+	nvj_size = size;
+	nvj_pending_count = 0;
+
+	nvj_fd = open (image_file, O_RDWR | O_CREAT, 0644);
+	if (nvj_fd < 0)
+		goto fail;
+	if (fstat (nvj_fd, &st) < 0)
+		goto fail;
+	if (st.st_size != size && ftruncate (nvj_fd, size) < 0)
+		goto fail;
+
+	nvj_image = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, nvj_fd, 0);
+	if (nvj_image == MAP_FAILED)
+	{
+		nvj_image = NULL;
+		goto fail;
+	}
+
+	nvj_jfd = open (journal_file, O_RDWR | O_CREAT, 0644);
+	if (nvj_jfd < 0)
+		goto fail;
+
+	/* Pending ranges may overlap, so each could be as large as the
+	whole image */
+	nvj_buf = malloc (sizeof (struct nvj_header)
+		+ NVJ_MAX_RANGES * (sizeof (struct nvj_range) + size)
+		+ sizeof (struct nvj_trailer));
+
+	nvj_recover ();
+	memcpy (ram, nvj_image, size);
+	return 0;
+
+fail:
+	nvj_release ();
+	return -1;
+}
+
+
+/**
+ * Mark LEN bytes at OFFSET as changed, to be written at the next commit.
+ */
+void nvj_add (unsigned int offset, unsigned int len)
+{
+	struct nvj_range *r;
+	unsigned int n, end;
+
+	if (offset >= nvj_size)
+		return;
+	if (len > nvj_size - offset)
+		len = nvj_size - offset;
+	if (len == 0)
+		return;
+	end = offset + len;
+
+	nvj_lock ();
+	for (n = 0, r = nvj_pending; n < nvj_pending_count; n++, r++)
+	{
+		if (offset <= r->offset + r->len && end >= r->offset)
+		{
+			if (r->offset + r->len > end)
+				end = r->offset + r->len;
+			if (r->offset < offset)
+				offset = r->offset;
+			r->offset = offset;
+			r->len = end - offset;
+			nvj_unlock ();
+			return;
+		}
+	}
+
+	if (nvj_pending_count == NVJ_MAX_RANGES)
+	{
+		for (n = 0, r = nvj_pending; n < nvj_pending_count; n++, r++)
+		{
+			if (r->offset < offset)
+				offset = r->offset;
+			if (r->offset + r->len > end)
+				end = r->offset + r->len;
+		}
+		nvj_pending_count = 0;
+	}
+	r = &nvj_pending[nvj_pending_count++];
+	r->offset = offset;
+	r->len = end - offset;
+	nvj_unlock ();
+}
+
+
+/**
+ * Mark every region that differs from the image as changed.
+ */
+void nvj_add_changes (void)
+{
+	unsigned int off = 0, start, last;
+
+	if (!nvj_image)
+		return;
+	while (off < nvj_size)
+	{
+		if (nvj_ram[off] == nvj_image[off])
+		{
+			off++;
+			continue;
+		}
+		start = last = off;
+		for (off = start + 1; off < nvj_size && off - last <= NVJ_MERGE_GAP; off++)
+			if (nvj_ram[off] != nvj_image[off])
+				last = off;
+		nvj_add (start, last + 1 - start);
+		off = last + 1;
+	}
+}
+
+
+/**
+ * Write all pending changes to the image as one transaction.
+ * Returns zero on success.  On failure, the changes stay pending.
+ */
+int nvj_commit (void)
+{
+	struct nvj_header hdr;
+	struct nvj_trailer trailer;
+	struct nvj_range *r;
+	unsigned char *p;
+	unsigned int n, body;
+	int rc = -1;
+
+	nvj_lock ();
+	if (!nvj_image || nvj_pending_count == 0)
+	{
+		nvj_unlock ();
+		return 0;
+	}
+
+	/* Build the whole transaction in memory first */
+	p = nvj_buf + sizeof (hdr);
+	for (n = 0, r = nvj_pending; n < nvj_pending_count; n++, r++)
+	{
+		memcpy (p, r, sizeof (*r));
+		p += sizeof (*r);
+		memcpy (p, nvj_ram + r->offset, r->len);
+		p += r->len;
+	}
+	body = p - nvj_buf - sizeof (hdr);
+
+	hdr.magic = NVJ_MAGIC;
+	hdr.seq = nvj_seq + 1;
+	hdr.count = nvj_pending_count;
+	hdr.length = body;
+	memcpy (nvj_buf, &hdr, sizeof (hdr));
+	trailer.csum = nvj_checksum (nvj_buf, sizeof (hdr) + body);
+	trailer.commit = NVJ_COMMIT;
+	memcpy (p, &trailer, sizeof (trailer));
+
+	/* Step 1: write and sync the journal */
+	if (nvj_write (nvj_jfd, nvj_buf, sizeof (hdr), 0) < 0)
+		goto out;
+	nvj_fault (NVJ_FAULT_HEADER);
+	if (nvj_write (nvj_jfd, nvj_buf + sizeof (hdr), body / 2, sizeof (hdr)) < 0)
+		goto out;
+	nvj_fault (NVJ_FAULT_DATA);
+	if (nvj_write (nvj_jfd, nvj_buf + sizeof (hdr) + body / 2,
+			body - body / 2 + sizeof (trailer), sizeof (hdr) + body / 2) < 0)
+		goto out;
+	nvj_fault (NVJ_FAULT_TRAILER);
+	if (fdatasync (nvj_jfd) < 0)
+		goto out;
+	nvj_fault (NVJ_FAULT_SYNCED);
+
+	/* Step 2: apply the changes to the image and sync it */
+	for (n = 0, r = nvj_pending; n < nvj_pending_count; n++, r++)
+	{
+		memcpy (nvj_image + r->offset, nvj_ram + r->offset, r->len);
+		nvj_stats.bytes += r->len;
+		nvj_fault (NVJ_FAULT_APPLY);
+	}
+	if (msync (nvj_image, nvj_size, MS_SYNC) < 0)
+		goto out;
+	nvj_fault (NVJ_FAULT_APPLIED);
+
+	nvj_seq++;
+	nvj_stats.commits++;
+	nvj_pending_count = 0;
+	rc = 0;
+out:
+	nvj_unlock ();
+	return rc;
+}
+
+
+/**
+ * Close the image.  Pending changes must be committed first.  The
+ * journal is emptied, since the image is now known to be complete.
+ */
+void nvj_close (void)
+{
+	if (nvj_image)
+	{
+		msync (nvj_image, nvj_size, MS_SYNC);
+		if (ftruncate (nvj_jfd, 0) == 0)
+			fdatasync (nvj_jfd);
+	}
+	nvj_release ();
+}
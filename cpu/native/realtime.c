@@ -19,7 +19,9 @@
  */
 
 #include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <freewpc.h>
 #include <native/log.h>
 #include <simulation.h>
@@ -44,6 +46,21 @@ unsigned long realtime_read (void)
 	return realtime_counter;
 }
 
+#ifdef CONFIG_TRACE
+/**
+ * Returns a free-running microsecond clock for timestamping trace
+ * records.  Unlike realtime_read(), this is real time, not simulated
+ * time, so it shows how long the native code actually took.
+ */
+U32 trace_read_clock (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (U32)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+#endif
+
+
 /** Realtime callback function.
  *
  * This event simulates an elapsed 1ms.
@@ -94,6 +111,54 @@ void realtime_tick (void)
 }
 
 
+#ifdef CONFIG_GREEN
+/** When true, the clock does not follow real time: each call to
+realtime_idle() just runs the next tick. */
+bool realtime_free_run;
+
+
+/**
+ * Wait for the next 1ms to pass, and run the realtime functions for it.
+ *
+ * The green-thread dispatcher calls this when no task is ready to run, in
+ * place of a separate realtime task.  If the tasks kept the CPU for longer
+ * than 1ms, the missed ticks are all run now, so that the simulated time
+ * keeps up with real time.
+ */
+void realtime_idle (void)
+{
+	static unsigned long next_usecs;
+	struct timespec ts;
+	unsigned long now;
+
+	if (realtime_free_run)
+	{
+		realtime_counter++;
+		realtime_tick ();
+		return;
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+	if (next_usecs == 0)
+		next_usecs = now;
+
+	if (now < next_usecs)
+	{
+		usleep (next_usecs - now);
+		now = next_usecs;
+	}
+
+	while (now >= next_usecs)
+	{
+		realtime_counter++;
+		realtime_tick ();
+		next_usecs += 1000;
+	}
+}
+
+#else
+
 /**
  * Implement a realtime loop on a non-realtime OS.
  *
@@ -131,10 +196,10 @@ void realtime_loop (void)
 		int usecs_asked = 1000 - usecs_elapsed - 100;
 		if (usecs_asked > 0)
 		{
-#if defined(CONFIG_PTH)
-			pth_nap (pth_time (0, usecs_asked));
-#elif defined(CONFIG_PTHREADS)
+#if defined(CONFIG_PTHREADS)
 			usleep (usecs_asked);
+#elif defined(CONFIG_PTH)
+			pth_nap (pth_time (0, usecs_asked));
 #else
 #error "No thread library supported for realtime yet"
 #endif
@@ -181,6 +246,7 @@ void realtime_loop (void)
 		that we stay on schedule */
 	}
 }
+#endif /* CONFIG_GREEN */
 
 
 CALLSET_ENTRY (native_realtime, init)
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief A sampling profiler for the native build.
+ *
+ * While the sampler runs, SIGPROF interrupts the program SAMPLER_HZ
+ * times per second of CPU time.  Each sample records the group ID of the
+ * task that was running and the call stack, and identical samples are
+ * counted together in a fixed table, so that nothing is allocated inside
+ * the signal handler.
+ *
+ * sampler_write() saves the table as folded stacks, one line per stack:
+ *
+ *   GID_DEFF;deff_start_task;tz_clock_deff;dmd_draw_border 12
+ *
+ * with the task's group ID as the outermost frame.  This is the input
+ * format of flamegraph.pl, speedscope and similar tools.  Samples taken
+ * outside of any task, such as in the green-thread dispatcher, are
+ * shown under 'idle'.
+ *
+ * The sample rate is in CPU time, not simulated time.  With the
+ * green-thread backend, simulated time only moves in the idle loop, so
+ * a sample taken on every simulated tick would always land there.
+ */
+
+#define _GNU_SOURCE /* for dladdr */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+#include <freewpc.h>
+#include <native/sampler.h>
+
+/** The sample rate.  This is prime so that it does not beat with the
+1ms and 16ms periodic functions. */
+#define SAMPLER_HZ 997
+
+/** The deepest stack that is recorded; deeper frames are dropped from
+the outer end. */
+#define SAMPLER_MAX_DEPTH 32
+
+/** The number of distinct stacks that can be counted */
+#define SAMPLER_SLOTS 8192
+
+/** Frames at the top of each backtrace that belong to the handler
+itself: sampler_handler() and the signal trampoline */
+#define SAMPLER_SKIP 2
+
+/** The group ID recorded for samples taken outside of any task */
+#define SAMPLER_GID_IDLE 0
+
+struct sampler_slot
+{
+	unsigned long count;
+	unsigned int hash;
+	U8 gid;
+	U8 depth;
+	void *pc[SAMPLER_MAX_DEPTH];
+};
+
+static struct sampler_slot sampler_table[SAMPLER_SLOTS];
+
+/** Nonzero while samples are being taken */
+static volatile int sampler_running;
+
+/** Nonzero while the handler is updating the table */
+static volatile int sampler_busy;
+
+struct sampler_stats sampler_stats;
+
+
+static unsigned int sampler_hash (U8 gid, void **pc, int depth)
+{
+	unsigned int hash = 2166136261U ^ gid;
+	while (depth-- > 0)
+		hash = (hash ^ (unsigned long)*pc++) * 16777619U;
+	return hash ? hash : 1;
+}
+
+
+/** Record one sample.  This runs in the task that was interrupted. */
+static void sampler_handler (int sig)
+{
+	void *pc[SAMPLER_MAX_DEPTH + SAMPLER_SKIP];
+	struct sampler_slot *slot;
+	unsigned int hash, n;
+	int depth;
+	U8 gid;
+
+	if (!sampler_running || __sync_lock_test_and_set (&sampler_busy, 1))
+		return;
+
+	depth = backtrace (pc, SAMPLER_MAX_DEPTH + SAMPLER_SKIP) - SAMPLER_SKIP;
+	if (depth < 0)
+		depth = 0;
+	gid = task_getpid () ? task_getgid () : SAMPLER_GID_IDLE;
+	hash = sampler_hash (gid, pc + SAMPLER_SKIP, depth);
+
+	sampler_stats.samples++;
+	for (n = 0; n < SAMPLER_SLOTS; n++)
+	{
+		slot = &sampler_table[(hash + n) % SAMPLER_SLOTS];
+		if (slot->hash == 0)
+		{
+			slot->hash = hash;
+			slot->gid = gid;
+			slot->depth = depth;
+			memcpy (slot->pc, pc + SAMPLER_SKIP, depth * sizeof (void *));
+			sampler_stats.stacks++;
+		}
+		else if (slot->hash != hash || slot->gid != gid || slot->depth != depth
+			|| memcmp (slot->pc, pc + SAMPLER_SKIP, depth * sizeof (void *)))
+			continue;
+		slot->count++;
+		break;
+	}
+	if (n == SAMPLER_SLOTS)
+		sampler_stats.dropped++;
+
+	__sync_lock_release (&sampler_busy);
+}
+
+
+/** Start taking samples, adding to any taken before. */
+void sampler_start (void)
+{
+	struct sigaction act;
+	struct itimerval timer;
+	void *dummy[1];
+
+	/* The first backtrace() loads the unwinder, which is not safe to
+	do inside a signal handler */
+	backtrace (dummy, 1);
+
+	memset (&act, 0, sizeof (act));
+	act.sa_handler = sampler_handler;
+	act.sa_flags = SA_RESTART;
+	sigemptyset (&act.sa_mask);
+	sigaction (SIGPROF, &act, NULL);
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / SAMPLER_HZ;
+	timer.it_value = timer.it_interval;
+	sampler_running = 1;
+	setitimer (ITIMER_PROF, &timer, NULL);
+}
+
+
+/** Stop taking samples.  The samples taken so far are kept. */
+void sampler_stop (void)
+{
+	struct itimerval timer;
+
+	memset (&timer, 0, sizeof (timer));
+	setitimer (ITIMER_PROF, &timer, NULL);
+	sampler_running = 0;
+}
+
+
+/** Discard all samples. */
+void sampler_reset (void)
+{
+	int running = sampler_running;
+
+	sampler_running = 0;
+	while (sampler_busy)
+		;
+	memset (sampler_table, 0, sizeof (sampler_table));
+	memset (&sampler_stats, 0, sizeof (sampler_stats));
+	sampler_running = running;
+}
+
+
+/** A function in the program, from its symbol table */
+struct sampler_symbol
+{
+	unsigned long addr;
+	char *name;
+};
+
+static struct sampler_symbol *sampler_symbols;
+static unsigned int sampler_symbol_count;
+
+/** The difference between where the program was linked and where it
+was loaded */
+static unsigned long sampler_load_offset;
+
+
+/** Read the program's own symbol table with nm, so that static
+functions can be named too.  dladdr() only knows exported symbols. */
+static void sampler_load_symbols (void)
+{
+	char exe[256], line[512], name[256], type;
+	unsigned int max = 0;
+	unsigned long addr;
+	ssize_t len;
+	FILE *fp;
+
+	if (sampler_symbols)
+		return;
+	len = readlink ("/proc/self/exe", exe, sizeof (exe) - 1);
+	if (len < 0)
+		return;
+	exe[len] = '\0';
+	snprintf (line, sizeof (line), "nm -n --defined-only '%s' 2>/dev/null", exe);
+	fp = popen (line, "r");
+	if (!fp)
+		return;
+
+	while (fgets (line, sizeof (line), fp))
+	{
+		if (sscanf (line, "%lx %c %255s", &addr, &type, name) != 3)
+			continue;
+		if (!strcmp (name, "sampler_start"))
+			sampler_load_offset = (unsigned long)sampler_start - addr;
+		if (type != 't' && type != 'T' && type != 'w' && type != 'W')
+			continue;
+		if (sampler_symbol_count == max)
+		{
+			max = max ? max * 2 : 1024;
+			sampler_symbols = realloc (sampler_symbols,
+				max * sizeof (struct sampler_symbol));
+		}
+		sampler_symbols[sampler_symbol_count].addr = addr;
+		sampler_symbols[sampler_symbol_count].name = strdup (name);
+		sampler_symbol_count++;
+	}
+	pclose (fp);
+}
+
+
+/** Return the name of the function containing a code address. */
+static const char *sampler_symbol_name (void *pc)
+{
+	unsigned long addr = (unsigned long)pc - sampler_load_offset;
+	unsigned int lo = 0, hi = sampler_symbol_count;
+	Dl_info info;
+
+	while (hi - lo > 1)
+	{
+		unsigned int mid = (lo + hi) / 2;
+		if (sampler_symbols[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (sampler_symbol_count && sampler_symbols[lo].addr <= addr
+		&& lo < sampler_symbol_count - 1)
+		return sampler_symbols[lo].name;
+
+	/* Not in the program; try the shared libraries, which only name
+	their exported functions */
+	if (dladdr (pc, &info))
+	{
+		if (info.dli_sname)
+			return info.dli_sname;
+		if (info.dli_fname)
+			return strrchr (info.dli_fname, '/')
+				? strrchr (info.dli_fname, '/') + 1 : info.dli_fname;
+	}
+	return "??";
+}
+
+
+/** Name a group ID in the output. */
+static const char *sampler_gid_name (U8 gid)
+{
+	if (gid == SAMPLER_GID_IDLE)
+		return "idle";
+	return task_gid_name (gid);
+}
+
+
+/**
+ * Write the samples as folded stacks.  Also logs how the samples are
+ * spread across group IDs.  Returns -1 if the file cannot be written.
+ */
+int sampler_write (const char *filename)
+{
+	unsigned long per_gid[256];
+	struct sampler_slot *slot;
+	unsigned int n, gid;
+	int frame, running;
+	FILE *fp;
+
+	fp = fopen (filename, "w");
+	if (!fp)
+		return -1;
+
+	running = sampler_running;
+	sampler_running = 0;
+	sampler_load_symbols ();
+	memset (per_gid, 0, sizeof (per_gid));
+
+	for (n = 0; n < SAMPLER_SLOTS; n++)
+	{
+		slot = &sampler_table[n];
+		if (!slot->count)
+			continue;
+		per_gid[slot->gid] += slot->count;
+		fputs (sampler_gid_name (slot->gid), fp);
+		for (frame = slot->depth - 1; frame >= 0; frame--)
+		{
+			/* Return addresses point after the call; step back into
+			it, except for the interrupted instruction itself */
+			void *pc = slot->pc[frame];
+			if (frame > 0)
+				pc = (char *)pc - 1;
+			fprintf (fp, ";%s", sampler_symbol_name (pc));
+		}
+		fprintf (fp, " %lu\n", slot->count);
+	}
+	fclose (fp);
+
+	printf ("Sampler: %lu samples, %lu stacks, %lu dropped, in %s\n",
+		sampler_stats.samples, sampler_stats.stacks, sampler_stats.dropped,
+		filename);
+	for (gid = 0; gid < 256; gid++)
+		if (per_gid[gid])
+			printf ("  %-32s %6lu  %5.1f%%\n", sampler_gid_name (gid),
+				per_gid[gid], per_gid[gid] * 100.0 / sampler_stats.samples);
+
+	sampler_running = running;
+	return 0;
+}
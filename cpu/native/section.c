@@ -21,6 +21,7 @@
 #include <freewpc.h>
 #undef sprintf
 #include <native/log.h>
+#include <native/nvjournal.h>
 
 /**
  * \file
@@ -28,35 +29,65 @@
  *
  * Protected memory variables can be detected because they reside in a special
  * section of the output file (in much the same way that the 6809 compile does
- * it).  The entire block of RAM can be read from/written to a file to
- * provide persistence.
+ * it).  The block of RAM is kept in a disk image to provide persistence.
+ *
+ * Writes to the image go through a journal (see nvjournal.c), so that
+ * a crash or power cut while saving cannot leave it half-written.  The
+ * csum module commits each area that changed together with the file
+ * table entry that holds its checksum, so the two always agree on disk:
+ * at once for csum_area_update(), and within a second for audits.
+ * Anything else that changed is written at exit.
  */
 
-/** The name of the backing file */
-char protected_memory_file[256] = "nvram/default.nv";
+/** The name of the backing file.  If not set on the command-line,
+it is named after the machine. */
+char protected_memory_file[256];
+
+/** The name of the journal file */
+char protected_memory_journal_file[256];
 
 
 /** Load the contents of the protected memory from file to RAM. */
 void protected_memory_load (void)
 {
 	int size = AREA_SIZE(nvram);
-	FILE *fp;
 
 	/* Use a different file for each machine */
-	sprintf (protected_memory_file, "nvram/%s.nv", MACHINE_SHORTNAME);
-
-	print_log ("Loading protected memory from '%s'\n", protected_memory_file);
-	fp = fopen (protected_memory_file, "r");
-	if (fp)
+	if (!*protected_memory_file)
 	{
-		fread (AREA_BASE(nvram), 1, size, fp);
-		fclose (fp);
+		sprintf (protected_memory_file, "nvram/%s.nv", MACHINE_SHORTNAME);
+		sprintf (protected_memory_journal_file, "nvram/%s.jnl", MACHINE_SHORTNAME);
 	}
-	else
+
+	print_log ("Loading protected memory from '%s'\n", protected_memory_file);
+	if (nvj_open (protected_memory_file, protected_memory_journal_file,
+		(U8 *)AREA_BASE(nvram), size) < 0)
 	{
 		print_log ("Error loading memory, using defaults\n");
 		memset (AREA_BASE(nvram), 0, size);
 	}
+	else if (nvj_stats.recovered)
+	{
+		print_log ("Recovered last change from '%s'\n",
+			protected_memory_journal_file);
+	}
+}
+
+
+/** Mark a region of protected memory as changed.  It is written
+ * out at the next call to protected_memory_commit(). */
+void protected_memory_journal (const void *ptr, U16 len)
+{
+	nvj_add ((const U8 *)ptr - (const U8 *)AREA_BASE(nvram), len);
+}
+
+
+/** Write all changed regions of protected memory to disk, as a
+ * single transaction. */
+void protected_memory_commit (void)
+{
+	if (nvj_commit () < 0)
+		print_log ("Warning: could not write to memory file\n");
 }
 
 
@@ -64,24 +95,13 @@ void protected_memory_load (void)
 void protected_memory_save (void)
 {
 	int size = AREA_SIZE(nvram);
-	FILE *fp;
 
 	print_log ("Saving 0x%X bytes of protected memory to %s\n", size, protected_memory_file);
-	fp = fopen (protected_memory_file, "w");
-	if (fp)
+	nvj_add_changes ();
+	if (nvj_commit () < 0)
 	{
-		if (fwrite (AREA_BASE(nvram), 1, size, fp) < size)
-		{
-			print_log ("Warning: could not save all of memory\n");
-			task_sleep_sec (1);
-		}
-		fclose (fp);
-	}
-	else
-	{
-		print_log ("Warning: could not write to memory file\n");
+		print_log ("Warning: could not save all of memory\n");
 		task_sleep_sec (1);
 	}
+	nvj_close ();
 }
-
-
@@ -0,0 +1,378 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <poll.h>
+#include <freewpc.h>
+#include <native/log.h>
+
+/**
+ * \file
+ * \brief This module implements the task scheduler under Linux with
+ * green threads: every task runs on its own stack, but all of them share
+ * one OS thread, and switch only when they sleep or exit.
+ *
+ * The scheduling follows the 6809 dispatcher in cpu/m6809/task.c, so
+ * that a game behaves the same way here as on the real machine.  New
+ * tasks go to the end of a run queue.  A task that sleeps goes into a
+ * list sorted by wakeup time.  When the run queue is empty, the
+ * dispatcher waits for the system time to change and then moves the
+ * tasks whose time has come onto the run queue; task_sleep(0) therefore
+ * runs again on the next tick, not right away.
+ *
+ * On the 6809, the IRQ interrupts the dispatcher while it waits.  Here,
+ * the dispatcher calls realtime_idle() instead, which sleeps until the
+ * next 1ms and runs the realtime functions, so there is no separate
+ * realtime task.  Those functions run with no current task, like the
+ * periodic functions on the 6809, and cannot sleep either.
+ */
+
+/** The size of each task's stack.  The pages are only backed by
+memory as they are touched. */
+#ifndef GREEN_STACK_SIZE
+#define GREEN_STACK_SIZE (256 * 1024UL)
+#endif
+
+#define TASK_NONE -1
+
+enum green_state
+{
+	GREEN_FREE,
+	GREEN_READY,
+	GREEN_BLOCKED,
+};
+
+struct green_task
+{
+	/** The saved registers, while the task is not running */
+	ucontext_t context;
+
+	/** The start of the stack mapping, including the guard page at
+	the bottom.  It is kept when the task exits, and reused by the next
+	task that gets the same entry.  The first task has none: it runs on
+	the stack of main(). */
+	void *stack;
+
+	/** The function that a new task starts at */
+	task_function_t fn;
+
+	/** When the task should wake up, in system time ticks */
+	U16 wakeup;
+
+	enum green_state state;
+
+	/** The next task on the run queue or sleep list */
+	S8 chain;
+
+	/** This entry's index in green_tasks[] */
+	S8 index;
+};
+
+struct green_task green_tasks[NUM_TASKS];
+
+/** The task now running, or NULL inside the dispatcher */
+struct green_task *green_current;
+
+static S8 green_run_head;
+static S8 green_run_tail;
+static S8 green_sleep_head;
+
+/** The dispatcher runs in its own context, so that a task which exits
+can leave its stack before the stack is given to another task. */
+static ucontext_t green_dispatch_context;
+
+static U16 last_dispatch_time;
+
+static size_t green_page_size;
+
+
+/** Add a task to the end of the run queue. */
+static void green_run_append (struct green_task *tp)
+{
+	tp->chain = TASK_NONE;
+	tp->state = GREEN_READY;
+	if (green_run_head == TASK_NONE)
+		green_run_head = tp->index;
+	else
+		green_tasks[green_run_tail].chain = tp->index;
+	green_run_tail = tp->index;
+}
+
+
+/** Add a task to the sleep list, after all of the tasks that wake up
+at the same time or earlier. */
+static void green_sleep_insert (struct green_task *tp)
+{
+	S8 *linkp = &green_sleep_head;
+
+	while (*linkp != TASK_NONE &&
+		!((tp->wakeup - green_tasks[*linkp].wakeup) & 0x8000UL))
+		linkp = &green_tasks[*linkp].chain;
+	tp->chain = *linkp;
+	*linkp = tp->index;
+}
+
+
+/** Remove a task from whichever list it is on. */
+static void green_unlink (struct green_task *tp)
+{
+	S8 *linkp;
+	S8 prev = TASK_NONE;
+
+	if (tp->state == GREEN_BLOCKED)
+		linkp = &green_sleep_head;
+	else
+		linkp = &green_run_head;
+
+	while (*linkp != TASK_NONE)
+	{
+		if (*linkp == tp->index)
+		{
+			*linkp = tp->chain;
+			if (tp->state == GREEN_READY && green_run_tail == tp->index)
+				green_run_tail = prev;
+			return;
+		}
+		prev = *linkp;
+		linkp = &green_tasks[*linkp].chain;
+	}
+}
+
+
+/** Move the tasks that are done sleeping onto the run queue. */
+static void green_wake_expired (void)
+{
+	struct green_task *tp;
+
+	while (green_sleep_head != TASK_NONE)
+	{
+		tp = &green_tasks[green_sleep_head];
+		if (!time_reached_p (tp->wakeup))
+			break;
+		green_sleep_head = tp->chain;
+		green_run_append (tp);
+	}
+}
+
+
+/**
+ * The task dispatcher.  It is entered whenever the current task sleeps
+ * or exits, and picks the next task to run.
+ */
+static void green_dispatcher (void)
+{
+	struct green_task *tp;
+
+	for (;;)
+	{
+		/* A task which exited has already been freed.  Any other task
+		that gets here is sleeping. */
+		tp = green_current;
+		green_current = NULL;
+		if (tp && tp->state == GREEN_BLOCKED)
+			green_sleep_insert (tp);
+
+		/* When nothing is ready, let time pass until something is.
+		The realtime functions run the debugger and periodic functions. */
+		while (green_run_head == TASK_NONE)
+		{
+			while (likely (last_dispatch_time == get_sys_time ()))
+				realtime_idle ();
+			last_dispatch_time = get_sys_time ();
+			task_dispatching_ok = TRUE;
+			green_wake_expired ();
+		}
+
+		/* Run the next ready task.  This returns when it gives up the
+		CPU again. */
+		tp = &green_tasks[green_run_head];
+		green_run_head = tp->chain;
+		green_current = tp;
+		swapcontext (&green_dispatch_context, &tp->context);
+	}
+}
+
+
+/** The first function run by every new task */
+static void green_start (void)
+{
+	green_current->fn ();
+	task_exit ();
+}
+
+
+/** Map a stack for a task entry, with an inaccessible page below it
+to catch overflows. */
+static void green_stack_alloc (struct green_task *tp)
+{
+	tp->stack = mmap (NULL, GREEN_STACK_SIZE + green_page_size,
+		PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+		-1, 0);
+	if (tp->stack == MAP_FAILED)
+	{
+		tp->stack = NULL;
+		print_log ("cannot map a task stack\n");
+		fatal (ERR_NO_FREE_TASKS);
+	}
+	mprotect (tp->stack, green_page_size, PROT_NONE);
+}
+
+
+/** Set up a context that starts FN on the stack of TP. */
+static void green_context_init (struct green_task *tp, ucontext_t *ctx,
+	void (*fn) (void))
+{
+	getcontext (ctx);
+	ctx->uc_stack.ss_sp = (char *)tp->stack + green_page_size;
+	ctx->uc_stack.ss_size = GREEN_STACK_SIZE;
+	ctx->uc_link = NULL;
+	makecontext (ctx, fn, 0);
+}
+
+
+/**
+ * The main function for creating a new task.  As on the 6809, the
+ * new task does not run until the caller sleeps.
+ */
+task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
+{
+	struct green_task *tp;
+
+	for (tp = green_tasks; tp < &green_tasks[NUM_TASKS]; tp++)
+		if (tp->state == GREEN_FREE)
+			break;
+	if (tp == &green_tasks[NUM_TASKS])
+		fatal (ERR_NO_FREE_TASKS);
+
+	if (!tp->stack)
+		green_stack_alloc (tp);
+	tp->fn = fn;
+	tp->wakeup = 0;
+	green_context_init (tp, &tp->context, green_start);
+	green_run_append (tp);
+	return aux_task_create (tp, gid);
+}
+
+
+/** Give up the CPU until the current task's wakeup time has passed. */
+static void green_block (void)
+{
+	struct green_task *tp = green_current;
+	tp->state = GREEN_BLOCKED;
+	swapcontext (&tp->context, &green_dispatch_context);
+}
+
+
+void task_sleep (task_ticks_t ticks)
+{
+	if (green_current == NULL)
+		fatal (ERR_IDLE_CANNOT_SLEEP);
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_SLEEP, ticks);
+	green_current->wakeup = get_sys_time () + ticks;
+	green_block ();
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_WAKE, ticks);
+}
+
+
+void task_sleep_sec1 (U8 secs)
+{
+	if (green_current == NULL)
+		fatal (ERR_IDLE_CANNOT_SLEEP);
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_SLEEP, TIME_1S * secs);
+	green_current->wakeup = get_sys_time () + ((U16)secs * TIME_1S);
+	green_block ();
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_WAKE, TIME_1S * secs);
+}
+
+
+__noreturn__
+void task_exit (void)
+{
+	if (green_current == NULL)
+		fatal (ERR_IDLE_CANNOT_EXIT);
+	aux_task_delete (green_current);
+	green_current->state = GREEN_FREE;
+	for (;;)
+		setcontext (&green_dispatch_context);
+}
+
+
+void task_kill_pid (task_pid_t tp)
+{
+	if (tp == PID_NONE)
+		return;
+	if (tp == green_current)
+		fatal (ERR_TASK_KILL_CURRENT);
+	aux_task_delete (tp);
+	green_unlink (tp);
+	tp->state = GREEN_FREE;
+}
+
+
+task_pid_t task_getpid (void)
+{
+	return green_current;
+}
+
+
+/**
+ * Read from a file descriptor without blocking the other tasks.
+ * The caller sleeps, a tick at a time, until there is something to read.
+ */
+ssize_t green_read (int fd, void *buf, size_t count)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll (&pfd, 1, 0) == 0)
+		task_sleep (0);
+	return read (fd, buf, count);
+}
+
+
+/**
+ * Initialize the task subsystem.  The caller becomes the first task.
+ */
+void task_init (void)
+{
+	static struct green_task dispatch_task;
+	S8 n;
+
+	green_page_size = sysconf (_SC_PAGESIZE);
+	for (n = 0; n < NUM_TASKS; n++)
+	{
+		green_tasks[n].index = n;
+		green_tasks[n].state = GREEN_FREE;
+	}
+	green_run_head = green_sleep_head = TASK_NONE;
+
+	/* The dispatcher gets a stack of its own */
+	green_stack_alloc (&dispatch_task);
+	green_context_init (&dispatch_task, &green_dispatch_context,
+		green_dispatcher);
+
+	green_current = &green_tasks[0];
+	green_current->state = GREEN_READY;
+	last_dispatch_time = get_sys_time ();
+	ntask_init ();
+}
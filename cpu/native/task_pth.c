@@ -75,13 +75,17 @@ task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
 
 void task_sleep (task_ticks_t ticks)
 {
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_SLEEP, ticks);
 	pth_nap (pth_time (0, ticks * PTH_USECS_PER_TICK));
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_WAKE, ticks);
 }
 
 
 void task_sleep_sec1 (U8 secs)
 {
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_SLEEP, TIME_1S * secs);
 	pth_nap (pth_time (0, secs * TIME_1S * PTH_USECS_PER_TICK));
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_WAKE, TIME_1S * secs);
 }
 
 __noreturn__
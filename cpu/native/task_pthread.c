@@ -54,6 +54,10 @@ pthread_attr_t attr_task;
 pthread_attr_t attr_input;
 pthread_attr_t attr_interrupt;
 
+/** Serializes tasks that produce into a queue drained by the RTT.
+ * It is recursive so that a producer can call another producer. */
+static pthread_mutex_t rt_queue_mutex;
+
 
 
 /**
@@ -90,15 +94,31 @@ task_pid_t task_create_gid (task_gid_t gid, task_function_t fn)
 }
 
 
+void rt_queue_lock (void)
+{
+	pthread_mutex_lock (&rt_queue_mutex);
+}
+
+
+void rt_queue_unlock (void)
+{
+	pthread_mutex_unlock (&rt_queue_mutex);
+}
+
+
 void task_sleep (task_ticks_t ticks)
 {
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_SLEEP, ticks);
 	usleep (ticks * USECS_PER_TICK);
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_WAKE, ticks);
 }
 
 
 void task_sleep_sec1 (U8 secs)
 {
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_SLEEP, TIME_1S * secs);
 	usleep (TIME_1S * secs * USECS_PER_TICK);
+	log_event (SEV_DEBUG, MOD_TASK, EV_TASK_WAKE, TIME_1S * secs);
 }
 
 __noreturn__
@@ -129,6 +149,8 @@ task_pid_t task_getpid (void)
 void task_init (void)
 {
 	struct sched_param sched_param;
+	pthread_mutexattr_t mutex_attr;
+
 	sched_param.sched_priority = 1;
 	sched_setscheduler (0, SCHED_FIFO, &sched_param);
 
@@ -148,5 +170,9 @@ void task_init (void)
 	attr_interrupt = attr_task;
 	sched_param.sched_priority = 8;
 	pthread_attr_setschedparam (&attr_interrupt, &sched_param);
+
+	pthread_mutexattr_init (&mutex_attr);
+	pthread_mutexattr_settype (&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init (&rt_queue_mutex, &mutex_attr);
 	ntask_init ();
 }
@@ -102,9 +102,18 @@ typedef struct
 	audit_t exec_lockups; /* done */
 	audit_t trough_rescues;
 	audit_t chase_balls;
+	audit_t sound_drops; /* done */
+	audit_t sound_coalesced; /* done */
 	time_audit_t total_game_time; /* done */
 	audit_t hist_score[13];
 	audit_t hist_game_time[13];
+	audit_t device_kicks[MAX_DEVICES]; /* done */
+	audit_t device_kick_avg[MAX_DEVICES]; /* done */
+	audit_t device_kick_max[MAX_DEVICES]; /* done */
+	audit_t search_recoveries; /* done */
+	audit_t search_recovery_avg; /* done */
+	audit_t search_recovery_max; /* done */
+	audit_t search_learned; /* done */
 } std_audits_t;
 
 
@@ -137,6 +146,7 @@ void audit_reset (void);
 void audit_increment (audit_t *aud);
 void audit_add (audit_t *aud, U8 val);
 void audit_assign (audit_t *aud, audit_t val);
+void audit_average (audit_t *count, audit_t *avg, audit_t *max, U16 sample);
 
 __test2__ void time_audit_format (time_audit_t *t);
 __test2__ void time_audit_clear (time_audit_t *t);
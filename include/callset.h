@@ -57,7 +57,12 @@ from EVENT_PAGE. */
 			asm ("inc\t_log_callset+1"); \
 	} while (0)
 #else
-#define callset_debug(id) do { extern U16 log_callset; log_callset = id; } while (0)
+#define callset_debug(id) \
+	do { \
+		extern U16 log_callset; \
+		log_callset = id; \
+		trace_event (MOD_CALLSET, EV_CALLSET_INVOKE, id); \
+	} while (0)
 #endif
 
 #endif /* GENCALLSET */
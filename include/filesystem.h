@@ -93,11 +93,16 @@ struct file_info
 };
 
 
+extern struct file_info file_info[MAX_FILE_INFO];
+
 struct file_info *file_find (enum file_type type);
 void file_init (void);
 void file_reset (void);
 void file_register (const struct area_csum *csi);
 
+void csum_flush (void);
 void csum_area_update (const struct area_csum *csi);
+void csum_area_update_range (const struct area_csum *csi,
+	const U8 *ptr, const U8 *old, U8 len);
 void csum_area_reset (const struct area_csum *csi);
 void csum_area_check (const struct area_csum *csi);
@@ -196,6 +196,9 @@ __noreturn__ void freewpc_init (void);
 #else
 #include <system/task.h>
 #endif /* CONFIG_NATIVE */
+#if defined(CONFIG_MALLOC) && !defined(CONFIG_NATIVE)
+#include <system/malloc.h>
+#endif
 #if (MACHINE_DMD == 1)
 #include <system/font.h>
 #endif
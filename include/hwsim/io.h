@@ -52,6 +52,8 @@ U8 io_mem_reader (U8 *valp, unsigned int addr);
 void io_mem_writer (U8 *valp, unsigned int addr, U8 val);
 
 void io_write_sol (U8 *memp, unsigned int addr, U8 val);
+void io_add_sol_bank (IOPTR addr, U8 solno);
+void io_add_sol_bank_inverted (IOPTR addr, U8 solno, io_reader reader);
 
 #define io_add(addr, len, reader, writer, data) \
 	io_add_1 (addr, len, (io_reader)reader, (io_writer)writer, data)
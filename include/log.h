@@ -46,15 +46,82 @@ been used and is not very useful.  It can be turned back on via
 CONFIG_LOG if anyone cares. */
 #ifdef CONFIG_LOG
 #define log_event(severity, module, event, arg) \
-	log_event1(make_module_event (module, event), arg)
+	do { \
+		log_event1(make_module_event (module, event), arg); \
+		trace_event (module, event, arg); \
+	} while (0)
 #else
-#define log_event(severity, module, event, arg)
+#define log_event(severity, module, event, arg) \
+	trace_event (module, event, arg)
 #endif
 
 #define make_module_event(module, event) (((U16)(module) << 8UL) | event)
 #define module_part(module_event) ((U8)((module_event) >> 8))
 #define event_part(module_event) ((U8)((module_event) & 0xFF))
 
+
+/* The trace ring is a much larger, binary-only sibling of the event log.
+It is only available in native builds, where memory is plentiful, and
+records a high resolution timestamp along with every event.  The ring
+can be written to a file with trace_dump() and converted into
+Chrome trace/Perfetto JSON with tools/trace2json. */
+#if defined(CONFIG_TRACE) && defined(CONFIG_NATIVE)
+
+/** The number of trace records kept.  Must be a power of 2. */
+#define TRACE_RING_SIZE 65536
+
+/** The on-disk format of a trace dump is a trace_header followed by
+ * 'count' trace_records, oldest first.  tools/trace2json must be kept
+ * in sync with these. */
+#define TRACE_MAGIC 0x52545746 /* "FWTR" */
+#define TRACE_VERSION 1
+
+struct trace_header
+{
+	U32 magic;
+	U16 version;
+	U16 record_size;
+	U32 count;
+	U32 dropped;
+};
+
+struct trace_record
+{
+	/* Microseconds since trace_init() */
+	U32 usecs;
+
+	/* The module ID (upper 8-bits) and event ID (lower 8-bits) */
+	U16 module_event;
+
+	/* An event-specific argument */
+	U16 arg;
+
+	/* The group ID of the task that logged the event */
+	U16 gid;
+
+	U16 reserved;
+};
+
+extern U16 trace_module_mask;
+void trace_event1 (U16 module_event, U16 arg);
+void trace_init (void);
+void trace_dump (const char *filename);
+U32 trace_read_clock (void);
+
+/** Add an event to the trace ring, if tracing is enabled for its module.
+ * The mask test is inline so that disabled modules cost one AND. */
+#define trace_event(module, event, arg) \
+	do { \
+		if (trace_module_mask & (1U << (module))) \
+			trace_event1 (make_module_event (module, event), arg); \
+	} while (0)
+
+#else
+#define trace_event(module, event, arg)
+#define trace_init()
+#define trace_dump(filename)
+#endif
+
 #define log_set_min_severity(severity)
 
 #define log_set_wrapping(wrap_flag)
@@ -103,6 +170,8 @@ CONFIG_LOG if anyone cares. */
 	#define EV_TASK_RESTART 3
 	#define EV_TASK_START1 4
 	#define EV_TASK_100MS 5
+	#define EV_TASK_SLEEP 6
+	#define EV_TASK_WAKE 7
 
 #define MOD_SWITCH 4
 	#define EV_SW_SCHEDULE 0 /* done */
@@ -136,9 +205,14 @@ CONFIG_LOG if anyone cares. */
 #define MOD_SOL 9
 	#define EV_SOL_START 0 /* done */
 	#define EV_SOL_STOP 1 /* done */
+	#define EV_SOL_PULSE 8
+	#define EV_SOL_PULSE_END 9
 	#define EV_DEV_ENTER 4
 	#define EV_DEV_KICK 5
 	#define EV_DEV_LOCK 6
 	#define EV_DEV_UNLOCK 7
 
+#define MOD_CALLSET 10
+	#define EV_CALLSET_INVOKE 4
+
 #endif /* _LOG_H */
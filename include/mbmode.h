@@ -58,15 +58,10 @@ struct mb_mode_ops
 	.deff_running = DEFF_NULL, \
 	.deff_ending = DEFF_NULL, \
 	.prio = PRI_NULL, \
-	.active_task = mb_mode_active_task, \
+	.active_task = NULL, \
 	.grace_period = TIME_500MS
 
 
-struct mb_mode_task_config
-{
-	struct mb_mode_ops *ops;
-};
-
 U8 mb_mode_running_count (void);
 void mb_mode_active_task (void);
 void mb_mode_start (struct mb_mode_ops *ops);
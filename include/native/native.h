@@ -48,6 +48,13 @@ AREA_DECL(stack)
 AREA_DECL(permanent)
 AREA_DECL(nvram)
 
+/* Protected memory is kept in a journaled disk image.  Changes
+ * are marked as they are made, and written together at each commit. */
+void protected_memory_journal (const void *ptr, U16 len);
+void protected_memory_commit (void);
+#define pinio_nvram_journal(ptr, len) protected_memory_journal (ptr, len)
+#define pinio_nvram_commit() protected_memory_commit ()
+
 
 #endif /* _NATIVE_NATIVE_H */
 
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _NATIVE_NVJOURNAL_H
+#define _NATIVE_NVJOURNAL_H
+
+/* This header only uses C types, so that it can also be used by
+ * the host tools. */
+
+/** The points at which a fault can be injected during a commit */
+enum nvj_fault_point
+{
+	NVJ_FAULT_HEADER,      /* journal header written */
+	NVJ_FAULT_DATA,        /* some of the journal data written */
+	NVJ_FAULT_TRAILER,     /* journal complete, but not synced */
+	NVJ_FAULT_SYNCED,      /* journal synced */
+	NVJ_FAULT_APPLY,       /* some of the changes copied to the image */
+	NVJ_FAULT_APPLIED,     /* image synced */
+};
+
+struct nvj_stats
+{
+	unsigned long commits;
+	unsigned long bytes;
+	unsigned long recovered;
+	unsigned long discarded;
+};
+
+extern struct nvj_stats nvj_stats;
+extern void (*nvj_fault_hook) (enum nvj_fault_point point);
+
+int nvj_open (const char *image_file, const char *journal_file,
+	unsigned char *ram, unsigned int size);
+void nvj_add (unsigned int offset, unsigned int len);
+void nvj_add_changes (void);
+int nvj_commit (void);
+void nvj_close (void);
+
+#endif /* _NATIVE_NVJOURNAL_H */
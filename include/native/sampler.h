@@ -0,0 +1,43 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _NATIVE_SAMPLER_H
+#define _NATIVE_SAMPLER_H
+
+struct sampler_stats
+{
+	/** Samples taken */
+	unsigned long samples;
+
+	/** Distinct stacks seen */
+	unsigned long stacks;
+
+	/** Samples lost because the table was full */
+	unsigned long dropped;
+};
+
+extern struct sampler_stats sampler_stats;
+
+void sampler_start (void);
+void sampler_stop (void);
+void sampler_reset (void);
+int sampler_write (const char *filename);
+
+#endif /* _NATIVE_SAMPLER_H */
@@ -35,9 +35,9 @@ extern bool task_dispatching_ok;
 
 #include <sys/time.h>
 #define USECS_PER_TICK (16000 / linux_irq_multiplier)
-#if defined(CONFIG_PTH)
-#include <pth.h>
-typedef pth_t task_pid_t;
+#if defined(CONFIG_GREEN)
+struct green_task;
+typedef struct green_task *task_pid_t;
 #define PID_NONE NULL
 #elif defined(CONFIG_PTHREADS)
 #undef __noreturn__
@@ -45,6 +45,10 @@ typedef pth_t task_pid_t;
 #define __noreturn__ __attribute__((noreturn))
 typedef pthread_t task_pid_t;
 #define PID_NONE 0
+#elif defined(CONFIG_PTH)
+#include <pth.h>
+typedef pth_t task_pid_t;
+#define PID_NONE NULL
 #else
 typedef int task_pid_t;
 #endif
@@ -56,7 +60,7 @@ typedef void (*task_function_t) (void);
 
 typedef struct
 {
-	pthread_t pid;
+	task_pid_t pid;
 	task_gid_t gid;
 	PTR_OR_U16 arg;
 	U8 duration;
@@ -106,11 +110,16 @@ void task_set_pointer_arg (task_pid_t tp, void *arg);
 __noreturn__ void task_dispatcher (task_pid_t tp);
 task_pid_t task_getpid (void);
 task_gid_t task_getgid (void);
+const char *task_gid_name (task_gid_t gid);
 void do_periodic (void);
 void ntask_init (void);
 aux_task_data_t *aux_task_find_pid (task_pid_t pid);
 task_pid_t aux_task_create (task_pid_t pid, task_gid_t gid);
 void aux_task_delete (task_pid_t tp);
+#ifdef CONFIG_GREEN
+ssize_t green_read (int fd, void *buf, size_t count);
+void realtime_idle (void);
+#endif
 
 /** Create a new task that has the same group ID as the current one. */
 #define task_create_peer(fn)		task_create_gid (task_getgid (), fn)
@@ -123,10 +132,12 @@ void aux_task_delete (task_pid_t tp);
 #define task_kill_peers()			task_kill_gid (task_getgid ())
 
 /** Yield control to another task, but do not impose a minimum sleep time. */
-#if defined(CONFIG_PTH)
-#define task_yield() pth_yield(0)
+#if defined(CONFIG_GREEN)
+#define task_yield() task_sleep (0)
 #elif defined(CONFIG_PTHREADS)
 #define task_yield() sched_yield()
+#elif defined(CONFIG_PTH)
+#define task_yield() pth_yield(0)
 #else
 #define task_yield() task_sleep (0)
 #endif
@@ -259,6 +259,18 @@ extern U8 *pinio_dmd_low_page;
 extern U8 *pinio_dmd_high_page;
 #define pinio_dmd_window_ptr(w) \
 	((w == PINIO_DMD_WINDOW_0) ? pinio_dmd_low_page : pinio_dmd_high_page)
+#ifdef CONFIG_SIM
+/* The simulator takes whole frames from the kernel each time it
+   shows a new page pair, rather than following the page flips. */
+void asciidmd_publish (U8 dark, U8 bright);
+#define pinio_dmd_publish(dark, bright) asciidmd_publish (dark, bright)
+
+/* Every page is an ordinary buffer, so any number of them can be
+   addressed at once, not just the two that are mapped. */
+#define HAVE_PINIO_DMD_PAGE_PTR
+U8 *asciidmd_page_ptr (U8 page);
+#define pinio_dmd_page_ptr(page) asciidmd_page_ptr (page)
+#endif
 #else
 /* WPC can map up to 2 of the DMD pages into address space at
  * 0x3800 and 0x3A00.  Additionally, on WPC-95, 4 more pages
@@ -827,6 +839,18 @@ extern inline U8 pinio_read_sound (void)
 #endif
 }
 
+#if defined(CONFIG_SIM) && !defined(MACHINE_SYS11_SOUND)
+/** The simulated sound board also sets this bit in the status register
+ * while it cannot take another command.  The real boards do not. */
+#define WPCS_WRITE_BUSY 0x40
+
+#define HAVE_PINIO_SOUND_BUSY
+extern inline bool pinio_sound_busy_p (void)
+{
+	return readb (WPCS_CONTROL_STATUS) & WPCS_WRITE_BUSY;
+}
+#endif
+
 #define SW_VOLUME_UP SW_UP
 #define SW_VOLUME_DOWN SW_DOWN
 
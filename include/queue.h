@@ -32,7 +32,15 @@
  *
  * If head_off == tail_off, the queue is empty.
  *
- * Queue full conditions are not checked...
+ * Queue full conditions are not checked by queue_insert(); callers
+ * that can overrun the queue should test queue_full_p() first.
+ *
+ * Each queue has exactly one producer and one consumer, normally a
+ * task on one side and a realtime function on the other.  The producer
+ * only writes tail_off and the consumer only writes head_off, and each
+ * offset is published with rt_store() after the element itself has
+ * been written/read, so no locking is needed even when the RTT runs
+ * in a separate native thread.
  */
 
 #ifndef __QUEUE_H
@@ -61,9 +69,11 @@ extern inline void queue_init (queue_t *q)
 /** Insert an element into a generic queue */
 extern inline void queue_insert (queue_t *q, U8 qlen, U8 v)
 {
-	q->elems[q->tail_off] = v;
-	if (++q->tail_off == qlen)
-		q->tail_off = 0;
+	U8 tail = q->tail_off;
+	q->elems[tail] = v;
+	if (++tail == qlen)
+		tail = 0;
+	rt_store (q->tail_off, tail);
 }
 
 
@@ -72,13 +82,15 @@ the caller has already checked to see that there is something in
 the queue, by verifying !queue_empty(). */
 extern inline U8 queue_remove (queue_t *q, U8 qlen)
 {
-	U8 v = q->elems[q->head_off];
+	U8 head = q->head_off;
+	U8 v = q->elems[head];
 	if (qlen == 8)
 	{
-		q->head_off = (q->head_off + 1) & 7;
+		head = (head + 1) & 7;
 	}
-	else if (++q->head_off == qlen)
-		q->head_off = 0;
+	else if (++head == qlen)
+		head = 0;
+	rt_store (q->head_off, head);
 	return (v);
 }
 
@@ -86,7 +98,18 @@ extern inline U8 queue_remove (queue_t *q, U8 qlen)
 /** Check if a generic queue is empty. */
 extern inline bool queue_empty_p (queue_t *q)
 {
-	return (q->head_off == q->tail_off);
+	return (rt_load (q->head_off) == rt_load (q->tail_off));
+}
+
+
+/** Check if a generic queue is full.  One slot is always left
+unused so that a full queue can be told apart from an empty one. */
+extern inline bool queue_full_p (queue_t *q, U8 qlen)
+{
+	U8 tail = rt_load (q->tail_off) + 1;
+	if (tail == qlen)
+		tail = 0;
+	return (tail == rt_load (q->head_off));
 }
 
 
@@ -24,6 +24,7 @@
 extern U8 ball_search_count;
 
 __common__ void ball_search_timer_reset (void);
+__common__ void ball_search_pf_switch (U8 sw);
 __common__ bool ball_search_timed_out (void);
 __common__ void ball_search_timeout_set (U8 secs);
 __common__ void ball_search_monitor_start (void);
@@ -37,4 +38,10 @@ __common__ void ball_search_now (void);
 #define BS_TIMEOUT_DEFAULT	15
 #endif
 
+/** The number of coils remembered for freeing stuck balls */
+#define BS_HISTORY_SIZE 8
+
+/** The ball search from which each coil is pulsed twice */
+#define BS_REPEAT_COUNT 4
+
 #endif /* _SEARCH_H */
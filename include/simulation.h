@@ -108,6 +108,12 @@ void flipper_button_depress (int sw);
 int sim_switch_read (int sw);
 void sim_switch_init (void);
 
+extern const char *trace_exit_file;
+#ifdef CONFIG_NATIVE_SAMPLER
+#include <native/sampler.h>
+extern const char *sampler_exit_file;
+#endif
+
 void exec_script (char *cmd);
 void exec_script_file (const char *filename);
 
@@ -118,10 +124,40 @@ void conf_push (int val);
 void conf_pop (unsigned int count);
 int conf_read_stack (int offset);
 
+/** A published DMD frame.  DATA holds one byte per pixel, from 0
+(off) to 3 (brightest). */
+struct dmd_frame
+{
+	U32 seq;
+	U8 dark;
+	U8 bright;
+	U8 data[PINIO_DMD_WIDTH * PINIO_DMD_HEIGHT];
+};
+
+/** The state kept by each consumer of published frames */
+struct dmd_frame_reader
+{
+	U32 seq;
+	U32 frames;
+	U32 dropped;
+};
+
+const struct dmd_frame *dmd_frame_next (struct dmd_frame_reader *reader);
+bool dmd_frame_done (struct dmd_frame_reader *reader,
+	const struct dmd_frame *frame);
+
 void asciidmd_map_page (int mapping, int page);
+void asciidmd_publish (U8 dark, U8 bright);
 void asciidmd_refresh (void);
 void asciidmd_set_visible (int page);
 void asciidmd_init (void);
+void asciidmd_exit (void);
+
+struct buffer;
+void dmdrec_frame (struct buffer *dark, struct buffer *bright);
+void dmdrec_mark (U16 id);
+void dmdrec_stop (void);
+void dmdrec_start (const char *filename);
 
 void sim_coil_init (void);
 void sim_coil_change (unsigned int coil, unsigned int on);
@@ -132,6 +168,16 @@ void coil_clone (unsigned int parent_id, unsigned int child_id);
 unsigned char hwtimer_read (void);
 void hwtimer_write (unsigned char val);
 
+#if (MACHINE_FLIPTRONIC == 1)
+void sim_flipper_switch (int sw, int level);
+void sim_flipper_coil (unsigned int coil, unsigned int on);
+void sim_flipper_eos (unsigned int power_sol, int on);
+void sim_flipper_print_stats (void);
+#endif
+
+void sim_stuck_ball (unsigned int sw, unsigned int sol);
+void sim_stuck_coil (unsigned int coil, unsigned int on);
+
 void sim_zc_init (void);
 int sim_zc_read (void);
 
@@ -139,6 +185,58 @@ void sim_key_install (char key, unsigned int swno);
 void keyboard_open (const char *filename);
 void keyboard_init (void);
 
+extern int sim_instance_fd;
+void sim_instance_init (void);
+
+extern unsigned int sim_nonfatal_count;
+extern U8 sim_last_nonfatal;
+void sim_nonfatal (U8 error_code);
+void sim_coverage_init (void);
+
+void sim_gamerec_open (const char *filename);
+void sim_gamerec_mode (task_gid_t gid);
+
+#ifdef CONFIG_SIM_AUDIO
+struct sim_mixer_stats
+{
+	/** Blocks mixed, and those mixed too late to be played on time */
+	unsigned long blocks;
+	unsigned long underruns;
+
+	/** The longest time taken to mix a block */
+	unsigned long mix_max_us;
+
+	/** Commands carried out, and how long they waited to be mixed */
+	unsigned long commands;
+	unsigned long long latency_sum_us;
+	unsigned long long latency_max_us;
+
+	/** Commands lost because the mixer's queue was full */
+	unsigned long dropped;
+
+	/** Commands with no sample, which played a tone instead */
+	unsigned long unmapped;
+
+	/** Sounds that cut off another, and sounds that no voice was
+	free for */
+	unsigned long stolen;
+	unsigned long refused;
+};
+
+extern struct sim_mixer_stats sim_mixer_stats;
+void sim_mixer_open (const char *target);
+void sim_mixer_load_map (const char *filename);
+void sim_mixer_init (void);
+void sim_mixer_exit (void);
+void sim_mixer_command (U16 code);
+bool sim_mixer_busy (void);
+void sim_mixer_stop_music (void);
+void sim_mixer_stop_sound (void);
+void sim_mixer_volume (U8 vol);
+void sim_mixer_channel_volume (const char *channel, U8 percent);
+void sim_mixer_print_stats (void);
+#endif
+
 void protected_memory_load (void);
 void protected_memory_save (void);
 
@@ -24,6 +24,20 @@
 #define AC_DOMESTIC_CYCLE 17
 #define AC_EXPORT_CYCLE 20
 
+/** The longest time between zerocross points, in IRQs.  If no zerocross
+ * is seen by then, one is assumed.  Without a zerocross circuit, this
+ * sets the length of the simulated half-cycle. */
+#ifdef CONFIG_NO_ZEROCROSS
+#define ZC_MAX_PERIOD 8
+#else
+#define ZC_MAX_PERIOD 11
+#endif
+
+/** The number of half-cycles after which the phase repeats.  Outputs
+ * that are switched at a point in the AC cycle can use a different
+ * point in each of these, to get levels in between. */
+#define AC_PHASES 4
+
 /**
  * The different states of the zerocross circuit.
  */
@@ -49,6 +63,7 @@ typedef enum {
 
 
 extern __fastram__ U8 zc_timer;
+extern __fastram__ U8 zc_phase;
 
 extern inline U8 zc_get_timer (void)
 {
@@ -56,6 +71,13 @@ extern inline U8 zc_get_timer (void)
 }
 
 
+/** Return which of the AC_PHASES half-cycles is in progress */
+extern inline U8 zc_get_phase (void)
+{
+	return zc_phase;
+}
+
+
 extern inline zc_status_t zc_get_status (void)
 {
 	extern zc_status_t zc_status;
@@ -36,6 +36,27 @@
 #define MACHINE_MAX_BALLS MACHINE_TROUGH_SIZE
 #endif
 
+/** The minimum time between the starts of two kicks, from any devices.
+ * This keeps the pulses from overlapping, and gives each ball a chance
+ * to clear the eject before another one follows it. */
+#ifdef MACHINE_DEVICE_KICK_GAP
+#define DEVICE_KICK_GAP MACHINE_DEVICE_KICK_GAP
+#else
+#define DEVICE_KICK_GAP TIME_100MS
+#endif
+
+/** The maximum number of kicks that can be in flight at once; that is,
+ * kicked but not yet seen to have left their devices. */
+#ifdef MACHINE_DEVICE_KICKS_IN_FLIGHT
+#define DEVICE_KICKS_IN_FLIGHT MACHINE_DEVICE_KICKS_IN_FLIGHT
+#else
+#define DEVICE_KICKS_IN_FLIGHT 4
+#endif
+
+/** How long a kick is considered in flight, if its device never
+ * rechecks its count */
+#define DEVICE_KICK_TIMEOUT TIME_3S
+
 /** The GIDs for the device update tasks.
  * Every device has its own GID for the function that runs to service it.
  * This task is in charge of processing switch closures AND servicing
@@ -207,6 +228,18 @@ typedef struct device
 	/** The operational state of the device, one of the DEV_STATE_ values */
 	U8 state;
 
+	/** The part of counted_balls contributed by this device */
+	U8 counted_share;
+
+	/** The part of held_balls contributed by this device */
+	U8 held_share;
+
+	/** The position of this device in the queue of waiting kicks */
+	U8 kick_ticket;
+
+	/** The time of the first attempt at the current kick */
+	U16 kick_time;
+
 	/** Pointer to the read-only device properties */
 	device_properties_t *props;
 } device_t;
@@ -223,10 +256,12 @@ typedef U8 devicenum_t;
 #define device_full_p(dev)		(dev->actual_count == dev->size)
 
 /** Disable an automatic ball lock on this device */
-#define device_disable_lock(dev)	(dev->max_count--)
+#define device_disable_lock(dev) \
+	do { (dev)->max_count--; device_account (dev); } while (0)
 
 /** Enable an automatic ball lock on this device */
-#define device_enable_lock(dev)	(dev->max_count++)
+#define device_enable_lock(dev) \
+	do { (dev)->max_count++; device_account (dev); } while (0)
 
 /** Test if a device is the trough.  For the test fixture ROM, no
 ball devices are defined, and this always returns FALSE. */
@@ -246,6 +281,7 @@ extern U8 kickout_locks;
 __common__ void device_clear (device_t *dev);
 __common__ void device_register (devicenum_t devno, device_properties_t *props);
 __common__ U8 device_recount (device_t *dev);
+__common__ void device_account (device_t *dev);
 __common__ void device_update_globals (void);
 __common__ void device_probe (void);
 __common__ void device_request_kick (device_t *dev);
@@ -71,6 +71,19 @@
 #define DMD_ALLOC_PAGE_COUNT \
 	(PINIO_NUM_DMD_PAGES - DMD_OVERLAY_PAGE_COUNT - DMD_BLANK_PAGE_COUNT)
 
+/** The number of page pairs that can be held as surfaces at once.  The
+ * rest are left to the allocator, which needs at least three pairs for
+ * a transition. */
+#define DMD_SURFACE_COUNT 2
+
+/** The most layers that can be composited onto one frame */
+#define DMD_MAX_LAYERS 4
+
+/** How a layer is blended by dmd_compose() */
+#define DMD_LAYER_COLOR    0 /* a page pair, each ORed onto its own plane */
+#define DMD_LAYER_MONO     1 /* one page, ORed onto both planes */
+#define DMD_LAYER_OUTLINE  2 /* one page, with its outline mask in the next */
+
 /** Coordinates that are aligned various ways */
 #define DMD_CENTER_X (DMD_PIXEL_WIDTH / 2)
 #define DMD_CENTER_Y (DMD_PIXEL_HEIGHT / 2)
@@ -138,6 +151,15 @@ extern dmd_pagepair_t dmd_visible_pages;
 
 #define dmd_low_page dmd_mapped_pages.u.first
 #define dmd_high_page dmd_mapped_pages.u.second
+
+/** In the simulator, count every pass over a whole page, so that the
+ * cost of drawing a frame can be measured. */
+#ifdef CONFIG_SIM
+extern U32 dmd_page_passes;
+#define dmd_count_pass() (dmd_page_passes++)
+#else
+#define dmd_count_pass()
+#endif
 #define dmd_dark_page dmd_visible_pages.u.first
 #define dmd_bright_page dmd_visible_pages.u.second
 
@@ -218,6 +240,9 @@ void dmd_copy_page (dmd_buffer_t dst, const dmd_buffer_t src);
 void dmd_copy_low_to_high (void);
 void dmd_alloc_low_clean (void);
 void dmd_alloc_pair_clean (void);
+dmd_pagenum_t dmd_surface_alloc (void);
+void dmd_surface_free (dmd_pagenum_t page);
+void dmd_surface_free_all (void);
 void dmd_shift_up (dmd_buffer_t dbuf);
 void dmd_shift_down (dmd_buffer_t dbuf);
 void dmd_draw_bitmap (dmd_buffer_t image_bits, U8 x, U8 y, U8 width, U8 height);
@@ -236,6 +261,10 @@ __transition__ void dmd_overlay_outline (void);
 __transition__ void dmd_overlay_color (void);
 __transition__ void dmd_overlay_onto_color (void);
 __transition__ void dmd_dup_mapped (void);
+__transition__ void dmd_compose_begin (dmd_pagepair_t base);
+__transition__ void dmd_compose_layer (dmd_pagenum_t page, U8 mode);
+__transition__ void dmd_compose (void);
+__transition__ void dmd_compose_low (void);
 
 __effect__ void dmd_draw_border (U8 *dbuf);
 __effect__ void dmd_draw_thin_border (U8 *dbuf);
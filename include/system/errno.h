@@ -65,6 +65,8 @@
 #define ERR_NOT_SOUND_PROC       46
 #define ERR_BALL_SEARCH_TIMEOUT  47
 #define ERR_ZERO_SCORE_MULT      48
+#define ERR_DMD_SURFACE          49
+#define ERR_NO_FREE_TIMERS       50
 
 #ifndef __ASSEMBLER__
 
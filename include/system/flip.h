@@ -21,6 +21,16 @@
 #ifndef _SYS_FLIP_H
 #define _SYS_FLIP_H
 
+/** The longest time, in IRQs, that a flipper's power winding is kept on
+ * while waiting for its EOS switch.  After that the EOS is taken to be
+ * broken, and only the hold winding is used until the button is
+ * released. */
+#ifdef MACHINE_FLIPPER_POWER_TIME
+#define FLIPPER_POWER_TIME MACHINE_FLIPPER_POWER_TIME
+#else
+#define FLIPPER_POWER_TIME 40
+#endif
+
 void flipper_enable (void);
 void flipper_disable (void);
 void flipper_init (void);
@@ -61,8 +61,36 @@ extern bool linux_firq_enable;
 #define rtt_disable() disable_irq()
 #define rtt_enable() enable_irq()
 
+/** Natively, the realtime functions run in their own thread and
+ * rtt_disable() does not actually exclude them.  Data passed between
+ * a task and the RTT must be published with a release store and
+ * picked up with an acquire load, so that the payload written before
+ * the index/timer is visible to the other side. */
+#define rt_load(v)		__atomic_load_n (&(v), __ATOMIC_ACQUIRE)
+#define rt_store(v, x)	__atomic_store_n (&(v), (x), __ATOMIC_RELEASE)
+#define rt_fence()		__atomic_thread_fence (__ATOMIC_SEQ_CST)
+
+#ifdef CONFIG_PTHREADS
+/** With pthreads, several tasks can produce into the same RTT queue at
+ * once.  Producers serialize among themselves with this lock; the
+ * realtime functions that consume the queue never take it. */
+void rt_queue_lock (void);
+void rt_queue_unlock (void);
+#endif
+
 #endif /* CONFIG_NATIVE */
 
+#ifndef rt_load
+#define rt_load(v)		(v)
+#define rt_store(v, x)	((v) = (x))
+#define rt_fence()
+#endif
+
+#ifndef CONFIG_PTHREADS
+#define rt_queue_lock()
+#define rt_queue_unlock()
+#endif
+
 /* For compatibility with the older names used */
 #define disable_interrupts() rtt_disable()
 #define enable_interrupts() rtt_enable()
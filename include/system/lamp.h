@@ -50,14 +50,67 @@ typedef const lampnum_t lamplist_t[];
 /** Lampsets are identified by small integers */
 typedef U8 lamplist_id_t;
 
-/** The set of all lamps, with one bit for each */
-typedef U8 lamp_set[NUM_LAMP_COLS];
+/** The widest integer that lamp sets are operated on at once.
+The 6809 has 16-bit loads and stores; native builds use the host word.
+On the host, these words alias the bytes of a lamp_set. */
+#ifdef CONFIG_NATIVE
+typedef unsigned long __attribute__((may_alias)) lamp_word_t;
+#else
+typedef U16 lamp_word_t;
+#endif
+
+/** The number of words in a lamp set */
+#define LAMP_SET_WORDS \
+	((NUM_LAMP_COLS + sizeof (lamp_word_t) - 1) / sizeof (lamp_word_t))
+
+/** The set of all lamps, with one bit for each.  It is padded to a
+whole number of words; the padding is always zero. */
+#ifdef CONFIG_NATIVE
+typedef U8 lamp_set[LAMP_SET_WORDS * sizeof (lamp_word_t)]
+	__attribute__((aligned (sizeof (lamp_word_t))));
+#else
+typedef U8 lamp_set[LAMP_SET_WORDS * sizeof (lamp_word_t)];
+#endif
+
+/** Expand OP(n) for each word N of a lamp set.  The count is a
+constant, so this is fully unrolled for the sizes that machines use;
+only sets larger than 8 words need a loop. */
+#define lamp_set_unroll(op) \
+do { \
+	U8 __n; \
+	op (0); \
+	if (LAMP_SET_WORDS > 1) op (1); \
+	if (LAMP_SET_WORDS > 2) op (2); \
+	if (LAMP_SET_WORDS > 3) op (3); \
+	if (LAMP_SET_WORDS > 4) op (4); \
+	if (LAMP_SET_WORDS > 5) op (5); \
+	if (LAMP_SET_WORDS > 6) op (6); \
+	if (LAMP_SET_WORDS > 7) op (7); \
+	for (__n = 8; __n < LAMP_SET_WORDS; __n++) \
+		op (__n); \
+} while (0)
 
 
 extern __fastram__ lamp_set lamp_matrix;
 extern lamp_set lamp_flash_matrix;
 extern __fastram__ lamp_set lamp_flash_matrix_now;
 
+/** The number of bits of lamp intensity */
+#define LAMP_PWM_BITS 4
+
+/** The intensity of a lamp that is fully on */
+#define LAMP_PWM_MAX ((1 << LAMP_PWM_BITS) - 1)
+
+/** The number of strobes of the whole matrix that make up one period
+of intensity control.  A lamp at level N is on for N of them. */
+#define LAMP_PWM_SLOTS LAMP_PWM_MAX
+
+extern lamp_set lamp_pwm_mask;
+extern lamp_set lamp_pwm_planes[LAMP_PWM_BITS];
+extern const U8 *lamp_pwm_now;
+extern U8 lamp_pwm_slot;
+extern const U8 *const lamp_pwm_schedule[LAMP_PWM_SLOTS];
+
 extern U8 bit_matrix[BITS_TO_BYTES (MAX_FLAGS)];
 extern U8 global_bits[BITS_TO_BYTES (MAX_GLOBAL_FLAGS)];
 
@@ -170,6 +223,18 @@ bool lamplist_test_all (lamplist_id_t id, lamp_boolean_operator_t op);
 
 __attribute__((noinline)) void lamp_set_on (lamp_set matrix);
 
+void lamp_pwm_init (void);
+void lamp_fade_rtt (void);
+void lamp_pwm_set (lampnum_t lamp, U8 level);
+U8 lamp_pwm_get (lampnum_t lamp);
+void lamp_fade (lampnum_t lamp, U8 level, U8 rate);
+void lamp_pwm_release (lampnum_t lamp);
+void lamp_pwm_release_set (const lamp_set set);
+void lamp_pwm_release_all (void);
+bool lamp_fade_running_p (void);
+void lamplist_fade (lamplist_id_t id, U8 level, U8 rate);
+void lamplist_sweep (lamplist_id_t id, U8 rate);
+
 void lamp_set_zero (lamp_set dst);
 void lamp_set_copy (lamp_set dst, const lamp_set src);
 void lamp_set_add (lamp_set dst, const lamp_set src);
@@ -50,6 +50,9 @@ typedef struct
 	lamplist_id_t llid;
 
 	U8 gi;
+
+	/** The flashers that it needs */
+	flasher_mask_t flashers;
 } leff_t;
 
 
@@ -92,6 +95,22 @@ extern inline void leff_create_peer (void (*fn)(void))
 	task_inherit_class_data (tp, leff_data_t);
 }
 
+extern flasher_mask_t leff_flasher_alloc;
+bool leff_flasher_owner_p (solnum_t sol);
+
+/**
+ * Return true if the current task may not start the flasher SOL,
+ * because it has been allocated to a lamp effect other than it.
+ */
+extern inline bool leff_flasher_denied_p (solnum_t sol)
+{
+	if ((U8)(sol - SOL_MIN_FLASHER) >= 32)
+		return FALSE;
+	if (likely (!(leff_flasher_alloc & FLASHER_BIT (sol))))
+		return FALSE;
+	return !leff_flasher_owner_p (sol);
+}
+
 void leff_start (leffnum_t dn);
 void leff_stop (leffnum_t dn);
 void leff_restart (leffnum_t dn);
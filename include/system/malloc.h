@@ -0,0 +1,74 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SYSTEM_MALLOC_H
+#define _SYSTEM_MALLOC_H
+
+/** The number of size classes: 8, 16, 32, and 64 bytes */
+#define MALLOC_CLASSES 4
+
+/** The most slots that a size class can have */
+#define MALLOC_MAX_SLOTS 16
+
+/* The number of slots in each size class.  A machine can override
+these in its config; a class with no slots is skipped, and its
+requests are served from the next larger class. */
+#ifndef MALLOC_SLOTS_8
+#define MALLOC_SLOTS_8 8
+#endif
+#ifndef MALLOC_SLOTS_16
+#define MALLOC_SLOTS_16 8
+#endif
+#ifndef MALLOC_SLOTS_32
+#define MALLOC_SLOTS_32 4
+#endif
+#ifndef MALLOC_SLOTS_64
+#define MALLOC_SLOTS_64 2
+#endif
+
+/** The size of the malloc heap, which is reserved apart from the
+task blocks */
+#define MALLOC_HEAP_SIZE (MALLOC_SLOTS_8 * 8 + MALLOC_SLOTS_16 * 16 \
+	+ MALLOC_SLOTS_32 * 32 + MALLOC_SLOTS_64 * 64)
+
+/** Statistics kept for each size class */
+struct malloc_stats
+{
+	/** The number of slots now allocated */
+	U8 used;
+
+	/** The most slots ever allocated at once */
+	U8 high_water;
+
+	/** The number of times that the class was full, so that the
+	request had to go to a larger class or failed */
+	U8 failures;
+
+	/** The number of allocations made from this class */
+	U16 allocs;
+};
+
+extern struct malloc_stats malloc_stats[MALLOC_CLASSES];
+
+U8 malloc_class_size (U8 class);
+U8 malloc_class_slots (U8 class);
+void malloc_dump (void);
+
+#endif /* _SYSTEM_MALLOC_H */
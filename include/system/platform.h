@@ -45,12 +45,6 @@ extern inline U8 platform_lamp_compute (const U8 col)
 	 */
 	bits |= lamp_flash_matrix_now[col];
 
-	/* TODO : implement lamp strobing, like the newer Stern games
-	do.  Implement like DMD page flipping, alternating between 2
-	different lamp matrices rapidly to present 4 different
-	intensities.  A background task, like the flash_rtt above,
-	would toggle the intensities at a slower rate. */
-
 	/* Override with the lamp effect lamps.
 	 * Leff2 bits are low priority and used for long-running
 	 * lamp effects.  Leff1 is higher priority and used
@@ -59,9 +53,23 @@ extern inline U8 platform_lamp_compute (const U8 col)
 	 */
 	bits &= leff_free_set[col];
 	bits |= (leff_data_set[col] & ~leff_free_set[col]);
+
+	/* Override with the lamps whose intensity is controlled, using
+	the current plane of their levels (see kernel/lamppwm.c). */
+	bits &= ~lamp_pwm_mask[col];
+	bits |= lamp_pwm_now[col];
 	return bits;
 }
 
+/** Move on to the next plane of lamp intensities.  The lamp driver
+calls this each time it has strobed the whole matrix. */
+extern inline void platform_lamp_pwm_advance (void)
+{
+	lamp_pwm_now = lamp_pwm_schedule[lamp_pwm_slot];
+	if (++lamp_pwm_slot >= LAMP_PWM_SLOTS)
+		lamp_pwm_slot = 0;
+}
+
 extern __fastram__ U8 sol_duty_mask;
 
 #endif /* __SYS_PLATFORM_H */
@@ -47,6 +47,7 @@ the more powerful the pulse. */
 #define SOL_DUTY_50     0x55   /* 1/2 */
 #define SOL_DUTY_62     0xB5   /* 5/8 */
 #define SOL_DUTY_75     0x77   /* 3/4 */
+#define SOL_DUTY_87     0xF7   /* 7/8 */
 #define SOL_DUTY_100    0xFF
 
 /** The default solenoid timing */
@@ -58,10 +59,58 @@ the more powerful the pulse. */
 #define FLASHER_TIME_DEFAULT 24
 #define FLASHER_DUTY_DEFAULT SOL_DUTY_100
 
+/** The number of flasher intensities, counting off.  Each is one more
+eighth of the duty cycle. */
+#define FLASHER_INTENSITY_MAX 8
+
+/** The most flashers that may be lit at once.  When more are pulsing,
+the rest wait, and their pulses are delayed rather than shortened. */
+#ifdef MACHINE_FLASHER_POWER_BUDGET
+#define FLASHER_POWER_BUDGET MACHINE_FLASHER_POWER_BUDGET
+#else
+#define FLASHER_POWER_BUDGET 4
+#endif
+
+/** A set of flashers, as used to allocate them to lamp effects.  Only
+the first 32 outputs from SOL_MIN_FLASHER can be in a set. */
+typedef U32 flasher_mask_t;
+
+#define FLASHER_BIT(sol) (1UL << ((sol) - SOL_MIN_FLASHER))
+
+/** Pulse request priorities.  When requests are waiting for the
+pulse driver, the highest priority goes first. */
+#define SOL_PRI_SEARCH     1   /* ball search */
+#define SOL_PRI_DEFAULT    2   /* sol_request_async */
+#define SOL_PRI_DEVICE     3   /* ball device kicks and launches */
+
+/** Pulse request statistics, shown in test mode.  Times are in
+16ms ticks. */
+struct sol_req_stats
+{
+	U16 requests;
+	U16 started;
+	U16 coalesced;
+	U16 expired;
+	U16 dropped;
+	U16 deferred;
+	U16 wait_max;
+	U16 wait_total;
+	U16 wait_count;
+
+	/** Updates in which a flasher was held back by FLASHER_POWER_BUDGET */
+	U16 flash_held;
+};
+
+extern struct sol_req_stats sol_req_stats;
+
 /* Function prototypes */
 void sol_req_start_specific (U8 sol, U8 mask, U8 time);
+void sol_request_queue (U8 sol, U8 prio, U8 deadline);
 void sol_request_async (U8 sol);
+bool sol_pulse_busy_p (void);
 void sol_request (U8 sol);
+void sol_modify_duty (U8 sol, U8 duty);
+void sol_modify_timeout (U8 sol, U8 timeout);
 void sol_start_real (solnum_t sol, U8 cycle_mask, U8 ticks);
 void sol_stop (solnum_t sol);
 void sol_init (void);
@@ -92,6 +141,17 @@ extern inline void flasher_pulse (U8 sol)
 }
 
 
+/*
+ * Pulse a flasher for the default time, at an intensity from 1 to
+ * FLASHER_INTENSITY_MAX.
+ */
+extern inline void flasher_pulse_intensity (U8 sol, U8 level)
+{
+	extern const U8 flasher_intensity_duty[];
+	flasher_start (sol, flasher_intensity_duty[level], FLASHER_TIME_DEFAULT);
+}
+
+
 /*
  * Pulse a flasher for a shorter-than usual time.
  */
@@ -123,6 +123,31 @@ typedef U16 sound_cmd_t;
 
 typedef U16 music_code_t, sound_code_t;
 
+/** The priority of commands that must reach the sound board: music,
+ * volume, and queries */
+#define SOUND_PRIO_SYSTEM		0xFF
+
+/** Counts of what happened to sound board commands since reset */
+struct sound_queue_stats
+{
+	/** Commands sent to the board */
+	U16 sent;
+
+	/** Calls that were merged with one already waiting */
+	U16 coalesced;
+
+	/** Calls that were dropped or cancelled because the queue was full */
+	U16 dropped;
+
+	/** Times that a command was held back because the board was busy */
+	U16 held;
+
+	/** The most commands that were ever waiting at once */
+	U8 max_depth;
+};
+
+extern struct sound_queue_stats sound_queue_stats;
+
 void music_off (void);
 void music_set (music_code_t code);
 void sound_rtt (void);
@@ -130,6 +155,7 @@ void sound_init (void);
 void sound_board_init (void);
 void sound_send (sound_code_t code);
 void sound_write (sound_code_t code);
+void sound_write_prio (sound_code_t code, U8 prio);
 void sound_reset (void);
 void volume_set (U8);
 bool sound_version_render (void);
@@ -41,9 +41,6 @@ extern bool task_dispatching_ok;
 /* Says that the block is in use */
 #define BLOCK_USED  0x1
 
-/* Says that the block is used by the 'malloc' function */
-#define BLOCK_MALLOC 0x2
-
 /* Says that the block is used by the task scheduler */
 #define BLOCK_TASK 0x4
 
@@ -83,11 +80,14 @@ typedef struct task_struct
 {
 	/** The execution state of the task.  It can be BLOCK_FREE, if the
 	 * task entry isn't being used at all; BLOCK_USED for a running/waiting
-	 * task; or TASK_BLOCKED for a sleeping task. */
+	 * task; or TASK_BLOCKED for a sleeping task.  A task with TASK_BLOCKED
+	 * is on the sleep list; any other task, except the current one, is
+	 * on the run queue. */
 	U8				state;
 
-	/** The index of the next block in the same chain.  Not used yet.
-	 * A NULL is indicated by a -1, hence it is signed. */
+	/** The index of the next task in the same queue: the run queue
+	 * or the sleep list.  A NULL is indicated by a -1, hence it is
+	 * signed. */
 	S8          chain;
 
 	/** The task group ID.  This is a compile-time assigned value
@@ -137,8 +137,9 @@ typedef struct task_struct
 	 * stopped automatically due to some external event. */
 	U8				duration;
 
-	/** Not currently used */
-	U8				reserved;
+	/** The index of this block in the task table, so that it can
+	 * be linked into a queue without a division */
+	U8				index;
 
 	/** The task stack save area.  This is NOT used as the live stack
 	 * area; the live stack is copied here when the task blocks.
@@ -180,11 +181,9 @@ typedef task_t *task_pid_t;
 /*     Function Prototypes      */
 /********************************/
 
+extern U8 idle_chunks;
+
 task_t *block_allocate (void);
-void malloc_chunk_dump (task_t *task);
-#ifdef CONFIG_MALLOC
-void block_free (task_t *tp);
-#endif
 
 void task_dump (void);
 void task_init (void);
@@ -227,10 +226,12 @@ void do_periodic (void);
 #define task_kill_peers()			task_kill_gid (task_getgid ())
 
 /** Yield control to another task, but do not impose a minimum sleep time. */
-#if defined(CONFIG_PTH)
-#define task_yield() pth_yield(0)
+#if defined(CONFIG_GREEN)
+#define task_yield() task_sleep (0)
 #elif defined(CONFIG_PTHREADS)
 #define task_yield() sched_yield()
+#elif defined(CONFIG_PTH)
+#define task_yield() pth_yield(0)
 #else
 #define task_yield() task_sleep (0)
 #endif
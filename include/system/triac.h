@@ -24,10 +24,13 @@
 /** The number of triacs provided by the hardware */
 #define NUM_GI_TRIACS	5
 
-/** The number of brightness levels for a GI circuit.
-The state of the triac can be rapidly switched this many times
-per AC cycle */
-#define NUM_BRIGHTNESS_LEVELS 8
+/** The number of brightness levels for a GI circuit, counting off.
+The top level is fully on; the ones in between fire the triac at a
+point in each half-cycle. */
+#define NUM_BRIGHTNESS_LEVELS 16
+
+/** The brightness of a GI string that is fully on */
+#define GI_BRIGHTNESS_MAX (NUM_BRIGHTNESS_LEVELS - 1)
 
 
 typedef U8 triacbits_t;
@@ -36,7 +39,10 @@ typedef U8 triacbits_t;
 void triac_rtt (void);
 void triac_update (void);
 void gi_dim (U8 bits, U8 brightness);
+void gi_fade (U8 bits, U8 brightness, U8 rate);
 void gi_leff_dim (U8 bits, U8 brightness);
+void gi_leff_fade (U8 bits, U8 brightness, U8 rate);
+bool gi_fade_running_p (U8 bits);
 #endif
 
 void gi_enable (triacbits_t bits);
@@ -27,17 +27,20 @@ struct timed_mode_ops
 	/* The constructor, called during timed_mode_begin() */
 	void (*init) (void);
 
-	/* The destructor, called when the mode ends. */
+	/* The destructor, called when the mode ends.  When the mode runs
+	out, it is called from the timer service and must not sleep. */
 	void (*exit) (void);
 
 	/* The update function, called repeatedly while the mode is
-	running.  Currently, the frequency is about every 200ms. */
+	running.  Currently, the frequency is about every 200ms.  It is
+	called from the timer service and must not sleep. */
 	void (*update) (void);
 
 	/* Called to determine when the timer should be paused.
 	Use 'null_false_function' for a timer that should always run.
 	Use 'system_timer_pause' for a default function that pauses
-	during most of the time that you would want it to.  Write
+	during most of the time that you would want it to; such modes
+	share a single check of it.  Write
 	a custom function that calls 'system_timer_pause' if you
 	want to add additional pause conditions. */
 	bool (*pause) (void);
@@ -57,7 +60,7 @@ struct timed_mode_ops
 	/* The priority for the background display/music effects */
 	U8 prio;
 
-	/* A task group ID that can be used to track the mode.  Just
+	/* A group ID for the timer that runs the mode.  Just
 	make up a name when you initialize it. */
 	task_gid_t gid;
 
@@ -88,15 +91,6 @@ fields which are different from the default need to be said. */
 	.grace_timer = 2
 
 
-/** The task that runs the mode timer is passed this structure
-to inform it of all the mode parameters.  Currently, this is just
-a pointer to the ops, but more could be added here. */
-
-struct timed_mode_task_config
-{
-	struct timed_mode_ops *ops;
-};
-
 /* Timed mode APIs */
 
 void timed_mode_begin (struct timed_mode_ops *ops);
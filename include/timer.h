@@ -25,10 +25,56 @@
  * has an unrolled loop that requires this. */
 #define MAX_FREE_TIMERS (4 * ((MAX_TIMERS + 3) / 4))
 
-task_pid_t timer_restart (task_gid_t gid, U16 ticks, task_function_t fn);
-task_pid_t timer_start1 (task_gid_t gid, U16 ticks, task_function_t fn);
-task_pid_t timer_start (task_gid_t gid, U16 ticks, task_function_t fn);
-void timer_init (void);
+/** The number of timers that can run at once */
+#define NUM_TIMERS 24
+
+/** How often the timer service runs */
+#define TIMER_SERVICE_GRAN TIME_100MS
+
+/** Timer pause groups.  Timers in the system group stop counting
+while system_timer_pause() is true; it is checked once per pass for
+all of them. */
+#define TIMER_GROUP_FREE 0
+#define TIMER_GROUP_SYSTEM 1
+
+struct timer;
+
+/** The function called when a timer expires.  It is called from the
+timer service task and must not sleep. */
+typedef void (*timer_function_t) (struct timer *);
+
+/** A timer.  A slot with a gid of zero is not in use. */
+struct timer
+{
+	/* The group ID by which the timer is found or stopped */
+	task_gid_t gid;
+
+	/* The pause group */
+	U8 group;
+
+	/* The conditions under which the timer is stopped, as for tasks */
+	U8 duration;
+
+	/* A counter for the use of the expiry function */
+	U8 count;
+
+	/* The ticks until the timer expires */
+	U16 ticks;
+
+	/* The function to call on expiry, or NULL */
+	timer_function_t fn;
+
+	/* Data for the use of the expiry function */
+	void *data;
+};
+
+struct timer *timer_restart (task_gid_t gid, U16 ticks, timer_function_t fn);
+struct timer *timer_start1 (task_gid_t gid, U16 ticks, timer_function_t fn);
+struct timer *timer_start (task_gid_t gid, U16 ticks, timer_function_t fn);
+void timer_rearm (struct timer *t, U16 ticks);
+struct timer *timer_find_gid (task_gid_t gid);
+bool timer_kill_gid (task_gid_t gid);
+void timer_duration_expire (U8 cond);
 
 void timer_lock (void);
 void timer_unlock (void);
@@ -46,16 +92,11 @@ void free_timer_init (void);
 #define free_timer_stop(tid)            __free_timer_stop(__addrval (&tid))
 #define free_timer_test(tid)            __free_timer_test(__addrval (&tid))
 
-#define timer_kill_gid 	task_kill_gid
-#define timer_kill_pid 	task_kill_pid
-#define timer_find_gid	task_find_gid
-#define timer_test_and_kill_gid	task_kill_gid
-
-void freerunning_timer_function (void);
+#define timer_test_and_kill_gid	timer_kill_gid
 
-#define timer_restart_free(g,t)	timer_restart(g,t,freerunning_timer_function)
-#define timer_start1_free(g,t)	timer_start1(g,t,freerunning_timer_function)
-#define timer_start_free(g,t)		timer_start(g,t,freerunning_timer_function)
+#define timer_restart_free(g,t)	timer_restart(g,t,NULL)
+#define timer_start1_free(g,t)	timer_start1(g,t,NULL)
+#define timer_start_free(g,t)		timer_start(g,t,NULL)
 
 #endif /* _TIMER_H */
 
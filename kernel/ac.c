@@ -32,6 +32,9 @@
  *
  * This module exports a value, 'zc_timer', which is zero right
  * at the zerocross point, and increments every millisecond after.
+ * It also exports 'zc_phase', which counts the half-cycles modulo
+ * AC_PHASES.  Together they say where in the AC waveform an IRQ falls;
+ * the triac driver uses them to fire each GI string at its own slot.
  */
 
 /**
@@ -41,17 +44,20 @@
  */
 __fastram__ U8 zc_timer;
 
+/**
+ * The number of zerocross points seen, modulo AC_PHASES.
+ */
+__fastram__ U8 zc_phase;
+
 /**
  * The current status of the zerocross circuit.
  */
 #ifdef CONFIG_NO_ZEROCROSS
 #define zc_status ZC_BROKEN
 #define zc_set_status(x)
-#define ZC_MAX_PERIOD 8
 #else
 zc_status_t zc_status;
 #define zc_set_status(x) zc_status = x
-#define ZC_MAX_PERIOD 11
 #endif
 
 
@@ -79,6 +85,7 @@ void ac_rtt (void)
 		 * If we are currently at a zero crossing,
 		 * reset the timer. */
 		zc_timer = 0;
+		zc_phase = (zc_phase + 1) & (AC_PHASES - 1);
 	}
 	else
 	{
@@ -93,6 +100,7 @@ void ac_rtt (void)
 			we didn't.  We'll just pretend we got one anyway. */
 			interrupt_dbprintf ("ZC failure?\n");
 			zc_timer = 0;
+			zc_phase = (zc_phase + 1) & (AC_PHASES - 1);
 
 #if 0
 			ac_zerocross_errors++;
@@ -115,6 +123,7 @@ void ac_rtt (void)
 void ac_init (void)
 {
 	zc_timer = 0;
+	zc_phase = 0;
 	ac_zerocross_errors = 0;
 
 	/* Assume working AC/zerocross for now - TODO */
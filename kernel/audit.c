@@ -52,16 +52,26 @@ void audit_reset (void)
 }
 
 
+/** Store a new value into an audit.  Only the two bytes that changed
+ * are summed into the checksum, and they are saved along with any
+ * other audits that change in the same second. */
+static void audit_write (audit_t *aud, audit_t val)
+{
+	audit_t old = *aud;
+
+	pinio_nvram_unlock ();
+	*aud = val;
+	csum_area_update_range (&audit_csum_info,
+		(U8 *)aud, (U8 *)&old, sizeof (audit_t));
+	pinio_nvram_lock ();
+}
+
+
 /** Increment an audit by 1 */
 void audit_increment (audit_t *aud)
 {
 	if (*aud < 0xFFFF)
-	{
-		pinio_nvram_unlock ();
-		(*aud)++;
-		csum_area_update (&audit_csum_info);
-		pinio_nvram_lock ();
-	}
+		audit_write (aud, *aud + 1);
 }
 
 
@@ -69,22 +79,33 @@ void audit_increment (audit_t *aud)
 void audit_add (audit_t *aud, U8 val)
 {
 	if (*aud < 0xFFFF - (val - 1))
-	{
-		pinio_nvram_unlock ();
-		(*aud) += val;
-		csum_area_update (&audit_csum_info);
-		pinio_nvram_lock ();
-	}
+		audit_write (aud, *aud + val);
 }
 
 
 /** Assign an audit value directly */
 void audit_assign (audit_t *aud, audit_t val)
 {
-	pinio_nvram_unlock ();
-	(*aud) = val;
-	csum_area_update (&audit_csum_info);
-	pinio_nvram_lock ();
+	audit_write (aud, val);
+}
+
+
+/** Count one more SAMPLE, and fold it into a running average and a
+ * maximum.  The average weighs the last 16 or so samples, so that it
+ * follows changes in the machine without keeping any history. */
+void audit_average (audit_t *count, audit_t *avg, audit_t *max, U16 sample)
+{
+	U16 n, val;
+
+	audit_increment (count);
+	n = *count;
+	if (n > 16)
+		n = 16;
+	val = *avg;
+	val += ((S16)(sample - val)) / (S16)n;
+	audit_assign (avg, val);
+	if (sample > *max)
+		audit_assign (max, sample);
 }
 
 
@@ -29,13 +29,38 @@
  * to verify the area.  If the checksum does not match, the
  * structure provides a callback function that says how to reset the
  * data to sane values.
+ *
+ * The checksum is a simple sum of the bytes in the area, so a small
+ * change can be applied to it without reading the rest of the area:
+ * see csum_area_update_range().  Changes made that way are also tracked
+ * in a per-file bitmap of dirty blocks, so that platforms which write
+ * protected memory to disk only write what changed, and can batch many
+ * small updates (audits, mostly) into a single write.
  */
 
 #include <freewpc.h>
 
+/* Platforms which keep protected memory on disk provide these to
+ * write changes there.  Battery-backed RAM needs neither. */
+#ifndef pinio_nvram_journal
+#define pinio_nvram_journal(ptr, len) ((void)(ptr), (void)(len))
+#define pinio_nvram_commit()
+#endif
 
-U8 *
-csum_get_var (const struct area_csum *csi)
+/** Dirty blocks are this many bytes.  Areas are at most 255 bytes
+long, so one byte of bitmap covers a whole file. */
+#define CSUM_BLOCK_SHIFT 5
+
+/** The dirty block bitmap for each entry in the file table.  These
+are in ordinary RAM; they are only meaningful until the next flush. */
+U8 csum_dirty[MAX_FILE_INFO];
+
+/** Nonzero if any file has dirty blocks */
+U8 csum_dirty_any;
+
+
+static struct file_info *
+csum_get_file (const struct area_csum *csi)
 {
 	if (csi->type == 0 || csi->csum)
 	{
@@ -45,8 +70,71 @@ csum_get_var (const struct area_csum *csi)
 	struct file_info *fi = file_find (csi->type);
 	if (!fi)
 		dbprintf ("warning: csum_get_var could not find fi\n");
-	U8 *res = &fi->csum;
-	return res;
+	return fi;
+}
+
+
+U8 *
+csum_get_var (const struct area_csum *csi)
+{
+	return &csum_get_file (csi)->csum;
+}
+
+
+/**
+ * Mark the bytes from OFFSET to OFFSET+LEN-1 of the file described by FI
+ * as dirty.
+ */
+static void
+csum_mark_dirty (struct file_info *fi, U8 offset, U8 len)
+{
+	U8 block = offset >> CSUM_BLOCK_SHIFT;
+	U8 last = (offset + len - 1) >> CSUM_BLOCK_SHIFT;
+	U8 *dirty = &csum_dirty[fi - file_info];
+
+	if (len == 0)
+		return;
+	do {
+		*dirty |= 1 << block;
+	} while (++block <= last);
+	csum_dirty_any = TRUE;
+}
+
+
+/**
+ * Write all dirty blocks of protected memory, along with the file
+ * table entries that hold their checksums, as a single transaction.
+ * Every dirty file is written at once so that what is saved always
+ * agrees with its checksum.
+ */
+void
+csum_flush (void)
+{
+	U8 i, block;
+	struct file_info *fi;
+
+	if (!csum_dirty_any)
+		return;
+	for (i=0, fi = file_info; i < MAX_FILE_INFO; i++, fi++)
+	{
+		if (!csum_dirty[i])
+			continue;
+		for (block = 0; block < 8; block++)
+		{
+			if (csum_dirty[i] & (1 << block))
+			{
+				U16 offset = (U16)block << CSUM_BLOCK_SHIFT;
+				U16 len = fi->len - offset;
+				if (len > (1 << CSUM_BLOCK_SHIFT))
+					len = 1 << CSUM_BLOCK_SHIFT;
+				pinio_nvram_journal ((U8 *)fi->data + offset, len);
+			}
+		}
+		pinio_nvram_journal (fi, sizeof (*fi));
+		csum_dirty[i] = 0;
+	}
+	pinio_nvram_commit ();
+	csum_dirty_any = FALSE;
 }
 
 
@@ -54,13 +142,17 @@ csum_get_var (const struct area_csum *csi)
  * Updates a checksummed region after an update.
  * This should be invoked immediately after any changes to protected
  * memory.  It assumes the region is UNLOCKED, since you just wrote to it.
+ *
+ * This recomputes the checksum over the whole area and saves it at
+ * once.  For small, frequent changes, csum_area_update_range() is
+ * cheaper.
  */
 void
 csum_area_update (const struct area_csum *csi)
 {
 	U8 csum;
 	U8 *ptr;
-	U8 *csum_var_p;
+	struct file_info *fi;
 
 	/* Compute the current checksum of the area */
 	csum = 0;
@@ -68,8 +160,38 @@ csum_area_update (const struct area_csum *csi)
 		csum += *ptr;
 
 	/* Store this as the new checksum */
-	csum_var_p = csum_get_var (csi);
-	*csum_var_p = csum;
+	fi = csum_get_file (csi);
+	fi->csum = csum;
+
+	/* Save the whole area now, together with anything else that was
+	pending */
+	csum_mark_dirty (fi, 0, csi->length);
+	csum_flush ();
+}
+
+
+/**
+ * Updates a checksummed region after LEN bytes at PTR were changed.
+ * OLD holds what those bytes contained before the change.
+ *
+ * The difference is applied to the stored checksum, so this costs
+ * the same no matter how large the area is.  The change is not
+ * saved until the next csum_flush(); that happens within a second, at
+ * idle time, or sooner if another area is updated in full.
+ */
+void
+csum_area_update_range (const struct area_csum *csi,
+	const U8 *ptr, const U8 *old, U8 len)
+{
+	struct file_info *fi = csum_get_file (csi);
+	U8 csum = fi->csum;
+	U8 n;
+
+	for (n = 0; n < len; n++)
+		csum += ptr[n] - old[n];
+	fi->csum = csum;
+
+	csum_mark_dirty (fi, ptr - csi->area, len);
 }
 
 
@@ -111,3 +233,9 @@ csum_area_check (const struct area_csum *csi)
 		csum_area_reset (csi);
 }
 
+
+
+CALLSET_ENTRY (csum, idle_every_second)
+{
+	csum_flush ();
+}
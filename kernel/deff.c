@@ -119,6 +119,7 @@ static void deff_stop_task (void)
 #ifdef CONFIG_DMD
 	/* TODO : if (!task_find_gid (GID_DEFF_EXITING)) -- not working yet */
 		dmd_reset_transition ();
+	dmd_surface_free_all ();
 #endif
 	kickout_unlock (KLOCK_DEFF);
 }
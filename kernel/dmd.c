@@ -69,13 +69,33 @@
  * two pairs are ever needed at once, so there is no concern for
  * overflow.  A few pages are reserved for special use and are
  * always skipped by the allocator.
+ *
+ * A deff that wants to keep an image across many frames, such as
+ * a background to composite text onto, can hold a pair as a surface
+ * with dmd_surface_alloc().  The allocator skips held pairs until
+ * they are freed, or until the deff stops.
  */
 
 #include <freewpc.h>
 
+/** pinio_dmd_publish is called whenever a new page pair becomes
+ * visible, so that a platform can hand completed frames to an observer
+ * without watching every page flip.  Real hardware has no use for it. */
+#ifndef pinio_dmd_publish
+#define pinio_dmd_publish(dark, bright)
+#endif
+
 /** Points to the next free page that can be allocated */
 dmd_pagenum_t dmd_free_page;
 
+/** The page pairs held as surfaces, one bit per pair */
+U8 dmd_held_pairs;
+
+#ifdef CONFIG_SIM
+/** The number of passes made over whole pages */
+U32 dmd_page_passes;
+#endif
+
 /** Low/High cache the current pages that are mapped into
  * visible memory.  Note that you can't read the I/O
  * register directly; they are write-only. */
@@ -179,7 +199,9 @@ void dmd_init (void)
 	pinio_dmd_window_set (PINIO_DMD_WINDOW_1, 0);
 	dmd_clean_page_low ();
 	pinio_dmd_set_visible (dmd_dark_page = dmd_bright_page = 0);
+	pinio_dmd_publish (0, 0);
 	dmd_free_page = 2;
+	dmd_held_pairs = 0;
 
 	/* Program the DMD controller to generate interrupts */
 	pinio_dmd_request_interrupt ();
@@ -239,14 +261,58 @@ void dmd_rtt2 (void)
  */
 static __attribute__((noinline)) dmd_pagenum_t dmd_alloc (void)
 {
-	dmd_pagenum_t page = dmd_free_page;
-	dmd_free_page += 2;
-	if (dmd_free_page >= DMD_ALLOC_PAGE_COUNT)
-		dmd_free_page = 0;
+	dmd_pagenum_t page;
+	do {
+		page = dmd_free_page;
+		dmd_free_page += 2;
+		if (dmd_free_page >= DMD_ALLOC_PAGE_COUNT)
+			dmd_free_page = 0;
+	} while (dmd_held_pairs & (1 << (page / 2)));
 	return page;
 }
 
 
+/**
+ * Allocate a page pair to be kept as a surface.  It is not mapped.
+ * The pair is not handed out by the allocator until it is given back
+ * with dmd_surface_free(), or the current deff stops.
+ *
+ * If too many surfaces are held already, a nonfatal error is taken and
+ * an ordinary pair is returned instead, which will be reused later.
+ */
+dmd_pagenum_t dmd_surface_alloc (void)
+{
+	dmd_pagenum_t page = dmd_alloc ();
+	U8 held = dmd_held_pairs;
+	U8 count = 0;
+
+	while (held)
+	{
+		count += held & 1;
+		held >>= 1;
+	}
+	if (count >= DMD_SURFACE_COUNT)
+		nonfatal (ERR_DMD_SURFACE);
+	else
+		dmd_held_pairs |= 1 << (page / 2);
+	return page;
+}
+
+
+/** Give back a surface. */
+void dmd_surface_free (dmd_pagenum_t page)
+{
+	dmd_held_pairs &= ~(1 << (page / 2));
+}
+
+
+/** Give back all surfaces.  This is done whenever a deff stops. */
+void dmd_surface_free_all (void)
+{
+	dmd_held_pairs = 0;
+}
+
+
 /** Map a consecutive display page pair into windows 0 & 1 */
 __attribute__((noinline))
 void dmd_map_low_high (dmd_pagenum_t page)
@@ -295,6 +361,7 @@ void dmd_show_low (void)
 	else
 	{
 		dmd_dark_page = dmd_bright_page = dmd_low_page;
+		pinio_dmd_publish (dmd_low_page, dmd_low_page);
 	}
 }
 
@@ -308,6 +375,7 @@ void dmd_show_high (void)
 	else
 	{
 		dmd_dark_page = dmd_bright_page = dmd_high_page;
+		pinio_dmd_publish (dmd_high_page, dmd_high_page);
 	}
 }
 
@@ -332,6 +400,7 @@ currently mapped */
 void dmd_show_other (void)
 {
 	dmd_visible_pages.pair ^= 0x0101;
+	pinio_dmd_publish (dmd_dark_page, dmd_bright_page);
 }
 
 /** Called from a deff when it wants to toggle between two images
@@ -376,6 +445,7 @@ void dmd_show2 (void)
 		without any locking is at all, because the following
 		results in a single store of 16-bits operation. */
 		dmd_visible_pages = dmd_mapped_pages;
+		pinio_dmd_publish (dmd_dark_page, dmd_bright_page);
 	}
 }
 
@@ -388,12 +458,14 @@ void dmd_show2 (void)
 void dmd_clean_page (dmd_buffer_t dbuf)
 {
 	__blockclear16 (dbuf, DMD_PAGE_SIZE);
+	dmd_count_pass ();
 }
 #endif /* __m6809__ */
 
 
 void dmd_fill_page_low (void)
 {
+	dmd_count_pass ();
 #if PINIO_DMD_PIXEL_BITS == 1
 	memset (dmd_low_buffer, 0xFF, DMD_PAGE_SIZE);
 #else
@@ -431,6 +503,7 @@ void dmd_invert_page (dmd_buffer_t dbuf)
 		*dbuf16 = ~*dbuf16;
 		dbuf16++;
 	}
+	dmd_count_pass ();
 }
 
 
@@ -441,6 +514,7 @@ void dmd_copy_page (dmd_buffer_t dst, const dmd_buffer_t src)
 #else
 	__blockcopy16 (dst, src, DMD_PAGE_SIZE);
 #endif
+	dmd_count_pass ();
 }
 
 
@@ -562,6 +636,7 @@ void dmd_do_transition (void)
 		/* Make the composite pages visible */
 		dmd_dark_page = dmd_composite_page;
 		dmd_bright_page = dmd_composite_page+1;
+		pinio_dmd_publish (dmd_dark_page, dmd_bright_page);
 	}
 
 	page_pop ();
@@ -19,6 +19,9 @@
  */
 
 #include <freewpc.h>
+#ifdef CONFIG_SIM
+#include <simulation.h>
+#endif
 
 /** Indicates the last nonfatal error taken */
 U8 last_nonfatal_error_code;
@@ -154,6 +157,9 @@ void nonfatal (errcode_t error_code)
 	dbprintf ("Nonfatal error %d\n", error_code);
 #endif
 	log_event (SEV_ERROR, MOD_SYSTEM, EV_SYSTEM_NONFATAL, error_code);
+#ifdef CONFIG_SIM
+	sim_nonfatal (error_code);
+#endif
 }
 
 
@@ -34,10 +34,10 @@ __fastram__ bool flippers_enabled;
 /** Stores the last computed values for the flipper outputs. */
 __fastram__ U8 fliptronic_powered_coil_outputs;
 
-/** A temporary register to hold the current flipper inputs */
+/** The flipper inputs as of the last update of the flippers */
 volatile __fastram__ U8 flipper_inputs;
 
-/** A temporary register to hold the most recent flipper outputs */
+/** The flipper coil outputs wanted by the last update of the flippers */
 volatile __fastram__ U8 flipper_outputs;
 
 /** Software controlled flipper inputs for Fliptronic games.
@@ -45,6 +45,106 @@ volatile __fastram__ U8 flipper_outputs;
  * flipper logic. */
 #if (MACHINE_FLIPTRONIC == 1)
 __fastram__ U8 flipper_overrides;
+
+/*
+ * Each flipper is driven by a small state machine, which is stepped in
+ * the same IRQ that sees its button or EOS switch change:
+ *
+ * - IDLE: both windings off, until the button is pressed.
+ * - POWER: both windings on, until the EOS switch becomes active at the
+ * end of the stroke.  If it does not within FLIPPER_POWER_TIME IRQs,
+ * the EOS is assumed broken.
+ * - HOLD: the hold winding only.  If the EOS goes inactive while the
+ * button is held (the ball knocked the flipper down), full power is
+ * given again.
+ * - HOLD_TIMED: as HOLD, after the EOS was not seen.  The EOS is
+ * ignored until the button is released, so that a broken one cannot
+ * keep the power winding on.
+ *
+ * Releasing the button always returns to IDLE.
+ */
+
+/** The flipper states */
+#define FLIP_IDLE 0
+#define FLIP_POWER 1
+#define FLIP_HOLD 2
+#define FLIP_HOLD_TIMED 3
+#define FLIP_STATES 4
+
+/** Set in a transition to restart the power timer */
+#define FLIP_START 0x80
+
+/** The inputs to the state machine, which index its table */
+#define FLIP_IN_EOS 0x1
+#define FLIP_IN_BUTTON 0x2
+#define FLIP_IN_EXPIRED 0x4
+
+/** The flipper numbers */
+#define FLIP_LL 0
+#define FLIP_LR 1
+#define FLIP_UL 2
+#define FLIP_UR 3
+#define NUM_FLIPPERS 4
+
+#ifdef MACHINE_FLIPPER_NO_EOS
+#define FLIPPER_EOS_MASK 0
+#else
+#define FLIPPER_EOS_MASK WPC_FLIP_EOS
+#endif
+
+/** The next state for each state and set of inputs */
+static const U8 flipper_next[FLIP_STATES][8] = {
+	[FLIP_IDLE] = {
+		FLIP_IDLE, FLIP_IDLE, FLIP_POWER+FLIP_START, FLIP_HOLD,
+		FLIP_IDLE, FLIP_IDLE, FLIP_POWER+FLIP_START, FLIP_HOLD,
+	},
+	[FLIP_POWER] = {
+		FLIP_IDLE, FLIP_IDLE, FLIP_POWER, FLIP_HOLD,
+		FLIP_IDLE, FLIP_IDLE, FLIP_HOLD_TIMED, FLIP_HOLD,
+	},
+	[FLIP_HOLD] = {
+		FLIP_IDLE, FLIP_IDLE, FLIP_POWER+FLIP_START, FLIP_HOLD,
+		FLIP_IDLE, FLIP_IDLE, FLIP_POWER+FLIP_START, FLIP_HOLD,
+	},
+	[FLIP_HOLD_TIMED] = {
+		FLIP_IDLE, FLIP_IDLE, FLIP_HOLD_TIMED, FLIP_HOLD_TIMED,
+		FLIP_IDLE, FLIP_IDLE, FLIP_HOLD_TIMED, FLIP_HOLD_TIMED,
+	},
+};
+
+#define FLIPPER_DRIVE(power, hold) { 0, (power) | (hold), (hold), (hold) }
+
+/** The coil outputs of each flipper in each state */
+static const U8 flipper_drive[NUM_FLIPPERS][FLIP_STATES] = {
+	[FLIP_LL] = FLIPPER_DRIVE (WPC_LL_FLIP_POWER, WPC_LL_FLIP_HOLD),
+	[FLIP_LR] = FLIPPER_DRIVE (WPC_LR_FLIP_POWER, WPC_LR_FLIP_HOLD),
+	[FLIP_UL] = FLIPPER_DRIVE (WPC_UL_FLIP_POWER, WPC_UL_FLIP_HOLD),
+	[FLIP_UR] = FLIPPER_DRIVE (WPC_UR_FLIP_POWER, WPC_UR_FLIP_HOLD),
+};
+
+/** The current state of each flipper */
+__fastram__ U8 flipper_state[NUM_FLIPPERS];
+
+/** For each flipper in the POWER state, the IRQs left before the EOS
+is given up on */
+__fastram__ U8 flipper_timer[NUM_FLIPPERS];
+
+/** Nonzero when a power winding is on, so that its timer must be
+stepped even if no input changes */
+__fastram__ U8 flipper_timing;
+
+
+/** Return all of the flippers to IDLE, with the coils off. */
+static void flipper_reset (void)
+{
+	U8 f;
+
+	for (f = 0; f < NUM_FLIPPERS; f++)
+		flipper_state[f] = FLIP_IDLE;
+	flipper_timing = 0;
+	flipper_inputs = 0;
+	flipper_outputs = 0;
+}
 #endif
 
 
@@ -67,6 +167,9 @@ void flipper_disable (void)
 	disable_interrupts ();
 	flippers_enabled = FALSE;
 	flipper_outputs = 0;
+#if (MACHINE_FLIPTRONIC == 1)
+	flipper_reset ();
+#endif
 	enable_interrupts ();
 }
 
@@ -127,76 +230,76 @@ void flipper_override_pulse (U8 switches)
 }
 
 
-/** Perform real-time processing for a single flipper.
- * This is executed once per flipper every 4ms.
- */
-static inline void flipper_service (
-	const U8 sw_button, const U8 sw_eos,
-	const U8 sol_power, const U8 sol_hold )
+/** Step the state machine of one flipper, and return the coil outputs
+ * that it wants. */
+static inline U8 flipper_step (const U8 f, const U8 inputs,
+	const U8 sw_button, const U8 sw_eos)
 {
-	/* The logic is as follows:
-	 * If the button is held and the EOS is active, enable holding power.
-	 * If the button is held and no EOS is seen, enable full power.
-	 * If the button is not held, then the coil is off by default.
-	 *
-	 * Future enhancements:
-	 * - Duty cycling: pulsing the coil at less than 100%
-	 * - Handling EOS errors: If the EOS is broken, there will always be
-	 * full power.
-	 * - Handle button errors: If a button is not working, its
-	 * peer button (upper & lower as part of a set) should compensate.
-	 * - Switch debouncing on the EOS
-	 * - Minimum off time between presses, to prevent constant full
-	 * power because EOS never has a chance to kick in.
-	 * - Detect system crashes where the entire memory becomes FF.
-	 * This causes the flippers to go permanently (at least for a while).
-	 */
-
-	if (unlikely (flipper_inputs & sw_button))
+	U8 in = 0;
+	U8 next;
+
+	if (inputs & sw_button)
+		in |= FLIP_IN_BUTTON;
+	if (inputs & sw_eos & FLIPPER_EOS_MASK)
+		in |= FLIP_IN_EOS;
+	if (flipper_state[f] == FLIP_POWER && --flipper_timer[f] == 0)
+		in |= FLIP_IN_EXPIRED;
+
+	next = flipper_next[flipper_state[f]][in];
+	if (next & FLIP_START)
 	{
-		if (likely (flipper_inputs & sw_eos))
-		{
-			flipper_outputs |= sol_hold;
-		}
-		else
-		{
-			flipper_outputs |= sol_power | sol_hold;
-		}
+		next &= ~FLIP_START;
+		flipper_timer[f] = FLIPPER_POWER_TIME;
 	}
+	flipper_state[f] = next;
+	return flipper_drive[f][next];
+}
+
+
+/** Step all of the flippers, after an input has changed or while a
+ * power winding is on. */
+static void flipper_update (U8 inputs)
+{
+	U8 outputs;
+
+	flipper_inputs = inputs;
+	outputs = flipper_step (FLIP_LL, inputs, WPC_LL_FLIP_SW, WPC_LL_FLIP_EOS);
+	outputs |= flipper_step (FLIP_LR, inputs, WPC_LR_FLIP_SW, WPC_LR_FLIP_EOS);
+
+	/* Some machines use the upper flipper coils for other uses.
+	 * Those can already be handled by the regular solenoid module. */
+#ifdef MACHINE_HAS_UPPER_LEFT_FLIPPER
+	outputs |= flipper_step (FLIP_UL, inputs, WPC_UL_FLIP_SW, WPC_UL_FLIP_EOS);
+#endif
+#ifdef MACHINE_HAS_UPPER_RIGHT_FLIPPER
+	outputs |= flipper_step (FLIP_UR, inputs, WPC_UR_FLIP_SW, WPC_UR_FLIP_EOS);
+#endif
+
+	flipper_outputs = outputs;
+	flipper_timing = outputs & (WPC_LL_FLIP_POWER | WPC_LR_FLIP_POWER
+		| WPC_UL_FLIP_POWER | WPC_UR_FLIP_POWER);
 }
 
 
 /** Real-time function that services all of the flipper switches and coils.
+ * It runs every IRQ, so that a button press is seen and the coil turned on
+ * in the same IRQ.  The state machines are only stepped when an input has
+ * changed or a power winding is on; otherwise only the last outputs are
+ * written again.
+ *
  * On non-Fliptronic games, the CPU has no visibility to the flippers so
  * this isn't necessary. */
+/* RTT(name=fliptronic_rtt freq=1) */
 void fliptronic_rtt (void)
 {
 	if (likely (flippers_enabled))
 	{
 		register U8 inputs = ~wpc_read_flippers () | flipper_overrides;
-		if (unlikely (inputs))
-		{
-			flipper_inputs = inputs;
-			flipper_outputs = fliptronic_powered_coil_outputs;
-
-			flipper_service (WPC_LL_FLIP_SW, WPC_LL_FLIP_EOS, WPC_LL_FLIP_POWER, WPC_LL_FLIP_HOLD);
-			flipper_service (WPC_LR_FLIP_SW, WPC_LR_FLIP_EOS, WPC_LR_FLIP_POWER, WPC_LR_FLIP_HOLD);
-
-			/* Some machines use the upper flipper coils for other uses.
-			 * Those can already be handled by the regular solenoid module. */
-#ifdef MACHINE_HAS_UPPER_LEFT_FLIPPER
-			flipper_service (WPC_UL_FLIP_SW, WPC_UL_FLIP_EOS, WPC_UL_FLIP_POWER, WPC_UL_FLIP_HOLD);
-#endif
-
-#ifdef MACHINE_HAS_UPPER_RIGHT_FLIPPER
-			flipper_service (WPC_UR_FLIP_SW, WPC_UR_FLIP_EOS, WPC_UR_FLIP_POWER, WPC_UR_FLIP_HOLD);
-#endif
-			wpc_write_flippers (flipper_outputs);
-			return;
-		}
+		if (unlikely (inputs != flipper_inputs || flipper_timing))
+			flipper_update (inputs);
 	}
 
-	wpc_write_flippers (fliptronic_powered_coil_outputs);
+	wpc_write_flippers (flipper_outputs | fliptronic_powered_coil_outputs);
 }
 
 #endif /* MACHINE_FLIPTRONIC */
@@ -221,6 +324,9 @@ void flipper_init (void)
 	pinio_disable_flippers ();
 	flippers_enabled = FALSE;
 	flipper_outputs = 0;
+#if (MACHINE_FLIPTRONIC == 1)
+	flipper_reset ();
+#endif
 	fliptronic_powered_coil_outputs = 0;
 }
 
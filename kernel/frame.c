@@ -109,6 +109,7 @@ void frame_decode (U8 *data, U8 type)
 	{
 		frame_decode_sparse (data);
 	}
+	dmd_count_pass ();
 }
 
 /**
@@ -22,9 +22,9 @@
  * \file
  * \brief An implementation of short, free-running timers.
  *
- * Free timers are similar to the other timer API, but they do not have
- * tasks executing and are therefore more efficient.  The timer is just
- * a counter that is updated at IRQ level.  No action is taken upon
+ * Free timers are similar to the other timer API, but they are not
+ * counted by the timer service and are therefore more efficient.  The
+ * timer is just a counter that is updated at IRQ level.  No action is taken upon
  * expiration, so the only usage is to query a free timer ID to see if
  * it is running.  Free timers are ideal for hardware debouncing such
  * as testing whether or not two switches have been tripped sequentially;
@@ -260,6 +260,7 @@ void end_ball (void)
 	/* Stop tasks that should run only until end-of-ball. */
 	task_remove_duration (TASK_DURATION_BALL);
 	task_duration_expire (TASK_DURATION_BALL);
+	timer_duration_expire (TASK_DURATION_BALL);
 	in_bonus = FALSE;
 
 	/* If the player has extra balls stacked, then start the
@@ -631,6 +632,7 @@ void stop_game (void)
 	a chance to do cleanup before this happens. */
 	task_remove_duration (TASK_DURATION_GAME);
 	task_duration_expire (TASK_DURATION_GAME);
+	timer_duration_expire (TASK_DURATION_GAME);
 }
 
 
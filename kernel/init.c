@@ -149,7 +149,7 @@ __noreturn__ void freewpc_init (void)
 	   made. */
 	log_init ();
 
-#ifdef CONFIG_NATIVE
+#if defined(CONFIG_NATIVE) && !defined(CONFIG_GREEN)
 	{
 		void realtime_loop (void);
 
@@ -108,6 +108,7 @@ void lamp_init (void)
 	lamp_power_timer = 0;
 	lamp_power_level = 0;
 	lamp_power_idle_timer = 0;
+	lamp_pwm_init ();
 }
 
 
@@ -117,22 +118,12 @@ void lamp_init (void)
 /* RTT(name=lamp_flash_rtt freq=128) */
 void lamp_flash_rtt (void)
 {
-	U16 *lamp_matrix_words = (U16 *)lamp_flash_matrix_now;
-	U16 *lamp_flash_matrix_words = (U16 *)lamp_flash_matrix;
+	register lamp_word_t *now = (lamp_word_t *)lamp_flash_matrix_now;
+	register const lamp_word_t *flash = (const lamp_word_t *)lamp_flash_matrix;
 
-	lamp_matrix_words[0] ^= lamp_flash_matrix_words[0];
-#if (PINIO_NUM_LAMPS > 16)
-	lamp_matrix_words[1] ^= lamp_flash_matrix_words[1];
-#endif
-#if (PINIO_NUM_LAMPS > 32)
-	lamp_matrix_words[2] ^= lamp_flash_matrix_words[2];
-#endif
-#if (PINIO_NUM_LAMPS > 48)
-	lamp_matrix_words[3] ^= lamp_flash_matrix_words[3];
-#endif
-#if (PINIO_NUM_LAMPS > 64)
-	lamp_matrix_words[4] ^= lamp_flash_matrix_words[4];
-#endif
+#define op(n) now[n] ^= flash[n]
+	lamp_set_unroll (op);
+#undef op
 }
 
 
@@ -177,24 +168,27 @@ bool bit_test (const_bitset matrix, U8 bit)
 }
 
 
-/** Return nonzero if all bits in a matrix are set. */
+/** Return nonzero if all bits in a lamp matrix are set. */
 bool bit_test_all_on (const_bitset matrix)
 {
-	U8 product = (matrix[0] & matrix[1]
-		& matrix[2] & matrix[3]
-		& matrix[4] & matrix[5]
-		& matrix[6] & matrix[7]);
+	U8 product = 0xFF;
+	U8 col;
+
+	for (col = 0; col < NUM_LAMP_COLS; col++)
+		product &= matrix[col];
 	return (product == 0xFF);
 }
 
 
-/** Return nonzero if all bits in a matrix are clear. */
+/** Return nonzero if all bits in a lamp matrix are clear. */
 bool bit_test_all_off (const_bitset matrix)
 {
-	U8 sum = (matrix[0] | matrix[1]
-		| matrix[2] | matrix[3]
-		| matrix[4] | matrix[5]
-		| matrix[6] | matrix[7]);
+	register const lamp_word_t *words = (const lamp_word_t *)matrix;
+	register lamp_word_t sum = 0;
+
+#define op(n) sum |= words[n]
+	lamp_set_unroll (op);
+#undef op
 	return (sum == 0);
 }
 
@@ -322,6 +316,7 @@ void lamp_all_off (void)
 	lamp_set_zero (leff_data_set);
 	enable_interrupts ();
 	lamp_set_zero (lamp_matrix);
+	lamp_pwm_release_all ();
 }
 
 
@@ -50,6 +50,12 @@ extern const lampnum_t * const lamplist_table[];
 
 U8 lamplist_alternation_state;
 
+/** The level and rate of the fades started by lamplist_fade().  These
+are read as each lamp is reached, so two effects that fade lists with
+an apply delay at the same time will share them. */
+U8 lamplist_fade_level;
+U8 lamplist_fade_rate;
+
 
 /** Returns true if the current task is a lamp effect. */
 static inline bool leff_caller_p (void)
@@ -300,6 +306,40 @@ void lamplist_apply_leff_alternating (lamplist_id_t id, U8 initially_on)
 }
 
 
+static void lamp_fade_operator (lampnum_t lamp)
+{
+	lamp_fade (lamp, lamplist_fade_level, lamplist_fade_rate);
+}
+
+
+/** Fade each lamp in a lamplist to LEVEL, at RATE fade ticks per step.
+With an apply delay, the fades start one after another, so the change
+moves along the list while the lamp effect just waits. */
+void lamplist_fade (lamplist_id_t id, U8 level, U8 rate)
+{
+	lamplist_fade_level = level;
+	lamplist_fade_rate = rate;
+	lamplist_apply (id, lamp_fade_operator);
+}
+
+
+static void lamp_sweep_operator (lampnum_t lamp)
+{
+	lamp_pwm_set (lamp, LAMP_PWM_MAX);
+	lamp_fade (lamp, 0, lamplist_fade_rate);
+}
+
+
+/** Turn on each lamp in a lamplist and let it fade out, at RATE fade
+ticks per step.  With an apply delay, this is a band of light that
+moves along the list with a tail behind it. */
+void lamplist_sweep (lamplist_id_t id, U8 rate)
+{
+	lamplist_fade_rate = rate;
+	lamplist_apply (id, lamp_sweep_operator);
+}
+
+
 /* Step functions.  These routines treat the lamplist of length N as
  * an integer in the range of 0 to N-1.  When the 'value' is k, that
  * means the kth lamp is on, and all other lamps are off.
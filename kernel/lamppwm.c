@@ -0,0 +1,320 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * \file
+ * \brief Lamp intensity control and fading.
+ *
+ * Any lamp can be given one of 16 intensities instead of just on or off,
+ * and can fade from one intensity to another without a task toggling it.
+ *
+ * The intensities are kept as bit-planes: a lamp's bit is set in
+ * lamp_pwm_planes[k] when bit k of its level is set.  Each time the lamp
+ * driver has strobed the whole matrix, it moves on to the next plane in
+ * lamp_pwm_schedule, where plane k appears 2^k times out of 15.  A lamp
+ * at level N is therefore lit for N strobes in 15, and the lamp driver
+ * does the same AND and OR per column however many lamps are dimmed or
+ * fading.
+ *
+ * WPC strobes the matrix every 16ms, so the period is 240ms.  The
+ * filament smooths out the middle levels, where the plane changes on
+ * most strobes; the lowest levels flicker, which is why there are only
+ * 4 bits.
+ *
+ * Lamps in lamp_pwm_mask are controlled here, and override the normal,
+ * flashing and lamp effect outputs.  A lamp stays controlled, even at
+ * level 0, until it is released; the lamps of a lamp effect are released
+ * when it exits.
+ *
+ * Fades are stepped by lamp_fade_rtt, one column per call, so no call
+ * has more than 8 lamps to update.  A pass over all of the columns is
+ * one fade tick.
+ */
+
+#include <freewpc.h>
+#include <system/platform.h>
+
+#if (LAMP_PWM_BITS != 4)
+#error "lamp_pwm_schedule is only written for 4 bits"
+#endif
+
+/** The lamps whose intensity is controlled here */
+lamp_set lamp_pwm_mask;
+
+/** The bit-planes of the levels of the controlled lamps.  Bits are only
+ever set for lamps in lamp_pwm_mask. */
+lamp_set lamp_pwm_planes[LAMP_PWM_BITS];
+
+/** The plane being output during the current strobe of the matrix */
+const U8 *lamp_pwm_now;
+
+/** The position in lamp_pwm_schedule of the next plane */
+U8 lamp_pwm_slot;
+
+/** The order in which the planes are output.  This is the bit-reversed
+order, which keeps the strobes of each plane as far apart as possible. */
+const U8 *const lamp_pwm_schedule[LAMP_PWM_SLOTS] = {
+	lamp_pwm_planes[3], lamp_pwm_planes[2], lamp_pwm_planes[3],
+	lamp_pwm_planes[1], lamp_pwm_planes[3], lamp_pwm_planes[2],
+	lamp_pwm_planes[3], lamp_pwm_planes[0], lamp_pwm_planes[3],
+	lamp_pwm_planes[2], lamp_pwm_planes[3], lamp_pwm_planes[1],
+	lamp_pwm_planes[3], lamp_pwm_planes[2], lamp_pwm_planes[3],
+};
+
+/** The lamps that are still fading */
+lamp_set lamp_fading;
+
+/** For each lamp, its current level in the low nibble and the level it
+is fading to in the high nibble */
+U8 lamp_fade_level[NUM_LAMP_COLS * 8];
+
+/** For each fading lamp, the number of fade ticks per step in the high
+nibble, and the ticks left until the next step in the low nibble */
+U8 lamp_fade_timer[NUM_LAMP_COLS * 8];
+
+/** The column that lamp_fade_rtt will step next */
+U8 lamp_fade_column;
+
+
+/** Write LEVEL into the planes of the lamp at column COL and bit MASK.
+This must not be interrupted by lamp_fade_rtt. */
+static void lamp_pwm_write (U8 col, U8 mask, U8 level)
+{
+	U8 plane;
+
+	for (plane = 0; plane < LAMP_PWM_BITS; plane++)
+	{
+		if (level & 1)
+			lamp_pwm_planes[plane][col] |= mask;
+		else
+			lamp_pwm_planes[plane][col] &= ~mask;
+		level >>= 1;
+	}
+}
+
+
+/** In column COL, add one to the levels of the lamps in UP and take one
+from the levels of those in DOWN.  The planes are treated as the bits of
+8 binary numbers, and the carries and borrows rippled up through them a
+plane at a time, so this costs the same however many lamps move. */
+static void lamp_pwm_step (U8 col, U8 up, U8 down)
+{
+	U8 plane, bits;
+
+	for (plane = 0; (up | down) && plane < LAMP_PWM_BITS; plane++)
+	{
+		bits = lamp_pwm_planes[plane][col];
+		lamp_pwm_planes[plane][col] = bits ^ (up | down);
+		up &= bits;
+		down &= ~bits;
+	}
+}
+
+
+/** Step the fading lamps in one column. */
+/* RTT(name=lamp_fade_rtt freq=2) */
+void lamp_fade_rtt (void)
+{
+	U8 col = lamp_fade_column;
+	U8 fading, mask, now, target;
+	U8 up = 0, down = 0;
+	U8 *level, *timer;
+
+	if (++lamp_fade_column >= NUM_LAMP_COLS)
+		lamp_fade_column = 0;
+
+	fading = lamp_fading[col];
+	if (likely (fading == 0))
+		return;
+
+	level = lamp_fade_level + col * 8;
+	timer = lamp_fade_timer + col * 8;
+	for (mask = 0x1; mask; mask <<= 1, level++, timer++)
+	{
+		if (!(fading & mask))
+			continue;
+
+		/* The countdown is never zero here, so this cannot borrow
+		from the rate.  When it reaches zero, reload it. */
+		if (--*timer & 0x0F)
+			continue;
+		*timer |= *timer >> 4;
+
+		now = *level & 0x0F;
+		target = *level >> 4;
+		if (now < target)
+		{
+			now++;
+			up |= mask;
+		}
+		else
+		{
+			now--;
+			down |= mask;
+		}
+		*level = (*level & 0xF0) | now;
+		if (now == target)
+			fading &= ~mask;
+	}
+	lamp_pwm_step (col, up, down);
+	lamp_fading[col] = fading;
+}
+
+
+/** Return the current level of a lamp.  A lamp that is not controlled
+here is either fully on or off, according to whoever owns it. */
+static U8 lamp_pwm_level (lampnum_t lamp)
+{
+	if (bit_test (lamp_pwm_mask, lamp))
+		return lamp_fade_level[lamp] & 0x0F;
+	else if (bit_test (leff_free_set, lamp))
+		return lamp_test (lamp) ? LAMP_PWM_MAX : 0;
+	else
+		return leff_test (lamp) ? LAMP_PWM_MAX : 0;
+}
+
+
+/**
+ * Set the intensity of a lamp at once, cancelling any fade.
+ */
+void lamp_pwm_set (lampnum_t lamp, U8 level)
+{
+	U8 col = lamp / 8;
+	U8 mask = single_bit_set (lamp % 8);
+
+	if (level > LAMP_PWM_MAX)
+		level = LAMP_PWM_MAX;
+
+	disable_interrupts ();
+	lamp_pwm_mask[col] |= mask;
+	lamp_fading[col] &= ~mask;
+	lamp_fade_level[lamp] = (level << 4) | level;
+	lamp_pwm_write (col, mask, level);
+	enable_interrupts ();
+}
+
+
+/**
+ * Return the intensity of a lamp.
+ */
+U8 lamp_pwm_get (lampnum_t lamp)
+{
+	U8 level;
+
+	disable_interrupts ();
+	level = lamp_pwm_level (lamp);
+	enable_interrupts ();
+	return level;
+}
+
+
+/**
+ * Fade a lamp from its current intensity to LEVEL, moving one level
+ * every RATE fade ticks.  A rate of zero changes it at once.
+ */
+void lamp_fade (lampnum_t lamp, U8 level, U8 rate)
+{
+	U8 col = lamp / 8;
+	U8 mask = single_bit_set (lamp % 8);
+	U8 now;
+
+	if (level > LAMP_PWM_MAX)
+		level = LAMP_PWM_MAX;
+	if (rate > 0x0F)
+		rate = 0x0F;
+
+	disable_interrupts ();
+	now = rate ? lamp_pwm_level (lamp) : level;
+	lamp_pwm_mask[col] |= mask;
+	lamp_fade_level[lamp] = (level << 4) | now;
+	lamp_fade_timer[lamp] = (rate << 4) | rate;
+	lamp_pwm_write (col, mask, now);
+	if (now != level)
+		lamp_fading[col] |= mask;
+	else
+		lamp_fading[col] &= ~mask;
+	enable_interrupts ();
+}
+
+
+/**
+ * Return a lamp to normal on/off control.
+ */
+void lamp_pwm_release (lampnum_t lamp)
+{
+	U8 col = lamp / 8;
+	U8 mask = single_bit_set (lamp % 8);
+
+	disable_interrupts ();
+	lamp_pwm_mask[col] &= ~mask;
+	lamp_fading[col] &= ~mask;
+	lamp_pwm_write (col, mask, 0);
+	enable_interrupts ();
+}
+
+
+/**
+ * Return a set of lamps to normal on/off control.
+ */
+void lamp_pwm_release_set (const lamp_set set)
+{
+	U8 plane;
+
+	disable_interrupts ();
+	lamp_set_subtract (lamp_pwm_mask, set);
+	lamp_set_subtract (lamp_fading, set);
+	for (plane = 0; plane < LAMP_PWM_BITS; plane++)
+		lamp_set_subtract (lamp_pwm_planes[plane], set);
+	enable_interrupts ();
+}
+
+
+/**
+ * Return every lamp to normal on/off control.
+ */
+void lamp_pwm_release_all (void)
+{
+	U8 plane;
+
+	disable_interrupts ();
+	lamp_set_zero (lamp_pwm_mask);
+	lamp_set_zero (lamp_fading);
+	for (plane = 0; plane < LAMP_PWM_BITS; plane++)
+		lamp_set_zero (lamp_pwm_planes[plane]);
+	enable_interrupts ();
+}
+
+
+/**
+ * Return true if any lamp is still fading.
+ */
+bool lamp_fade_running_p (void)
+{
+	return !bit_test_all_off (lamp_fading);
+}
+
+
+void lamp_pwm_init (void)
+{
+	lamp_pwm_release_all ();
+	lamp_pwm_now = lamp_pwm_schedule[0];
+	lamp_pwm_slot = 1;
+	lamp_fade_column = 0;
+}
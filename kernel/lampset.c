@@ -19,15 +19,14 @@
  */
 
 #include <freewpc.h>
+#include <system/platform.h>
 
 /**
  * Lamp set low-level operators.  Each lamp set is just a bitmap,
- * one bit per resource (lamp/GI string/flasher).  These are
- * optimized according to the maximum number of resources we have.
+ * one bit per resource (lamp/GI string/flasher).  They are sized from
+ * PINIO_NUM_LAMPS and operated on a word at a time; see lamp_word_t.
  */
 
-/* TODO - look at PINIO_NUM_LAMPS */
-
 void lamp_set_zero (lamp_set dst)
 {
 	memset (dst, 0, sizeof (lamp_set));
@@ -35,47 +34,43 @@ void lamp_set_zero (lamp_set dst)
 
 void lamp_set_copy (lamp_set dst, const lamp_set src)
 {
-	register U16 *dst1 = (U16 *)dst;
-	register U16 *src1 = (U16 *)src;
+	register lamp_word_t *dst1 = (lamp_word_t *)dst;
+	register const lamp_word_t *src1 = (const lamp_word_t *)src;
 
-	dst1[0] = src1[0];
-	dst1[1] = src1[1];
-	dst1[2] = src1[2];
-	dst1[3] = src1[3];
+#define op(n) dst1[n] = src1[n]
+	lamp_set_unroll (op);
+#undef op
 }
 
 void lamp_set_add (lamp_set dst, const lamp_set src)
 {
-	register U16 *dst1 = (U16 *)dst;
-	register U16 *src1 = (U16 *)src;
+	register lamp_word_t *dst1 = (lamp_word_t *)dst;
+	register const lamp_word_t *src1 = (const lamp_word_t *)src;
 
-	dst1[0] |= src1[0];
-	dst1[1] |= src1[1];
-	dst1[2] |= src1[2];
-	dst1[3] |= src1[3];
+#define op(n) dst1[n] |= src1[n]
+	lamp_set_unroll (op);
+#undef op
 }
 
 void lamp_set_subtract (lamp_set dst, const lamp_set src)
 {
-	register U16 *dst1 = (U16 *)dst;
-	register U16 *src1 = (U16 *)src;
+	register lamp_word_t *dst1 = (lamp_word_t *)dst;
+	register const lamp_word_t *src1 = (const lamp_word_t *)src;
 
-	dst1[0] &= ~src1[0];
-	dst1[1] &= ~src1[1];
-	dst1[2] &= ~src1[2];
-	dst1[3] &= ~src1[3];
+#define op(n) dst1[n] &= ~src1[n]
+	lamp_set_unroll (op);
+#undef op
 }
 
 bool lamp_set_disjoint (const lamp_set a, const lamp_set b)
 {
-	register U16 *a1 = (U16 *)a;
-	register U16 *b1 = (U16 *)b;
-	register U16 x = 0;
+	register const lamp_word_t *a1 = (const lamp_word_t *)a;
+	register const lamp_word_t *b1 = (const lamp_word_t *)b;
+	register lamp_word_t x = 0;
 
-	x |= (a1[0] & b1[0]);
-	x |= (a1[1] & b1[1]);
-	x |= (a1[2] & b1[2]);
-	x |= (a1[3] & b1[3]);
+#define op(n) x |= (a1[n] & b1[n])
+	lamp_set_unroll (op);
+#undef op
 	if (x)
 		return FALSE;
 	return TRUE;
@@ -84,14 +79,13 @@ bool lamp_set_disjoint (const lamp_set a, const lamp_set b)
 
 bool lamp_set_can_be_added (const lamp_set a, const lamp_set b)
 {
-	register U16 *a1 = (U16 *)a;
-	register U16 *b1 = (U16 *)b;
-	register U16 x = 0;
+	register const lamp_word_t *a1 = (const lamp_word_t *)a;
+	register const lamp_word_t *b1 = (const lamp_word_t *)b;
+	register lamp_word_t x = 0;
 
-	x |= (~a1[0] & b1[0]);
-	x |= (~a1[1] & b1[1]);
-	x |= (~a1[2] & b1[2]);
-	x |= (~a1[3] & b1[3]);
+#define op(n) x |= (~a1[n] & b1[n])
+	lamp_set_unroll (op);
+#undef op
 	if (x)
 		return FALSE;
 	return TRUE;
@@ -54,15 +54,15 @@ extern const U8 * lampset_table[];
 enum { L_NORMAL, L_RUNNING, L_SHARED };
 
 /* Declare externs for all of the deff functions */
-#define DECL_LEFF(num, flags, prio, llid, gi, fn, fnpage) \
+#define DECL_LEFF(num, flags, prio, llid, gi, flash, fn, fnpage) \
 	extern void fn (void);
 #ifdef MACHINE_LAMP_EFFECTS
 MACHINE_LAMP_EFFECTS
 #endif
 /* Now declare the deff table itself */
 #undef DECL_LEFF
-#define DECL_LEFF(num, flags, prio, llid, gi, fn, fnpage) \
-	[num] = { prio, fn, fnpage, llid, gi },
+#define DECL_LEFF(num, flags, prio, llid, gi, flash, fn, fnpage) \
+	[num] = { prio, fn, fnpage, llid, gi, flash },
 
 static const leff_t leff_table[] = {
 #define null_leff leff_exit
@@ -93,6 +93,13 @@ lamp_set leff_free_set;
 lamp_set leff_data_set;
 
 
+/**
+ * The flashers which are allocated to running lamp effects.
+ * Only the effect that holds a flasher can start it.
+ */
+flasher_mask_t leff_flasher_alloc;
+
+
 /**
  * The GID to be assigned to the next lamp effect task.
  * GIDs are assigned sequentially; if the next GID happens
@@ -216,27 +223,40 @@ static task_gid_t leff_gid_find_by_id (leffnum_t id)
 /**
  * Allocate resources to a new lamp effect.
  */
-static void leff_res_alloc (const lamp_set res)
+static void leff_res_alloc (const leff_t *leff)
 {
-	lamp_set_subtract (leff_free_set, res);
+	lamp_set_subtract (leff_free_set, leff_get_set (leff));
+	leff_flasher_alloc |= leff->flashers;
 }
 
 
 /**
  * Free resources for an exiting lamp effect.
  */
-static void leff_res_free (const lamp_set res)
+static void leff_res_free (const leff_t *leff)
 {
-	lamp_set_add (leff_free_set, res);
+	lamp_set_add (leff_free_set, leff_get_set (leff));
+	leff_flasher_alloc &= ~leff->flashers;
 }
 
 
 /**
  * Test if the given resources can be allocated.
  */
-static bool leff_res_can_alloc (const lamp_set res)
+static bool leff_res_can_alloc (const leff_t *leff)
+{
+	return lamp_set_can_be_added (leff_free_set, leff_get_set (leff))
+		&& !(leff_flasher_alloc & leff->flashers);
+}
+
+
+/**
+ * Test if two lamp effects need any of the same resources.
+ */
+static bool leff_res_overlap_p (const leff_t *leff1, const leff_t *leff2)
 {
-	return lamp_set_can_be_added (leff_free_set, res);
+	return !lamp_set_disjoint (leff_get_set (leff1), leff_get_set (leff2))
+		|| (leff1->flashers & leff2->flashers);
 }
 
 
@@ -263,8 +283,7 @@ static bool leff_can_preempt (const leff_t *leff)
 		if (rid != LEFF_NULL)
 		{
 			rleff = &leff_table[rid];
-			if (!lamp_set_disjoint (leff_get_set (rleff), leff_get_set (leff))
-				&& rleff->prio >= leff->prio)
+			if (leff_res_overlap_p (rleff, leff) && rleff->prio >= leff->prio)
 			{
 				/* This running leff has some of the lamps we need, but
 				it is higher priority than us.  So the new effect cannot
@@ -283,8 +302,7 @@ static bool leff_can_preempt (const leff_t *leff)
 		if (rid != LEFF_NULL)
 		{
 			rleff = &leff_table[rid];
-			if (!lamp_set_disjoint (leff_get_set (rleff), leff_get_set (leff))
-				&& rleff->prio < leff->prio)
+			if (leff_res_overlap_p (rleff, leff) && rleff->prio < leff->prio)
 			{
 				leff_stop (rid);
 			}
@@ -308,8 +326,9 @@ static void leff_close (const leff_t *leff, U8 idx)
 	page_push (MD_PAGE);
 	rtt_disable ();
 	lamp_set_subtract (leff_data_set, leff_get_set (leff));
-	leff_res_free (leff_get_set (leff));
+	leff_res_free (leff);
 	rtt_enable ();
+	lamp_pwm_release_set (leff_get_set (leff));
 	page_pop ();
 #ifdef CONFIG_GI
 	gi_leff_free (leff->gi);
@@ -358,13 +377,13 @@ void leff_start (leffnum_t id)
 	If this does fail, note that we do not explicitly free up the GID
 	allocated, but it will get reused implicitly since they cycle. */
 	page_push (MD_PAGE);
-	if (!leff_res_can_alloc (leff_get_set (leff)) && !leff_can_preempt (leff))
+	if (!leff_res_can_alloc (leff) && !leff_can_preempt (leff))
 	{
 		goto conflict;
 	}
 
 	/* Mark resources as in use. */
-	leff_res_alloc (leff_get_set (leff));
+	leff_res_alloc (leff);
 #ifdef CONFIG_GI
 	gi_leff_allocate (leff->gi);
 #ifdef CONFIG_TRIAC
@@ -379,6 +398,7 @@ void leff_start (leffnum_t id)
 	/* TODO - it won't start in the same page as caller! */
 	leff_create_task (leff, gid);
 
+	log_event (SEV_INFO, MOD_LAMP, EV_LEFF_START, id);
 	dbprintf ("Started leff %d\n", id);
 #ifdef DEBUG_LEFFS
 	leff_dump ();
@@ -402,6 +422,7 @@ void leff_stop (leffnum_t id)
 		return;
 
 	/* Stop it */
+	log_event (SEV_INFO, MOD_LAMP, EV_LEFF_STOP, id);
 	dbprintf ("Stopping leff %d\n", id);
 	task_kill_gid (gid);
 
@@ -413,6 +434,24 @@ void leff_stop (leffnum_t id)
 }
 
 
+/**
+ * Return true if the current task is a lamp effect that holds the
+ * flasher SOL.
+ */
+bool leff_flasher_owner_p (solnum_t sol)
+{
+	task_gid_t gid = task_getgid ();
+	leffnum_t id;
+
+	if (gid < GID_LEFF_BASE || gid >= GID_LEFF_BASE + MAX_RUNNING_LEFFS)
+		return FALSE;
+	id = leff_running_list[gid - GID_LEFF_BASE];
+	if (id == LEFF_NULL)
+		return FALSE;
+	return (leff_table[id].flashers & FLASHER_BIT (sol)) != 0;
+}
+
+
 const leff_t *leff_get_current (void)
 {
 	task_gid_t gid;
@@ -441,6 +480,7 @@ void leff_exit (void)
 	/* Free up the resources */
 	idx = gid - GID_LEFF_BASE;
 	id = leff_running_list[idx];
+	log_event (SEV_INFO, MOD_LAMP, EV_LEFF_EXIT, id);
 	leff_close (&leff_table[id], idx);
 #ifdef DEBUG_LEFFS
 	leff_dump ();
@@ -474,6 +514,7 @@ void leff_restart (leffnum_t id)
 	task_kill_gid (gid);
 	page_push (MD_PAGE);
 	lamp_set_subtract (leff_data_set, leff_get_set (leff));
+	lamp_pwm_release_set (leff_get_set (leff));
 	page_pop ();
 	leff_create_task (leff, gid);
 #ifdef DEBUG_LEFFS
@@ -495,6 +536,7 @@ void leff_reset (void)
 	lamp matrix bits */
 	memset (&leff_free_set, 0xFF, sizeof (leff_free_set));
 	memset (&leff_data_set, 0, sizeof (leff_data_set));
+	leff_flasher_alloc = 0;
 }
 
 
@@ -133,12 +133,108 @@ void log_event1 (U16 module_event, U8 arg)
 #endif /* CONFIG_LOG */
 
 
+#if defined(CONFIG_TRACE) && defined(CONFIG_NATIVE)
+
+#include <native/log.h>
+
+/** A bitmask of modules (MOD_xxx) for which tracing is enabled */
+U16 trace_module_mask = 0xFFFF;
+
+/** The trace ring itself.  When it fills, the oldest records are
+overwritten. */
+struct trace_record trace_ring[TRACE_RING_SIZE];
+
+/** The total number of records ever written.  The next free slot is
+this value modulo TRACE_RING_SIZE.  Events can be logged from the
+realtime thread and from task threads at the same time, so slots are
+claimed with an atomic increment and no lock is needed. */
+U32 trace_count;
+
+/** The clock value at trace_init(), so that records hold small deltas */
+U32 trace_base_time;
+
+
+/** Add an entry to the trace ring. */
+void trace_event1 (U16 module_event, U16 arg)
+{
+	U32 slot = __sync_fetch_and_add (&trace_count, 1);
+	struct trace_record *rec = &trace_ring[slot & (TRACE_RING_SIZE - 1)];
+
+	rec->usecs = trace_read_clock () - trace_base_time;
+	rec->module_event = module_event;
+	rec->arg = arg;
+	rec->gid = task_getgid ();
+	rec->reserved = 0;
+}
+
+
+/** Write the contents of the trace ring to a file, oldest first.
+The ring is not cleared, so it can be dumped again later. */
+void trace_dump (const char *filename)
+{
+	struct trace_header hdr;
+	U32 count = trace_count;
+	U32 first;
+	FILE *fp;
+
+	fp = fopen (filename, "wb");
+	if (!fp)
+	{
+		print_log ("Cannot open trace file %s\n", filename);
+		return;
+	}
+
+	hdr.magic = TRACE_MAGIC;
+	hdr.version = TRACE_VERSION;
+	hdr.record_size = sizeof (struct trace_record);
+	if (count > TRACE_RING_SIZE)
+	{
+		hdr.count = TRACE_RING_SIZE;
+		hdr.dropped = count - TRACE_RING_SIZE;
+	}
+	else
+	{
+		hdr.count = count;
+		hdr.dropped = 0;
+	}
+	fwrite (&hdr, sizeof (hdr), 1, fp);
+
+	/* The ring may wrap, so write it in at most two pieces */
+	first = (count - hdr.count) & (TRACE_RING_SIZE - 1);
+	if (first + hdr.count > TRACE_RING_SIZE)
+	{
+		fwrite (&trace_ring[first], sizeof (struct trace_record),
+			TRACE_RING_SIZE - first, fp);
+		fwrite (&trace_ring[0], sizeof (struct trace_record),
+			first + hdr.count - TRACE_RING_SIZE, fp);
+	}
+	else
+	{
+		fwrite (&trace_ring[first], sizeof (struct trace_record),
+			hdr.count, fp);
+	}
+	fclose (fp);
+	print_log ("Wrote %u trace records to %s\n", hdr.count, filename);
+}
+
+
+/** Initialize the trace ring. */
+void trace_init (void)
+{
+	trace_count = 0;
+	trace_base_time = trace_read_clock ();
+}
+
+#endif /* CONFIG_TRACE */
+
+
 /** Initialize the event log. */
 void log_init (void)
 {
 #ifdef CONFIG_LOG
 	log_head = log_tail = 0;
 #endif
+	trace_init ();
 
 	/* Save the last event logged from the previous run. */
 	prev_log_callset = log_callset;
@@ -54,11 +54,12 @@ static void mb_mode_update (struct mb_mode_ops *ops, enum mb_mode_state state)
 	}
 }
 
-/*	The default task that runs when the multiball mode is active
-   (running, not in grace).  It doesn't do anything other than
-	keep the GID in use.  Users can substitute their own task
-	instead if someone needs to happen constantly while it's
-	running (e.g. move a jackpot shot around or adjust shot values). */
+/*	A task that does nothing but keep the GID in use while the
+	multiball mode is active.  The mode state says whether it is
+	running, so no task is needed by default.  Users can give their
+	own task as 'active_task' if something needs to happen constantly
+	while it's running (e.g. move a jackpot shot around or adjust
+	shot values). */
 void mb_mode_active_task (void)
 {
 	for (;;)
@@ -66,16 +67,11 @@ void mb_mode_active_task (void)
 	task_exit ();
 }
 
-/*	A task that runs when the multiball mode is in its grace period. */
-static void mb_mode_grace_task (void)
+/*	Called when a multiball mode's grace period is over. */
+static void mb_mode_grace_expire (struct timer *t)
 {
-	struct mb_mode_task_config *cfg =
-		task_current_class_data (struct mb_mode_task_config);
-	struct mb_mode_ops *ops = cfg->ops;
 	/* TBD: implement grace-grace periods like TSPP/LOTR. */
-	task_sleep (ops->grace_period);
-	mb_mode_update (ops, MB_INACTIVE);
-	task_exit ();
+	mb_mode_update (t->data, MB_INACTIVE);
 }
 
 /*	Return the number of running multiball modes */
@@ -89,7 +85,8 @@ void mb_mode_start (struct mb_mode_ops *ops)
 {
 	if (mb_mode_running_p (ops))
 		return;
-	task_create_gid1 (ops->gid_running, ops->active_task);
+	if (ops->active_task)
+		task_create_gid1 (ops->gid_running, ops->active_task);
 	if (ops->deff_starting)
 		deff_start (ops->deff_starting);
 	mb_mode_update (ops, MB_ACTIVE);
@@ -100,8 +97,9 @@ void mb_mode_restart (struct mb_mode_ops *ops)
 {
 	if (!mb_mode_in_grace_p (ops))
 		return;
-	task_create_gid1 (ops->gid_running, ops->active_task);
-	task_kill_gid (ops->gid_in_grace);
+	if (ops->active_task)
+		task_create_gid1 (ops->gid_running, ops->active_task);
+	timer_kill_gid (ops->gid_in_grace);
 	deff_stop (ops->deff_ending);
 	mb_mode_update (ops, MB_ACTIVE);
 }
@@ -120,16 +118,15 @@ void mb_mode_restart (struct mb_mode_ops *ops)
 	to stop the mode.  Note that it still gets a grace period! */
 void mb_mode_single_ball (struct mb_mode_ops *ops)
 {
-	if (task_find_gid (ops->gid_running))
+	if (mb_mode_effect_running_p (ops) && in_live_game)
 	{
-		task_pid_t tp;
-		struct mb_mode_task_config *cfg;
+		struct timer *t;
 
 		task_kill_gid (ops->gid_running);
 
-		tp = task_create_gid1 (ops->gid_in_grace, mb_mode_grace_task);
-		cfg = task_init_class_data (tp, struct mb_mode_task_config);
-		cfg->ops = ops;
+		t = timer_start1 (ops->gid_in_grace, ops->grace_period,
+			mb_mode_grace_expire);
+		t->data = ops;
 
 		mb_mode_update (ops, MB_IN_GRACE);
 	}
@@ -150,7 +147,7 @@ void mb_mode_start_ball (struct mb_mode_ops *ops)
 void mb_mode_end_ball (struct mb_mode_ops *ops)
 {
 	task_kill_gid (ops->gid_running);
-	task_kill_gid (ops->gid_in_grace);
+	timer_kill_gid (ops->gid_in_grace);
 	mb_mode_update (ops, MB_INACTIVE);
 }
 
@@ -19,7 +19,6 @@
  */
 
 #include <freewpc.h>
-#include <queue.h>
 
 /**
  * \file
@@ -31,9 +30,9 @@
  * There are two different mechanisms here, one for solenoids and one for
  * flashers.  For the flashers, there is duplicate inline code for each
  * flasher that controls it.  This allows multiple flashers to run in
- * parallel.  For the solenoids (the first 16 on WPC), there is a single
- * update function, with the solenoid number as a parameter, so only one
- * of these can be pulsed at a time.  (If you need to control an output
+ * parallel.  For the solenoids (the first 16 on WPC), there is a small
+ * number of shared pulse slots, so only a few of these can be pulsed at
+ * a time.  (If you need to control an output
  * that might need to run concurrently with other things, like a long-lived
  * divertor, then these are not the right functions to use; you want to
  * use a driver in the 'drivers' directory.)
@@ -45,9 +44,13 @@
  * parameters in the [drives] section of the machine description.  When you
  * call sol_request(), these are the settings that are used.
  *
- * When using the shared driver, if another request is made while the driver
- * is already pulsing another solenoid, that request can be queued up
- * so the caller does not have to wait for it.
+ * When using the shared driver, if another request is made while the slots
+ * are busy, that request is queued up so the caller does not have to wait
+ * for it.  Queued requests are started by priority, then age, subject to
+ * power budgets which limit how many strong coils fire together, both
+ * overall and within each bank of drivers.
+ * Duplicate requests for a coil that is already waiting are merged, and
+ * a request may carry a deadline after which it is no longer wanted.
  */
 
 
@@ -69,44 +72,196 @@ __fastram__ U8 sol_duty_mask;
 outside of this module, providing the initial on/off states for everything. */
 U8 sol_reg_readable[SOL_REG_COUNT];
 
-/**
- * A locking mechanism used to implement synchronous pulse requests.
- * At most one synchronous request can be in process at a time; this
- * variable controls the access.
- *
- * When it is zero, the lock is available; no sync request in progress.
- * When a request is active, it is set to the solenoid number plus one
- * (so for sol 0, lock=1).
- * When a request finishes, it is set to 0x80 by the realtime driver.
- * This signals the task-level code to continue, which then releases
- * the lock by writing it back to zero.
- */
-volatile U8 req_lock;
+/** The number of pulses that may be in flight at once */
+#ifdef MACHINE_SOL_PULSE_SLOTS
+#define SOL_PULSE_SLOTS MACHINE_SOL_PULSE_SLOTS
+#else
+#define SOL_PULSE_SLOTS 2
+#endif
+
+/** The overall power budget for concurrent pulses, in duty-cycle eighths.  A coil
+at 100% duty costs 8, so by default two full-strength coils never overlap
+but a full and a half-strength one may.  A single pulse is always allowed,
+whatever its cost. */
+#ifdef MACHINE_SOL_POWER_BUDGET
+#define SOL_POWER_BUDGET MACHINE_SOL_POWER_BUDGET
+#else
+#define SOL_POWER_BUDGET 12
+#endif
+
+/** The power budget for concurrent pulses within one bank of eight
+drivers, which share a register and a driver circuit.  By default, the
+first bank, which has the high power drivers on WPC, may run one
+full-strength coil or two at half strength; the other banks are limited
+only by SOL_POWER_BUDGET. */
+#ifdef MACHINE_SOL_HIGH_POWER_BUDGET
+#define SOL_HIGH_POWER_BUDGET MACHINE_SOL_HIGH_POWER_BUDGET
+#else
+#define SOL_HIGH_POWER_BUDGET 8
+#endif
+
+#define SOL_BANK_BUDGET(bank) \
+	((bank) == 0 ? SOL_HIGH_POWER_BUDGET : SOL_POWER_BUDGET)
+
+/** The bank of drivers that a solenoid belongs to */
+#define SOL_BANK(sol) ((sol) / 8)
+
+/** Passed to sol_power_in_use() to count every bank */
+#define SOL_BANK_ALL 0xFF
+
+/** The number of pending requests that can be queued */
+#define SOL_REQ_QUEUE_LEN 8
+
+/** A pulse driver slot.  Only the timer and duty are touched by the
+realtime function; the rest is set up at task level before the timer is
+written, to make the RTT run faster. */
+struct sol_pulse_slot
+{
+	/** Remaining time in 4ms ticks; nonzero while pulsing */
+	U8 timer;
+
+	/** The duty cycle mask */
+	U8 duty;
+
+	IOPTR reg_write;
+	U8 *reg_read;
+	U8 bit;
+	U8 inverted;
+
+	/** The solenoid that owns the slot */
+	U8 sol;
+
+	/** The cost of this pulse against the power budgets */
+	U8 power;
 
-/* The read-only parameters to the one-at-a-time pulse driver,
-which says which solenoid to pulse.  These are setup outside of
-the realtime task to make it run faster. */
-IOPTR req_reg_write;
-U8 *req_reg_read;
-U8 req_bit;
-U8 req_inverted;
+	/** Nonzero if granted to a synchronous request which has not
+	started its pulse yet */
+	U8 reserved;
+} sol_pulse_slots[SOL_PULSE_SLOTS];
 
-/** The timer for the shared pulse driver */
-U8 sol_pulse_timer;
+/** A pending pulse request */
+struct sol_req
+{
+	/** The solenoid number, or SOL_REQ_FREE */
+	U8 sol;
+
+	/** One of the SOL_PRI_ values; higher goes first */
+	U8 prio;
+
+	/** SOL_REQ_ flags below */
+	U8 flags;
+
+	/** When the request was queued, for the wait statistics */
+	U16 queued;
+
+	/** If nonzero, the request is dropped if not started by this time */
+	U16 deadline;
+} sol_req_queue[SOL_REQ_QUEUE_LEN];
 
-/** The duty cycle for the shared pulse driver */
-U8 sol_pulse_duty;
+#define SOL_REQ_FREE     0xFF
+#define SOL_REQ_SYNC     0x1  /* the caller is waiting in sol_alloc */
+#define SOL_REQ_GRANTED  0x2  /* a sync request has been given a slot */
+#define SOL_REQ_DEFERRED 0x4  /* counted once as held by the power budget */
+
+/** The number of entries in use in sol_req_queue */
+U8 sol_req_count;
+
+/** True while the dispatcher task is running */
+bool sol_req_task_running;
+
+/** Statistics for the test mode display */
+struct sol_req_stats sol_req_stats;
 
 /** The solenoid number for the current pulse */
 U8 sol_pulsing;
 
-#define SOL_REQ_QUEUE_LEN 8
+/** The duty cycle for each flasher intensity */
+const U8 flasher_intensity_duty[FLASHER_INTENSITY_MAX + 1] = {
+	SOL_DUTY_0, SOL_DUTY_12, SOL_DUTY_25, SOL_DUTY_37, SOL_DUTY_50,
+	SOL_DUTY_62, SOL_DUTY_75, SOL_DUTY_87, SOL_DUTY_100,
+};
+
+
+/** Return the power cost of a pulse with the given duty cycle */
+static U8 sol_duty_power (U8 duty)
+{
+	U8 power = 0;
+	while (duty)
+	{
+		if (duty & 1)
+			power++;
+		duty >>= 1;
+	}
+	return power;
+}
+
+
+/** Return the total power of the pulses that are active or reserved
+on BANK, or on all banks if BANK is SOL_BANK_ALL */
+static U8 sol_power_in_use (U8 bank)
+{
+	struct sol_pulse_slot *p;
+	U8 power = 0;
+
+	for (p = sol_pulse_slots; p < sol_pulse_slots + SOL_PULSE_SLOTS; p++)
+		if ((p->reserved || rt_load (p->timer))
+			&& (bank == SOL_BANK_ALL || SOL_BANK (p->sol) == bank))
+			power += p->power;
+	return power;
+}
+
+
+/** Return TRUE if a pulse of POWER on SOL would go over either the
+overall power budget or that of its bank.  A pulse that would be the
+only one running is always allowed. */
+static bool sol_power_exceeded_p (U8 sol, U8 power)
+{
+	U8 in_use;
+
+	in_use = sol_power_in_use (SOL_BANK_ALL);
+	if (in_use != 0 && in_use + power > SOL_POWER_BUDGET)
+		return TRUE;
+	in_use = sol_power_in_use (SOL_BANK (sol));
+	if (in_use != 0 && in_use + power > SOL_BANK_BUDGET (SOL_BANK (sol)))
+		return TRUE;
+	return FALSE;
+}
+
+
+/** Return the slot that is reserved for or pulsing SOL, or NULL */
+static struct sol_pulse_slot *sol_pulse_slot_find (U8 sol)
+{
+	struct sol_pulse_slot *p;
+
+	for (p = sol_pulse_slots; p < sol_pulse_slots + SOL_PULSE_SLOTS; p++)
+		if (p->sol == sol && (p->reserved || rt_load (p->timer)))
+			return p;
+	return NULL;
+}
 
-/** A queue of solenoid pulse requests that are pending */
-struct {
-	queue_t header;
-	U8 sols[SOL_REQ_QUEUE_LEN];
-} sol_req_queue;
+
+/** Return a slot that is neither reserved nor pulsing, or NULL */
+static struct sol_pulse_slot *sol_pulse_slot_free (void)
+{
+	struct sol_pulse_slot *p;
+
+	for (p = sol_pulse_slots; p < sol_pulse_slots + SOL_PULSE_SLOTS; p++)
+		if (!p->reserved && !rt_load (p->timer))
+			return p;
+	return NULL;
+}
+
+
+/** Return TRUE if any pulse slot is in use */
+bool sol_pulse_busy_p (void)
+{
+	struct sol_pulse_slot *p;
+
+	for (p = sol_pulse_slots; p < sol_pulse_slots + SOL_PULSE_SLOTS; p++)
+		if (p->reserved || rt_load (p->timer))
+			return TRUE;
+	return FALSE;
+}
 
 
 /**
@@ -115,42 +270,58 @@ struct {
 void
 sol_req_start_specific (U8 sol, U8 mask, U8 time)
 {
+	struct sol_pulse_slot *p;
+
 	dbprintf ("Starting pulse %d now.\n", sol);
 
-	/* If the timer is nonzero, another request is already running.
-	This shouldn't happen.  The solenoid code takes care not to start
-	a request when something is already active.  The test mode code
-	calls this directly and bypasses those checks, but it enforces a delay
-	between pulses so it shouldn't occur. */
-	if (sol_pulse_timer != 0)
+	/* Use the slot granted to this solenoid, if any, otherwise any free
+	one.  If there is none, too many requests are active.  This shouldn't
+	happen.  The dispatcher takes care not to start a request when the
+	slots are full.  The test mode code calls this directly and bypasses
+	those checks, but it enforces a delay between pulses so it shouldn't
+	occur. */
+	p = sol_pulse_slot_find (sol);
+	if (p && !p->reserved)
+		p = NULL;
+	if (!p)
+		p = sol_pulse_slot_free ();
+	if (!p)
 	{
 		nonfatal (ERR_SOL_REQUEST);
 		return;
 	}
 
-	req_reg_write = sol_get_write_reg (sol);
-	if (req_reg_write == (IOPTR)0)
+	p->reg_write = sol_get_write_reg (sol);
+	if (p->reg_write == (IOPTR)0)
+	{
+		p->reserved = 0;
 		return;
+	}
 
-	req_reg_read = sol_get_read_reg (sol);
-	req_bit = sol_get_bit (sol);
-	sol_pulse_duty = mask;
+	p->reg_read = sol_get_read_reg (sol);
+	p->bit = sol_get_bit (sol);
+	p->duty = mask;
 #ifdef PINIO_SOL_INVERTED
-	req_inverted = PINIO_SOL_INVERTED (sol) ? 0xFF : 0x00;
+	p->inverted = PINIO_SOL_INVERTED (sol) ? 0xFF : 0x00;
 #else
-	req_inverted = 0;
+	p->inverted = 0;
 #endif
+	p->sol = sol;
+	p->power = sol_duty_power (mask);
+	p->reserved = 0;
 
-	/* This must be last, as it triggers the IRQ code */
-	sol_pulse_timer = time / 4;
+	log_event (SEV_INFO, MOD_SOL, EV_SOL_PULSE, sol);
+
+	/* This must be last, as it triggers the IRQ code.  The release
+	store publishes the slot setup above to a native RTT thread. */
+	rt_store (p->timer, time / 4);
 }
 
 
 
 /**
  * Start a solenoid request now.
- * The state machine must be in IDLE.  This call puts it
- * into PENDING state.
+ * A pulse slot must be available.
  */
 void sol_req_start (U8 sol)
 {
@@ -177,52 +348,258 @@ void sol_req_start (U8 sol)
 }
 
 
+/** Remove an entry from the request queue */
+static void sol_req_remove (struct sol_req *req)
+{
+	req->sol = SOL_REQ_FREE;
+	sol_req_count--;
+}
+
+
+/** Update the wait statistics for a request that is about to start */
+static void sol_req_record_wait (struct sol_req *req)
+{
+	U16 wait = get_sys_time () - req->queued;
+
+	sol_req_stats.started++;
+	if (wait > sol_req_stats.wait_max)
+		sol_req_stats.wait_max = wait;
+
+	/* Halve the running totals before they overflow; this keeps
+	the average correct. */
+	if (sol_req_stats.wait_total > 0xFFFFUL - wait)
+	{
+		sol_req_stats.wait_total /= 2;
+		sol_req_stats.wait_count /= 2;
+	}
+	sol_req_stats.wait_total += wait;
+	sol_req_stats.wait_count++;
+}
+
+
 /**
- * Periodically inspect the solenoid queue and dispatch
- * the next pending request.
+ * Start as many pending requests as the pulse slots and the power
+ * budget allow.  The highest priority request goes first, and among
+ * equals the oldest.  Requests which pass their deadline are dropped.
+ * If the best request does not fit in the budget, nothing else starts
+ * either, so that a strong coil is not starved by weaker ones.
+ *
+ * Must be called with rt_queue_lock() held.  The lock is dropped while
+ * an async pulse is started, so that the sol_pulse handlers do not run
+ * under it; the slot stays reserved for the solenoid meanwhile.
  */
-CALLSET_ENTRY (sol, idle_every_100ms)
+static void sol_req_dispatch (void)
 {
-	if (sol_pulse_timer == 0 &&
-		!queue_empty_p (&sol_req_queue.header))
+	struct sol_req *req, *best;
+	struct sol_pulse_slot *p;
+	U8 power;
+
+	for (;;)
 	{
-		U8 sol = queue_remove (&sol_req_queue.header, SOL_REQ_QUEUE_LEN);
-		sol_req_start (sol);
+		best = NULL;
+		for (req = sol_req_queue; req < sol_req_queue + SOL_REQ_QUEUE_LEN; req++)
+		{
+			if (req->sol == SOL_REQ_FREE || (req->flags & SOL_REQ_GRANTED))
+				continue;
+
+			if (req->deadline && time_reached_p (req->deadline))
+			{
+				dbprintf ("Pulse %d expired\n", req->sol);
+				sol_req_stats.expired++;
+				sol_req_remove (req);
+				continue;
+			}
+
+			/* The same coil cannot be pulsed twice at once */
+			if (sol_pulse_slot_find (req->sol))
+				continue;
+
+			if (!best || req->prio > best->prio ||
+				(req->prio == best->prio &&
+					(S16)(req->queued - best->queued) < 0))
+				best = req;
+		}
+
+		if (!best)
+			return;
+
+		p = sol_pulse_slot_free ();
+		if (!p)
+			return;
+
+		power = sol_duty_power (sol_get_duty (best->sol));
+		if (sol_power_exceeded_p (best->sol, power))
+		{
+			if (!(best->flags & SOL_REQ_DEFERRED))
+			{
+				best->flags |= SOL_REQ_DEFERRED;
+				sol_req_stats.deferred++;
+			}
+			return;
+		}
+
+		sol_req_record_wait (best);
+		if (best->flags & SOL_REQ_SYNC)
+		{
+			/* Hold the slot for the caller, which starts the pulse itself */
+			p->sol = best->sol;
+			p->power = power;
+			p->reserved = 1;
+			best->flags |= SOL_REQ_GRANTED;
+		}
+		else
+		{
+			U8 sol = best->sol;
+			sol_req_remove (best);
+			p->sol = sol;
+			p->power = power;
+			p->reserved = 1;
+			rt_queue_unlock ();
+			sol_req_start (sol);
+			rt_queue_lock ();
+
+			/* If a handler declined the pulse, give up the slot */
+			if (p->sol == sol && p->reserved)
+				p->reserved = 0;
+		}
 	}
 }
 
 
 /**
- * Make a solenoid request, and return immediately, even if it
- * is not started.
+ * Add a request to the queue.  A request for a solenoid which is already
+ * waiting is merged into the existing entry.  If the queue is full, the
+ * lowest priority entry is replaced if the new one outranks it.
+ *
+ * Must be called with rt_queue_lock() held.  Returns the entry used, or
+ * NULL if the request was dropped.
  */
-void sol_request_async (U8 sol)
+static struct sol_req *sol_req_enqueue (U8 sol, U8 prio, U8 deadline, U8 flags)
 {
-	/*
-	 * If no request is active, start it now.  Otherwise, it will need to be queued.
-	 */
-	if (sol_pulse_timer == 0)
+	struct sol_req *req, *slot = NULL, *lowest = NULL;
+	U16 expires = 0;
+
+	if (deadline)
 	{
-		sol_req_start (sol);
+		expires = get_sys_time () + deadline;
+		if (expires == 0)
+			expires = 1;
+	}
+
+	sol_req_stats.requests++;
+	for (req = sol_req_queue; req < sol_req_queue + SOL_REQ_QUEUE_LEN; req++)
+	{
+		if (req->sol == SOL_REQ_FREE)
+		{
+			if (!slot)
+				slot = req;
+			continue;
+		}
+
+		if (!flags && req->sol == sol && !(req->flags & SOL_REQ_SYNC))
+		{
+			/* Coalesce: keep the original queue time, take the
+			higher priority and the later deadline. */
+			sol_req_stats.coalesced++;
+			if (prio > req->prio)
+				req->prio = prio;
+			if (!expires || (req->deadline && (S16)(expires - req->deadline) > 0))
+				req->deadline = expires;
+			return req;
+		}
+
+		if (!(req->flags & SOL_REQ_SYNC) &&
+			(!lowest || req->prio < lowest->prio))
+			lowest = req;
 	}
-	else
+
+	if (!slot)
+	{
+		/* Full: either this request or the least important one goes */
+		sol_req_stats.dropped++;
+		if (!lowest || lowest->prio >= prio)
+			return NULL;
+		slot = lowest;
+		sol_req_count--;
+	}
+
+	slot->sol = sol;
+	slot->prio = prio;
+	slot->flags = flags;
+	slot->queued = get_sys_time ();
+	slot->deadline = expires;
+	sol_req_count++;
+	return slot;
+}
+
+
+/**
+ * The dispatcher task.  This runs while any requests are pending, and
+ * starts each one as soon as a slot and enough power are available.
+ */
+static void sol_req_task (void)
+{
+	for (;;)
+	{
+		rt_queue_lock ();
+		sol_req_dispatch ();
+		if (sol_req_count == 0)
+		{
+			sol_req_task_running = FALSE;
+			rt_queue_unlock ();
+			task_exit ();
+		}
+		rt_queue_unlock ();
+		task_sleep (TIME_16MS);
+	}
+}
+
+
+/** Make sure the dispatcher is running.  Must be called with
+rt_queue_lock() held. */
+static void sol_req_task_wakeup (void)
+{
+	if (sol_req_count && !sol_req_task_running)
+	{
+		sol_req_task_running = TRUE;
+		task_create_gid (GID_SOL_REQUEST, sol_req_task);
+	}
+}
+
+
+/**
+ * Make a solenoid request with a given priority, and return immediately,
+ * even if it is not started.  If DEADLINE is nonzero, the request is
+ * abandoned when it cannot be started within that many ticks.
+ */
+void sol_request_queue (U8 sol, U8 prio, U8 deadline)
+{
+	rt_queue_lock ();
+	if (sol_req_enqueue (sol, prio, deadline, 0))
 	{
-		dbprintf ("Queueing pulse %d\n", sol);
-		/* Note that we do not check for ring buffer overflow.  This should
-		never happen in practice; if it does, at worst some pulse will be
-		skipped, which must already be handled elsewhere as when a pulse
-		is too weak... */
-		queue_insert (&sol_req_queue.header, SOL_REQ_QUEUE_LEN, sol);
+		/* If possible, start it now */
+		sol_req_dispatch ();
+		sol_req_task_wakeup ();
 	}
+	rt_queue_unlock ();
+}
+
+
+/**
+ * Make a solenoid request, and return immediately, even if it
+ * is not started.
+ */
+void sol_request_async (U8 sol)
+{
+	sol_request_queue (sol, SOL_PRI_DEFAULT, 0);
 }
 
 
 /**
  * Allocate a slot in the pulse driver for SOL.
  * This is an internal function only, and is called only when a
- * synchronous pulse request is made.  It waits if a
- * previous request is being serviced, then acquires a
- * lock so that future sync requests will be blocked.
+ * synchronous pulse request is made.  It queues the request at
+ * device priority and waits until the dispatcher grants it a slot.
  *
  * The caller MUST invoke sol_free() at some point later when the
  * pulse is done.  Thiis is done automatically if you use sol_request();
@@ -230,12 +607,35 @@ void sol_request_async (U8 sol)
  */
 static void sol_alloc (U8 sol)
 {
-	/* Wait until any existing sync requests are finished. */
-	while (req_lock || sol_pulse_timer)
+	struct sol_req *req;
+	U8 granted;
+
+	for (;;)
+	{
+		rt_queue_lock ();
+		req = sol_req_enqueue (sol, SOL_PRI_DEVICE, 0, SOL_REQ_SYNC);
+		if (req)
+		{
+			sol_req_dispatch ();
+			sol_req_task_wakeup ();
+		}
+		rt_queue_unlock ();
+		if (req)
+			break;
 		task_sleep (TIME_66MS);
+	}
 
-	/* Acquire the lock for this solenoid. */
-	req_lock = (sol + 1) | 0x80;
+	for (;;)
+	{
+		rt_queue_lock ();
+		granted = req->flags & SOL_REQ_GRANTED;
+		if (granted)
+			sol_req_remove (req);
+		rt_queue_unlock ();
+		if (granted)
+			break;
+		task_sleep (TIME_16MS);
+	}
 
 	/* Remember which solenoid we are pulsing now */
 	sol_pulsing = sol;
@@ -243,35 +643,60 @@ static void sol_alloc (U8 sol)
 
 
 /**
- * Change the duty cycle of a pulse in progress.
+ * Change the duty cycle of the pulse in progress on SOL.  The solenoid
+ * is given explicitly because several pulses may be in flight.  Nothing
+ * happens if SOL is not pulsing.
  */
-void sol_modify_duty (U8 duty)
+void sol_modify_duty (U8 sol, U8 duty)
 {
-	sol_pulse_duty = duty;
+	struct sol_pulse_slot *p;
+
+	rt_queue_lock ();
+	p = sol_pulse_slot_find (sol);
+	if (p && !p->reserved)
+		rt_store (p->duty, duty);
+	rt_queue_unlock ();
 }
 
 
 /**
- * Change the timeout of a pulse in progress.
+ * Change the timeout of the pulse in progress on SOL.
  */
-void sol_modify_timeout (U8 timeout)
+void sol_modify_timeout (U8 sol, U8 timeout)
 {
-	sol_pulse_timer = timeout / 4;
+	struct sol_pulse_slot *p;
+
+	rt_queue_lock ();
+	p = sol_pulse_slot_find (sol);
+	if (p && !p->reserved)
+		rt_store (p->timer, timeout / 4);
+	rt_queue_unlock ();
 }
 
 
 /**
- * Free the lock on a particular solenoid.  This waits for the
+ * Free the slot held by a particular solenoid.  This waits for the
  * pulse to finish, then releases the driver for others.
  */
 void sol_free (U8 sol)
 {
-	/* Wait for the pulse to finish */
-	while (req_lock != 0x80)
-		task_sleep (TIME_66MS);
+	struct sol_pulse_slot *p;
 
-	/* Release the lock for another task */
-	req_lock = 0;
+	for (;;)
+	{
+		rt_queue_lock ();
+		p = sol_pulse_slot_find (sol);
+		if (p && p->reserved)
+		{
+			/* A custom pulse shaper never started a pulse */
+			p->reserved = 0;
+			p = NULL;
+		}
+		rt_queue_unlock ();
+		if (!p)
+			break;
+		task_sleep (TIME_16MS);
+	}
 }
 
 
@@ -299,43 +724,44 @@ void sol_request (U8 sol)
 }
 
 
-static inline void sol_req_on (void)
+/** Update one slot of the pulse driver */
+static inline void sol_req_slot_update (struct sol_pulse_slot *p)
 {
-	writeb (req_reg_write, (*req_reg_read |= req_bit) ^ req_inverted);
-}
-
+	U8 timer = rt_load (p->timer);
+	if (timer != 0)
+	{
+		if (--timer && (rt_load (p->duty) & sol_duty_mask))
+			writeb (p->reg_write, (*p->reg_read |= p->bit) ^ p->inverted);
+		else
+		{
+			writeb (p->reg_write, (*p->reg_read &= ~p->bit) ^ p->inverted);
+			if (timer == 0)
+			{
+				log_event (SEV_INFO, MOD_SOL, EV_SOL_PULSE_END, p->sol);
+				rt_store (p->duty, 0);
+			}
+		}
 
-static inline void sol_req_off (void)
-{
-	writeb (req_reg_write, (*req_reg_read &= ~req_bit) ^ req_inverted);
+		/* Store the timer last: once it reads zero, a task may start
+		the next pulse in this slot. */
+		rt_store (p->timer, timer);
+	}
 }
 
 
 /**
  * The realtime pulsed solenoid update.
  *
- * It works identically to the code for the flashers, except there can only be
- * one at a time.
+ * It works identically to the code for the flashers, except there are
+ * only a few slots, shared by all of the solenoids.
  */
 /* RTT(name=sol_req_rtt   freq=4) */
 void sol_req_rtt (void)
 {
-	if (sol_pulse_timer != 0)
-	{
-		sol_pulse_timer--;
-		if (sol_pulse_timer && (sol_pulse_duty & sol_duty_mask))
-			sol_req_on ();
-		else
-		{
-			sol_req_off ();
-			if (sol_pulse_timer == 0)
-			{
-				sol_pulse_duty = 0;
-				if (req_lock)
-					req_lock = 0x80;
-			}
-		}
-	}
+	struct sol_pulse_slot *p;
+
+	for (p = sol_pulse_slots; p < sol_pulse_slots + SOL_PULSE_SLOTS; p++)
+		sol_req_slot_update (p);
 }
 
 
@@ -350,14 +776,19 @@ macros in sys/sol.h instead. */
 __attribute__((noinline)) void
 sol_start_real (solnum_t sol, U8 duty_mask, U8 ticks)
 {
+	/* A flasher that belongs to a lamp effect can only be started by
+	 * that effect. */
+	if (unlikely (leff_flasher_denied_p (sol)))
+		return;
+
 	/* The duty cycle mask is only read by the IRQ
 	 * function, so it can be modified easily.
 	 * The timer value is read-and-decremented, so it
 	 * needs to set atomically. */
 	log_event (SEV_INFO, MOD_SOL, EV_SOL_START, sol);
-	sol_duty_state[sol - SOL_MIN_FLASHER] = duty_mask;
+	rt_store (sol_duty_state[sol - SOL_MIN_FLASHER], duty_mask);
 	disable_interrupts ();
-	sol_timers[sol - SOL_MIN_FLASHER] = ticks;
+	rt_store (sol_timers[sol - SOL_MIN_FLASHER], ticks);
 	enable_interrupts ();
 }
 
@@ -368,8 +799,8 @@ sol_stop (solnum_t sol)
 {
 	log_event (SEV_INFO, MOD_SOL, EV_SOL_STOP, sol);
 	disable_interrupts ();
-	sol_timers[sol - SOL_MIN_FLASHER] = 0;
-	sol_duty_state[sol - SOL_MIN_FLASHER] = 0;
+	rt_store (sol_timers[sol - SOL_MIN_FLASHER], 0);
+	rt_store (sol_duty_state[sol - SOL_MIN_FLASHER], 0);
 	enable_interrupts ();
 }
 
@@ -393,13 +824,15 @@ sol_init (void)
 	/* Initialize the rotating duty strobe mask */
 	sol_duty_mask = 0x1;
 
-	/* Initialize the one-at-a-time pulse driver */
-	sol_pulse_timer = sol_pulse_duty = 0;
-	req_lock = 0;
+	/* Initialize the pulse driver slots */
+	memset (sol_pulse_slots, 0, sizeof (sol_pulse_slots));
 
 	memset (sol_reg_readable, 0, SOL_REG_COUNT);
 
-	/* Initialize the solenoid queue. */
-	queue_init (&sol_req_queue.header);
+	/* Initialize the request queue. */
+	memset (sol_req_queue, SOL_REQ_FREE, sizeof (sol_req_queue));
+	sol_req_count = 0;
+	sol_req_task_running = FALSE;
+	memset (&sol_req_stats, 0, sizeof (sol_req_stats));
 }
 
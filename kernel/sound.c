@@ -28,37 +28,87 @@
  * and DCS versions.
  *
  * Because the sound board runs asynchronously to the CPU board, all input/output
- * is buffered.  A fast running realtime function pulls data from a "write queue"
- * and transmits it to the sound board, at the required rate.  Another
- * realtime function reads from the sound board and places it into a "read queue",
- * where it can be processed by higher-layer logic at a slower pace (but hopefully
- * not so slow that the queue overflows).
+ * is buffered.  A fast running realtime function pulls commands from a "write
+ * queue" and transmits them to the sound board, a byte at a time at the
+ * required rate.  Another realtime function reads from the sound board and
+ * places it into a "read queue", where it can be processed by higher-layer
+ * logic at a slower pace (but hopefully not so slow that the queue overflows).
  *
  * The WPC sound board uses 8-bit commands for most things; one of the command
  * values acts as an escape, though, and causes the next 8-bit value to be
  * interpreted (differently) instead.
+ *
+ * The write queue holds whole commands rather than bytes, so that a burst
+ * of sound calls is handled sensibly:
+ *
+ * - A call that is already waiting to be sent is coalesced with it rather
+ *   than queued again.  A new music command replaces one that has not been
+ *   sent yet.
+ *
+ * - Once SOUND_CMD_SOFT_LIMIT commands are waiting, a new call only gets in
+ *   if it outranks one of them, which is then cancelled.  The last few slots
+ *   are kept for these, so that a jackpot call is not lost behind a string
+ *   of switch sounds.  Music, volume and board commands are never cancelled.
+ *
+ * - If the board says that it is busy, sound_read_rtt() notes it, and
+ *   sound_write_rtt() holds back the next command until it is ready.
+ *
+ * Dropped and coalesced calls are counted in the standard audits.
  */
 
 
-/** The length of the sound queue buffer.  These are bytes pending transmit from
- * the CPU board to the sound board. */
+/** The length of the sound read queue.  These are bytes pending receive
+ * from the sound board. */
 #define SOUND_QUEUE_LEN 8
 
+/** The number of commands that can wait to be sent.  This must be a power
+ * of 2; one slot is always left empty. */
+#define SOUND_CMD_QUEUE_LEN 16
 
-/** The sound write queue.  head and tail are offsets; elems hold the actual
- * data bytes to be transmitted. */
-__fastram__ struct {
-	queue_t header;
-	U8 elems[SOUND_QUEUE_LEN];
-} sound_write_queue;
+/** The depth at which a new call must outrank a waiting one to get in */
+#define SOUND_CMD_SOFT_LIMIT 12
 
-/** The sound read queue, which works just like the write queue but takes
-back data from the sound board. */
+/** Kinds of commands, which say how they are coalesced */
+#define SOUND_CMD_CALL  0
+#define SOUND_CMD_MUSIC 1
+#define SOUND_CMD_BOARD 2
+
+/** A command waiting to be sent to the sound board.  Once a command is
+ * in the queue, only prio and cancelled are changed. */
+struct sound_cmd
+{
+	U8 bytes[4];
+	U8 len;
+	U8 kind;
+	U8 prio;
+	U8 cancelled;
+};
+
+/** The sound write queue.  head is only changed by sound_write_rtt(), and
+ * tail only by tasks, under rt_queue_lock(). */
+struct sound_cmd sound_cmds[SOUND_CMD_QUEUE_LEN];
+__fastram__ U8 sound_cmd_head;
+__fastram__ U8 sound_cmd_tail;
+
+/** The number of bytes of the command at the head that have been sent */
+__fastram__ U8 sound_tx_pos;
+
+/** Nonzero while the sound board says that it cannot take more data */
+__fastram__ U8 sound_board_busy;
+
+/** The sound read queue, which takes back data from the sound board. */
 __fastram__ struct {
 	queue_t header;
 	U8 elems[SOUND_QUEUE_LEN];
 } sound_read_queue;
 
+/** What has happened to sound calls since reset */
+struct sound_queue_stats sound_queue_stats;
+
+/** Calls dropped and coalesced since the audits were last updated */
+U8 sound_audit_dropped;
+U8 sound_audit_coalesced;
+
 /** The last music code transmitted */
 music_code_t current_music;
 
@@ -116,24 +166,102 @@ bool sound_version_render (void)
 	}
 }
 
-/** Queues a byte for transmit to the sound board */
-static __attribute__((noinline)) void sound_write_queue_insert (U8 val)
-{
-	queue_insert (&sound_write_queue.header, SOUND_QUEUE_LEN, val);
-}
+/** Count a call that was dropped or coalesced.  The audits are updated
+later, at idle time. */
+#define sound_count(stat, pending) \
+	do { \
+		sound_queue_stats.stat++; \
+		if (pending != 0xFF) \
+			pending++; \
+	} while (0)
 
 
-/** Dequeues a byte for transmit to the sound board */
-static U8 sound_write_queue_remove (void)
+/** Returns true if two commands would send the same bytes */
+static bool sound_cmd_same_p (const struct sound_cmd *a, const struct sound_cmd *b)
 {
-	return queue_remove (&sound_write_queue.header, SOUND_QUEUE_LEN);
+	U8 n;
+
+	if (a->kind != b->kind || a->len != b->len)
+		return FALSE;
+	for (n = 0; n < a->len; n++)
+		if (a->bytes[n] != b->bytes[n])
+			return FALSE;
+	return TRUE;
 }
 
 
-/** Checks whether the write queue is empty or not */
-inline bool sound_write_queue_empty_p (void)
+/**
+ * Queue a command for transmit to the sound board.  NEW is copied into the
+ * queue, unless it can be coalesced with a command that is already there.
+ */
+static __attribute__((noinline)) void sound_cmd_insert (const struct sound_cmd *new)
 {
-	return queue_empty_p (&sound_write_queue.header);
+	struct sound_cmd *cmd;
+	struct sound_cmd *victim = NULL;
+	U8 head, tail, depth, n;
+
+	rt_queue_lock ();
+	tail = sound_cmd_tail;
+	head = rt_load (sound_cmd_head);
+	depth = (tail - head) & (SOUND_CMD_QUEUE_LEN - 1);
+
+	/* Look at the commands that are waiting.  The one at the head is
+	skipped, as it may already be going out. */
+	if (depth > 1)
+	{
+		for (n = (head + 1) & (SOUND_CMD_QUEUE_LEN - 1); n != tail;
+			n = (n + 1) & (SOUND_CMD_QUEUE_LEN - 1))
+		{
+			cmd = &sound_cmds[n];
+			if (cmd->cancelled)
+				continue;
+
+			if (new->kind == SOUND_CMD_MUSIC && cmd->kind == SOUND_CMD_MUSIC)
+			{
+				/* Only the newest music matters */
+				cmd->cancelled = TRUE;
+				sound_count (coalesced, sound_audit_coalesced);
+			}
+			else if (sound_cmd_same_p (cmd, new))
+			{
+				if (new->prio > cmd->prio)
+					cmd->prio = new->prio;
+				sound_count (coalesced, sound_audit_coalesced);
+				goto done;
+			}
+			else if (cmd->prio < new->prio
+				&& (!victim || cmd->prio < victim->prio))
+			{
+				victim = cmd;
+			}
+		}
+	}
+
+	/* When the queue is getting full, make room by cancelling the
+	lowest priority call, if the new one outranks it.  Otherwise drop
+	the new one. */
+	if (depth >= SOUND_CMD_SOFT_LIMIT)
+	{
+		if (depth == SOUND_CMD_QUEUE_LEN - 1
+			|| (!victim && new->prio != SOUND_PRIO_SYSTEM))
+		{
+			sound_count (dropped, sound_audit_dropped);
+			goto done;
+		}
+		if (victim)
+		{
+			victim->cancelled = TRUE;
+			sound_count (dropped, sound_audit_dropped);
+		}
+	}
+
+	memcpy (&sound_cmds[tail], new, sizeof (struct sound_cmd));
+	sound_cmds[tail].cancelled = FALSE;
+	rt_store (sound_cmd_tail, (tail + 1) & (SOUND_CMD_QUEUE_LEN - 1));
+	if (depth >= sound_queue_stats.max_depth)
+		sound_queue_stats.max_depth = depth + 1;
+done:
+	rt_queue_unlock ();
 }
 
 
@@ -155,10 +283,19 @@ void music_set (music_code_t code)
 			&& (system_config.game_music == ON))
 		|| (code == MUS_OFF))
 	{
+		struct sound_cmd cmd = {
+			.kind = SOUND_CMD_MUSIC,
+			.prio = SOUND_PRIO_SYSTEM,
+		};
 #if (MACHINE_DCS == 1)
-		sound_write_queue_insert (0);
+		cmd.bytes[0] = 0;
+		cmd.bytes[1] = current_music;
+		cmd.len = 2;
+#else
+		cmd.bytes[0] = current_music;
+		cmd.len = 1;
 #endif
-		sound_write_queue_insert (current_music);
+		sound_cmd_insert (&cmd);
 	}
 }
 
@@ -209,13 +346,21 @@ U8 sound_board_read (U8 retries)
 U8 sound_board_command (sound_cmd_t cmd, U8 retries)
 {
 #ifndef CONFIG_NATIVE
-	do {
+	struct sound_cmd board_cmd = {
+		.kind = SOUND_CMD_BOARD,
+		.prio = SOUND_PRIO_SYSTEM,
+	};
 #if (MACHINE_DCS == 1)
-		sound_write_queue_insert (cmd >> 8);
-		sound_write_queue_insert (cmd & 0xFF);
+	board_cmd.bytes[0] = cmd >> 8;
+	board_cmd.bytes[1] = cmd & 0xFF;
+	board_cmd.len = 2;
 #else
-		sound_write_queue_insert (cmd);
+	board_cmd.bytes[0] = cmd;
+	board_cmd.len = 1;
 #endif
+
+	do {
+		sound_cmd_insert (&board_cmd);
 		task_sleep (TIME_33MS);
 
 		if (queue_empty_p ((queue_t *)&sound_read_queue))
@@ -248,10 +393,16 @@ CALLSET_ENTRY (sound, idle_every_100ms)
 
 
 /** Real time task for the sound board.
- * Transmit one pending byte of data to the sound board.
- * Receive up to one pending byte of data from it. */
+ * Receive up to one pending byte of data from it, and see whether it
+ * can take more. */
 void sound_read_rtt (void)
 {
+#ifdef HAVE_PINIO_SOUND_BUSY
+	/* The board acknowledges that it has taken in what was sent by
+	clearing its busy flag.  Until then, sound_write_rtt() holds off. */
+	sound_board_busy = pinio_sound_busy_p ();
+#endif
+
 	/* Read back from sound board if bytes ready */
 	if (unlikely (pinio_sound_ready_p ()))
 	{
@@ -260,13 +411,37 @@ void sound_read_rtt (void)
 	}
 }
 
+/** Real time task for the sound board.
+ * Transmit one pending byte of data to the sound board. */
 void sound_write_rtt (void)
 {
-	/* Write a pending byte to the sound board */
-	if (unlikely (!sound_write_queue_empty_p ()))
+	struct sound_cmd *cmd;
+	U8 head = sound_cmd_head;
+
+	if (likely (head == rt_load (sound_cmd_tail)))
+		return;
+
+	/* Commands that were cancelled before they started are skipped.
+	A new command is not started while the board is busy. */
+	cmd = &sound_cmds[head];
+	if (sound_tx_pos == 0)
 	{
-		pinio_write_sound (sound_write_queue_remove ());
+		if (unlikely (cmd->cancelled))
+			goto next;
+		if (unlikely (sound_board_busy))
+		{
+			sound_queue_stats.held++;
+			return;
+		}
 	}
+
+	pinio_write_sound (cmd->bytes[sound_tx_pos]);
+	if (++sound_tx_pos < cmd->len)
+		return;
+	sound_tx_pos = 0;
+	sound_queue_stats.sent++;
+next:
+	rt_store (sound_cmd_head, (head + 1) & (SOUND_CMD_QUEUE_LEN - 1));
 }
 
 
@@ -288,7 +463,9 @@ void sound_init (void)
 {
 	/* Initialize the input/output queues to the sound board. */
 	queue_init (&sound_read_queue.header);
-	queue_init (&sound_write_queue.header);
+	sound_cmd_head = sound_cmd_tail = 0;
+	sound_tx_pos = 0;
+	sound_board_busy = FALSE;
 }
 
 
@@ -340,10 +517,15 @@ exit_func:
 
 
 /**
- * Write a 16-bit value to the sound board.
+ * Write a 16-bit value to the sound board, at a given priority.  The
+ * priority only matters when the queue is nearly full.
  */
-__attribute__((noinline)) void sound_write (sound_code_t code)
+__attribute__((noinline)) void sound_write_prio (sound_code_t code, U8 prio)
 {
+	struct sound_cmd cmd = {
+		.kind = SOUND_CMD_CALL,
+		.prio = prio,
+	};
 	U8 code_lo;
 	U8 code_hi;
 
@@ -353,18 +535,30 @@ __attribute__((noinline)) void sound_write (sound_code_t code)
 #if (MACHINE_DCS == 0)
 	if (code_hi == 0)
 	{
-		sound_write_queue_insert (code_lo);
+		cmd.bytes[0] = code_lo;
+		cmd.len = 1;
 	}
 	else
 #endif
 	{
 #if (MACHINE_DCS == 1)
-		sound_write_queue_insert (code_hi);
+		cmd.bytes[0] = code_hi;
 #else
-		sound_write_queue_insert (SND_START_EXTENDED);
+		cmd.bytes[0] = SND_START_EXTENDED;
 #endif
-		sound_write_queue_insert (code_lo);
+		cmd.bytes[1] = code_lo;
+		cmd.len = 2;
 	}
+	sound_cmd_insert (&cmd);
+}
+
+
+/**
+ * Write a 16-bit value to the sound board.
+ */
+void sound_write (sound_code_t code)
+{
+	sound_write_prio (code, 0);
 }
 
 
@@ -401,17 +595,24 @@ void volume_set (U8 vol)
 	}
 	else
 	{
+		struct sound_cmd cmd = {
+			.kind = SOUND_CMD_BOARD,
+			.prio = SOUND_PRIO_SYSTEM,
+		};
 #if (MACHINE_DCS == 1)
 		U8 code = current_volume * 8;
-		sound_write_queue_insert (0x55);
-		sound_write_queue_insert (0xAA);
-		sound_write_queue_insert (code);
-		sound_write_queue_insert (~code);
+		cmd.bytes[0] = 0x55;
+		cmd.bytes[1] = 0xAA;
+		cmd.bytes[2] = code;
+		cmd.bytes[3] = ~code;
+		cmd.len = 4;
 #else
-		sound_write_queue_insert (SND_SET_VOLUME_CMD);
-		sound_write_queue_insert (current_volume);
-		sound_write_queue_insert (~current_volume);
+		cmd.bytes[0] = SND_SET_VOLUME_CMD;
+		cmd.bytes[1] = current_volume;
+		cmd.bytes[2] = ~current_volume;
+		cmd.len = 3;
 #endif
+		sound_cmd_insert (&cmd);
 	}
 }
 
@@ -449,6 +650,26 @@ void volume_refresh (void)
 }
 
 
+/** Add the calls that were dropped or coalesced to the audits.  This is
+done at idle time, rather than on every call, since updating the audits
+is slow. */
+CALLSET_ENTRY (sound, idle_every_second)
+{
+	U8 dropped, coalesced;
+
+	rt_queue_lock ();
+	dropped = sound_audit_dropped;
+	coalesced = sound_audit_coalesced;
+	sound_audit_dropped = sound_audit_coalesced = 0;
+	rt_queue_unlock ();
+
+	if (dropped)
+		audit_add (&system_audits.sound_drops, dropped);
+	if (coalesced)
+		audit_add (&system_audits.sound_coalesced, coalesced);
+}
+
+
 CALLSET_ENTRY (sound, file_register)
 {
 	file_register (&volume_csum_info);
@@ -314,7 +314,7 @@ void switch_sched_task (void)
 			else
 				set_valid_playfield ();
 		}
-		ball_search_timer_reset ();
+		ball_search_pf_switch (sw);
 	}
 
 cleanup:
@@ -32,6 +32,9 @@
  */
 
 #include <freewpc.h>
+#ifdef CONFIG_SIM
+#include <simulation.h>
+#endif
 
 
 /**
@@ -47,62 +50,82 @@ static void timed_mode_exit_handler (struct timed_mode_ops *ops)
 
 
 /**
- * A task that runs and implements a mode.
+ * Called when a mode's grace period is over.
  */
-static void timed_mode_monitor (void)
+static void timed_mode_expire (struct timer *t)
 {
-	struct timed_mode_task_config *cfg;
-	struct timed_mode_ops *ops;
-	U8 n;
+	timed_mode_exit_handler (t->data);
+}
 
-	/* Get the mode operations / parameters structure */
-	cfg = task_current_class_data (struct timed_mode_task_config);
-	ops = cfg->ops;
 
-#define the_timer (*(ops->timer))
+/**
+ * Called one second after a mode's timer runs out.
+ */
+static void timed_mode_grace (struct timer *t)
+{
+	struct timed_mode_ops *ops = t->data;
 
-	/* Request effect update immediately, now that the mode is started. */
 	effect_update_request ();
 
-	/* Run the mode timer.  Sleep a little more than 1s between loops,
-	since task timing is a little inaccurate.  Run the user pause()
-	hook to determine when the timer should stop.  Use system_timer_pause()
-	in most cases. */
-	while (the_timer > 0)
+	/* Implement the rest of the grace period */
+	if (ops->grace_timer > 1)
 	{
-		for (n=5; n != 0; --n)
-		{
-			do {
-				task_sleep (TIME_200MS + TIME_16MS);
-			} while (ops->pause ());
-			ops->update ();
-		}
-		the_timer--;
+		t->fn = timed_mode_expire;
+		timer_rearm (t, (ops->grace_timer - 1) * TIME_1S);
 	}
+	else
+		timed_mode_exit_handler (ops);
+}
 
-	/* Update effects after a brief pause */
-	task_sleep (TIME_1S);
-	effect_update_request ();
 
-	/* Implement the rest of the grace period */
-	if (ops->grace_timer > 1)
-		task_sleep_sec (ops->grace_timer - 1);
+/**
+ * Called every 200ms while a mode is running, unless it is paused.
+ */
+static void timed_mode_tick (struct timer *t)
+{
+	struct timed_mode_ops *ops = t->data;
 
-	/* The mode is now officially over and cannot be extended.   From here
-	on, no task switching is allowed, as that could produce race conditions. */
-	timed_mode_exit_handler (ops);
-	task_exit ();
+#define the_timer (*(ops->timer))
+
+	/* Modes using system_timer_pause() are in the system timer group,
+	and are not called while it is true.  Others check their own pause
+	function here. */
+	if (t->group == TIMER_GROUP_FREE && ops->pause ())
+	{
+		timer_rearm (t, TIME_200MS);
+		return;
+	}
+
+	ops->update ();
+	if (++t->count == 5)
+	{
+		t->count = 0;
+		if (the_timer > 0)
+			the_timer--;
+	}
+
+	if (the_timer > 0)
+		timer_rearm (t, TIME_200MS);
+	else
+	{
+		/* Update effects after a brief pause */
+		t->fn = timed_mode_grace;
+		timer_rearm (t, TIME_1S);
+	}
 }
 
 
-static void timed_mode_start_task (struct timed_mode_ops *ops)
+static void timed_mode_start_timer (struct timed_mode_ops *ops)
 {
-	task_pid_t tp;
-	struct timed_mode_task_config *cfg;
+	struct timer *t;
 
-	tp = task_recreate_gid (ops->gid, timed_mode_monitor);
-	cfg = task_init_class_data (tp, struct timed_mode_task_config);
-	cfg->ops = ops;
+	t = timer_restart (ops->gid, TIME_200MS, timed_mode_tick);
+	t->data = ops;
+	if (ops->pause == system_timer_pause)
+		t->group = TIMER_GROUP_SYSTEM;
+
+	/* Request effect update immediately, now that the mode is started. */
+	effect_update_request ();
 }
 
 
@@ -119,8 +142,11 @@ void timed_mode_begin (struct timed_mode_ops *ops)
 	*ops->timer = ops->init_timer;
 	if (ops->deff_starting)
 		deff_start (ops->deff_starting);
-	timed_mode_start_task (ops);
+	timed_mode_start_timer (ops);
 	ops->init ();
+#ifdef CONFIG_SIM
+	sim_gamerec_mode (ops->gid);
+#endif
 }
 
 
@@ -129,7 +155,7 @@ void timed_mode_begin (struct timed_mode_ops *ops)
  */
 void timed_mode_end (struct timed_mode_ops *ops)
 {
-	task_kill_gid (ops->gid);
+	timer_kill_gid (ops->gid);
 	timed_mode_exit_handler (ops);
 }
 
@@ -156,7 +182,7 @@ U8 timed_mode_get_timer (struct timed_mode_ops *ops)
  */
 bool timed_mode_running_p (struct timed_mode_ops *ops)
 {
-	if (task_find_gid (ops->gid))
+	if (timer_find_gid (ops->gid))
 		return in_live_game;
 	else
 		return FALSE;
@@ -170,15 +196,15 @@ bool timed_mode_running_p (struct timed_mode_ops *ops)
 void timed_mode_reset (struct timed_mode_ops *ops, U8 time)
 {
 	/* If the mode isn't running, this call is a no-op. */
-	if (!task_find_gid (ops->gid))
+	if (!timer_find_gid (ops->gid))
 		return;
 
 	/* If the timer is nonzero, we aren't in a grace period and can just
-	update the timer directly.  But at zero, the mode task is probably not
-	in its main loop anymore (it is at timeout() or later).  We need to
-	restart the mode task from the beginning. */
+	update the timer directly.  But at zero, the mode timer is counting
+	down the grace period instead.  We need to restart it from the
+	beginning. */
 	if (*ops->timer == 0)
-		timed_mode_start_task (ops);
+		timed_mode_start_timer (ops);
 	*ops->timer = time;
 }
 
@@ -25,17 +25,28 @@
  * \file
  * \brief Timer APIs
  *
- * Timers are special cases of tasks; they just all run the same
- * function, counting down the time, then exiting.  Actually, there
- * are a few different predefined timer functions, which offer
- * slightly different behavior.
+ * Timers are entries in a table, not tasks.  A single service task
+ * counts all of them down every TIMER_SERVICE_GRAN, and calls the
+ * expiry function of each one that runs out; it exists only while some
+ * timer is running.  This sits above the free timers in freetimer.c,
+ * which are decremented at IRQ level but cannot call anything.
  *
  * The timer APIs are very similar to the task APIs, just with the
- * addition of a timeout value in most places.
+ * addition of a timeout value in most places.  Timers are found and
+ * stopped by group ID, and like tasks they are stopped at the end of
+ * the ball unless their duration says otherwise.
+ *
+ * Each timer is in a pause group.  Free timers always count; system
+ * timers stop while system_timer_pause() is true, which is evaluated
+ * at most once per pass however many of them are running.
  */
 
 
-#define TIMER_FREERUNNING_GRAN	TIME_100MS
+/** The running timers */
+struct timer timer_table[NUM_TIMERS];
+
+/** The system time at which the timer service last ran */
+U16 timer_service_last;
 
 /**
  * When nonzero, system timers are paused.  This feature can allow you to pause
@@ -149,40 +160,189 @@ void timer_pause_second (void)
 }
 
 
-void freerunning_timer_function (void)
+/**
+ * Count down the running timers, and call the expiry functions of
+ * those that have run out.  Returns FALSE if no timer is running
+ * afterwards.
+ */
+static bool timer_service_update (void)
 {
-	U16 ticks = task_get_arg ();
-	while (ticks > 0)
+	struct timer *t;
+	U16 elapsed = get_sys_time () - timer_service_last;
+	U8 paused = 0xFF;
+	bool running = FALSE;
+
+	for (t = timer_table; t < timer_table + NUM_TIMERS; t++)
 	{
-		task_sleep (TIMER_FREERUNNING_GRAN);
-		ticks -= TIMER_FREERUNNING_GRAN;
+		if (t->gid == 0)
+			continue;
+
+		if (t->group == TIMER_GROUP_SYSTEM)
+		{
+			if (paused == 0xFF)
+				paused = system_timer_pause ();
+			if (paused)
+			{
+				running = TRUE;
+				continue;
+			}
+		}
+
+		if (t->ticks > elapsed)
+		{
+			t->ticks -= elapsed;
+			running = TRUE;
+			continue;
+		}
+
+		/* The timer keeps its group ID during the expiry function, which
+		can rearm it to keep it running */
+		t->ticks = 0;
+		if (t->fn)
+			t->fn (t);
+		if (t->ticks == 0)
+			t->gid = 0;
+		else
+			running = TRUE;
 	}
+
+	timer_service_last += elapsed;
+	return running;
+}
+
+
+static void timer_service_task (void)
+{
+	do {
+		task_sleep (TIMER_SERVICE_GRAN);
+	} while (timer_service_update ());
 	task_exit ();
 }
 
 
+/**
+ * Allocate a timer.  If the service is already running, the time since
+ * its last pass is added, so that the first pass does not cut the
+ * timer short.
+ */
+static struct timer *timer_alloc (task_gid_t gid, U16 ticks, timer_function_t fn)
+{
+	struct timer *t;
 
-task_pid_t timer_restart (task_gid_t gid, U16 ticks, task_function_t fn)
+	if (task_find_gid (GID_TIMER_SERVICE))
+		ticks += get_sys_time () - timer_service_last;
+	else
+	{
+		task_pid_t tp = task_create_gid (GID_TIMER_SERVICE, timer_service_task);
+		task_set_duration (tp, TASK_DURATION_INF);
+		timer_service_last = get_sys_time ();
+	}
+
+	for (t = timer_table; t < timer_table + NUM_TIMERS; t++)
+	{
+		if (t->gid == 0)
+		{
+			t->gid = gid;
+			t->group = TIMER_GROUP_FREE;
+			t->duration = TASK_DURATION_BALL;
+			t->count = 0;
+			t->ticks = ticks;
+			t->fn = fn;
+			t->data = NULL;
+			return t;
+		}
+	}
+	fatal (ERR_NO_FREE_TIMERS);
+}
+
+
+/**
+ * Find a running timer by its group ID.
+ */
+struct timer *timer_find_gid (task_gid_t gid)
 {
-	task_pid_t tp = task_recreate_gid (gid, fn);
-	task_set_arg (tp, ticks);
-	return (tp);
+	struct timer *t;
+
+	for (t = timer_table; t < timer_table + NUM_TIMERS; t++)
+		if (t->gid == gid)
+			return t;
+	return NULL;
 }
 
 
-task_pid_t timer_start1 (task_gid_t gid, U16 ticks, task_function_t fn)
+/**
+ * Stop all timers with the given group ID, without calling their expiry
+ * functions.  Returns TRUE if any were running.
+ */
+bool timer_kill_gid (task_gid_t gid)
 {
-	task_pid_t tp = task_create_gid1 (gid, fn);
-	task_set_arg (tp, ticks);
-	return (tp);
+	struct timer *t;
+	bool found = FALSE;
+
+	for (t = timer_table; t < timer_table + NUM_TIMERS; t++)
+	{
+		if (t->gid == gid)
+		{
+			t->gid = 0;
+			found = TRUE;
+		}
+	}
+	return found;
+}
+
+
+/**
+ * Stop all timers whose duration includes COND.
+ */
+void timer_duration_expire (U8 cond)
+{
+	struct timer *t;
+
+	for (t = timer_table; t < timer_table + NUM_TIMERS; t++)
+		if (t->duration & cond)
+			t->gid = 0;
+}
+
+
+/**
+ * Restart a timer from its expiry function, keeping its group ID and
+ * data.  TICKS must be nonzero.
+ */
+void timer_rearm (struct timer *t, U16 ticks)
+{
+	t->ticks = ticks;
 }
 
 
-task_pid_t timer_start (task_gid_t gid, U16 ticks, task_function_t fn)
+/**
+ * Start a timer, stopping any others with the same group ID first.
+ */
+struct timer *timer_restart (task_gid_t gid, U16 ticks, timer_function_t fn)
+{
+	timer_kill_gid (gid);
+	return timer_alloc (gid, ticks, fn);
+}
+
+
+/**
+ * Start a timer, unless one with the same group ID is already running;
+ * if so, return that one.
+ */
+struct timer *timer_start1 (task_gid_t gid, U16 ticks, timer_function_t fn)
+{
+	struct timer *t = timer_find_gid (gid);
+	if (t)
+		return t;
+	return timer_alloc (gid, ticks, fn);
+}
+
+
+/**
+ * Start a timer, even if others with the same group ID are running.
+ */
+struct timer *timer_start (task_gid_t gid, U16 ticks, timer_function_t fn)
 {
-	task_pid_t tp = task_create_gid (gid, fn);
-	task_set_arg (tp, ticks);
-	return (tp);
+	return timer_alloc (gid, ticks, fn);
 }
 
 
@@ -17,7 +17,6 @@
  * along with FreeWPC; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
-
 /**
  * \file
  * \brief Manage the triacs.
@@ -35,7 +34,8 @@
  * one positive per cycle).
  *
  * The AC module (ac.c) monitors the zerocross and tracks how
- * long it has been since the last crossing.
+ * long it has been since the last crossing, and which of AC_PHASES
+ * half-cycles is in progress.
  *
  * The state of each triac is maintained by a latch (LS374) on the
  * power driver board.  When '1', the triac is enabled and allows
@@ -59,15 +59,23 @@
  * zerocrossing, the dimmer the lamps will be.  Maintaining the
  * lamps at this intensity requires rewriting the latch continuously
  * at the exact point in the AC cycle.
+ *
+ * There are only about 6 usable IRQs in a half-cycle, so a dimmed
+ * string may fire at a different one in each of the AC_PHASES
+ * half-cycles, which gives 14 levels between off and fully on.
+ * gi_phase_table says, for each half-cycle and each IRQ after the
+ * zerocross, which strings fire then.  It is only changed when a
+ * level changes, so the IRQ does one lookup.
+ *
+ * Levels are kept for the game and for lamp effects separately; a
+ * string allocated by a lamp effect follows the effect's level.  Either
+ * can fade, one level every so many passes through the AC_PHASES
+ * half-cycles.  Fading is done at the zerocross, so a string never
+ * changes level partway through a half-cycle.
  */
 
 #include <freewpc.h>
 
-/* The maximum length of the AC period when dimming via triacs.
- * See kernel/ac.c for a similar define.  TODO : these should be merged.
- */
-#define ZC_MAX_PERIOD 11
-
 /** The normal state of the triacs, not accounting for lamp effects. */
 U8 triac_output;
 
@@ -81,17 +89,60 @@ U8 gi_leff_alloc;
 U8 gi_leff_output;
 
 #ifdef CONFIG_TRIAC
+
+/** The brightness of the GI strings, as set by the game or by lamp effects */
+struct gi_layer
+{
+	/** For each string, its current level in the low nibble and the
+	level it is fading to in the high nibble */
+	U8 level[NUM_GI_TRIACS];
+
+	/** For each fading string, the number of fade ticks per step in the
+	high nibble, and the ticks left until the next step in the low nibble */
+	U8 timer[NUM_GI_TRIACS];
+
+	/** The strings that are still fading */
+	U8 fading;
+};
+
+struct gi_layer gi_normal_layer;
+struct gi_layer gi_leff_layer;
+
 /** Says which triacs need to be turned on at specific times
  * during the AC phase.  Each entry is a triac bitset.
- * If entry X is enabled, then X ms after the last zerocross,
- * those triacs are turned on, and remain on until the next ZC.
- * Note that only values between 0..NUM_BRIGHTNESS_LEVELS are actually
- * written, but values up to ZC_MAX_PERIOD are read.
+ * If entry [P][X] is set, then X ms after the zerocross that starts
+ * half-cycle P, those triacs are turned on, and remain on until the
+ * next ZC.
  */
-U8 gi_dimming[ZC_MAX_PERIOD];
-
-/** Like gi_dimming, but for lamp effects */
-U8 gi_leff_dimming[ZC_MAX_PERIOD];
+U8 gi_phase_table[AC_PHASES][ZC_MAX_PERIOD + 1];
+
+/** The row of gi_phase_table for the current half-cycle */
+const U8 *gi_phase_row;
+
+/** For each string, the level that it has in gi_phase_table, or zero
+if it is not there */
+U8 gi_phase_level[NUM_GI_TRIACS];
+
+/** For each dimmed level, the IRQ after the zerocross at which to fire
+the triac in each half-cycle.  Each level adds about 1/15 of the power
+of a full half-cycle, at 60Hz.  The slots that are used less are spread
+out over the half-cycles. */
+static const U8 gi_phase_slots[NUM_BRIGHTNESS_LEVELS][AC_PHASES] = {
+	[1] = { 6, 6, 6, 6 },
+	[2] = { 5, 6, 5, 6 },
+	[3] = { 5, 5, 5, 6 },
+	[4] = { 4, 5, 5, 5 },
+	[5] = { 4, 5, 4, 5 },
+	[6] = { 4, 4, 4, 5 },
+	[7] = { 4, 4, 4, 4 },
+	[8] = { 3, 4, 4, 4 },
+	[9] = { 3, 3, 3, 4 },
+	[10] = { 3, 3, 3, 3 },
+	[11] = { 2, 3, 3, 3 },
+	[12] = { 2, 2, 2, 3 },
+	[13] = { 2, 2, 2, 2 },
+	[14] = { 1, 1, 1, 2 },
+};
 #endif
 
 
@@ -99,23 +150,177 @@ void triac_dump (void)
 {
 	dbprintf ("Normal:    %02X\n", triac_output);
 #ifdef CONFIG_TRIAC
-	dbprintf ("Dim:       %02X %02X %02X %02X %02X\n",
-		gi_dimming[0], gi_dimming[1], gi_dimming[2], gi_dimming[3], gi_dimming[4]);
+	dbprintf ("Levels:    %02X %02X %02X %02X %02X\n",
+		gi_normal_layer.level[0], gi_normal_layer.level[1],
+		gi_normal_layer.level[2], gi_normal_layer.level[3],
+		gi_normal_layer.level[4]);
 #endif
 	dbprintf ("Alloc:     %02X\n", gi_leff_alloc);
 	if (gi_leff_alloc)
 	{
 		dbprintf ("Leff GI:   %02X\n", gi_leff_output);
 #ifdef CONFIG_TRIAC
-		dbprintf ("Leff dim:  %02X %02X %02X %02X %02X\n",
-			gi_leff_dimming[0], gi_leff_dimming[1], gi_leff_dimming[2],
-			gi_leff_dimming[3], gi_leff_dimming[4]);
+		dbprintf ("Leff lvl:  %02X %02X %02X %02X %02X\n",
+			gi_leff_layer.level[0], gi_leff_layer.level[1],
+			gi_leff_layer.level[2], gi_leff_layer.level[3],
+			gi_leff_layer.level[4]);
 #endif
 	}
 }
 
 
+void triac_update (void)
+{
+	U8 latch;
+
+	/* Refresh the triac latch by turning on all 'normal'
+	 * outputs, masked by anything allocated by a lamp effect. */
+	latch = triac_output;
+	latch &= ~gi_leff_alloc;
+	latch |= gi_leff_output;
+#ifdef CONFIG_TRIAC
+	pinio_write_triac (latch);
+#else
+	pinio_write_gi (latch);
+#endif
+}
+
+
 #ifdef CONFIG_TRIAC
+/** Return true if a string at LEVEL is latched on rather than fired
+at a point in the half-cycle.  When dimming has been disabled in the
+menu adjustments, every level but off is fully on. */
+static bool gi_level_full_p (U8 level)
+{
+	return level == GI_BRIGHTNESS_MAX
+		|| (level != 0 && system_config.allow_dim_illum != YES);
+}
+
+
+/** Move the strings in TRIAC to the slots of gi_phase_table for the
+level they should be at now.  This must not be interrupted by
+triac_rtt. */
+static void gi_phase_update (U8 triac)
+{
+	U8 string, bit, level, phase;
+
+	for (string = 0, bit = 0x1; string < NUM_GI_TRIACS; string++, bit <<= 1)
+	{
+		if (!(triac & bit))
+			continue;
+
+		if (gi_leff_alloc & bit)
+			level = gi_leff_layer.level[string] & 0x0F;
+		else
+			level = gi_normal_layer.level[string] & 0x0F;
+		if (gi_level_full_p (level))
+			level = 0;
+
+		if (level == gi_phase_level[string])
+			continue;
+		for (phase = 0; phase < AC_PHASES; phase++)
+		{
+			if (gi_phase_level[string])
+				gi_phase_table[phase][gi_phase_slots[gi_phase_level[string]][phase]] &= ~bit;
+			if (level)
+				gi_phase_table[phase][gi_phase_slots[level][phase]] |= bit;
+		}
+		gi_phase_level[string] = level;
+	}
+}
+
+
+/** Set the strings in TRIAC of a layer to fade to LEVEL, one level
+every RATE fade ticks.  A rate of zero changes them at once.  OUTPUT is
+the layer's set of strings that are fully on.  This must not be
+interrupted by triac_rtt. */
+static void gi_layer_write (struct gi_layer *layer, U8 *output,
+	U8 triac, U8 level, U8 rate)
+{
+	U8 string, bit, now;
+
+	if (level > GI_BRIGHTNESS_MAX)
+		level = GI_BRIGHTNESS_MAX;
+	if (rate > 0x0F)
+		rate = 0x0F;
+
+	for (string = 0, bit = 0x1; string < NUM_GI_TRIACS; string++, bit <<= 1)
+	{
+		if (!(triac & bit))
+			continue;
+
+		now = rate ? (layer->level[string] & 0x0F) : level;
+		layer->level[string] = (level << 4) | now;
+		layer->timer[string] = (rate << 4) | rate;
+		if (now != level)
+			layer->fading |= bit;
+		else
+			layer->fading &= ~bit;
+		if (gi_level_full_p (now))
+			*output |= bit;
+		else
+			*output &= ~bit;
+	}
+	gi_phase_update (triac);
+}
+
+
+/** Step the fading strings of a layer by one fade tick.  Returns the
+strings whose level changed. */
+static U8 gi_layer_step (struct gi_layer *layer, U8 *output)
+{
+	U8 string, bit, now, target;
+	U8 changed = 0;
+
+	for (string = 0, bit = 0x1; string < NUM_GI_TRIACS; string++, bit <<= 1)
+	{
+		if (!(layer->fading & bit))
+			continue;
+
+		/* As for lamps, the countdown is never zero here. */
+		if (--layer->timer[string] & 0x0F)
+			continue;
+		layer->timer[string] |= layer->timer[string] >> 4;
+
+		now = layer->level[string] & 0x0F;
+		target = layer->level[string] >> 4;
+		if (now < target)
+			now++;
+		else
+			now--;
+		layer->level[string] = (target << 4) | now;
+		if (now == target)
+			layer->fading &= ~bit;
+		if (gi_level_full_p (now))
+			*output |= bit;
+		else
+			*output &= ~bit;
+		changed |= bit;
+	}
+	return changed;
+}
+
+
+/**
+ * Handle the start of a half-cycle: step any fades at the start of the
+ * first one, and switch to its row of the phase table.
+ */
+static __attribute__((noinline)) void triac_rtt_zerocross (void)
+{
+	U8 phase = zc_get_phase ();
+	U8 changed;
+
+	if (phase == 0 && (gi_normal_layer.fading | gi_leff_layer.fading))
+	{
+		changed = gi_layer_step (&gi_normal_layer, &triac_output);
+		changed |= gi_layer_step (&gi_leff_layer, &gi_leff_output);
+		gi_phase_update (changed);
+		triac_update ();
+	}
+	gi_phase_row = gi_phase_table[phase];
+}
+
+
 /**
  * Update the triacs at interrupt time, when GI dimming is in effect
  * DIM_BITS says which triac strings need to be turned on briefly
@@ -136,18 +341,23 @@ static __attribute__((noinline)) void triac_rtt_1 (U8 dim_bits)
 }
 
 
-/** Update the triacs at interrupt time */
+/** Update the triacs at interrupt time.  This runs after ac_rtt, so
+that zc_timer is already zero in the IRQ that sees the zerocross. */
 /* RTT(name=triac_rtt freq=1) */
 void triac_rtt (void)
 {
 	/* We only need to update the triacs if dimming
 	 * needs to be done during this phase of the AC cycle.
 	 *
-	 * Moved the mechanics of the triac update into a separate function
+	 * Moved the mechanics of the triac update into separate functions
 	 * above, to optimize the function in the common case when nothing
 	 * needs to be done.
 	 */
-	U8 dim_bits = gi_dimming[zc_get_timer ()] | gi_leff_dimming[zc_get_timer ()];
+	U8 dim_bits;
+
+	if (unlikely (zc_get_timer () == 0))
+		triac_rtt_zerocross ();
+	dim_bits = gi_phase_row[zc_get_timer ()];
 	if (unlikely (dim_bits))
 	{
 		triac_rtt_1 (dim_bits);
@@ -156,71 +366,60 @@ void triac_rtt (void)
 #endif /* CONFIG_TRIAC */
 
 
-/** Clear the dimming feature on a set of triacs. */
-#ifdef CONFIG_TRIAC
-void gi_clear_dimming (U8 triac, U8 *dimming)
+/** Turns on one or more triacs */
+void gi_enable (U8 triac)
 {
-	U8 i;
-	for (i=0; i < NUM_BRIGHTNESS_LEVELS; i++)
-	{
-		dimming[i] &= ~triac;
-	}
-}
+	log_event (SEV_INFO, MOD_TRIAC, EV_TRIAC_ON, triac);
+#ifdef CONFIG_TRIAC
+	gi_dim (triac, GI_BRIGHTNESS_MAX);
 #else
-#define gi_clear_dimming(triac,dimming)
+	triac_output |= triac;
+	triac_update ();
 #endif
+}
 
 
-void triac_update (void)
+/** Turns off one or more triacs */
+void gi_disable (U8 triac)
 {
-	U8 latch;
-
-	/* Refresh the triac latch by turning on all 'normal'
-	 * outputs, masked by anything allocated by a lamp effect. */
-	latch = triac_output;
-	latch &= ~gi_leff_alloc;
-	latch |= gi_leff_output;
+	log_event (SEV_INFO, MOD_TRIAC, EV_TRIAC_OFF, triac);
 #ifdef CONFIG_TRIAC
-	pinio_write_triac (latch);
+	gi_dim (triac, 0);
 #else
-	pinio_write_gi (latch);
+	triac_output &= ~triac;
+	triac_update ();
 #endif
 }
 
 
-/** Turns on one or more triacs */
-void gi_enable (U8 triac)
+#ifdef CONFIG_TRIAC
+/** Set the brightness of one or more GI strings, from 0 (off) to
+GI_BRIGHTNESS_MAX (fully on). */
+void gi_dim (U8 triac, U8 brightness)
 {
-	log_event (SEV_INFO, MOD_TRIAC, EV_TRIAC_ON, triac);
-	gi_clear_dimming (triac, gi_dimming);
-	triac_output |= triac;
+	disable_interrupts ();
+	gi_layer_write (&gi_normal_layer, &triac_output, triac, brightness, 0);
 	triac_update ();
+	enable_interrupts ();
 }
 
 
-/** Turns off one or more triacs */
-void gi_disable (U8 triac)
+/** Fade one or more GI strings to a new brightness, moving one level
+every RATE fade ticks.  A fade tick is AC_PHASES half-cycles. */
+void gi_fade (U8 triac, U8 brightness, U8 rate)
 {
-	log_event (SEV_INFO, MOD_TRIAC, EV_TRIAC_OFF, triac);
-	gi_clear_dimming (triac, gi_dimming);
-	triac_output &= ~triac;
+	disable_interrupts ();
+	gi_layer_write (&gi_normal_layer, &triac_output, triac, brightness, rate);
 	triac_update ();
+	enable_interrupts ();
 }
 
 
-#ifdef CONFIG_TRIAC
-/** Enable dimming for a GI string. */
-void gi_dim (U8 triac, U8 brightness)
+/** Return true if any of the strings in TRIAC are still fading, either
+for the game or for a lamp effect. */
+bool gi_fade_running_p (U8 triac)
 {
-	gi_clear_dimming (triac, gi_dimming);
-	triac_output &= ~triac;
-	if (brightness == 0)
-		;
-	else if (brightness < 7 && system_config.allow_dim_illum == YES)
-		gi_dimming[7 - brightness] |= triac;
-	else
-		triac_output |= triac;
-	triac_update ();
+	return ((gi_normal_layer.fading | gi_leff_layer.fading) & triac) != 0;
 }
 #endif
 
@@ -233,11 +432,20 @@ void gi_leff_allocate (U8 triac)
 	 * by this effect. */
 	triac &= ~gi_leff_alloc;
 
+#ifdef CONFIG_TRIAC
+	disable_interrupts ();
+	/* Mark the strings as allocated.  By default, allocated strings
+	 * are off. */
+	gi_leff_alloc |= triac;
+	gi_layer_write (&gi_leff_layer, &gi_leff_output, triac, 0, 0);
+	enable_interrupts ();
+#else
 	/* Mark the strings as allocated */
 	gi_leff_alloc |= triac;
 
 	/* By default, allocated strings are off. */
 	gi_leff_output &= ~triac;
+#endif
 
 	/* TODO - return actually allocated strings to the caller
 	 * so that only those will be freed up on leff exit. */
@@ -248,9 +456,15 @@ void gi_leff_allocate (U8 triac)
 /** Frees a set of triacs at the end of a lamp effect */
 void gi_leff_free (U8 triac)
 {
-	gi_clear_dimming (triac, gi_leff_dimming);
+#ifdef CONFIG_TRIAC
+	disable_interrupts ();
+	gi_leff_alloc &= ~triac;
+	gi_layer_write (&gi_leff_layer, &gi_leff_output, triac, 0, 0);
+	enable_interrupts ();
+#else
 	gi_leff_alloc &= ~triac;
 	gi_leff_output &= ~triac;
+#endif
 	triac_update ();
 }
 
@@ -259,52 +473,47 @@ void gi_leff_free (U8 triac)
 /** Enables a triac from a lamp effect at full brightness */
 void gi_leff_enable (U8 triac)
 {
-	gi_clear_dimming (triac, gi_leff_dimming);
+#ifdef CONFIG_TRIAC
+	gi_leff_dim (triac, GI_BRIGHTNESS_MAX);
+#else
 	gi_leff_output |= triac;
 	triac_update ();
+#endif
 }
 
 
 /** Disables a triac from a lamp effect */
 void gi_leff_disable (U8 triac)
 {
-	gi_clear_dimming (triac, gi_leff_dimming);
+#ifdef CONFIG_TRIAC
+	gi_leff_dim (triac, 0);
+#else
 	gi_leff_output &= ~triac;
 	triac_update ();
+#endif
 }
 
 
 #ifdef CONFIG_TRIAC
-/** Sets the intensity (brightness) of a single GI triac */
+/** Sets the intensity (brightness) of GI strings from a lamp effect */
 void gi_leff_dim (U8 triac, U8 brightness)
 {
-	/* Disable the GI string first. */
-	gi_clear_dimming (triac, gi_leff_dimming);
-	gi_leff_output &= ~triac;
+	disable_interrupts ();
+	gi_layer_write (&gi_leff_layer, &gi_leff_output, triac, brightness, 0);
+	triac_update ();
+	enable_interrupts ();
+}
 
-	if (brightness == 0)
-	{
-		/* Nothing to do if brightness = off */
-	}
-	else if (brightness < 7 && system_config.allow_dim_illum == YES)
-	{
-		/* We want to dim the lamps at levels 1-6.
-		Level 7 doesn't work because the GI string
-		would have to be turned on and off very shortly
-		before the next zerocross point, which can't be
-		guaranteed to work. */
-		gi_leff_dimming[7-brightness] |= triac;
-	}
-	else
-	{
-		/* If the brightness is greater than the threshold,
-		or if dimming has been disabled in the menu adjustments,
-		then just it turn on all the way -- no need to do any
-		dimming at IRQ time. */
-		gi_leff_output |= triac;
-	}
 
+/** Fades GI strings from a lamp effect, moving one level every RATE
+fade ticks.  The effect need not wait for the fade to finish; it stops
+when the strings are freed. */
+void gi_leff_fade (U8 triac, U8 brightness, U8 rate)
+{
+	disable_interrupts ();
+	gi_layer_write (&gi_leff_layer, &gi_leff_output, triac, brightness, rate);
 	triac_update ();
+	enable_interrupts ();
 }
 #endif
 
@@ -316,10 +525,11 @@ void gi_init (void)
 	gi_leff_output = 0;
 	triac_output = 0;
 #ifdef CONFIG_TRIAC
-	memset (gi_dimming, 0, ZC_MAX_PERIOD);
-	memset (gi_leff_dimming, 0, ZC_MAX_PERIOD);
+	memset (&gi_normal_layer, 0, sizeof (gi_normal_layer));
+	memset (&gi_leff_layer, 0, sizeof (gi_leff_layer));
+	memset (gi_phase_table, 0, sizeof (gi_phase_table));
+	memset (gi_phase_level, 0, sizeof (gi_phase_level));
+	gi_phase_row = gi_phase_table[0];
 #endif
 	triac_update ();
 }
-
-
@@ -109,7 +109,7 @@ CALLSET_ENTRY (jets, jet_hit)
 		jets_hit = 0;
 		deff_start (DEFF_JETS_LEVEL_UP);
 	}
-	else if (!task_find_gid (GID_JETS_LEVEL_UP))
+	else if (!timer_find_gid (GID_JETS_LEVEL_UP))
 	{
 		deff_restart (DEFF_JET_HIT);
 	}
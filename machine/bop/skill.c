@@ -48,7 +48,7 @@ CALLSET_ENTRY (skill, enable_skill_shot)
 static void award_skill_switch (U8 sw)
 {
 	set_valid_playfield ();
-	if (task_find_gid (GID_SKILL_DEBOUNCE)
+	if (timer_find_gid (GID_SKILL_DEBOUNCE)
 		|| !flag_test (FLAG_SKILLSHOT_ENABLED))
 		return;
 	
@@ -90,13 +90,13 @@ CALLSET_ENTRY (skill, ball_search)
 CALLSET_ENTRY (skill, start_ball)
 {
 	flag_on (FLAG_SKILLSHOT_ENABLED);
-	task_kill_gid (GID_SKILL_DEBOUNCE);
+	timer_kill_gid (GID_SKILL_DEBOUNCE);
 }
 
 CALLSET_ENTRY (skill, serve_ball)
 {
 	flag_on (FLAG_SKILLSHOT_ENABLED);
-	task_kill_gid (GID_SKILL_DEBOUNCE);
+	timer_kill_gid (GID_SKILL_DEBOUNCE);
 }
 
 CALLSET_ENTRY (skill, end_ball)
@@ -195,8 +195,8 @@ void high_score_leff_flashers (void)
 void high_score_leff (void)
 {
 	gi_leff_enable (GI_ALL_ILLUMINATION);
-	gi_leff_dim (GI_FRONT_PLAYFIELD, 3);
-	gi_leff_dim (GI_REAR_PLAYFIELD, 3);
+	gi_leff_dim (GI_FRONT_PLAYFIELD, 6);
+	gi_leff_dim (GI_REAR_PLAYFIELD, 6);
 	lamplist_apply_leff_alternating (LAMPLIST_PLAYFIELD, 0);
 	leff_create_peer (high_score_leff_flashers);
 	for (;;)
@@ -152,7 +152,7 @@ CALLSET_ENTRY (shot, sw_captive_ball_rest)
 
 CALLSET_ENTRY (shot, sw_loop_left)
 {
-	if (!task_kill_gid (GID_RIGHT_LOOP_DEBOUNCE))
+	if (!timer_kill_gid (GID_RIGHT_LOOP_DEBOUNCE))
 	{
 		shot_define ("LEFT LOOP"); /* not working */
 		combo_detect (5);
@@ -166,8 +166,8 @@ CALLSET_ENTRY (shot, sw_spinner_start)
 {
 	/* TBD - Also require left loop switch to be seen before awarding
 	the right loop - spinner by itself is not enough */
-	if (!task_kill_gid (GID_LEFT_LOOP_DEBOUNCE) &&
-			!task_find_gid (GID_RIGHT_LOOP_DEBOUNCE) &&
+	if (!timer_kill_gid (GID_LEFT_LOOP_DEBOUNCE) &&
+			!timer_find_gid (GID_RIGHT_LOOP_DEBOUNCE) &&
 			!free_timer_test (timer_right_ramp_entered))
 	{
 		shot_define ("RIGHT LOOP");
@@ -186,7 +186,7 @@ CALLSET_ENTRY (shot, sw_spinner_slow)
 
 CALLSET_ENTRY (shot, sw_trunk_hit)
 {
-	if (!task_kill_gid (GID_TRUNK_DEBOUNCE))
+	if (!timer_kill_gid (GID_TRUNK_DEBOUNCE))
 	{
 		shot_define ("TRUNK WALL");
 		combo_detect (7);
@@ -205,7 +205,7 @@ CALLSET_ENTRY (shot, sw_subway_micro)
 {
 	if (free_timer_test (timer_loop_to_lock))
 		return;
-	else if (task_find_gid (GID_TRUNK_DEBOUNCE))
+	else if (timer_find_gid (GID_TRUNK_DEBOUNCE))
 	{
 		shot_define ("TRUNK HOLE");
 		combo_detect (7);
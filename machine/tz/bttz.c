@@ -142,7 +142,7 @@ void load_gumball_task (void)
 
 CALLSET_ENTRY (bttz, sw_gumball_enter)
 {
-	if (task_kill_gid (GID_LOAD_ATTEMPT))
+	if (timer_kill_gid (GID_LOAD_ATTEMPT))
 	{
 		bounded_decrement (balls_needed_to_load, 0);
 	}
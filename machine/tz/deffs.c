@@ -289,7 +289,7 @@ void tv_static_deff (void)
 	{
 		dmd_alloc_pair ();
 		dmd = (U16 *)dmd_low_buffer;
-		while (dmd < (U16 *)dmd_high_buffer)
+		while (dmd < ((U16 *)(dmd_low_buffer + DMD_PAGE_SIZE)))
 		{
 			r = random_scaled (11);
 			*dmd++ = tv_static_data[r++];
@@ -47,7 +47,7 @@ const struct {
 	{ "BALLY'S NIP-IT, AS PLAYED BY", "THE FONZ IN HAPPY DAYS", "WHICH IS SET IN THE 50'S,", "WASN'T MADE UNTIL 1972" },
 	{ "TOM HANKS ASKED FOR HIS", "IMAGE TO BE REMOVED FROM", "THE BACKGLASS ART OF", "APOLLO 13" },
 	{ "DOLPHINS SLEEP", "WITH ONE EYE OPEN", "", "" },
-	{ "TWELVE OR MORE COWS", "ARE KNOWN AS", "A FLINK" },
+	{ "TWELVE OR MORE COWS", "ARE KNOWN AS", "A FLINK", "" },
 	{ "THE MAN FEATURED BY", "THE UPPER RIGHT FLIPPER", "IS BURGESS MEREDITH FROM", "THE ROCKY FILMS" },
 };
 
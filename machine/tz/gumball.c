@@ -458,7 +458,7 @@ CALLSET_ENTRY (gumball, sw_gumball_popper)
 {
 	/* A right loop was completed, TODO Could be BUGGY */
 	timer_restart_free (GID_GUMBALL, TIME_1S);
-	if (task_kill_gid (GID_RIGHT_LOOP_ENTERED))
+	if (timer_kill_gid (GID_RIGHT_LOOP_ENTERED))
 		task_create_anon (award_right_loop_task);
 }
 
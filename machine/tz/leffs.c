@@ -87,9 +87,12 @@ void left_ramp_leff (void)
 
 void no_gi_leff (void)
 {
-	gi_leff_disable (PINIO_GI_STRINGS);
-	task_sleep_sec (2);
 	gi_leff_enable (PINIO_GI_STRINGS);
+	gi_leff_fade (PINIO_GI_STRINGS, 0, 1);
+	task_sleep_sec (2);
+	gi_leff_fade (PINIO_GI_STRINGS, GI_BRIGHTNESS_MAX, 1);
+	while (gi_fade_running_p (PINIO_GI_STRINGS))
+		task_sleep (TIME_33MS);
 	leff_exit ();
 }
 
@@ -217,10 +220,13 @@ void multiball_running_leff (void)
 	leff_exit ();
 }
 
+/* The strobes are two bands of light, 200ms apart, that sweep across
+the playfield and fade out behind them. */
+
 static void pf_strobe_down_subtask (void)
 {
-	for (;;)
-		lamplist_apply (LAMPLIST_SORT2, leff_toggle);
+	lamplist_sweep (LAMPLIST_SORT2, 1);
+	task_exit ();
 }
 
 void strobe_down_leff (void)
@@ -228,8 +234,8 @@ void strobe_down_leff (void)
 	lamplist_set_apply_delay (TIME_16MS);
 	leff_create_peer (pf_strobe_down_subtask);
 	task_sleep (TIME_200MS);
-	leff_create_peer (pf_strobe_down_subtask);
-	task_sleep_sec (1);
+	lamplist_sweep (LAMPLIST_SORT2, 1);
+	task_sleep (TIME_300MS);
 	task_kill_peers ();
 	leff_exit ();
 }
@@ -237,8 +243,8 @@ void strobe_down_leff (void)
 
 static void pf_strobe_up_subtask (void)
 {
-	for (;;)
-		lamplist_apply (LAMPLIST_SORT1, leff_toggle);
+	lamplist_sweep (LAMPLIST_SORT1, 1);
+	task_exit ();
 }
 
 void strobe_up_leff (void)
@@ -247,8 +253,8 @@ void strobe_up_leff (void)
 	lamplist_set_apply_delay (TIME_16MS);
 	leff_create_peer (pf_strobe_up_subtask);
 	task_sleep (TIME_200MS);
-	leff_create_peer (pf_strobe_up_subtask);
-	task_sleep_sec (1);
+	lamplist_sweep (LAMPLIST_SORT1, 1);
+	task_sleep (TIME_300MS);
 	task_kill_peers ();
 	leff_exit ();
 }
@@ -500,7 +506,7 @@ void mpf_hit_leff (void)
 void spiralaward_leff (void)
 {
 	lamplist_set_apply_delay (TIME_33MS);
-	while (task_find_gid (GID_SPIRALAWARD))
+	while (timer_find_gid (GID_SPIRALAWARD))
 	{
 		lamplist_apply (LAMPLIST_SPIRAL_AWARDS, leff_toggle);
 	}
@@ -38,7 +38,7 @@ extern void thing_flips (void);
 /* Functions to stop leffs/deffs during certain game situations */
 static inline bool can_show_loop_leff (void)
 {
-	if (task_find_gid (GID_SPIRALAWARD))
+	if (timer_find_gid (GID_SPIRALAWARD))
 		return FALSE;
 	else
 		return TRUE;
@@ -110,7 +110,7 @@ static void award_loop (void)
 		}
 		fastlock_loop_completed ();
 
-		if (!task_find_gid (GID_SPIRALAWARD) || !task_find_gid (GID_GUMBALL))
+		if (!timer_find_gid (GID_SPIRALAWARD) || !timer_find_gid (GID_GUMBALL))
 			sound_send (SND_SPIRAL_AWARDED);
 		deff_start (DEFF_LOOP);
 	}
@@ -147,7 +147,7 @@ void loop_deff (void)
 	{
 		dmd_alloc_low_clean ();
 		psprintf ("1 LOOP", "%d LOOPS", loops);
-		font_render_string_center (&font_fixed6, 64, i, sprintf_buffer);
+		font_render_string_center (&font_fixed6, 64, 5 + i, sprintf_buffer);
 		
 		sprintf_score (loop_score);
 		font_render_string_center (&font_mono5, 64, 23 - i, sprintf_buffer);
@@ -170,12 +170,12 @@ void stop_loop_speed_timer (void)
 
 CALLSET_ENTRY (loop, sw_left_magnet)
 {
-	if (task_kill_gid (GID_LEFT_LOOP_ENTERED))
+	if (timer_kill_gid (GID_LEFT_LOOP_ENTERED))
 	{
 		/* Left loop aborted */
 		abort_loop ();
 	}
-	else if (task_kill_gid (GID_RIGHT_LOOP_ENTERED))
+	else if (timer_kill_gid (GID_RIGHT_LOOP_ENTERED))
 	{
 		/* Right loop completed */
 		stop_loop_speed_timer ();
@@ -199,7 +199,7 @@ CALLSET_ENTRY (loop, sw_lower_right_magnet)
 {
 
 	/* Inform gumball module that a ball may be approaching */
-	if (!task_find_gid (GID_LEFT_LOOP_ENTERED))
+	if (!timer_find_gid (GID_LEFT_LOOP_ENTERED))
 		sw_gumball_right_loop_entered ();
 
 	if (event_did_follow (dev_lock_kick_attempt, right_loop))
@@ -212,13 +212,13 @@ CALLSET_ENTRY (loop, sw_lower_right_magnet)
 		/* Ignore right loop switch after an autolaunch */
 		enter_loop ();
 	}
-	else if (task_kill_gid (GID_LEFT_LOOP_ENTERED))
+	else if (timer_kill_gid (GID_LEFT_LOOP_ENTERED))
 	{
 		/* Left loop completed */
 		stop_loop_speed_timer ();
 		callset_invoke (award_left_loop);
 	}
-	else if (task_kill_gid (GID_RIGHT_LOOP_ENTERED))
+	else if (timer_kill_gid (GID_RIGHT_LOOP_ENTERED))
 	{
 		/* Right loop aborted */
 		abort_loop ();
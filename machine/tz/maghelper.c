@@ -104,7 +104,7 @@ void magnet_enable_monitor_task (void)
 			/* Do nothing, magnet is busy */
 		}
 		/* Enable catch from an ballsave death */
-		else if (task_find_gid (GID_BALL_LAUNCH_DEATH))
+		else if (timer_find_gid (GID_BALL_LAUNCH_DEATH))
 		{
 			magnet_enable_catch_and_throw (MAG_LEFT);
 		}
@@ -124,7 +124,7 @@ void mpf_mode_exit (void)
 {
 	task_kill_gid (GID_MPF_COUNTDOWN);
 	task_kill_gid (GID_MPF_BALLSEARCH);
-	task_kill_gid (GID_MPF_BUTTON_MASHER);
+	timer_kill_gid (GID_MPF_BUTTON_MASHER);
 	mpf_active = FALSE;
 	leff_stop (LEFF_MPF_ACTIVE);
 }
@@ -275,7 +275,7 @@ CALLSET_ENTRY (mpf, sw_mpf_exit)
 	/* Stop the ball search timer */
 	task_kill_gid (GID_MPF_BALLSEARCH);
 	task_kill_gid (GID_MPF_COUNTDOWN);
-	task_kill_gid (GID_MPF_BUTTON_MASHER);
+	timer_kill_gid (GID_MPF_BUTTON_MASHER);
 	if (mpf_ball_count > 0)
 		bounded_decrement (mpf_ball_count, 0);
 	if (mpf_ball_count == 0)
@@ -374,7 +374,7 @@ static void mpf_button_masher_handler (void)
 {
 	if (mpf_timer != 0 && !multi_ball_play ())
 	{
-		if (task_find_gid (GID_MPF_BUTTON_MASHER))
+		if (timer_find_gid (GID_MPF_BUTTON_MASHER))
 		{
 			bounded_increment (mpf_buttons_pressed, 254);
 			check_button_masher ();
@@ -175,9 +175,9 @@ static void award_spiralaward (void)
 
 CALLSET_ENTRY (spiralaward, award_right_loop)
 {
-	if (task_kill_gid (GID_SPIRALAWARD_APPROACHING))
+	if (timer_kill_gid (GID_SPIRALAWARD_APPROACHING))
 	{
-		task_kill_gid (GID_SPIRALAWARD);
+		timer_kill_gid (GID_SPIRALAWARD);
 		leff_stop (LEFF_SPIRALAWARD);
 		sound_send (SND_SLOT_PAYOUT);
 		award_spiralaward ();
@@ -192,7 +192,7 @@ CALLSET_ENTRY (spiralaward, lamp_update)
 CALLSET_ENTRY (spiralaward, end_ball)
 {
 	task_kill_gid (GID_FLASH_SPIRALAWARD_LAMP);
-	task_kill_gid (GID_SPIRALAWARD);
+	timer_kill_gid (GID_SPIRALAWARD);
 }
 
 CALLSET_ENTRY (spiralaward, start_player)
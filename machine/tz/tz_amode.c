@@ -91,8 +91,9 @@ void show_text_on_stars (void)
 	U8 n;
 	for (n = 0; n < 40; n++)
 	{
-		dmd_dup_mapped ();
-		dmd_overlay_onto_color ();
+		dmd_compose_begin (wpc_dmd_get_mapped ());
+		dmd_compose_layer (DMD_OVERLAY_PAGE, DMD_LAYER_MONO);
+		dmd_compose ();
 		star_draw ();
 		dmd_show2 ();
 		task_sleep (TIME_100MS);
@@ -54,6 +54,9 @@ void lamp_rtt (void)
 
 		/* After strobing all lamps, reload the power saver timer */
 		lamp_power_timer = lamp_power_level;
+
+		/* And output the next plane of lamp intensities */
+		platform_lamp_pwm_advance ();
 	}
 	else
 	{
@@ -2,18 +2,40 @@
 #include <freewpc.h>
 #include <system/platform.h>
 
+/** The number of flashers that may still be lit by the current update,
+out of FLASHER_POWER_BUDGET */
+__fastram__ U8 sol_flash_budget;
+
+/** The number of flashers lit by the last update of each half of the
+outputs.  Each half stays as written while the other one is updated, so
+both count against the budget. */
+U8 sol_flash_lit[2];
+
+
 /** Return 0 if the given solenoid/flasher should be off,
 else return the bitmask that reflects that solenoid's
-position in the output register. */
+position in the output register.  A flasher that is due to be lit
+when the budget is used up is held off, and its timer is not
+decremented, so that the whole pulse is given later. */
 extern inline U8 platform_sol_timer_check (const U8 id)
 {
 	if (MACHINE_SOL_FLASHERP (id))
-		if (likely (sol_timers[id - SOL_MIN_FLASHER] != 0))
+		if (likely (rt_load (sol_timers[id - SOL_MIN_FLASHER]) != 0))
 		{
-			sol_timers[id - SOL_MIN_FLASHER]--;
-
-			if (likely (sol_duty_state[id - SOL_MIN_FLASHER] & sol_duty_mask))
+			if (likely (rt_load (sol_duty_state[id - SOL_MIN_FLASHER]) & sol_duty_mask))
+			{
+				if (unlikely (sol_flash_budget == 0))
+				{
+					sol_req_stats.flash_held++;
+					return 0;
+				}
+				sol_flash_budget--;
+				rt_store (sol_timers[id - SOL_MIN_FLASHER],
+					rt_load (sol_timers[id - SOL_MIN_FLASHER]) - 1);
 				return 1;
+			}
+			rt_store (sol_timers[id - SOL_MIN_FLASHER],
+				rt_load (sol_timers[id - SOL_MIN_FLASHER]) - 1);
 		}
 	return 0;
 }
@@ -83,12 +105,14 @@ extern inline void platform_sol_update_direct (const U8 sol_set)
 /* RTT(name=sol_update_rtt_0 freq=2) */
 void sol_update_rtt_0 (void)
 {
+	sol_flash_budget = FLASHER_POWER_BUDGET - sol_flash_lit[1];
 	platform_sol_update_direct (0);
 	platform_sol_update_timed (2);
 #ifdef CONFIG_PLATFORM_WPC
 	if (WPC_HAS_CAP (WPC_CAP_FLIPTRONIC))
 		sol_update_fliptronic_powered ();
 #endif
+	sol_flash_lit[0] = FLASHER_POWER_BUDGET - sol_flash_budget - sol_flash_lit[1];
 }
 
 
@@ -96,11 +120,13 @@ void sol_update_rtt_0 (void)
 /* RTT(name=sol_update_rtt_1 freq=2) */
 void sol_update_rtt_1 (void)
 {
+	sol_flash_budget = FLASHER_POWER_BUDGET - sol_flash_lit[0];
 	platform_sol_update_direct (1);
 	platform_sol_update_timed (3);
 #ifdef MACHINE_SOL_EXTBOARD1
 	platform_sol_update_timed (5);
 #endif
+	sol_flash_lit[1] = FLASHER_POWER_BUDGET - sol_flash_budget - sol_flash_lit[0];
 
 	/* Rotate the duty mask for the next iteration. */
 	/* TODO - the assembly code generated here is not ideal.
@@ -22,23 +22,51 @@
 #include <simulation.h>
 #include <imglib.h>
 
-#define MAX_PHASES 3
-
-struct buffer *asciidmd_buffers[PINIO_NUM_DMD_PAGES] = { NULL, };
-
-struct buffer *asciidmd_pre_splits[MAX_PHASES] = { NULL, };
-
-struct buffer *asciidmd_phases[MAX_PHASES] = { NULL, };
+/**
+ * \file
+ * \brief The simulated dot-matrix controller.
+ *
+ * Each of the 16 DMD pages is an ordinary buffer.  The kernel writes to
+ * them through the two mapping windows, and tells us about each page
+ * pair it shows through pinio_dmd_publish().
+ *
+ * Published frames go into a small ring.  Each frame has a sequence
+ * number and a greyscale composite of its page pair, one byte per pixel,
+ * weighted the same way as the FIRQ page flipping: the dark page is
+ * shown 1/3 of the time and the bright page 2/3, so each pixel is
+ * dark + 2 * bright, from 0 to 3.  Readers (the UI, the recorder)
+ * are handed a pointer into the ring rather than a copy.  A reader
+ * that falls behind only ever sees the newest frame; the ones it missed
+ * are counted as dropped.
+ *
+ * The publisher does not wait for readers, so a slow reader's slot can
+ * be reused while it is still looking at it.  The slot's sequence
+ * number is cleared while it is being rewritten, like a seqlock, and
+ * dmd_frame_done() checks it again once the reader has finished.  A
+ * frame that changed underneath the reader is counted as dropped; a
+ * newer frame is then always waiting for it.
+ */
 
-U8 asciidmd_pages[MAX_PHASES] = { 0, 0 };
+/** The number of published frames kept for readers */
+#define DMD_FRAME_QUEUE_LEN 4
 
-unsigned int asciidmd_phase = 0;
+struct buffer *asciidmd_buffers[PINIO_NUM_DMD_PAGES] = { NULL, };
 
 U8 *pinio_dmd_low_page;
 U8 *pinio_dmd_high_page;
 
 U8 asciidmd_visible_page;
 
+/** The ring of published frames */
+struct dmd_frame dmd_frame_queue[DMD_FRAME_QUEUE_LEN];
+
+/** The sequence number of the newest frame.  Zero means that nothing
+has been published yet. */
+U32 dmd_frame_seq;
+
+/** The reader that drives the on-screen display */
+struct dmd_frame_reader asciidmd_reader;
+
 
 /**
  * Allocate a buffer for a dot-matrix page.
@@ -67,62 +95,123 @@ void asciidmd_map_page (int mapping, int page)
 
 
 /**
- * Refresh the ASCII dot-matrix.
+ * Return the buffer for any page, whether it is mapped or not.
  */
-void asciidmd_refresh (void)
+U8 *asciidmd_page_ptr (U8 page)
+{
+	return asciidmd_buffers[page & 0x0F]->_data;
+}
+
+
+/**
+ * Publish a new frame.  This is called by the kernel whenever it shows
+ * a new dark/bright page pair; for a mono image, both are the same.
+ */
+void asciidmd_publish (U8 dark, U8 bright)
+{
+	struct dmd_frame *frame;
+	const U8 *dp, *bp;
+	U8 *out;
+	unsigned int off;
+	U8 bit;
+	U32 seq;
+
+	rt_queue_lock ();
+	seq = dmd_frame_seq + 1;
+	frame = &dmd_frame_queue[seq % DMD_FRAME_QUEUE_LEN];
+	rt_store (frame->seq, 0);
+	rt_fence ();
+	frame->dark = dark &= 0x0F;
+	frame->bright = bright &= 0x0F;
+
+	dp = asciidmd_buffers[dark]->_data;
+	bp = asciidmd_buffers[bright]->_data;
+	out = frame->data;
+	for (off = 0; off < DMD_PAGE_SIZE; off++)
+		for (bit = 0; bit < 8; bit++)
+			*out++ = ((dp[off] >> bit) & 1) + (((bp[off] >> bit) & 1) << 1);
+	dmdrec_frame (asciidmd_buffers[dark], asciidmd_buffers[bright]);
+
+	rt_store (frame->seq, seq);
+	rt_store (dmd_frame_seq, seq);
+	rt_queue_unlock ();
+}
+
+
+/**
+ * Return the newest frame that READER has not yet seen, or NULL if
+ * there is nothing new.  Any frames published in between are skipped
+ * and counted as dropped.  The reader must call dmd_frame_done() when
+ * it has finished with the frame.
+ */
+const struct dmd_frame *dmd_frame_next (struct dmd_frame_reader *reader)
 {
-	int phase;
-	struct buffer *buf, *splitbuf, *composite;
-	int pos;
+	U32 seq = rt_load (dmd_frame_seq);
+	const struct dmd_frame *frame;
 
-	/* Convert from compact to expanded form */
-	buf = asciidmd_buffers[asciidmd_visible_page];
+	if (seq == reader->seq)
+		return NULL;
+	if (reader->seq != 0)
+		reader->dropped += seq - reader->seq - 1;
+	reader->seq = seq;
 
-	/* Add to the phase ring */
-	if (asciidmd_pre_splits[asciidmd_phase % MAX_PHASES] != buf)
+	frame = &dmd_frame_queue[seq % DMD_FRAME_QUEUE_LEN];
+	if (rt_load (frame->seq) != seq)
 	{
-		asciidmd_pre_splits[asciidmd_phase % MAX_PHASES] = buf;
-		splitbuf = buffer_splitbits (buf);
-		if (asciidmd_phases[asciidmd_phase % MAX_PHASES])
-			buffer_free (asciidmd_phases[asciidmd_phase % MAX_PHASES]);
-		asciidmd_phases[asciidmd_phase % MAX_PHASES] = splitbuf;
+		reader->dropped++;
+		return NULL;
 	}
-	else
-		return;
+	return frame;
+}
 
-	composite = frame_alloc ();
-	if (composite == NULL)
-		return;
 
-	for (phase = 0; phase < MAX_PHASES; phase++)
+/**
+ * Finish with a frame returned by dmd_frame_next().  Returns FALSE if
+ * the frame was overwritten while it was being read, in which case
+ * whatever the reader took from it is torn and should be discarded.
+ */
+bool dmd_frame_done (struct dmd_frame_reader *reader,
+	const struct dmd_frame *frame)
+{
+	rt_fence ();
+	if (rt_load (frame->seq) != reader->seq)
 	{
-		struct buffer *buf = asciidmd_phases[phase];
-		if (buf == NULL)
-			goto done;
+		reader->dropped++;
+		return FALSE;
+	}
+	reader->frames++;
+	return TRUE;
+}
+
 
-		for (pos=0; pos < composite->len; pos++)
-			composite->data[pos] += buf->data[pos];
+/**
+ * Refresh the ASCII dot-matrix from the newest published frame.  If it
+ * was torn, the next refresh draws the newer frame over it.
+ */
+void asciidmd_refresh (void)
+{
+	const struct dmd_frame *frame = dmd_frame_next (&asciidmd_reader);
+	if (frame)
+	{
+		ui_refresh_asciidmd ((unsigned char *)frame->data);
+		dmd_frame_done (&asciidmd_reader, frame);
 	}
+}
 
-	/* Show on the screen */
-	ui_refresh_asciidmd (composite->data);
 
-done:
-	/* Free the composite */
-	buffer_free (composite);
+static void asciidmd_periodic (void *data __attribute__((unused)))
+{
+	asciidmd_refresh ();
 }
 
 
 /**
- * Change the visible DMD page.
+ * Change the visible DMD page.  This happens on every phase of the
+ * page flipping; frames are taken from asciidmd_publish instead.
  */
 void asciidmd_set_visible (int page)
 {
-	page &= 0x0F;
-	asciidmd_phase++;
-	asciidmd_pages[asciidmd_phase % MAX_PHASES] = page;
-	asciidmd_visible_page = page;
-	asciidmd_refresh ();
+	asciidmd_visible_page = page & 0x0F;
 }
 
 
@@ -135,14 +224,25 @@ void asciidmd_init (void)
 	for (n = 0; n < PINIO_NUM_DMD_PAGES; n++)
 		asciidmd_buffers[n] = asciidmd_alloc ();
 
-	for (n = 0; n < MAX_PHASES; n++)
-	{
-		asciidmd_phases[n] = NULL;
-		asciidmd_pre_splits[n] = NULL;
-	}
-
 	asciidmd_map_page (0, 0);
 	asciidmd_map_page (1, 0);
 	asciidmd_visible_page = 0;
+
+	/* Redraw at about 60Hz.  Frames shown faster than that are
+	dropped, as they would be by a real display. */
+	sim_time_register (16, TRUE, asciidmd_periodic, NULL);
 }
 
+
+/**
+ * Report the frame statistics at exit.
+ */
+void asciidmd_exit (void)
+{
+	dmdrec_stop ();
+	simlog (SLC_DEBUG, "DMD: %u frames published, %u shown, %u dropped",
+		dmd_frame_seq, asciidmd_reader.frames, asciidmd_reader.dropped);
+	simlog (SLC_DEBUG, "DMD: %u page passes, %u.%02u per frame",
+		dmd_page_passes, dmd_page_passes / (dmd_frame_seq ? dmd_frame_seq : 1),
+		dmd_page_passes * 100 / (dmd_frame_seq ? dmd_frame_seq : 1) % 100);
+}
@@ -202,13 +202,30 @@ struct sim_coil_type generic_type_coil = {
 };
 
 
-/* Define the action for a flipper coil. */
+/* Define the action for a flipper coil.  The EOS switch is made when
+	the flipper reaches the end of its stroke.  The hold coil keeps it
+	there, so it only falls back once that is off. */
+
+#if (MACHINE_FLIPTRONIC == 1)
+void flipper_coil_at_max (struct sim_coil_state *c)
+{
+	sim_flipper_eos (c->master - coil_states, 1);
+}
+
+void flipper_coil_at_rest (struct sim_coil_state *c)
+{
+	sim_flipper_eos (c->master - coil_states, 0);
+}
+#endif
 
 struct sim_coil_type flipper_power_type_coil = {
-	/* TODO - trigger EOS when coil reaches peak */
+#if (MACHINE_FLIPTRONIC == 1)
+	.at_max = flipper_coil_at_max,
+	.at_rest = flipper_coil_at_rest,
+#endif
 	.max_pos = 32,
 	.on_step = 2,
-	.off_step = -1,
+	.off_step = 0,
 };
 
 struct sim_coil_type flipper_hold_type_coil = {
@@ -373,6 +390,11 @@ void sim_coil_change (unsigned int coil, unsigned int on)
 	if (c->on != on)
 	{
 		c->on = on;
+		sim_stuck_coil (coil, on);
+#if (MACHINE_FLIPTRONIC == 1)
+		if (coil >= SOL_BASE_FLIPTRONIC && coil < SOL_BASE_FLIPTRONIC + 8)
+			sim_flipper_coil (coil, on);
+#endif
 		/* Start a periodic function, called every 1ms, to update the value
 		of this coil, if it has not already been started. */
 		if (!c->scheduled)
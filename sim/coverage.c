@@ -0,0 +1,90 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <freewpc.h>
+#include <simulation.h>
+
+/**
+ * \file
+ * \brief Records which branches the program takes, for tools/swfuzz.
+ *
+ * With CONFIG_FUZZ, every object is compiled with
+ * -fsanitize-coverage=trace-pc, so that the compiler calls
+ * __sanitizer_cov_trace_pc() at the start of each basic block.  Each
+ * pair of consecutive blocks is hashed into a byte of a shared map,
+ * which counts how often that edge was taken, as AFL does.
+ *
+ * The map is a file named by the FREEWPC_COVERAGE environment variable,
+ * mapped shared so that the fuzzer sees it after the program exits.
+ * Without that variable, nothing is recorded.
+ */
+
+#define COVERAGE_MAP_SIZE 65536
+
+static U8 *coverage_map;
+
+static uintptr_t coverage_prev;
+
+extern char __executable_start;
+
+
+/** Called by the compiler-generated code at each basic block.  Addresses
+are taken relative to the program, so that they are the same in every
+run even when the program is loaded at a random address. */
+__attribute__((no_sanitize_coverage))
+void __sanitizer_cov_trace_pc (void)
+{
+	uintptr_t loc = (uintptr_t)__builtin_return_address (0)
+		- (uintptr_t)&__executable_start;
+
+	if (!coverage_map)
+		return;
+	loc = ((loc >> 4) ^ (loc << 8)) & (COVERAGE_MAP_SIZE - 1);
+	coverage_map[loc ^ coverage_prev]++;
+	coverage_prev = loc >> 1;
+}
+
+
+/** Map the coverage file, if one was given. */
+void sim_coverage_init (void)
+{
+	const char *file = getenv ("FREEWPC_COVERAGE");
+	void *map;
+	int fd;
+
+	if (!file)
+		return;
+	fd = open (file, O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || ftruncate (fd, COVERAGE_MAP_SIZE) < 0)
+	{
+		simlog (SLC_DEBUG, "cannot open coverage map '%s'", file);
+		return;
+	}
+	map = mmap (NULL, COVERAGE_MAP_SIZE, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close (fd);
+	if (map != MAP_FAILED)
+		coverage_map = map;
+}
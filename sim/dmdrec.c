@@ -0,0 +1,184 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <freewpc.h>
+#include <simulation.h>
+#include <imglib.h>
+
+/**
+ * \file
+ * \brief Record every frame shown on the DMD to a file.
+ *
+ * A recording is started and stopped with the 'dmdrec' script command.
+ * Every page pair published by the kernel is written, so the file holds
+ * exactly what a deff drew, regardless of how fast the UI refreshes.
+ * tools/dmdrec can print, summarize, and compare recordings.
+ *
+ * Each plane is compressed with buffer_compress(), using the same plane
+ * of the previous frame as the reference, so that an animation which
+ * changes a few pixels per frame costs a few bytes per frame.
+ *
+ * The file format (all values little-endian):
+ *
+ *   Header:  "FDMD", U8 version, U8 width/8, U8 height, U8 reserved
+ *   Frame:   'F', U32 time (ms), then for the dark and bright planes:
+ *            U16 length, followed by that many bytes of compressed data
+ *   Mark:    'M', U32 time (ms), U16 deff ID
+ *
+ * Marks are written by the 'deff' script command each time it starts a
+ * deff, so that frames can be attributed to the deff that drew them.
+ * Once a deff has been marked, frames are only recorded while it is
+ * the running deff; otherwise, whatever else was drawing in between
+ * (attract mode, for one) would make recordings differ from run to run.
+ */
+
+#define DMDREC_VERSION 1
+
+FILE *dmdrec_file;
+
+/** The previous frame's planes, used as the delta reference */
+struct buffer *dmdrec_prev[2];
+
+/** The deff that was last marked, or zero if none */
+U16 dmdrec_deff;
+
+U32 dmdrec_frames;
+U32 dmdrec_bytes;
+
+
+static void dmdrec_write16 (U16 val)
+{
+	fputc (val & 0xFF, dmdrec_file);
+	fputc (val >> 8, dmdrec_file);
+}
+
+
+static void dmdrec_write32 (U32 val)
+{
+	dmdrec_write16 (val & 0xFFFF);
+	dmdrec_write16 (val >> 16);
+}
+
+
+/**
+ * Compress and write one plane of a frame.
+ */
+static void dmdrec_write_plane (struct buffer *buf, unsigned int plane)
+{
+	struct buffer *enc = buffer_compress (buf, dmdrec_prev[plane]);
+
+	dmdrec_write16 (enc->len);
+	buffer_write (enc, dmdrec_file);
+	dmdrec_bytes += enc->len + 2;
+	buffer_free (enc);
+
+	if (dmdrec_prev[plane])
+		buffer_free (dmdrec_prev[plane]);
+	dmdrec_prev[plane] = buffer_copy (buf);
+}
+
+
+/**
+ * Record a frame.  DARK and BRIGHT are the joined page buffers.
+ * This is called from asciidmd_publish() with the queue lock held.
+ */
+void dmdrec_frame (struct buffer *dark, struct buffer *bright)
+{
+	if (!dmdrec_file)
+		return;
+	if (dmdrec_deff && deff_get_active () != dmdrec_deff)
+		return;
+	fputc ('F', dmdrec_file);
+	dmdrec_write32 (realtime_read ());
+	dmdrec_write_plane (dark, 0);
+	dmdrec_write_plane (bright, 1);
+	dmdrec_frames++;
+}
+
+
+/**
+ * Record that deff ID is about to be started.
+ */
+void dmdrec_mark (U16 id)
+{
+	if (!dmdrec_file)
+		return;
+	rt_queue_lock ();
+	fputc ('M', dmdrec_file);
+	dmdrec_write32 (realtime_read ());
+	dmdrec_write16 (id);
+	dmdrec_deff = id;
+	rt_queue_unlock ();
+}
+
+
+/**
+ * Stop recording.
+ */
+void dmdrec_stop (void)
+{
+	unsigned int plane;
+
+	if (!dmdrec_file)
+		return;
+	rt_queue_lock ();
+	fclose (dmdrec_file);
+	dmdrec_file = NULL;
+	for (plane = 0; plane < 2; plane++)
+	{
+		if (dmdrec_prev[plane])
+			buffer_free (dmdrec_prev[plane]);
+		dmdrec_prev[plane] = NULL;
+	}
+	rt_queue_unlock ();
+	simlog (SLC_DEBUG, "DMD recording: %u frames, %u bytes",
+		dmdrec_frames, dmdrec_bytes);
+}
+
+
+/**
+ * Start recording to FILENAME.  Any recording in progress is stopped.
+ */
+void dmdrec_start (const char *filename)
+{
+	FILE *fp;
+
+	dmdrec_stop ();
+	fp = fopen (filename, "wb");
+	if (!fp)
+	{
+		simlog (SLC_DEBUG, "DMD recording: cannot open '%s'", filename);
+		return;
+	}
+
+	fwrite ("FDMD", 4, 1, fp);
+	fputc (DMDREC_VERSION, fp);
+	fputc (PINIO_DMD_WIDTH / 8, fp);
+	fputc (PINIO_DMD_HEIGHT, fp);
+	fputc (0, fp);
+
+	rt_queue_lock ();
+	dmdrec_deff = 0;
+	dmdrec_frames = 0;
+	dmdrec_bytes = 0;
+	dmdrec_file = fp;
+	rt_queue_unlock ();
+	simlog (SLC_DEBUG, "DMD recording to '%s'", filename);
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <freewpc.h>
+#include <simulation.h>
+
+/* Simulation of the Fliptronic flipper switches.
+
+	The EOS switch of each flipper is driven from the position of its
+	coil, and the time from each button press to its coil turning on is
+	kept in a histogram.  The Fliptronic switches are column 9 of the
+	matrix: for flipper N, the EOS is bit 2N and the button is bit 2N+1,
+	in the same order as its power and hold coils. */
+
+/** The first Fliptronic switch */
+#define SIM_FLIPPER_SWITCH (9 * 8)
+
+/** The number of histogram buckets, in IRQs.  The last one holds all of
+the longer latencies. */
+#define SIM_FLIPPER_BUCKETS 8
+
+/** The time at which each button was pressed, while its coil has not
+yet turned on */
+static unsigned long sim_flipper_press_time[4];
+
+/** Nonzero if the button is pressed and the coil is not on yet */
+static int sim_flipper_pending[4];
+
+/** The latency histogram */
+static unsigned long sim_flipper_hist[SIM_FLIPPER_BUCKETS];
+
+static unsigned long sim_flipper_presses;
+static unsigned long sim_flipper_latency_sum;
+static unsigned long sim_flipper_latency_max;
+
+
+/** Called when a Fliptronic switch changes.  LEVEL is nonzero when the
+button is pressed, as the CPU reads it. */
+void sim_flipper_switch (int sw, int level)
+{
+	unsigned int n = (sw - SIM_FLIPPER_SWITCH) / 2;
+
+	if (!((sw - SIM_FLIPPER_SWITCH) & 1))
+		return;
+
+	if (level)
+	{
+		sim_flipper_press_time[n] = realtime_read ();
+		sim_flipper_pending[n] = 1;
+	}
+	else
+		sim_flipper_pending[n] = 0;
+}
+
+
+/** Called when a Fliptronic coil output changes.  The first of the power
+and hold coils to turn on after a press ends the measurement. */
+void sim_flipper_coil (unsigned int coil, unsigned int on)
+{
+	unsigned int n = (coil - SOL_BASE_FLIPTRONIC) / 2;
+	unsigned long latency;
+
+	if (!on || !sim_flipper_pending[n])
+		return;
+
+	sim_flipper_pending[n] = 0;
+	latency = realtime_read () - sim_flipper_press_time[n];
+	sim_flipper_presses++;
+	sim_flipper_latency_sum += latency;
+	if (latency > sim_flipper_latency_max)
+		sim_flipper_latency_max = latency;
+	if (latency >= SIM_FLIPPER_BUCKETS)
+		latency = SIM_FLIPPER_BUCKETS - 1;
+	sim_flipper_hist[latency]++;
+}
+
+
+/** Called when a flipper reaches the end of its stroke (ON nonzero), or
+falls back to rest.  POWER_SOL is its power coil. */
+void sim_flipper_eos (unsigned int power_sol, int on)
+{
+	int sw = SIM_FLIPPER_SWITCH + (power_sol - SOL_BASE_FLIPTRONIC);
+
+	if (!sim_switch_read (sw) != !on)
+		sim_switch_toggle (sw);
+}
+
+
+/** Print the latency histogram. */
+void sim_flipper_print_stats (void)
+{
+	unsigned int i;
+
+	if (sim_flipper_presses == 0)
+	{
+		simlog (SLC_DEBUG, "Flippers: no presses");
+		return;
+	}
+	simlog (SLC_DEBUG, "Flippers: %lu presses, latency mean %lu.%02lu max %lu IRQs",
+		sim_flipper_presses,
+		sim_flipper_latency_sum / sim_flipper_presses,
+		(sim_flipper_latency_sum * 100 / sim_flipper_presses) % 100,
+		sim_flipper_latency_max);
+	for (i = 0; i < SIM_FLIPPER_BUCKETS; i++)
+		simlog (SLC_DEBUG, "  %u%s: %lu", i,
+			(i == SIM_FLIPPER_BUCKETS - 1) ? "+" : "", sim_flipper_hist[i]);
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <freewpc.h>
+#include <simulation.h>
+#include <test.h>
+
+/**
+ * \file
+ * \brief Writes a record of every simulated game, for balancing.
+ *
+ * The audits in protected memory only give totals for one machine.
+ * With 'gamerec <file>' (or --gamerec), the simulator instead appends
+ * one record per player to the file at the end of each game:
+ *
+ *   players, player     the number of players, and which one this is
+ *   score               the final score
+ *   time, balls         seconds of play, and the number of balls played
+ *   ball_time           the mean and longest ball, in seconds
+ *   audit.<name>        how much each feature audit went up during this
+ *                       player's balls
+ *   mode.<gid>          how many times each timed mode was started
+ *
+ * Fields that are zero are left out, so a mode that was never reached
+ * costs nothing.  tools/gamestats merges the files from any number of
+ * simulators into percentile tables.
+ *
+ * Each record is written with a single write() to a file opened for
+ * appending, so many simulator processes can share one file.  The field
+ * names are written along with the first record from each process.
+ * Since each field always gets the same number in a given build, the
+ * name entries from different processes agree.
+ *
+ * The format, in little-endian byte order, is a sequence of entries:
+ *
+ *   'M' "FWGR" <version:1>               start of a process's output
+ *   'N' <id:2> <len:1> <name:len>        names field ID
+ *   'R' <count:2> { <id:2> <value:8> }   one record
+ */
+
+#define GAMEREC_VERSION 1
+
+/* Field IDs */
+#define GAMEREC_PLAYERS        1
+#define GAMEREC_PLAYER         2
+#define GAMEREC_SCORE          3
+#define GAMEREC_TIME           4
+#define GAMEREC_BALLS          5
+#define GAMEREC_BALL_TIME      6
+#define GAMEREC_MAX_BALL_TIME  7
+#define GAMEREC_AUDIT_BASE     16
+#define GAMEREC_MODE_BASE      512
+
+#define NUM_GAMEREC_AUDITS (sizeof (feature_audits_t) / sizeof (audit_t))
+
+/** What is known about each player in the current game */
+struct gamerec_player
+{
+	U32 time;
+	U16 balls;
+	U16 max_ball_time;
+	U32 audits[NUM_GAMEREC_AUDITS + 1];
+	U8 modes[256];
+};
+
+static struct gamerec_player gamerec_players[MAX_PLAYERS];
+
+/** The feature audits at the start of the current ball */
+static feature_audits_t gamerec_audit_snapshot;
+
+/** The record file, or -1 if records are not being written */
+static int gamerec_fd = -1;
+
+/** Nonzero once this process has written its header and names */
+static bool gamerec_started;
+
+/** The modes whose names have been written */
+static U8 gamerec_mode_named[256];
+
+/** The output buffer for one write() */
+static U8 gamerec_buf[16384];
+static unsigned int gamerec_len;
+
+
+static void gamerec_put (const void *data, unsigned int len)
+{
+	if (gamerec_len + len <= sizeof (gamerec_buf))
+		memcpy (gamerec_buf + gamerec_len, data, len);
+	gamerec_len += len;
+}
+
+static void gamerec_put16 (U16 val)
+{
+	U8 b[2] = { val, val >> 8 };
+	gamerec_put (b, 2);
+}
+
+static void gamerec_put64 (uint64_t val)
+{
+	U8 b[8];
+	unsigned int n;
+	for (n = 0; n < 8; n++)
+		b[n] = val >> (n * 8);
+	gamerec_put (b, 8);
+}
+
+
+static void gamerec_name (U16 id, const char *prefix, const char *name)
+{
+	char buf[128];
+	U8 len;
+
+	/* Audit names have spaces, which would make the tables hard to
+	parse */
+	snprintf (buf, sizeof (buf), "%s%s", prefix, name);
+	for (len = 0; buf[len]; len++)
+		if (buf[len] == ' ')
+			buf[len] = '_';
+	gamerec_put ("N", 1);
+	gamerec_put16 (id);
+	gamerec_put (&len, 1);
+	gamerec_put (buf, len);
+}
+
+
+/** Write the header and the names of the fixed fields. */
+static void gamerec_header (void)
+{
+#ifdef MACHINE_FEATURE_AUDITS
+	static const struct audit audit_info[] = { MACHINE_FEATURE_AUDITS };
+#endif
+	unsigned int n;
+
+	gamerec_put ("MFWGR", 5);
+	gamerec_put ((U8 []){ GAMEREC_VERSION }, 1);
+	gamerec_name (GAMEREC_PLAYERS, "", "players");
+	gamerec_name (GAMEREC_PLAYER, "", "player");
+	gamerec_name (GAMEREC_SCORE, "", "score");
+	gamerec_name (GAMEREC_TIME, "", "time");
+	gamerec_name (GAMEREC_BALLS, "", "balls");
+	gamerec_name (GAMEREC_BALL_TIME, "", "ball_time");
+	gamerec_name (GAMEREC_MAX_BALL_TIME, "", "max_ball_time");
+#ifdef MACHINE_FEATURE_AUDITS
+	for (n = 0; n < NUM_GAMEREC_AUDITS; n++)
+		gamerec_name (GAMEREC_AUDIT_BASE + n, "audit.", audit_info[n].name);
+#endif
+}
+
+
+static uint64_t gamerec_score (const U8 *score)
+{
+	uint64_t val = 0;
+	U8 n;
+
+	for (n = 0; n < BYTES_PER_SCORE; n++)
+		val = val * 100 + (score[n] >> 4) * 10 + (score[n] & 0x0F);
+	return val;
+}
+
+
+/** Write one player's record. */
+static void gamerec_write_player (U8 p)
+{
+	struct gamerec_player *pl = &gamerec_players[p];
+	U16 count = 0;
+	unsigned int n, start;
+
+	/* Name any modes that this process has not named yet */
+	for (n = 0; n < 256; n++)
+		if (pl->modes[n] && !gamerec_mode_named[n])
+		{
+			gamerec_mode_named[n] = 1;
+			gamerec_name (GAMEREC_MODE_BASE + n, "mode.", task_gid_name (n));
+		}
+
+	/* The record is built after the names, and its count is filled in
+	at the end */
+	start = gamerec_len;
+	gamerec_put ("R\0\0", 3);
+
+#define FIELD(id, val) \
+	do { if (val) { gamerec_put16 (id); gamerec_put64 (val); count++; } } while (0)
+
+	FIELD (GAMEREC_PLAYERS, num_players);
+	FIELD (GAMEREC_PLAYER, p + 1);
+	FIELD (GAMEREC_SCORE, gamerec_score (scores[p]));
+	FIELD (GAMEREC_TIME, pl->time);
+	FIELD (GAMEREC_BALLS, pl->balls);
+	if (pl->balls)
+		FIELD (GAMEREC_BALL_TIME, pl->time / pl->balls);
+	FIELD (GAMEREC_MAX_BALL_TIME, pl->max_ball_time);
+	for (n = 0; n < NUM_GAMEREC_AUDITS; n++)
+		FIELD (GAMEREC_AUDIT_BASE + n, pl->audits[n]);
+	for (n = 0; n < 256; n++)
+		FIELD (GAMEREC_MODE_BASE + n, pl->modes[n]);
+#undef FIELD
+
+	if (gamerec_len <= sizeof (gamerec_buf))
+	{
+		gamerec_buf[start + 1] = count;
+		gamerec_buf[start + 2] = count >> 8;
+	}
+}
+
+
+/** Start writing game records to a file. */
+void sim_gamerec_open (const char *filename)
+{
+	if (gamerec_fd >= 0)
+		close (gamerec_fd);
+	gamerec_fd = open (filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (gamerec_fd < 0)
+		simlog (SLC_DEBUG, "cannot open game records '%s'", filename);
+	gamerec_started = FALSE;
+	memset (gamerec_mode_named, 0, sizeof (gamerec_mode_named));
+}
+
+
+/** Called whenever a timed mode starts. */
+void sim_gamerec_mode (task_gid_t gid)
+{
+	if (in_game && player_up && gid < 256
+		&& gamerec_players[player_up - 1].modes[gid] < 0xFF)
+		gamerec_players[player_up - 1].modes[gid]++;
+}
+
+
+CALLSET_ENTRY (gamerec, start_game)
+{
+	memset (gamerec_players, 0, sizeof (gamerec_players));
+}
+
+
+CALLSET_ENTRY (gamerec, start_ball)
+{
+	memcpy (&gamerec_audit_snapshot, &feature_audits, sizeof (feature_audits_t));
+}
+
+
+CALLSET_ENTRY (gamerec, end_ball)
+{
+	extern U16 ball_time;
+	struct gamerec_player *pl;
+	const audit_t *now = (const audit_t *)&feature_audits;
+	const audit_t *then = (const audit_t *)&gamerec_audit_snapshot;
+	unsigned int n;
+
+	if (!player_up || player_up > MAX_PLAYERS)
+		return;
+	pl = &gamerec_players[player_up - 1];
+	pl->balls++;
+	pl->time += ball_time;
+	if (ball_time > pl->max_ball_time)
+		pl->max_ball_time = ball_time;
+	for (n = 0; n < NUM_GAMEREC_AUDITS; n++)
+		pl->audits[n] += (audit_t)(now[n] - then[n]);
+}
+
+
+CALLSET_ENTRY (gamerec, end_game)
+{
+	U8 named[sizeof (gamerec_mode_named)];
+	U8 p;
+
+	if (gamerec_fd < 0)
+		return;
+	memcpy (named, gamerec_mode_named, sizeof (named));
+	gamerec_len = 0;
+	if (!gamerec_started)
+		gamerec_header ();
+	for (p = 0; p < num_players; p++)
+		gamerec_write_player (p);
+	if (gamerec_len > sizeof (gamerec_buf)
+		|| write (gamerec_fd, gamerec_buf, gamerec_len) != gamerec_len)
+	{
+		/* The header and names did not reach the file either, so
+		write them again with the next game */
+		simlog (SLC_DEBUG, "game record not written");
+		memcpy (gamerec_mode_named, named, sizeof (named));
+		return;
+	}
+	gamerec_started = TRUE;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdarg.h>
+#include <unistd.h>
+#include <freewpc.h>
+#include <simulation.h>
+
+/**
+ * \file
+ * \brief Lets another program drive the simulator, one command at a time.
+ *
+ * With --instance <fd>, the simulator reads commands from the given file
+ * descriptor instead of the keyboard, and writes exactly one line back
+ * for each.  tools/simpool uses this to run many machines at once.
+ *
+ * With the green-thread task backend (CONFIG_GREEN), simulated time only
+ * passes during a command, and then as fast as the CPU allows.  The
+ * machine is frozen while the controlling program is busy, and the same
+ * commands always give the same results.  With the other backends the
+ * clock keeps running in real time.
+ *
+ * The commands are:
+ *
+ *   step <ms>      run for at least that long; replies "ok <time>"
+ *   lamps          replies with the lamp matrix, as hex bytes
+ *   score <n>      replies with player n's score, as BCD digits
+ *   game           replies "<in_game> <num_players> <player_up> <ball_up>"
+ *   errors         replies "<count> <last>" for nonfatal errors so far
+ *
+ * Anything else is run with exec_script(), and replies "ok"; so
+ * 'include <file>' loads a script, 'sw <name>' closes a switch, and
+ * 'exit' ends the simulation.  The line "ready" is written once the
+ * system is initialized and can take commands.
+ */
+
+/** The control channel, or -1 if not running as an instance */
+int sim_instance_fd = -1;
+
+#ifndef CONFIG_PTH
+static FILE *instance_in;
+#endif
+
+
+/** Read one command line into BUF.  Returns FALSE at end of input.
+
+With green threads this blocks the whole simulation until the next
+command, which is what keeps time from passing.  With GNU Pth, a plain
+read would also block every task, so the pipe is read with pth_read()
+and the clock keeps running, as it does under pthreads where only this
+thread waits. */
+static bool instance_getline (char *buf, int size)
+{
+#ifdef CONFIG_PTH
+	int len = 0;
+	char c;
+
+	while (len < size - 1)
+	{
+		if (pth_read (sim_instance_fd, &c, 1) <= 0)
+		{
+			if (len == 0)
+				return FALSE;
+			break;
+		}
+		buf[len++] = c;
+		if (c == '\n')
+			break;
+	}
+	buf[len] = '\0';
+	return TRUE;
+#else
+	return fgets (buf, size, instance_in) != NULL;
+#endif
+}
+
+
+/** Write one reply line to the controlling program. */
+static void instance_reply (const char *format, ...)
+{
+	va_list ap;
+	char buf[256];
+	int len;
+
+	va_start (ap, format);
+	len = vsnprintf (buf, sizeof (buf) - 1, format, ap);
+	va_end (ap);
+	if (len < 0 || len > sizeof (buf) - 2)
+		len = sizeof (buf) - 2;
+	buf[len++] = '\n';
+	if (write (sim_instance_fd, buf, len) != len)
+		sim_exit (0);
+}
+
+
+/** Let MS milliseconds of simulated time pass.  This overshoots to the
+next tick, since tasks only wake on a tick. */
+static void instance_step (unsigned long ms)
+{
+	unsigned long until = realtime_read () + ms;
+	while (realtime_read () < until)
+		task_sleep (TIME_16MS);
+	instance_reply ("ok %lu", realtime_read ());
+}
+
+
+static void instance_lamps (void)
+{
+	extern lamp_set lamp_matrix;
+	char buf[NUM_LAMP_COLS * 2 + 1];
+	U8 col;
+
+	for (col = 0; col < NUM_LAMP_COLS; col++)
+		snprintf (buf + col * 2, 3, "%02X", lamp_matrix[col]);
+	instance_reply ("%s", buf);
+}
+
+
+static void instance_score (unsigned int player)
+{
+	char buf[BYTES_PER_SCORE * 2 + 1];
+	U8 n;
+
+	if (player >= MAX_PLAYERS)
+	{
+		instance_reply ("error");
+		return;
+	}
+	for (n = 0; n < BYTES_PER_SCORE; n++)
+		snprintf (buf + n * 2, 3, "%02X", scores[player][n]);
+	instance_reply ("%s", buf);
+}
+
+
+static void instance_thread (void)
+{
+	char buf[256];
+	unsigned long arg;
+
+	while (!sys_init_complete)
+		task_sleep (TIME_100MS);
+	instance_reply ("ready");
+
+	for (;;)
+	{
+		if (!instance_getline (buf, sizeof (buf)))
+			sim_exit (0);
+
+		if (sscanf (buf, "step %lu", &arg) == 1)
+			instance_step (arg);
+		else if (!strncmp (buf, "lamps", 5))
+			instance_lamps ();
+		else if (sscanf (buf, "score %lu", &arg) == 1)
+			instance_score (arg);
+		else if (!strncmp (buf, "game", 4))
+			instance_reply ("%d %d %d %d",
+				in_game, num_players, player_up, ball_up);
+		else if (!strncmp (buf, "errors", 6))
+			instance_reply ("%u %d", sim_nonfatal_count, sim_last_nonfatal);
+		else
+		{
+			exec_script (buf);
+			instance_reply ("ok");
+		}
+	}
+}
+
+
+/** Start taking commands from the control channel.  This replaces the
+keyboard, and is called from sim_init(). */
+void sim_instance_init (void)
+{
+#ifndef CONFIG_PTH
+	instance_in = fdopen (sim_instance_fd, "r");
+	if (!instance_in)
+		sim_exit (1);
+#endif
+#ifdef CONFIG_GREEN
+	{
+		extern bool realtime_free_run;
+		realtime_free_run = TRUE;
+	}
+#endif
+	task_create_gid_while (GID_LINUX_INTERFACE, instance_thread,
+		TASK_DURATION_INF);
+}
@@ -173,6 +173,19 @@ void io_add_sol_bank (IOPTR addr, U8 solno)
 	io_add_wo (addr, io_write_sol, &sim_sols[solno / 8]);
 }
 
+/* Handle writes to a bank of solenoids that are driven active low.
+	Reads of the same address are given to READER, as on the Fliptronic
+	board, where it returns the flipper switches. */
+void io_write_sol_inverted (U8 *memp, unsigned int addr, U8 val)
+{
+	io_write_sol (memp, addr, ~val);
+}
+
+void io_add_sol_bank_inverted (IOPTR addr, U8 solno, io_reader reader)
+{
+	io_add (addr, 1, reader, io_write_sol_inverted, &sim_sols[solno / 8]);
+}
+
 void io_add_direct_switches (IOPTR addr, U8 switchno)
 {
 	io_add_ro (addr, io_mem_reader, sim_switch_matrix_get () + (switchno / 8));
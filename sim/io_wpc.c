@@ -258,6 +258,15 @@ void wpc_clock_writer (void *unused, unsigned int regno, U8 val)
 }
 
 
+#if (MACHINE_WPC95 == 0) && (MACHINE_FLIPTRONIC == 1)
+/** The Fliptronic port reads the flipper switches, active low */
+static U8 io_fliptronic_read (void *unused, unsigned int offset)
+{
+	return ~sim_switch_matrix_get ()[9];
+}
+#endif
+
+
 U8 wpc_timer_reader (void *unused, unsigned int reg)
 {
 	return 0;
@@ -361,9 +370,8 @@ void io_wpc_init (void)
 	io_add_sol_bank (WPC_SOL_GEN_OUTPUT, SOL_BASE_AUXILIARY);
 #if (MACHINE_WPC95 == 1)
 	io_add_sol_bank (WPC95_FLIPPER_COIL_OUTPUT, 32);
-#endif
-#if (MACHINE_FLIPTRONIC == 1)
-	io_add_sol_bank (WPC_FLIPTRONIC_PORT_A, 32);
+#elif (MACHINE_FLIPTRONIC == 1)
+	io_add_sol_bank_inverted (WPC_FLIPTRONIC_PORT_A, 32, io_fliptronic_read);
 #endif
 #ifdef MACHINE_SOL_EXTBOARD1
 	io_add_sol_bank (WPC_EXTBOARD1, SOL_BASE_EXTENDED);
@@ -114,7 +114,9 @@ void sim_key_install_shooter (char key)
 static char sim_getchar (void)
 {
 	char inbuf;
-#ifdef CONFIG_PTH
+#if defined(CONFIG_GREEN)
+	ssize_t res = green_read (sim_input_fd, &inbuf, 1);
+#elif defined(CONFIG_PTH)
 	ssize_t res = pth_read (sim_input_fd, &inbuf, 1);
 #else
 	ssize_t res = read (sim_input_fd, &inbuf, 1);
@@ -70,6 +70,19 @@ int exec_late_flag = 0;
 
 int crash_on_error = 0;
 
+/** If set, the trace ring is written to this file on exit */
+const char *trace_exit_file = NULL;
+
+#ifdef CONFIG_NATIVE_SAMPLER
+/** If set, the sampling profiler runs from startup, and its results
+are written to this file on exit */
+const char *sampler_exit_file = NULL;
+#endif
+
+/** The number of nonfatal errors taken, and the last one */
+unsigned int sim_nonfatal_count;
+U8 sim_last_nonfatal;
+
 
 /** Prints log messages, requested status, etc. to the console.
  * This is the only function that should use printf.
@@ -118,6 +131,18 @@ __noreturn__ void sim_exit (U8 error_code)
 {
 	simlog (SLC_DEBUG, "Shutting down simulation.");
 	protected_memory_save ();
+	if (trace_exit_file)
+		trace_dump (trace_exit_file);
+#ifdef CONFIG_NATIVE_SAMPLER
+	if (sampler_exit_file)
+		sampler_write (sampler_exit_file);
+#endif
+#if (MACHINE_DMD == 1)
+	asciidmd_exit ();
+#endif
+#ifdef CONFIG_SIM_AUDIO
+	sim_mixer_exit ();
+#endif
 	ui_exit ();
 	if (crash_on_error && error_code)
 		*(int *)0 = 1;
@@ -126,6 +151,16 @@ __noreturn__ void sim_exit (U8 error_code)
 
 
 
+/** Called on every nonfatal error, so that a program driving the
+simulation can see that one happened. */
+void sim_nonfatal (U8 error_code)
+{
+	sim_nonfatal_count++;
+	sim_last_nonfatal = error_code;
+	simlog (SLC_DEBUG, "Nonfatal error %d", error_code);
+}
+
+
 /**
  * Return the current wall clock time in minutes.
  */
@@ -145,8 +180,12 @@ sim_get_wall_clock (void)
  */
 void sim_init (void)
 {
-	/* Initialize the keyboard handler */
-	keyboard_init ();
+	/* Initialize the keyboard handler, or the control channel if
+	another program is driving the simulation */
+	if (sim_instance_fd >= 0)
+		sim_instance_init ();
+	else
+		keyboard_init ();
 
 	/* Initial the trough to contain all the balls.  By default,
 	 * it will fill the trough, based on its actual size.  You
@@ -166,6 +205,9 @@ int main (int argc, char *argv[])
 
 	/* Parse command-line arguments */
 	sim_output_stream = stdout;
+#ifdef CONFIG_FUZZ
+	sim_coverage_init ();
+#endif
 
 	while (argn < argc)
 	{
@@ -177,6 +219,16 @@ int main (int argc, char *argv[])
 			printf ("-o <file>           Log debug messages to file (default : stdout)\n");
 			printf ("--debuginit         Wait for GDB attach during init (default: no)\n");
 			printf ("--exec <file>       Read script commands from file\n");
+			printf ("--instance <fd>     Take commands from another program on fd\n");
+			printf ("--nvram <file>      Keep protected memory in file (default : nvram/<machine>.nv)\n");
+			printf ("--gamerec <file>    Append a record of each game to file\n");
+#ifdef CONFIG_SIM_AUDIO
+			printf ("--audio <file>      Write sound to a WAV file, or with '|cmd', to a command\n");
+			printf ("--sound-map <file>  Read the samples for each sound command from file\n");
+#endif
+#ifdef CONFIG_NATIVE_SAMPLER
+			printf ("--profile <file>    Sample the running tasks, and write folded stacks to file on exit\n");
+#endif
 			exit (0);
 		}
 		else if (!strcmp (arg, "-f"))
@@ -200,6 +252,37 @@ int main (int argc, char *argv[])
 		{
 			exec_file = argv[argn++];
 		}
+		else if (!strcmp (arg, "--instance"))
+		{
+			sim_instance_fd = strtoul (argv[argn++], NULL, 0);
+		}
+		else if (!strcmp (arg, "--nvram"))
+		{
+			extern char protected_memory_file[256];
+			extern char protected_memory_journal_file[256];
+			snprintf (protected_memory_file, 256, "%s", argv[argn]);
+			snprintf (protected_memory_journal_file, 256, "%s.jnl", argv[argn++]);
+		}
+#ifdef CONFIG_NATIVE_SAMPLER
+		else if (!strcmp (arg, "--profile"))
+		{
+			sampler_exit_file = argv[argn++];
+		}
+#endif
+		else if (!strcmp (arg, "--gamerec"))
+		{
+			sim_gamerec_open (argv[argn++]);
+		}
+#ifdef CONFIG_SIM_AUDIO
+		else if (!strcmp (arg, "--audio"))
+		{
+			sim_mixer_open (argv[argn++]);
+		}
+		else if (!strcmp (arg, "--sound-map"))
+		{
+			sim_mixer_load_map (argv[argn++]);
+		}
+#endif
 		else if (!strcmp (arg, "--late"))
 		{
 			exec_late_flag = 1;
@@ -227,6 +310,14 @@ int main (int argc, char *argv[])
 		}
 	}
 
+#ifdef CONFIG_NATIVE_SAMPLER
+	if (sampler_exit_file)
+		sampler_start ();
+#endif
+#ifdef CONFIG_SIM_AUDIO
+	sim_mixer_init ();
+#endif
+
 	/* Initialize the user interface.  GTK gets initialized
 	separately as it wants to see argc/argv. */
 #ifdef CONFIG_GTK
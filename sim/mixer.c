@@ -0,0 +1,740 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <freewpc.h>
+#include <simulation.h>
+
+/**
+ * \file
+ * \brief A software sound board for the simulator.
+ *
+ * The sound board commands decoded in sim/sound.c are played from
+ * sample files instead of only being logged.  A sound map names the
+ * sample for each command, one per line:
+ *
+ *   # code   file              channel  prio  volume
+ *   0x02     music/main.wav    music    0     100
+ *   0x7A0F   sfx/slam.wav      effect   20    80
+ *   0x7A40   speech/jackpot.wav speech  40
+ *
+ * Files are WAV, 8 or 16 bits, mono or stereo, at any rate; relative
+ * names are taken from the directory of the map.  Commands that are not
+ * in the map play a short tone, so that a game can be heard without any
+ * samples at all.
+ *
+ * There are SIM_MIXER_VOICES voices.  Music has a voice of its own and
+ * loops until it is replaced or stopped, and so does speech.  Effects
+ * take a free voice, or else the one with the lowest priority, if it is
+ * no higher than theirs; otherwise they are not played.
+ *
+ * Mixing is done in a thread of its own, which writes a block of
+ * samples every SIM_MIXER_BLOCK frames of real time, either to a WAV
+ * file or to a command such as 'aplay'.  The simulator hands it commands
+ * through a fixed-size ring that takes no locks, so writing to the sound
+ * board never waits for the mixer.  The ring has one writer, the sound
+ * board write in sim/sound.c, and one reader, the mixer.  The 'audio
+ * volume' script command runs in another thread, so it does not use the
+ * ring; it stores the new channel volume where the mixer reads it.
+ *
+ * While the ring is half full, the board reports that it is busy, and
+ * the CPU holds back its commands; see sound_read_rtt().
+ *
+ * The mixer counts how long commands wait before they are mixed, how
+ * long each block takes to mix, and underruns, where a block was mixed
+ * too late to be played on time.  These are printed at exit, or by the
+ * script command 'audio stats'.
+ */
+
+/** The output format: mono, signed 16-bit */
+#define SIM_MIXER_RATE 22050
+
+/** The number of frames mixed at a time, about 11.6ms */
+#define SIM_MIXER_BLOCK 256
+
+#define SIM_MIXER_VOICES 8
+
+/** The number of commands that can be waiting for the mixer.  This must
+be a power of 2. */
+#define SIM_MIXER_QUEUE_LEN 64
+
+/** The longest line that is read from the sound map */
+#define SIM_MIXER_LINE 512
+
+/** Channels, which decide how voices are allocated */
+#define MIXER_MUSIC   0
+#define MIXER_SPEECH  1
+#define MIXER_EFFECT  2
+#define MIXER_CHANNELS 3
+
+/** Commands passed to the mixer */
+#define MIXER_OP_PLAY         0
+#define MIXER_OP_STOP_MUSIC   1
+#define MIXER_OP_STOP_SOUND   2
+#define MIXER_OP_VOLUME       3
+
+/** The length of the tone played for commands with no sample */
+#define MIXER_TONE_FRAMES (SIM_MIXER_RATE / 12)
+
+struct mixer_sound
+{
+	U16 code;
+	U8 channel;
+	U8 prio;
+	/** The volume, out of 256 */
+	U16 gain;
+	/** The samples, at their own rate */
+	int16_t *data;
+	U32 frames;
+	/** The amount to step through the data per output frame, in 1/65536
+	of a frame */
+	U32 step;
+};
+
+struct mixer_voice
+{
+	const struct mixer_sound *sound;
+	U8 channel;
+	U8 prio;
+	/** The position in the data, in 1/65536 of a frame */
+	uint64_t pos;
+	/** For a tone, the frames left and the half-period in frames */
+	U32 tone_left;
+	U16 tone_half;
+};
+
+struct mixer_cmd
+{
+	U8 op;
+	U8 arg;
+	U16 code;
+	const struct mixer_sound *sound;
+	uint64_t when;
+};
+
+/** The sound map, sorted by code */
+static struct mixer_sound *mixer_sounds;
+static unsigned int mixer_sound_count;
+
+/** The command ring.  head is only written by the simulator, and tail
+only by the mixer. */
+static struct mixer_cmd mixer_queue[SIM_MIXER_QUEUE_LEN];
+static unsigned int mixer_queue_head;
+static unsigned int mixer_queue_tail;
+
+/** The volume of each channel, out of 256.  These are written directly
+by sim_mixer_channel_volume(), and read by the mixer. */
+static U16 mixer_channel_gain[MIXER_CHANNELS] = { 256, 256, 256 };
+
+/* The state below is only used by the mixer thread */
+static struct mixer_voice mixer_voices[SIM_MIXER_VOICES];
+static U16 mixer_master_gain = 256;
+
+static const char *mixer_target;
+static FILE *mixer_out;
+static int mixer_out_is_pipe;
+static U32 mixer_out_frames;
+
+static pthread_t mixer_thread;
+static volatile int mixer_running;
+
+struct sim_mixer_stats sim_mixer_stats;
+
+
+static uint64_t mixer_now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static U16 get16 (const U8 *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static U32 get32 (const U8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((U32)p[3] << 24);
+}
+
+
+/** Load a WAV file into a sound, as mono 16-bit samples.  Returns -1 if
+it cannot be read. */
+static int mixer_load_wav (struct mixer_sound *snd, const char *filename)
+{
+	FILE *fp;
+	U8 hdr[12], chunk[8], fmt[16];
+	U8 *raw = NULL;
+	U32 len, rate = 0, n;
+	U16 channels = 0, bits = 0, frame_bytes;
+
+	fp = fopen (filename, "rb");
+	if (!fp)
+		return -1;
+	if (fread (hdr, 12, 1, fp) != 1
+		|| memcmp (hdr, "RIFF", 4) || memcmp (hdr + 8, "WAVE", 4))
+		goto fail;
+
+	while (fread (chunk, 8, 1, fp) == 1)
+	{
+		len = get32 (chunk + 4);
+		if (!memcmp (chunk, "fmt ", 4) && len >= 16)
+		{
+			if (fread (fmt, 16, 1, fp) != 1)
+				goto fail;
+			if (get16 (fmt) != 1)
+				goto fail;
+			channels = get16 (fmt + 2);
+			rate = get32 (fmt + 4);
+			bits = get16 (fmt + 14);
+			fseek (fp, (len - 16 + 1) & ~1, SEEK_CUR);
+		}
+		else if (!memcmp (chunk, "data", 4) && channels)
+		{
+			raw = malloc (len);
+			if (!raw || fread (raw, 1, len, fp) != len)
+				goto fail;
+			break;
+		}
+		else
+			fseek (fp, (len + 1) & ~1, SEEK_CUR);
+	}
+	if (!raw || !rate || (bits != 8 && bits != 16) || channels < 1)
+		goto fail;
+
+	/* Keep only the first channel */
+	frame_bytes = channels * bits / 8;
+	snd->frames = len / frame_bytes;
+	snd->data = malloc (snd->frames * sizeof (int16_t));
+	for (n = 0; n < snd->frames; n++)
+	{
+		const U8 *p = raw + n * frame_bytes;
+		snd->data[n] = (bits == 8) ? (p[0] - 128) * 256 : (int16_t)get16 (p);
+	}
+	snd->step = ((uint64_t)rate << 16) / SIM_MIXER_RATE;
+	free (raw);
+	fclose (fp);
+	return 0;
+
+fail:
+	free (raw);
+	fclose (fp);
+	return -1;
+}
+
+
+static int mixer_sound_compare (const void *a, const void *b)
+{
+	return ((const struct mixer_sound *)a)->code
+		- ((const struct mixer_sound *)b)->code;
+}
+
+
+/**
+ * Read a sound map.  This must be done before the mixer starts, as the
+ * map is not locked.
+ */
+void sim_mixer_load_map (const char *filename)
+{
+	char line[SIM_MIXER_LINE], path[SIM_MIXER_LINE], name[SIM_MIXER_LINE];
+	char chname[16];
+	unsigned int prio, volume, max = 0, lineno = 0, dirlen;
+	struct mixer_sound *snd;
+	const char *slash;
+	FILE *fp;
+	int code, fields;
+
+	if (mixer_running)
+		return;
+	fp = fopen (filename, "r");
+	if (!fp)
+	{
+		simlog (SLC_DEBUG, "cannot open sound map '%s'", filename);
+		return;
+	}
+	slash = strrchr (filename, '/');
+	dirlen = slash ? slash - filename + 1 : 0;
+
+	while (fgets (line, sizeof (line), fp))
+	{
+		lineno++;
+		prio = 0;
+		volume = 100;
+		strcpy (chname, "effect");
+		fields = sscanf (line, "%i %511s %15s %u %u",
+			&code, name, chname, &prio, &volume);
+		if (fields < 2 || line[0] == '#')
+			continue;
+
+		if (mixer_sound_count == max)
+		{
+			max = max ? max * 2 : 64;
+			mixer_sounds = realloc (mixer_sounds, max * sizeof (struct mixer_sound));
+		}
+		snd = &mixer_sounds[mixer_sound_count];
+		memset (snd, 0, sizeof (*snd));
+		snd->code = code;
+		snd->prio = prio;
+		snd->gain = volume * 256 / 100;
+		if (!strcmp (chname, "music"))
+			snd->channel = MIXER_MUSIC;
+		else if (!strcmp (chname, "speech"))
+			snd->channel = MIXER_SPEECH;
+		else
+			snd->channel = MIXER_EFFECT;
+
+		if (name[0] == '/')
+			snprintf (path, sizeof (path), "%s", name);
+		else
+			snprintf (path, sizeof (path), "%.*s%s", dirlen, filename, name);
+		if (mixer_load_wav (snd, path) < 0)
+		{
+			simlog (SLC_DEBUG, "%s:%u: cannot load '%s'", filename, lineno, path);
+			continue;
+		}
+		mixer_sound_count++;
+	}
+	fclose (fp);
+
+	qsort (mixer_sounds, mixer_sound_count, sizeof (struct mixer_sound),
+		mixer_sound_compare);
+	simlog (SLC_DEBUG, "%u sounds in '%s'", mixer_sound_count, filename);
+}
+
+
+static const struct mixer_sound *mixer_lookup (U16 code)
+{
+	unsigned int lo = 0, hi = mixer_sound_count;
+
+	while (lo < hi)
+	{
+		unsigned int mid = (lo + hi) / 2;
+		if (mixer_sounds[mid].code == code)
+			return &mixer_sounds[mid];
+		else if (mixer_sounds[mid].code < code)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+
+/** Queue a command for the mixer.  This never waits for the mixer; if
+it has fallen so far behind that the ring is full, the command is
+dropped. */
+static void mixer_queue_insert (U8 op, U8 arg, U16 code)
+{
+	unsigned int head = mixer_queue_head;
+	struct mixer_cmd *cmd;
+
+	if (!mixer_running)
+		return;
+	if (head - rt_load (mixer_queue_tail) >= SIM_MIXER_QUEUE_LEN)
+	{
+		sim_mixer_stats.dropped++;
+		return;
+	}
+	cmd = &mixer_queue[head % SIM_MIXER_QUEUE_LEN];
+	cmd->op = op;
+	cmd->arg = arg;
+	cmd->code = code;
+	cmd->sound = (op == MIXER_OP_PLAY) ? mixer_lookup (code) : NULL;
+	cmd->when = mixer_now ();
+	rt_store (mixer_queue_head, head + 1);
+}
+
+
+/** Returns true if the mixer has fallen behind, so that the CPU should
+wait before sending more. */
+bool sim_mixer_busy (void)
+{
+	return mixer_running
+		&& rt_load (mixer_queue_head) - rt_load (mixer_queue_tail)
+			>= SIM_MIXER_QUEUE_LEN / 2;
+}
+
+
+/** Play a sound board command. */
+void sim_mixer_command (U16 code)
+{
+	mixer_queue_insert (MIXER_OP_PLAY, 0, code);
+}
+
+
+/** Stop the music. */
+void sim_mixer_stop_music (void)
+{
+	mixer_queue_insert (MIXER_OP_STOP_MUSIC, 0, 0);
+}
+
+
+/** Stop everything except the music. */
+void sim_mixer_stop_sound (void)
+{
+	mixer_queue_insert (MIXER_OP_STOP_SOUND, 0, 0);
+}
+
+
+/** Set the master volume, from 0 to 255. */
+void sim_mixer_volume (U8 vol)
+{
+	mixer_queue_insert (MIXER_OP_VOLUME, vol, 0);
+}
+
+
+/** Set the volume of one channel, as a percentage.  This comes from a
+script, not the sound board, so it does not go through the ring. */
+void sim_mixer_channel_volume (const char *channel, U8 percent)
+{
+	U16 chid;
+
+	if (!strcmp (channel, "music"))
+		chid = MIXER_MUSIC;
+	else if (!strcmp (channel, "speech"))
+		chid = MIXER_SPEECH;
+	else if (!strcmp (channel, "effect"))
+		chid = MIXER_EFFECT;
+	else
+		return;
+	rt_store (mixer_channel_gain[chid], percent * 256 / 100);
+}
+
+
+/** Find the voice for a new sound, or return NULL if it should not be
+played. */
+static struct mixer_voice *mixer_voice_alloc (U8 channel, U8 prio)
+{
+	struct mixer_voice *v, *best = NULL;
+
+	if (channel == MIXER_MUSIC)
+		return &mixer_voices[0];
+	if (channel == MIXER_SPEECH)
+	{
+		v = &mixer_voices[1];
+		if (v->sound && prio < v->prio)
+			return NULL;
+		return v;
+	}
+
+	for (v = &mixer_voices[2]; v < &mixer_voices[SIM_MIXER_VOICES]; v++)
+	{
+		if (!v->sound && !v->tone_left)
+			return v;
+		if (v->prio <= prio && (!best || v->prio < best->prio))
+			best = v;
+	}
+	if (best)
+		sim_mixer_stats.stolen++;
+	return best;
+}
+
+
+static void mixer_play (const struct mixer_cmd *cmd)
+{
+	const struct mixer_sound *snd = cmd->sound;
+	struct mixer_voice *v;
+
+	if (snd)
+	{
+		v = mixer_voice_alloc (snd->channel, snd->prio);
+		if (!v)
+		{
+			sim_mixer_stats.refused++;
+			return;
+		}
+		v->sound = snd;
+		v->channel = snd->channel;
+		v->prio = snd->prio;
+		v->pos = 0;
+		v->tone_left = 0;
+	}
+	else
+	{
+		/* Give each command a pitch of its own, between 220 and 1100Hz */
+		sim_mixer_stats.unmapped++;
+		v = mixer_voice_alloc (MIXER_EFFECT, 0);
+		if (!v)
+		{
+			sim_mixer_stats.refused++;
+			return;
+		}
+		v->sound = NULL;
+		v->channel = MIXER_EFFECT;
+		v->prio = 0;
+		v->tone_left = MIXER_TONE_FRAMES;
+		v->tone_half = SIM_MIXER_RATE / 2 / (220 + (cmd->code * 37) % 880);
+	}
+}
+
+
+static void mixer_stop_channel (U8 channel)
+{
+	struct mixer_voice *v;
+
+	for (v = mixer_voices; v < &mixer_voices[SIM_MIXER_VOICES]; v++)
+		if ((channel == MIXER_MUSIC) == (v->channel == MIXER_MUSIC))
+		{
+			v->sound = NULL;
+			v->tone_left = 0;
+		}
+}
+
+
+/** Carry out all of the commands that are waiting. */
+static void mixer_queue_drain (uint64_t now)
+{
+	unsigned int tail = mixer_queue_tail;
+	const struct mixer_cmd *cmd;
+	uint64_t latency;
+
+	while (tail != rt_load (mixer_queue_head))
+	{
+		cmd = &mixer_queue[tail % SIM_MIXER_QUEUE_LEN];
+		switch (cmd->op)
+		{
+			case MIXER_OP_PLAY:
+				mixer_play (cmd);
+				break;
+			case MIXER_OP_STOP_MUSIC:
+				mixer_stop_channel (MIXER_MUSIC);
+				break;
+			case MIXER_OP_STOP_SOUND:
+				mixer_stop_channel (MIXER_EFFECT);
+				break;
+			case MIXER_OP_VOLUME:
+				mixer_master_gain = cmd->arg + 1;
+				break;
+		}
+
+		latency = (now > cmd->when) ? (now - cmd->when) / 1000 : 0;
+		sim_mixer_stats.commands++;
+		sim_mixer_stats.latency_sum_us += latency;
+		if (latency > sim_mixer_stats.latency_max_us)
+			sim_mixer_stats.latency_max_us = latency;
+
+		tail++;
+		rt_store (mixer_queue_tail, tail);
+	}
+}
+
+
+/** Mix one block of every voice that is playing. */
+static void mixer_mix (int16_t *out)
+{
+	int32_t acc[SIM_MIXER_BLOCK];
+	struct mixer_voice *v;
+	unsigned int n;
+
+	memset (acc, 0, sizeof (acc));
+	for (v = mixer_voices; v < &mixer_voices[SIM_MIXER_VOICES]; v++)
+	{
+		const struct mixer_sound *snd = v->sound;
+
+		if (snd)
+		{
+			int32_t gain = (snd->gain * rt_load (mixer_channel_gain[v->channel])) >> 8;
+			for (n = 0; n < SIM_MIXER_BLOCK; n++)
+			{
+				U32 frame = v->pos >> 16;
+				if (frame >= snd->frames)
+				{
+					if (v->channel != MIXER_MUSIC || !snd->frames)
+					{
+						v->sound = NULL;
+						break;
+					}
+					v->pos = 0;
+					frame = 0;
+				}
+				acc[n] += (snd->data[frame] * gain) >> 8;
+				v->pos += snd->step;
+			}
+		}
+		else if (v->tone_left)
+		{
+			int32_t level = rt_load (mixer_channel_gain[MIXER_EFFECT]) * 16;
+			for (n = 0; n < SIM_MIXER_BLOCK && v->tone_left; n++, v->tone_left--)
+				acc[n] += ((v->tone_left / v->tone_half) & 1) ? level : -level;
+		}
+	}
+
+	for (n = 0; n < SIM_MIXER_BLOCK; n++)
+	{
+		int32_t val = (acc[n] * mixer_master_gain) >> 8;
+		if (val > 32767)
+			val = 32767;
+		else if (val < -32768)
+			val = -32768;
+		out[n] = val;
+	}
+}
+
+
+static void mixer_write_header (U32 frames)
+{
+	U8 hdr[44];
+	U32 bytes = frames * 2;
+
+	memcpy (hdr, "RIFF", 4);
+	hdr[4] = (bytes + 36); hdr[5] = (bytes + 36) >> 8;
+	hdr[6] = (bytes + 36) >> 16; hdr[7] = (bytes + 36) >> 24;
+	memcpy (hdr + 8, "WAVEfmt ", 8);
+	memcpy (hdr + 16, (U8 []){ 16, 0, 0, 0, 1, 0, 1, 0 }, 8);
+	hdr[24] = SIM_MIXER_RATE & 0xFF; hdr[25] = SIM_MIXER_RATE >> 8;
+	hdr[26] = hdr[27] = 0;
+	hdr[28] = (SIM_MIXER_RATE * 2) & 0xFF; hdr[29] = (SIM_MIXER_RATE * 2) >> 8;
+	hdr[30] = (SIM_MIXER_RATE * 2) >> 16; hdr[31] = 0;
+	memcpy (hdr + 32, (U8 []){ 2, 0, 16, 0 }, 4);
+	memcpy (hdr + 36, "data", 4);
+	hdr[40] = bytes; hdr[41] = bytes >> 8;
+	hdr[42] = bytes >> 16; hdr[43] = bytes >> 24;
+	fwrite (hdr, sizeof (hdr), 1, mixer_out);
+}
+
+
+/** The mixer thread.  It mixes a block, writes it out, and then waits
+until the block would have finished playing. */
+static void *mixer_thread_main (void *arg)
+{
+	int16_t out[SIM_MIXER_BLOCK];
+	const uint64_t period = SIM_MIXER_BLOCK * 1000000000ULL / SIM_MIXER_RATE;
+	uint64_t next, start, now, took;
+	struct timespec ts;
+
+	next = mixer_now ();
+	while (mixer_running)
+	{
+		start = mixer_now ();
+		mixer_queue_drain (start);
+		mixer_mix (out);
+		took = (mixer_now () - start) / 1000;
+		if (took > sim_mixer_stats.mix_max_us)
+			sim_mixer_stats.mix_max_us = took;
+
+		if (fwrite (out, sizeof (out), 1, mixer_out) != 1)
+			break;
+		mixer_out_frames += SIM_MIXER_BLOCK;
+		sim_mixer_stats.blocks++;
+
+		/* If the next block is already overdue, the output has gone
+		quiet for a moment.  Start counting from now, rather than
+		mixing a burst of blocks to catch up. */
+		next += period;
+		now = mixer_now ();
+		if (now > next + period)
+		{
+			sim_mixer_stats.underruns++;
+			next = now;
+			continue;
+		}
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+	return NULL;
+}
+
+
+/** Say where the mixed audio goes: a WAV file, or with a leading '|', a
+command that reads raw samples on its input. */
+void sim_mixer_open (const char *target)
+{
+	mixer_target = target;
+}
+
+
+/** Start the mixer, if an output was given. */
+void sim_mixer_init (void)
+{
+	sigset_t all, old;
+
+	if (!mixer_target)
+		return;
+	if (mixer_target[0] == '|')
+	{
+		mixer_out = popen (mixer_target + 1, "w");
+		mixer_out_is_pipe = 1;
+	}
+	else
+	{
+		mixer_out = fopen (mixer_target, "wb");
+		if (mixer_out)
+			mixer_write_header (0);
+	}
+	if (!mixer_out)
+	{
+		simlog (SLC_DEBUG, "cannot open audio output '%s'", mixer_target);
+		return;
+	}
+
+	/* Signals, such as the profiler's, belong to the simulation; the
+	mixer thread never takes them. */
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &old);
+	mixer_running = 1;
+	if (pthread_create (&mixer_thread, NULL, mixer_thread_main, NULL))
+		mixer_running = 0;
+	pthread_sigmask (SIG_SETMASK, &old, NULL);
+	simlog (SLC_DEBUG, "Audio: %d Hz to '%s'", SIM_MIXER_RATE, mixer_target);
+}
+
+
+/** Print the mixer's counters. */
+void sim_mixer_print_stats (void)
+{
+	const struct sim_mixer_stats *s = &sim_mixer_stats;
+
+	simlog (SLC_DEBUG, "Audio: %lu blocks, %lu underruns, mix max %luus",
+		s->blocks, s->underruns, s->mix_max_us);
+	simlog (SLC_DEBUG,
+		"Audio: %lu commands, latency mean %luus max %luus, %lu dropped",
+		s->commands,
+		s->commands ? (unsigned long)(s->latency_sum_us / s->commands) : 0,
+		(unsigned long)s->latency_max_us, s->dropped);
+	simlog (SLC_DEBUG, "Audio: %lu without samples, %lu stolen, %lu refused",
+		s->unmapped, s->stolen, s->refused);
+}
+
+
+/** Stop the mixer and close the output. */
+void sim_mixer_exit (void)
+{
+	if (!mixer_running)
+		return;
+	mixer_running = 0;
+	pthread_join (mixer_thread, NULL);
+	sim_mixer_print_stats ();
+
+	if (mixer_out_is_pipe)
+		pclose (mixer_out);
+	else
+	{
+		/* Now that the length is known, fix up the header */
+		rewind (mixer_out);
+		mixer_write_header (mixer_out_frames);
+		fclose (mixer_out);
+	}
+}
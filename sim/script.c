@@ -131,6 +131,21 @@ uint32_t tconst (void)
 }
 
 
+/**
+ * Sleep for MS milliseconds of simulated time.
+ *
+ * This checks the clock rather than counting sleeps, since a sleep of
+ * one tick can last up to two under the 6809-style scheduler.
+ */
+static void script_sleep (uint32_t ms)
+{
+	unsigned long until = realtime_read () + ms;
+	do {
+		task_sleep (TIME_16MS);
+	} while (realtime_read () < until);
+}
+
+
 /**
  * Read the next token, which must be a signal name.
  * Currently, this must be the last token in the command.
@@ -361,17 +376,287 @@ void exec_script (char *cmd)
 		v = tconst ();
 		conf_pop (v);
 	}
+	/*********** seed [value] ***************/
+	else if (teq (t, "seed"))
+	{
+		extern U16 random_cong_seed;
+		random_cong_seed = tconst ();
+	}
+	/*********** gamerec [filename] ***************/
+	else if (teq (t, "gamerec"))
+	{
+		t = tnext ();
+		if (t)
+			sim_gamerec_open (t);
+	}
 	/*********** sleep [time] ***************/
 	else if (teq (t, "sleep"))
 	{
 		v = tconst ();
 		simlog (SLC_DEBUG, "Sleeping for %d ms", v);
-		v /= IRQS_PER_TICK;
-		do {
-			task_sleep (TIME_16MS);
-		} while (--v > 0);
+		script_sleep (v);
 		simlog (SLC_DEBUG, "Awake again.", v);
 	}
+#if (MACHINE_DMD == 1)
+	/*********** dmdrec [file|stop] ***************/
+	else if (teq (t, "dmdrec"))
+	{
+		t = tnext ();
+		if (!t || teq (t, "stop"))
+			dmdrec_stop ();
+		else
+			dmdrec_start (t);
+	}
+	/*********** deff [id|all] [time] ***************/
+	else if (teq (t, "deff"))
+	{
+		uint32_t first, last;
+
+		t = tnext ();
+		if (!t)
+			return;
+		if (teq (t, "all"))
+		{
+			first = 1;
+			last = MAX_DEFFS - 1;
+		}
+		else
+		{
+			tunget (t);
+			first = last = tconst ();
+		}
+		v = tconst ();
+		for (; first <= last; first++)
+		{
+			simlog (SLC_DEBUG, "Showing deff %d", first);
+			dmdrec_mark (first);
+			deff_start (first);
+			script_sleep (v);
+			deff_stop (first);
+		}
+	}
+#endif
+	/*********** leff <id> ***************/
+	else if (teq (t, "leff"))
+	{
+		leff_start (tconst ());
+	}
+	/*********** lamp [level|fade|release] <lamp> [level] [rate] ******/
+	else if (teq (t, "lamp"))
+	{
+		uint32_t level;
+
+		t = tnext ();
+		if (!t)
+			return;
+		v = tconst ();
+		if (teq (t, "level"))
+			lamp_pwm_set (v, tconst ());
+		else if (teq (t, "fade"))
+		{
+			level = tconst ();
+			lamp_fade (v, level, tconst ());
+		}
+		else if (teq (t, "release"))
+			lamp_pwm_release (v);
+	}
+	/*********** flash <sol> [intensity] ***************/
+	else if (teq (t, "flash"))
+	{
+		v = tconst ();
+		t = tnext ();
+		if (t)
+		{
+			tunget (t);
+			flasher_pulse_intensity (v, tconst ());
+		}
+		else
+			flasher_pulse (v);
+	}
+#if (MACHINE_FLIPTRONIC == 1)
+	/*********** flipper stats ***************/
+	else if (teq (t, "flipper"))
+	{
+		t = tnext ();
+		if (t && teq (t, "stats"))
+			sim_flipper_print_stats ();
+	}
+#endif
+	/*********** task stats ***************/
+	else if (teq (t, "task"))
+	{
+		extern U8 task_count, task_max_count;
+		t = tnext ();
+		if (t && teq (t, "stats"))
+			simlog (SLC_DEBUG, "Tasks: %d running, %d max", task_count, task_max_count);
+	}
+#ifdef MACHINE_SHOOTER_SWITCH
+	/*********** plunge ***************/
+	else if (teq (t, "plunge"))
+	{
+		node_kick (&shooter_node);
+	}
+#endif
+	/*********** stuck <sw> <sol> ***************/
+	else if (teq (t, "stuck"))
+	{
+		v = tsw ();
+		sim_stuck_ball (v, tconst ());
+	}
+	/*********** search stats ***************/
+	else if (teq (t, "search"))
+	{
+		t = tnext ();
+		if (t && teq (t, "stats"))
+			simlog (SLC_DEBUG, "Ball search: %d recovered, avg %d max %d secs, %d learned",
+				system_audits.search_recoveries,
+				system_audits.search_recovery_avg,
+				system_audits.search_recovery_max,
+				system_audits.search_learned);
+	}
+	/*********** device [kick|empty|ball] <devno> | device stats ******/
+	else if (teq (t, "device"))
+	{
+		t = tnext ();
+		if (!t)
+			return;
+		if (teq (t, "stats"))
+		{
+			for (v = 0; v < NUM_DEVICES; v++)
+				simlog (SLC_DEBUG, "%s: %d kicks, avg %d max %d ms",
+					device_table[v].props->name,
+					system_audits.device_kicks[v],
+					system_audits.device_kick_avg[v],
+					system_audits.device_kick_max[v]);
+			return;
+		}
+		v = tconst ();
+		if (v >= NUM_DEVICES)
+			return;
+		if (teq (t, "kick"))
+			device_request_kick (device_entry (v));
+		else if (teq (t, "empty"))
+			device_request_empty (device_entry (v));
+#ifdef DEVNO_TROUGH
+		else if (teq (t, "ball"))
+			node_move (&device_nodes[v], &trough_node);
+#endif
+	}
+#ifdef CONFIG_TRIAC
+	/*********** gi [level|fade] <strings> <level> [rate] ******/
+	else if (teq (t, "gi"))
+	{
+		uint32_t level;
+
+		t = tnext ();
+		if (!t)
+			return;
+		v = tconst ();
+		level = tconst ();
+		if (teq (t, "level"))
+			gi_dim (v, level);
+		else if (teq (t, "fade"))
+			gi_fade (v, level, tconst ());
+	}
+#endif
+#ifdef CONFIG_TRACE
+	/*********** trace [mask|dump|file] [args...] ***************/
+	else if (teq (t, "trace"))
+	{
+		t = tnext ();
+		if (teq (t, "mask"))
+		{
+			trace_module_mask = tconst ();
+		}
+		else if (teq (t, "dump"))
+		{
+			t = tnext ();
+			trace_dump (t ? t : "trace.bin");
+		}
+		else if (teq (t, "file"))
+		{
+			t = tnext ();
+			trace_exit_file = t ? strdup (t) : NULL;
+		}
+	}
+#endif
+#ifdef CONFIG_NATIVE_SAMPLER
+	/*********** profile [start|stop|reset|write] [args...] ***************/
+	else if (teq (t, "profile"))
+	{
+		t = tnext ();
+		if (!t)
+			return;
+		if (teq (t, "start"))
+			sampler_start ();
+		else if (teq (t, "stop"))
+			sampler_stop ();
+		else if (teq (t, "reset"))
+			sampler_reset ();
+		else if (teq (t, "write"))
+		{
+			t = tnext ();
+			sampler_write (t ? t : "profile.folded");
+		}
+	}
+#endif
+	/*********** sound [stats|stress] [args...] ***************/
+	else if (teq (t, "sound"))
+	{
+		t = tnext ();
+		if (!t)
+			return;
+		if (teq (t, "stress"))
+		{
+			/* Make RATE calls per second for SECS seconds, in bursts
+			every 50ms.  Calls are drawn from a small set, so that
+			some repeat, and one in 16 is an important one. */
+			uint32_t rate = tconst ();
+			uint32_t ticks = tconst () * 20;
+			uint32_t n;
+
+			while (ticks-- > 0)
+			{
+				for (n = 0; n < rate / 20; n++)
+				{
+					if ((rand () % 16) == 0)
+						sound_write_prio (0x140 + rand () % 8, PRI_JACKPOT);
+					else
+						sound_write_prio (0x100 + rand () % 24, rand () % 4);
+				}
+				script_sleep (50);
+			}
+			t = "stats";
+		}
+		if (teq (t, "stats"))
+		{
+			simlog (SLC_DEBUG, "Sound: %u sent, %u coalesced, %u dropped, %u held, %u deep",
+				sound_queue_stats.sent, sound_queue_stats.coalesced,
+				sound_queue_stats.dropped, sound_queue_stats.held,
+				sound_queue_stats.max_depth);
+		}
+	}
+#ifdef CONFIG_SIM_AUDIO
+	/*********** audio [stats|volume] [args...] ***************/
+	else if (teq (t, "audio"))
+	{
+		t = tnext ();
+		if (!t)
+			return;
+		if (teq (t, "stats"))
+			sim_mixer_print_stats ();
+		else if (teq (t, "volume"))
+		{
+			t = tnext ();
+			if (t)
+			{
+				char channel[16];
+				snprintf (channel, sizeof (channel), "%s", t);
+				sim_mixer_channel_volume (channel, tconst ());
+			}
+		}
+	}
+#endif
 	/*********** exit ***************/
 	else if (teq (t, "exit"))
 	{
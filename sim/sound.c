@@ -22,36 +22,100 @@
 #include <simulation.h>
 #include <hwsim/sound-ext.h>
 
+/* Bytes of a command that has not been completed */
+static U8 sound_ext_bytes[4];
+static int sound_ext_count;
+
 static void sound_ext_reset (void)
 {
+	sound_ext_count = 0;
 	ui_write_sound_reset ();
+#ifdef CONFIG_SIM_AUDIO
+	sim_mixer_stop_music ();
+	sim_mixer_stop_sound ();
+#endif
 }
 
 void sound_ext_command (U16 cmd)
 {
 	ui_write_sound_command (cmd);
+#ifdef CONFIG_SIM_AUDIO
+	if (cmd == MUS_OFF)
+		sim_mixer_stop_music ();
+#if (MACHINE_DCS == 0)
+	else if (cmd == SND_STOP_MUSIC)
+		sim_mixer_stop_music ();
+	else if (cmd == SND_STOP_SOUND)
+		sim_mixer_stop_sound ();
+#endif
+	else
+		sim_mixer_command (cmd);
+#endif
 }
 
-static void sound_ext_write_data (U8 val)
+static void sound_ext_volume (unsigned int vol)
 {
-	static int write_count = 0;
-	static U16 cmd = 0;
+#ifdef CONFIG_SIM_AUDIO
+	sim_mixer_volume (vol > 255 ? 255 : vol);
+#endif
+}
 
-	cmd <<= 8;
-	cmd |= val;
-	write_count++;
+/**
+ * Collect the bytes written to the sound board into commands, the way
+ * that the board's own firmware does.  Most WPC commands are one byte;
+ * SND_START_EXTENDED adds a second, and a volume change is followed by
+ * the volume and its complement.  DCS commands are always two bytes,
+ * and a volume change is 55 AA, the volume and its complement.
+ */
+static void sound_ext_write_data (U8 val)
+{
+	U8 *b = sound_ext_bytes;
 
-	if (write_count == 2)
+	b[sound_ext_count++] = val;
+#if (MACHINE_DCS == 1)
+	if (sound_ext_count == 2 && !(b[0] == 0x55 && b[1] == 0xAA))
+	{
+		sound_ext_command ((b[0] << 8) | b[1]);
+		sound_ext_count = 0;
+	}
+	else if (sound_ext_count == 4)
+	{
+		sound_ext_volume (b[2] * 255 / (MAX_VOLUME * 8));
+		sound_ext_count = 0;
+	}
+#else
+	if (b[0] == SND_START_EXTENDED)
+	{
+		if (sound_ext_count == 2)
+		{
+			sound_ext_command ((b[0] << 8) | b[1]);
+			sound_ext_count = 0;
+		}
+	}
+	else if (b[0] == SND_SET_VOLUME_CMD)
+	{
+		if (sound_ext_count == 3)
+		{
+			sound_ext_volume (b[1] * 255 / MAX_VOLUME);
+			sound_ext_count = 0;
+		}
+	}
+	else
 	{
-		sound_ext_command (cmd);
-		cmd = 0;
-		write_count = 0;
+		sound_ext_command (b[0]);
+		sound_ext_count = 0;
 	}
+#endif
 }
 
 
 U8 sound_ext_read (void *board, unsigned int regno)
 {
+#if defined(HAVE_PINIO_SOUND_BUSY) && defined(CONFIG_SIM_AUDIO)
+	/* Hold off the CPU while the mixer is behind */
+	if (regno == SOUND_ADDR_RESET_STATUS && sim_mixer_busy ())
+		return WPCS_WRITE_BUSY;
+#endif
 	return 0;
 }
 
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <freewpc.h>
+#include <simulation.h>
+
+/* Simulation of a stuck ball, for replaying ball search.
+
+	The ball is stuck near a switch, and only one coil can free it.  The
+	switch is pressed once, as the ball rolls over it before it stops;
+	after that, the ball makes no switch activity until that coil is
+	pulsed, when it rolls over the switch again.  The time taken, and the
+	number of coil pulses before the right one, are logged. */
+
+/** The switch where the ball is stuck, or -1 if there is none */
+static int sim_stuck_sw = -1;
+
+/** The coil that frees it */
+static unsigned int sim_stuck_sol;
+
+/** When the ball became stuck */
+static unsigned long sim_stuck_time;
+
+/** The number of coil pulses seen since then */
+static unsigned int sim_stuck_pulses;
+
+
+/** Make a ball stick near the switch SW until SOL is pulsed. */
+void sim_stuck_ball (unsigned int sw, unsigned int sol)
+{
+	sim_stuck_sw = sw;
+	sim_stuck_sol = sol;
+	sim_stuck_time = realtime_read ();
+	sim_stuck_pulses = 0;
+	simlog (SLC_DEBUG, "Ball stuck at switch %d until sol %d", sw, sol);
+	sim_switch_depress (sw);
+}
+
+
+/** Called when a coil output changes. */
+void sim_stuck_coil (unsigned int coil, unsigned int on)
+{
+	if (!on || sim_stuck_sw < 0)
+		return;
+
+	sim_stuck_pulses++;
+	if (coil != sim_stuck_sol)
+		return;
+
+	simlog (SLC_DEBUG, "Ball at switch %d freed by sol %d after %lu ms, %u pulses",
+		sim_stuck_sw, coil, realtime_read () - sim_stuck_time, sim_stuck_pulses);
+	sim_switch_depress (sim_stuck_sw);
+	sim_stuck_sw = -1;
+}
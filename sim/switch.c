@@ -20,6 +20,7 @@
 
 #include <freewpc.h>
 #include <simulation.h>
+#include <queue.h>
 
 int show_switch_levels = 0;
 
@@ -32,6 +33,22 @@ int sim_no_opto_power = 0;
  */
 U8 sim_switch_matrix[SWITCH_BITS_SIZE+1];
 
+/** The length of the switch event queue */
+#define SIM_SWITCH_QUEUE_LEN 64
+
+/** Switch toggles pending for the realtime thread.  The keyboard, script
+ * and task threads post switch numbers here; the realtime thread applies
+ * them to sim_switch_matrix once per tick, so that the switch RTT never
+ * sees the matrix change underneath it. */
+struct {
+	queue_t header;
+	U8 elems[SIM_SWITCH_QUEUE_LEN];
+} sim_switch_queue;
+
+/** The switch levels as seen by the producers, including any toggles
+ * that are still sitting in the queue.  Protected by rt_queue_lock(). */
+U8 sim_switch_shadow[SWITCH_BITS_SIZE+1];
+
 
 
 U8 *sim_switch_matrix_get (void)
@@ -55,6 +72,46 @@ static void sim_switch_update (int sw)
 }
 
 
+/** Toggle a switch in the matrix that the realtime thread reads.
+ * Only called from the realtime thread, or before it starts. */
+static void sim_switch_apply (int sw)
+{
+	sim_switch_matrix[sw / 8] ^= (1 << (sw % 8));
+	sim_switch_update (sw);
+#if (MACHINE_FLIPTRONIC == 1)
+	if (sw / 8 == 9)
+		sim_flipper_switch (sw, sim_switch_read (sw));
+#endif
+}
+
+
+/** Post a switch toggle to the realtime thread. */
+static void sim_switch_post (int sw)
+{
+	rt_queue_lock ();
+	if (queue_full_p (&sim_switch_queue.header, SIM_SWITCH_QUEUE_LEN))
+	{
+		simlog (SLC_DEBUG, "switch queue full, dropped %d", sw);
+	}
+	else
+	{
+		sim_switch_shadow[sw / 8] ^= (1 << (sw % 8));
+		queue_insert (&sim_switch_queue.header, SIM_SWITCH_QUEUE_LEN, sw);
+	}
+	rt_queue_unlock ();
+}
+
+
+/** Apply all pending switch toggles.  This runs every 1ms in
+ * the realtime thread, before the switch RTT polls the matrix. */
+static void sim_switch_drain (void *data __attribute__((unused)))
+{
+	while (!queue_empty_p (&sim_switch_queue.header))
+		sim_switch_apply (queue_remove (&sim_switch_queue.header,
+			SIM_SWITCH_QUEUE_LEN));
+}
+
+
 void sim_switch_toggle (int sw)
 {
 	if (sim_no_switch_power)
@@ -62,8 +119,7 @@ void sim_switch_toggle (int sw)
 	if (sim_no_opto_power && switch_is_opto (sw))
 		return;
 
-	sim_switch_matrix[sw / 8] ^= (1 << (sw % 8));
-	sim_switch_update (sw);
+	sim_switch_post (sw);
 }
 
 void sim_switch_set (int sw, int on)
@@ -75,11 +131,10 @@ void sim_switch_set (int sw, int on)
 
 	if (switch_is_opto (sw))
 		on = !on;
-	if (on)
-		sim_switch_matrix[sw / 8] |= (1 << (sw % 8));
-	else
-		sim_switch_matrix[sw / 8] &= ~(1 << (sw % 8));
-	sim_switch_update (sw);
+	rt_queue_lock ();
+	if (!(sim_switch_shadow[sw / 8] & (1 << (sw % 8))) != !on)
+		sim_switch_post (sw);
+	rt_queue_unlock ();
 }
 
 unsigned int sim_switch_timer;
@@ -130,6 +185,7 @@ void sim_switch_init (void)
 	/* Initialize switch levels to zero by default */
 	memset (sim_switch_matrix, 0, SWITCH_BITS_SIZE);
 	sim_switch_matrix[9] = 0xFF;
+	queue_init (&sim_switch_queue.header);
 
 	conf_add ("sw.no_power", &sim_no_switch_power);
 	conf_add ("sw.no_opto_power", &sim_no_opto_power);
@@ -139,10 +195,12 @@ void sim_switch_init (void)
 	for (sw = 0; sw < NUM_SWITCHES; sw++)
 		if (switch_is_opto (sw))
 		{
-			sim_switch_toggle (sw);
+			sim_switch_apply (sw);
 		}
 		else
 			sim_switch_update (sw);
+	memcpy (sim_switch_shadow, sim_switch_matrix, sizeof (sim_switch_shadow));
+	sim_time_register (1, TRUE, sim_switch_drain, NULL);
 	sim_switch_timer = 0;
 }
 
@@ -573,6 +573,12 @@ struct audit standard_audits[] = {
 	{ "RIGHT FLIPPER", AUDIT_TYPE_INT, &system_audits.right_flippers },
 	{ "TROUGH RESCUE", AUDIT_TYPE_INT, &system_audits.trough_rescues },
 	{ "CHASE BALLS", AUDIT_TYPE_INT, &system_audits.chase_balls },
+	{ "SEARCH RECOVERED", AUDIT_TYPE_INT, &system_audits.search_recoveries },
+	{ "RECOVERY AVG SEC", AUDIT_TYPE_INT, &system_audits.search_recovery_avg },
+	{ "RECOVERY MAX SEC", AUDIT_TYPE_INT, &system_audits.search_recovery_max },
+	{ "LEARNED RECOVERY", AUDIT_TYPE_INT, &system_audits.search_learned },
+	{ "SOUND DROPS", AUDIT_TYPE_INT, &system_audits.sound_drops },
+	{ "SOUND MERGED", AUDIT_TYPE_INT, &system_audits.sound_coalesced },
 	{ "LOCKUP 1 ADDR", AUDIT_TYPE_INT, &system_audits.lockup1_addr },
 	{ "LOCKUP 1 PID/LEF", AUDIT_TYPE_INT, &system_audits.lockup1_pid_lef },
 	{ NULL, AUDIT_TYPE_NONE, NULL },
@@ -660,6 +666,35 @@ void histogram_browser_draw (void)
 }
 
 
+/* The kick audits show, for each ball device, how many kicks were
+confirmed and how long it took from the first attempt until the device
+saw the ball leave. */
+
+void device_audit_browser_init (void)
+{
+	browser_init ();
+	browser_max = NUM_DEVICES-1;
+}
+
+void device_audit_browser_draw (void)
+{
+	U8 devno = menu_selection;
+
+	sprintf ("%d. %s", devno+1, device_table[devno].props->name);
+	print_row_center (&font_mono5, 3);
+
+	sprintf ("%ld KICKS", system_audits.device_kicks[devno]);
+	font_render_string_center (&font_var5, 64, 14, sprintf_buffer);
+
+	sprintf ("AVG %ld MS  MAX %ld MS",
+		system_audits.device_kick_avg[devno],
+		system_audits.device_kick_max[devno]);
+	font_render_string_center (&font_var5, 64, 23, sprintf_buffer);
+
+	dmd_show_low ();
+}
+
+
 #define INHERIT_FROM_AUDIT_BROWSER \
 	INHERIT_FROM_BROWSER, \
 	.init = audit_browser_init, \
@@ -675,6 +710,12 @@ struct window_ops histogram_browser_window = {
 	.draw = histogram_browser_draw,
 };
 
+struct window_ops device_audit_browser_window = {
+	INHERIT_FROM_AUDIT_BROWSER,
+	.init = device_audit_browser_init,
+	.draw = device_audit_browser_draw,
+};
+
 
 /*****************************************************/
 
@@ -1791,11 +1832,23 @@ struct menu dev_frametest_item = {
 
 #define SCHED_TEST_DURATION TIME_500MS
 #define SCHED_TEST_WORKERS  16
+#define SCHED_TEST_SLEEPERS 24
 #define SCHED_LOCAL_COUNT   16
 
 U16 sched_test_count;
 volatile U8 *local_data_pointer;
 
+#ifndef CONFIG_NATIVE
+/** The idle time measured while the sleepers were waiting */
+U16 sched_test_idle;
+
+void sched_test_sleeper (void)
+{
+	task_sleep_sec (10);
+	task_exit ();
+}
+#endif
+
 void sched_test_task (void)
 {
 	volatile U8 local_data[SCHED_LOCAL_COUNT];
@@ -1816,6 +1869,17 @@ void sched_test_init (void)
 	dmd_alloc_low_clean ();
 	dmd_show_low ();
 
+#ifndef CONFIG_NATIVE
+	/* Measure the CPU time left over while many tasks are asleep, as
+	in a multiball.  idle_profile_rtt() updates idle_chunks once a
+	second, so wait for two updates.  The result is a percentage. */
+	for (i=0 ; i < SCHED_TEST_SLEEPERS; i++)
+		task_create_gid (GID_SCHED_TEST_WORKER, sched_test_sleeper);
+	task_sleep_sec (2);
+	sched_test_idle = idle_chunks * 2UL / 5;
+	task_kill_gid (GID_SCHED_TEST_WORKER);
+#endif
+
 	for (i=0 ; i < SCHED_TEST_WORKERS; i++)
 		task_create_gid (GID_SCHED_TEST_WORKER, sched_test_task);
 	task_sleep (SCHED_TEST_DURATION);
@@ -1830,7 +1894,11 @@ void sched_test_draw (void)
 #if (MACHINE_DMD == 1)
 	sprintf ("SCHEDULES PER SEC. = %ld", sched_test_count);
 	print_row_center (&font_var5, 10);
-	font_render_string_center (&font_var5, 64, 20, "PRESS ENTER TO REPEAT");
+#ifndef CONFIG_NATIVE
+	sprintf ("IDLE %ld%% WITH %d ASLEEP", sched_test_idle, SCHED_TEST_SLEEPERS);
+	print_row_center (&font_var5, 17);
+#endif
+	font_render_string_center (&font_var5, 64, 24, "PRESS ENTER TO REPEAT");
 #else
 	sprintf ("%ld SCHED./SEC.", sched_test_count);
 	print_row_center (&font_var5, 16);
@@ -1854,6 +1922,153 @@ struct menu sched_test_item = {
 
 /**********************************************************************/
 
+#define SOL_STATS_PAGES 5
+
+U8 sol_stats_page;
+
+void sol_stats_init (void)
+{
+	sol_stats_page = 0;
+}
+
+void sol_stats_draw (void)
+{
+	U16 avg = sol_req_stats.wait_count ?
+		sol_req_stats.wait_total / sol_req_stats.wait_count : 0;
+
+	window_title ("SOL QUEUE STATS");
+	switch (sol_stats_page)
+	{
+		case 0:
+			sprintf ("REQ. %ld STARTED %ld",
+				sol_req_stats.requests, sol_req_stats.started);
+			break;
+		case 1:
+			sprintf ("MERGED %ld HELD %ld",
+				sol_req_stats.coalesced, sol_req_stats.deferred);
+			break;
+		case 2:
+			sprintf ("EXPIRED %ld DROPPED %ld",
+				sol_req_stats.expired, sol_req_stats.dropped);
+			break;
+		case 3:
+			sprintf ("WAIT %ld MAX %ld MS",
+				avg * 16, sol_req_stats.wait_max * 16);
+			break;
+		case 4:
+			sprintf ("FLASHERS HELD %ld", sol_req_stats.flash_held);
+			break;
+	}
+	print_row_center (&font_var5, 16);
+#if (MACHINE_DMD == 1)
+	font_render_string_center (&font_var5, 64, 26, "PRESS ENTER TO CLEAR");
+#endif
+	dmd_show_low ();
+}
+
+void sol_stats_up (void)
+{
+	if (++sol_stats_page == SOL_STATS_PAGES)
+		sol_stats_page = 0;
+}
+
+void sol_stats_down (void)
+{
+	if (sol_stats_page-- == 0)
+		sol_stats_page = SOL_STATS_PAGES-1;
+}
+
+void sol_stats_enter (void)
+{
+	memset (&sol_req_stats, 0, sizeof (sol_req_stats));
+}
+
+struct window_ops sol_stats_window = {
+	DEFAULT_WINDOW,
+	.init = sol_stats_init,
+	.draw = sol_stats_draw,
+	.up = sol_stats_up,
+	.down = sol_stats_down,
+	.enter = sol_stats_enter,
+};
+
+struct menu sol_stats_item = {
+	.name = "SOL QUEUE STATS",
+	.flags = M_ITEM,
+	.var = { .subwindow = { &sol_stats_window, NULL } },
+};
+
+/**********************************************************************/
+
+/* Native builds use the C library's malloc() */
+#if defined(CONFIG_MALLOC) && !defined(CONFIG_NATIVE)
+
+U8 malloc_stats_class;
+
+void malloc_stats_init (void)
+{
+	malloc_stats_class = 0;
+}
+
+void malloc_stats_draw (void)
+{
+	struct malloc_stats *st = &malloc_stats[malloc_stats_class];
+
+	window_title ("MALLOC STATS");
+	sprintf ("%d BYTES: %d OF %d USED",
+		malloc_class_size (malloc_stats_class), st->used,
+		malloc_class_slots (malloc_stats_class));
+	print_row_center (&font_var5, 12);
+	sprintf ("HIGH %d FAIL %d", st->high_water, st->failures);
+	print_row_center (&font_var5, 19);
+#if (MACHINE_DMD == 1)
+	font_render_string_center (&font_var5, 64, 26, "PRESS ENTER TO CLEAR");
+#endif
+	dmd_show_low ();
+}
+
+void malloc_stats_up (void)
+{
+	if (++malloc_stats_class == MALLOC_CLASSES)
+		malloc_stats_class = 0;
+}
+
+void malloc_stats_down (void)
+{
+	if (malloc_stats_class-- == 0)
+		malloc_stats_class = MALLOC_CLASSES-1;
+}
+
+void malloc_stats_enter (void)
+{
+	U8 class;
+	for (class = 0; class < MALLOC_CLASSES; class++)
+	{
+		malloc_stats[class].high_water = malloc_stats[class].used;
+		malloc_stats[class].failures = 0;
+		malloc_stats[class].allocs = 0;
+	}
+}
+
+struct window_ops malloc_stats_window = {
+	DEFAULT_WINDOW,
+	.init = malloc_stats_init,
+	.draw = malloc_stats_draw,
+	.up = malloc_stats_up,
+	.down = malloc_stats_down,
+	.enter = malloc_stats_enter,
+};
+
+struct menu malloc_stats_item = {
+	.name = "MALLOC STATS",
+	.flags = M_ITEM,
+	.var = { .subwindow = { &malloc_stats_window, NULL } },
+};
+
+#endif /* CONFIG_MALLOC && !CONFIG_NATIVE */
+
+/**********************************************************************/
+
 #ifndef CONFIG_NATIVE
 
 void irqload_test_init (void)
@@ -2143,6 +2358,10 @@ struct menu *dev_menu_items[] = {
 	&dev_force_error_item,
 	&dev_deff_stress_test_item,
 	&sched_test_item,
+	&sol_stats_item,
+#if defined(CONFIG_MALLOC) && !defined(CONFIG_NATIVE)
+	&malloc_stats_item,
+#endif
 #ifndef CONFIG_NATIVE
 	&irqload_test_item,
 #endif
@@ -2592,6 +2811,12 @@ struct menu score_histogram_item = {
 	.var = { .subwindow = { &histogram_browser_window, &score_histogram } },
 };
 
+struct menu kick_audits_item = {
+	.name = "KICK AUDITS",
+	.flags = M_ITEM,
+	.var = { .subwindow = { &device_audit_browser_window, NULL } },
+};
+
 #ifdef CONFIG_RTC
 
 struct menu timestamp_audits_item = {
@@ -2609,6 +2834,7 @@ struct menu *audit_menu_items[] = {
 	&feature_audits_item,
 	&score_histogram_item,
 	&game_time_histogram_item,
+	&kick_audits_item,
 #ifdef CONFIG_RTC
 	&timestamp_audits_item,
 #endif
@@ -3142,9 +3368,8 @@ void solenoid_test_draw (void)
 
 void solenoid_test_enter (void)
 {
-	extern U8 sol_pulse_timer;
 	U8 sel = win_top->w_class.menu.selected;
-	if (sol_pulse_timer != 0)
+	if (sol_pulse_busy_p ())
 		return;
 	task_sleep (TIME_100MS);
 	sol_req_start_specific (sel, sol_duty_masks[sol_duty_level], browser_action);
@@ -3249,7 +3474,7 @@ void gi_test_init (void)
 	/* menu_selection ranges from 0 to the number of strings+1; the last value
 	represnts all strings on */
 	browser_max = NUM_GI_TRIACS+1;
-	gi_test_brightness = 8;
+	gi_test_brightness = GI_BRIGHTNESS_MAX;
 	gi_disable (PINIO_GI_STRINGS);
 }
 
@@ -3292,7 +3517,7 @@ void gi_test_draw (void)
 
 void gi_test_right (void)
 {
-	bounded_increment (gi_test_brightness, 8);
+	bounded_increment (gi_test_brightness, GI_BRIGHTNESS_MAX);
 }
 
 void gi_test_left (void)
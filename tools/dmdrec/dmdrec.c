@@ -0,0 +1,350 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * dmdrec : inspect and compare DMD recordings made by the simulator's
+ * 'dmdrec' script command (see sim/dmdrec.c for the file format).
+ *
+ * Usage: dmdrec info <file>
+ *        dmdrec dump <file> [<deff>]
+ *        dmdrec cmp [-t <ms>] <reference> <new>
+ *
+ * 'info' prints one line per deff: the number of frames it drew, the
+ * time from its start to its first frame, and its total size.
+ *
+ * 'dump' prints every frame as ASCII art, optionally only those of
+ * one deff.
+ *
+ * 'cmp' compares the frames of each deff in order.  Any pixel
+ * difference, or a change in the number of frames, is a regression.
+ * A deff whose first frame is later than in the reference by more than
+ * the tolerance (default 50ms) is a render-time regression.  The exit
+ * status is 1 if anything regressed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "imglib.h"
+
+/* These must match sim/dmdrec.c */
+#define DMDREC_VERSION 1
+#define PLANES 2
+
+#define MAX_DEFF_ID 1024
+
+/** Frames recorded before the first mark are counted against deff 0,
+which is never a real deff. */
+#define NO_DEFF 0
+
+struct recording
+{
+	const char *filename;
+	FILE *fp;
+	struct buffer *plane[PLANES];
+	unsigned int deff;
+	unsigned long mark_time;
+	unsigned long time;
+	unsigned long bytes;
+	unsigned int frames;
+};
+
+/** Per-deff totals */
+struct deff_stats
+{
+	unsigned int frames;
+	unsigned long first_frame_delay;
+	unsigned long bytes;
+	unsigned int seen;
+};
+
+struct deff_stats stats[2][MAX_DEFF_ID + 1];
+
+
+static unsigned int read16 (FILE *fp)
+{
+	unsigned int lo = fgetc (fp);
+	return lo | (fgetc (fp) << 8);
+}
+
+
+static unsigned long read32 (FILE *fp)
+{
+	unsigned long lo = read16 (fp);
+	return lo | ((unsigned long)read16 (fp) << 16);
+}
+
+
+static void rec_open (struct recording *rec, const char *filename)
+{
+	char magic[4];
+	unsigned int plane;
+
+	memset (rec, 0, sizeof (*rec));
+	rec->filename = filename;
+	rec->fp = fopen (filename, "rb");
+	if (!rec->fp)
+	{
+		fprintf (stderr, "dmdrec: cannot open %s\n", filename);
+		exit (2);
+	}
+	if (fread (magic, 4, 1, rec->fp) != 1 || memcmp (magic, "FDMD", 4)
+		|| fgetc (rec->fp) != DMDREC_VERSION
+		|| fgetc (rec->fp) != FRAME_WIDTH / 8
+		|| fgetc (rec->fp) != FRAME_HEIGHT)
+	{
+		fprintf (stderr, "dmdrec: %s is not a DMD recording\n", filename);
+		exit (2);
+	}
+	fgetc (rec->fp);
+	for (plane = 0; plane < PLANES; plane++)
+		rec->plane[plane] = NULL;
+	rec->deff = NO_DEFF;
+}
+
+
+/**
+ * Read the next frame of a recording into rec->plane[], handling
+ * any marks along the way.  Returns 0 at the end of the file.
+ */
+static int rec_next_frame (struct recording *rec, struct deff_stats *st)
+{
+	int type;
+	unsigned int plane;
+
+	for (;;)
+	{
+		type = fgetc (rec->fp);
+		if (type == EOF)
+			return 0;
+		rec->time = read32 (rec->fp);
+		if (type == 'M')
+		{
+			rec->deff = read16 (rec->fp);
+			if (rec->deff > MAX_DEFF_ID)
+				rec->deff = NO_DEFF;
+			rec->mark_time = rec->time;
+			st[rec->deff].seen = 1;
+			continue;
+		}
+		else if (type != 'F')
+		{
+			fprintf (stderr, "dmdrec: %s: bad record type %02X\n",
+				rec->filename, type);
+			exit (2);
+		}
+
+		for (plane = 0; plane < PLANES; plane++)
+		{
+			struct buffer *enc, *dec;
+			unsigned int len = read16 (rec->fp);
+
+			enc = buffer_alloc (len);
+			if (fread (enc->data, 1, len, rec->fp) != len)
+			{
+				fprintf (stderr, "dmdrec: %s: truncated frame\n", rec->filename);
+				exit (2);
+			}
+			dec = buffer_decompress_delta (enc, rec->plane[plane]);
+			buffer_free (enc);
+			if (rec->plane[plane])
+				buffer_free (rec->plane[plane]);
+			rec->plane[plane] = dec;
+			rec->bytes += len + 2;
+			st[rec->deff].bytes += len + 2;
+		}
+
+		if (st[rec->deff].frames++ == 0)
+			st[rec->deff].first_frame_delay = rec->time - rec->mark_time;
+		rec->frames++;
+		return 1;
+	}
+}
+
+
+/** Return the 0-3 intensity of a pixel in the current frame */
+static unsigned int rec_pixel (struct recording *rec, unsigned int x, unsigned int y)
+{
+	unsigned int off = (y * FRAME_WIDTH + x) / 8;
+	unsigned int bit = x % 8;
+	return ((rec->plane[0]->data[off] >> bit) & 1)
+		+ (((rec->plane[1]->data[off] >> bit) & 1) << 1);
+}
+
+
+static void rec_print_frame (struct recording *rec)
+{
+	unsigned int x, y;
+
+	printf ("frame %u, deff %u, time %lu\n", rec->frames, rec->deff, rec->time);
+	for (y = 0; y < FRAME_HEIGHT; y++)
+	{
+		for (x = 0; x < FRAME_WIDTH; x++)
+			putchar (" .+#"[rec_pixel (rec, x, y)]);
+		putchar ('\n');
+	}
+}
+
+
+static int info (const char *filename)
+{
+	struct recording rec;
+	unsigned int id;
+
+	rec_open (&rec, filename);
+	while (rec_next_frame (&rec, stats[0]))
+		;
+	printf ("%-6s %8s %8s %10s\n", "deff", "frames", "first", "bytes");
+	for (id = 0; id <= MAX_DEFF_ID; id++)
+	{
+		struct deff_stats *st = &stats[0][id];
+		if (!st->seen && !st->frames)
+			continue;
+		if (id == NO_DEFF)
+			printf ("%-6s", "-");
+		else
+			printf ("%-6u", id);
+		printf (" %8u %6lums %10lu\n", st->frames, st->first_frame_delay, st->bytes);
+	}
+	printf ("%u frames, %lu bytes, %lu ms\n", rec.frames, rec.bytes, rec.time);
+	return 0;
+}
+
+
+static int dump (const char *filename, int only)
+{
+	struct recording rec;
+
+	rec_open (&rec, filename);
+	while (rec_next_frame (&rec, stats[0]))
+		if (only < 0 || rec.deff == only)
+			rec_print_frame (&rec);
+	return 0;
+}
+
+
+static int compare (const char *ref_file, const char *new_file, unsigned long tolerance)
+{
+	struct recording ref, new;
+	unsigned int x, y, id;
+	unsigned int pixels, bad_frames = 0, regressions = 0;
+	int ref_more, new_more;
+
+	rec_open (&ref, ref_file);
+	rec_open (&new, new_file);
+
+	/* Walk both recordings in step, one deff at a time, so that an
+	extra or missing frame in one deff does not throw off the rest. */
+	for (;;)
+	{
+		ref_more = rec_next_frame (&ref, stats[0]);
+		new_more = rec_next_frame (&new, stats[1]);
+		while (ref_more && new_more && ref.deff != new.deff)
+		{
+			if (ref.deff < new.deff)
+				ref_more = rec_next_frame (&ref, stats[0]);
+			else
+				new_more = rec_next_frame (&new, stats[1]);
+		}
+		if (!ref_more || !new_more)
+			break;
+
+		pixels = 0;
+		for (y = 0; y < FRAME_HEIGHT; y++)
+			for (x = 0; x < FRAME_WIDTH; x++)
+				if (rec_pixel (&ref, x, y) != rec_pixel (&new, x, y))
+					pixels++;
+		if (pixels)
+		{
+			printf ("deff %u frame %u: %u pixels differ\n",
+				new.deff, stats[1][new.deff].frames, pixels);
+			bad_frames++;
+		}
+	}
+	while (ref_more)
+		ref_more = rec_next_frame (&ref, stats[0]);
+	while (new_more)
+		new_more = rec_next_frame (&new, stats[1]);
+
+	for (id = 0; id <= MAX_DEFF_ID; id++)
+	{
+		struct deff_stats *rs = &stats[0][id];
+		struct deff_stats *ns = &stats[1][id];
+
+		if (rs->frames != ns->frames)
+		{
+			printf ("deff %u: %u frames, was %u\n", id, ns->frames, rs->frames);
+			regressions++;
+		}
+		if (rs->frames && ns->frames
+			&& ns->first_frame_delay > rs->first_frame_delay + tolerance)
+		{
+			printf ("deff %u: first frame after %lums, was %lums\n",
+				id, ns->first_frame_delay, rs->first_frame_delay);
+			regressions++;
+		}
+	}
+
+	regressions += bad_frames;
+	printf ("%s: %u frames compared, %u differ, %u regressions\n",
+		new_file, new.frames, bad_frames, regressions);
+	return regressions ? 1 : 0;
+}
+
+
+static void usage (void)
+{
+	fprintf (stderr, "usage: dmdrec info <file>\n");
+	fprintf (stderr, "       dmdrec dump <file> [<deff>]\n");
+	fprintf (stderr, "       dmdrec cmp [-t <ms>] <reference> <new>\n");
+	exit (2);
+}
+
+
+int main (int argc, char *argv[])
+{
+	unsigned long tolerance = 50;
+	int c;
+
+	if (argc < 3)
+		usage ();
+
+	if (!strcmp (argv[1], "info"))
+		return info (argv[2]);
+	else if (!strcmp (argv[1], "dump"))
+		return dump (argv[2], argc > 3 ? atoi (argv[3]) : -1);
+	else if (!strcmp (argv[1], "cmp"))
+	{
+		optind = 2;
+		while ((c = getopt (argc, argv, "t:")) != -1)
+		{
+			if (c == 't')
+				tolerance = strtoul (optarg, NULL, 0);
+			else
+				usage ();
+		}
+		if (argc - optind != 2)
+			usage ();
+		return compare (argv[optind], argv[optind + 1], tolerance);
+	}
+	usage ();
+	return 2;
+}
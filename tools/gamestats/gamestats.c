@@ -0,0 +1,348 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * gamestats : merge simulated game records into percentile tables.
+ *
+ * Usage: gamestats [-p <percentiles>] <file>...
+ *
+ * Each FILE is written by the simulator's 'gamerec' command (see
+ * sim/gamerec.c), by any number of processes.  Fields are matched up by
+ * name, so files from different builds can be merged.  For every field,
+ * one line is printed with:
+ *
+ *   reach    the percentage of records where the field was not zero,
+ *            i.e. how often a player started a mode or got an award
+ *   mean     the average over all records, counting zeros
+ *   pNN      the percentiles given with -p (default 10,50,90,99)
+ *   max      the largest value seen
+ *
+ * There is one record per player per game, so these are per player.
+ * The games line counts the records for player 1.
+ *
+ * Nothing is kept per record.  Each field has a histogram whose buckets
+ * are exact below 128 and then 64 to each power of two, so percentiles
+ * are within about 1.5% no matter how many games are read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define EXACT_BUCKETS 128
+#define SUB_BUCKETS 64
+#define NUM_BUCKETS (EXACT_BUCKETS + (64 - 7) * SUB_BUCKETS)
+
+#define MAX_IDS 65536
+#define MAX_PERCENTILES 16
+
+/* Field IDs that the tool needs to know about, from sim/gamerec.c */
+#define GAMEREC_PLAYER 2
+
+struct field
+{
+	char *name;
+	uint64_t nonzero;
+	uint64_t max;
+	double sum;
+	uint64_t buckets[NUM_BUCKETS];
+};
+
+static struct field **fields;
+static unsigned int field_count;
+static unsigned int field_max;
+
+static uint64_t records;
+static uint64_t games;
+
+static double percentiles[MAX_PERCENTILES] = { 10, 50, 90, 99 };
+static unsigned int percentile_count = 4;
+
+
+static unsigned int bucket_of (uint64_t val)
+{
+	unsigned int log2;
+
+	if (val < EXACT_BUCKETS)
+		return val;
+	log2 = 63 - __builtin_clzll (val);
+	return EXACT_BUCKETS + (log2 - 7) * SUB_BUCKETS
+		+ ((val >> (log2 - 6)) & (SUB_BUCKETS - 1));
+}
+
+
+/** Return the smallest value that falls in a bucket. */
+static uint64_t bucket_value (unsigned int bucket)
+{
+	unsigned int log2;
+
+	if (bucket < EXACT_BUCKETS)
+		return bucket;
+	log2 = 7 + (bucket - EXACT_BUCKETS) / SUB_BUCKETS;
+	return (uint64_t)(SUB_BUCKETS + (bucket - EXACT_BUCKETS) % SUB_BUCKETS)
+		<< (log2 - 6);
+}
+
+
+static struct field *field_lookup (const char *name)
+{
+	unsigned int n;
+
+	for (n = 0; n < field_count; n++)
+		if (!strcmp (fields[n]->name, name))
+			return fields[n];
+	if (field_count == field_max)
+	{
+		field_max = field_max ? field_max * 2 : 64;
+		fields = realloc (fields, field_max * sizeof (struct field *));
+	}
+	fields[field_count] = calloc (1, sizeof (struct field));
+	fields[field_count]->name = strdup (name);
+	return fields[field_count++];
+}
+
+
+static unsigned int get16 (const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+
+static uint64_t get64 (const unsigned char *p)
+{
+	uint64_t val = 0;
+	int n;
+	for (n = 7; n >= 0; n--)
+		val = (val << 8) | p[n];
+	return val;
+}
+
+
+/** Read one file of records.  Returns -1 if it is not valid. */
+static int read_file (const char *filename)
+{
+	struct field **by_id;
+	unsigned char *buf, *p, *end;
+	char name[256];
+	unsigned int count, id, len, n;
+	uint64_t val;
+	struct stat st;
+	int fd;
+
+	/* The file is mapped rather than read, so that files larger than
+	memory can be read */
+	fd = open (filename, O_RDONLY);
+	if (fd < 0 || fstat (fd, &st) < 0)
+	{
+		perror (filename);
+		return -1;
+	}
+	buf = st.st_size ? mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close (fd);
+	if (buf == MAP_FAILED)
+	{
+		perror (filename);
+		return -1;
+	}
+	madvise (buf, st.st_size, MADV_SEQUENTIAL);
+
+	/* Every process that appends to the file names its fields first,
+	and each build numbers them the same way, so one table serves for
+	the whole file */
+	by_id = calloc (MAX_IDS, sizeof (struct field *));
+	p = buf;
+	end = buf + st.st_size;
+	while (p < end)
+	{
+		switch (*p)
+		{
+			case 'M':
+				if (end - p < 6 || memcmp (p + 1, "FWGR", 4))
+					goto bad;
+				if (p[5] != 1)
+				{
+					fprintf (stderr, "%s: version %d not supported\n",
+						filename, p[5]);
+					goto fail;
+				}
+				p += 6;
+				break;
+
+			case 'N':
+				if (end - p < 4 || end - p < 4 + p[3])
+					goto bad;
+				id = get16 (p + 1);
+				len = p[3];
+				memcpy (name, p + 4, len);
+				name[len] = '\0';
+				if (by_id[id] && strcmp (by_id[id]->name, name))
+					fprintf (stderr, "%s: field %u is both %s and %s\n",
+						filename, id, by_id[id]->name, name);
+				by_id[id] = field_lookup (name);
+				p += 4 + len;
+				break;
+
+			case 'R':
+				if (end - p < 3)
+					goto bad;
+				count = get16 (p + 1);
+				p += 3;
+				if (end - p < count * 10)
+					goto bad;
+				records++;
+				for (n = 0; n < count; n++, p += 10)
+				{
+					struct field *f;
+
+					id = get16 (p);
+					val = get64 (p + 2);
+					if (id == GAMEREC_PLAYER && val == 1)
+						games++;
+					if (!val)
+						continue;
+					f = by_id[id];
+					if (!f)
+					{
+						snprintf (name, sizeof (name), "id%u", id);
+						f = by_id[id] = field_lookup (name);
+					}
+					f->nonzero++;
+					f->sum += val;
+					if (val > f->max)
+						f->max = val;
+					f->buckets[bucket_of (val)]++;
+				}
+				break;
+
+			default:
+				goto bad;
+		}
+	}
+	free (by_id);
+	munmap (buf, st.st_size);
+	return 0;
+
+bad:
+	fprintf (stderr, "%s: bad entry at offset %ld\n", filename,
+		(long)(p - buf));
+fail:
+	free (by_id);
+	munmap (buf, st.st_size);
+	return -1;
+}
+
+
+/** Return the value below which PCT percent of records fall, counting
+the records where the field was zero. */
+static uint64_t field_percentile (const struct field *f, double pct)
+{
+	uint64_t rank = (uint64_t)(pct / 100.0 * records);
+	uint64_t seen = records - f->nonzero;
+	unsigned int b;
+
+	if (rank < seen)
+		return 0;
+	for (b = 0; b < NUM_BUCKETS; b++)
+	{
+		seen += f->buckets[b];
+		if (rank < seen)
+			return bucket_value (b);
+	}
+	return f->max;
+}
+
+
+static int field_compare (const void *a, const void *b)
+{
+	return strcmp ((*(struct field **)a)->name, (*(struct field **)b)->name);
+}
+
+
+static void print_table (void)
+{
+	unsigned int n, p;
+	char head[16];
+
+	printf ("%lu games, %lu records\n\n", (unsigned long)games,
+		(unsigned long)records);
+	if (!records)
+		return;
+
+	qsort (fields, field_count, sizeof (struct field *), field_compare);
+	printf ("%-32s %7s %12s", "field", "reach", "mean");
+	for (p = 0; p < percentile_count; p++)
+	{
+		snprintf (head, sizeof (head), "p%g", percentiles[p]);
+		printf (" %12s", head);
+	}
+	printf (" %12s\n", "max");
+
+	for (n = 0; n < field_count; n++)
+	{
+		const struct field *f = fields[n];
+		printf ("%-32s %6.2f%% %12.2f", f->name,
+			f->nonzero * 100.0 / records, f->sum / records);
+		for (p = 0; p < percentile_count; p++)
+			printf (" %12lu", (unsigned long)field_percentile (f, percentiles[p]));
+		printf (" %12lu\n", (unsigned long)f->max);
+	}
+}
+
+
+int main (int argc, char *argv[])
+{
+	char *s, *next;
+	int c, n, errors = 0;
+
+	while ((c = getopt (argc, argv, "p:")) != -1)
+	{
+		switch (c)
+		{
+			case 'p':
+				percentile_count = 0;
+				for (s = optarg; *s && percentile_count < MAX_PERCENTILES; s = next)
+				{
+					percentiles[percentile_count++] = strtod (s, &next);
+					if (next == s)
+						return 2;
+					if (*next == ',')
+						next++;
+				}
+				break;
+			default: return 2;
+		}
+	}
+	if (optind >= argc)
+	{
+		fprintf (stderr, "usage: gamestats [-p percentiles] file...\n");
+		return 2;
+	}
+
+	for (n = optind; n < argc; n++)
+		if (read_file (argv[n]) < 0)
+			errors++;
+	print_table ();
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The machine configuration for the host programs in tools/ that build
+ * kernel code against the real <freewpc.h>.  They are compiled with
+ * -DCONFIG_NATIVE -Itools/host -Iinclude and no platform, so only the
+ * machine-independent headers are used; each program includes any
+ * others that the code it builds needs.
+ */
+
+#define MACHINE_DMD 0
+
+/* Needed by <system/switch.h>, which the lamp code uses */
+#define PINIO_NUM_SWITCHES 72
@@ -503,7 +503,8 @@ struct img_histogram *histogram_update (struct buffer *buf)
 	unsigned int already_taken[256] = { 0, };
 
 	if (!buf->hist)
-		hist = buf->hist = malloc (sizeof (struct img_histogram));
+		buf->hist = malloc (sizeof (struct img_histogram));
+	hist = buf->hist;
 
 	hist->unique = 0;
 	for (off = 0; off < 256; off++)
@@ -614,7 +615,7 @@ struct img_histogram *histogram_update (struct buffer *buf)
 static U8 *buffer_write_run (U8 *ptr, U8 sentinel, U8 data, unsigned int count)
 {
 	if (count == 0);
-	else if (count < 4)
+	else if (count < 4 && data != sentinel)
 	{
 		do {
 			*ptr++ = data;
@@ -667,14 +668,16 @@ struct buffer *buffer_compress (struct buffer *buf, struct buffer *prev)
 	/* Update the image histogram */
 	histogram_update (buf);
 
-	/* Find a byte value that does not occur in the image */
+	/* Find a byte value that does not occur in the image.  If every
+	value occurs, use the least frequent one; literal occurrences of it
+	are then written as runs of length 1. */
+	sentinel = 0;
 	for (n = 0; n <= 0xFF; n++)
 	{
-		if (buf->hist->count[n] == 0)
-		{
+		if (buf->hist->count[n] < buf->hist->count[sentinel])
 			sentinel = n;
+		if (buf->hist->count[n] == 0)
 			break;
-		}
 	}
 
 	/* Compute the run length encoded version of the buffer.
@@ -704,15 +707,20 @@ struct buffer *buffer_compress (struct buffer *buf, struct buffer *prev)
 	rleptr = buffer_write_run (rleptr, sentinel, last, last_count);
 	rle->len = rleptr - rle->data;
 
-	/* See if delta encoding is better */
+	/* See if delta encoding is better.  The delta is the exclusive-OR
+	of the two images, which is mostly zeroes when little has changed. */
 	if (prev != NULL)
 	{
-		struct buffer *delta = buffer_compress (prev, NULL);
-		if (delta->len < rle->len)
+		struct buffer *delta = buffer_compute_delta (buf, prev);
+		struct buffer *enc = buffer_compress (delta, NULL);
+		buffer_free (delta);
+		if (enc->len < rle->len)
 		{
-			/* TODO : it's possible that it needs to be _significantly_
-			smaller for this to be worthwhile... */
+			enc->data[0] |= CH_INIT_COPY;
+			buffer_free (rle);
+			return enc;
 		}
+		buffer_free (enc);
 	}
 
 #ifdef DEBUG
@@ -727,8 +735,10 @@ struct buffer *buffer_compress (struct buffer *buf, struct buffer *prev)
 
 /**
  * Given a compressed bitmap, return the uncompressed, joined buffer.
+ * PREV is the previous image in the animation, which is needed when
+ * the bitmap was compressed as a delta from it.
  */
-struct buffer *buffer_decompress (struct buffer *buf)
+struct buffer *buffer_decompress_delta (struct buffer *buf, struct buffer *prev)
 {
 	struct buffer *res;
 	U8 flags;
@@ -745,7 +755,15 @@ struct buffer *buffer_decompress (struct buffer *buf)
 	switch (flags & CH_INIT_MASK)
 	{
 		case CH_INIT_NONE:
+			break;
+
 		case CH_INIT_COPY:
+			if (prev == NULL)
+			{
+				fprintf (stderr, "error: delta image without a previous image\n");
+				res->len = 0;
+				return res;
+			}
 			break;
 
 		case CH_INIT_CLEAN:
@@ -778,10 +796,23 @@ struct buffer *buffer_decompress (struct buffer *buf)
 	}
 
 	res->len = outptr - res->data;
+
+	/* A delta is applied to the previous image with XOR */
+	if ((flags & CH_INIT_MASK) == CH_INIT_COPY)
+	{
+		for (outptr = res->data; outptr < res->data + res->len; outptr++)
+			*outptr ^= prev->data[outptr - res->data];
+	}
 	return res;
 }
 
 
+struct buffer *buffer_decompress (struct buffer *buf)
+{
+	return buffer_decompress_delta (buf, NULL);
+}
+
+
 /**
  * Encode a joined bitmap using run-length encoding (RLE).
  *
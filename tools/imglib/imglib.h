@@ -126,10 +126,12 @@ struct buffer *buffer_unop(struct buffer *buf, unary_operator op);
 struct buffer *buffer_joinbits(struct buffer *buf);
 struct buffer *buffer_splitbits(struct buffer *buf);
 int buffer_compare(struct buffer *a, struct buffer *b);
+struct buffer *buffer_compute_delta (struct buffer *dst, struct buffer *src);
 struct buffer *buffer_replace(struct buffer *old, struct buffer *new);
 struct img_histogram *histogram_update(struct buffer *buf);
 struct buffer *buffer_compress(struct buffer *buf, struct buffer *prev);
 struct buffer *buffer_decompress(struct buffer *buf);
+struct buffer *buffer_decompress_delta (struct buffer *buf, struct buffer *prev);
 struct buffer *buffer_rle_encode (struct buffer *buf);
 struct buffer *buffer_sparse_encode (struct buffer *buf);
 struct buffer *bitmap_crop(struct buffer *buf);
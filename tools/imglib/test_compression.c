@@ -24,15 +24,23 @@
 void compression_test (int passes)
 {
 	struct buffer *enc, *dec;
-	struct buffer *buf;
+	struct buffer *buf, *prev = NULL;
 	unsigned int x, y;
 	int n;
 	unsigned long pass;
 
 	for (pass = 0; pass < passes; pass++)
 	{
-		/* Allocate a test frame */
-		buf = frame_alloc ();
+		/* Allocate a test frame.  Every other pass starts from the
+		previous frame, so that the delta encoding gets exercised. */
+		if (prev && (pass & 1))
+		{
+			buf = buffer_splitbits (prev);
+			buf->width = FRAME_WIDTH;
+			buf->height = FRAME_HEIGHT;
+		}
+		else
+			buf = frame_alloc ();
 
 		/* Do 200 random pixel writes into the frame. */
 		for (n = 0; n < 200; n++)
@@ -45,7 +53,7 @@ void compression_test (int passes)
 		buf = buffer_replace (buf, buffer_joinbits (buf));
 
 		/* Test that compression and decompression are true
-		inverses. */
+		inverses, both standalone and as a delta. */
 		enc = buffer_compress (buf, NULL);
 		dec = buffer_decompress (enc);
 		if (buffer_compare (buf, dec))
@@ -55,11 +63,27 @@ void compression_test (int passes)
 			buffer_write_c (dec, stdout);
 			exit (1);
 		}
-
 		buffer_free (enc);
 		buffer_free (dec);
-		buffer_free (buf);
+
+		if (prev)
+		{
+			enc = buffer_compress (buf, prev);
+			dec = buffer_decompress_delta (enc, prev);
+			if (buffer_compare (buf, dec))
+			{
+				printf ("delta error on pass %ld:\n", pass);
+				buffer_write_c (buf, stdout);
+				buffer_write_c (dec, stdout);
+				exit (1);
+			}
+			buffer_free (enc);
+			buffer_free (dec);
+			buffer_free (prev);
+		}
+		prev = buf;
 	}
+	buffer_free (prev);
 }
 
 
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * lampbench : measure the cost of composing the lamp matrix.
+ *
+ * Usage: lampbench_64 [<count>]
+ *        lampbench_128 [<count>]
+ *        lampbench_256 [<count>]
+ *
+ * Each program is this file and kernel/lampset.c built for a matrix of
+ * that many lamps.  It times, in nanoseconds per operation:
+ *
+ * - byte: the whole matrix computed a column at a time with
+ *   platform_lamp_compute(), as the strobing lamp drivers do it;
+ * - word: the same with bench_compose_words(), a word at a time;
+ * - leff: a lamp effect allocating and freeing its lamps, which is
+ *   lamp_set_can_be_added(), lamp_set_subtract() and lamp_set_add().
+ *
+ * Before timing, the two composes are checked against each other on
+ * random matrices.
+ */
+
+#include <time.h>
+#include <freewpc.h>
+
+/* Without a platform, <freewpc.h> leaves out the I/O headers that
+kernel/lampset.c expects. */
+#include <system/sound.h>
+#include <system/switch.h>
+#include <system/lamp.h>
+#include "kernel/lampset.c"
+
+lamp_set lamp_matrix;
+lamp_set lamp_flash_matrix_now;
+lamp_set leff_free_set;
+lamp_set leff_data_set;
+lamp_set lamp_pwm_mask;
+const U8 *lamp_pwm_now;
+
+/** The intensity plane being output */
+lamp_set bench_pwm_plane;
+
+/** The outputs of each method */
+lamp_set bench_byte_out;
+lamp_set bench_word_out;
+
+/** The lamps that a benchmark lamp effect allocates */
+lamp_set bench_leff_set;
+
+
+static double bench_now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** Fill the real lamps of a set with random bits. */
+static void bench_randomize (lamp_set set)
+{
+	U8 col;
+	for (col = 0; col < NUM_LAMP_COLS; col++)
+		set[col] = rand ();
+}
+
+
+static void bench_compose_bytes (lamp_set out)
+{
+	U8 col;
+	for (col = 0; col < NUM_LAMP_COLS; col++)
+		out[col] = platform_lamp_compute (col);
+}
+
+
+/** Compute the outputs of every lamp at once, with the same terms as
+platform_lamp_compute(), for a driver that writes the whole matrix
+together. */
+static void bench_compose_words (lamp_set dst)
+{
+	register lamp_word_t *dst1 = (lamp_word_t *)dst;
+	register const lamp_word_t *lamps = (const lamp_word_t *)lamp_matrix;
+	register const lamp_word_t *flash = (const lamp_word_t *)lamp_flash_matrix_now;
+	register const lamp_word_t *leff_free = (const lamp_word_t *)leff_free_set;
+	register const lamp_word_t *leff_data = (const lamp_word_t *)leff_data_set;
+	register const lamp_word_t *pwm_mask = (const lamp_word_t *)lamp_pwm_mask;
+	register const lamp_word_t *pwm_now = (const lamp_word_t *)lamp_pwm_now;
+
+#define op(n) dst1[n] = ((((lamps[n] | flash[n]) & leff_free[n]) \
+	| (leff_data[n] & ~leff_free[n])) & ~pwm_mask[n]) | pwm_now[n]
+	lamp_set_unroll (op);
+#undef op
+}
+
+
+/** Return nonzero if both methods agree on many random matrices. */
+static bool bench_check (void)
+{
+	unsigned int n;
+
+	lamp_pwm_now = bench_pwm_plane;
+	for (n = 0; n < 10000; n++)
+	{
+		bench_randomize (lamp_matrix);
+		bench_randomize (lamp_flash_matrix_now);
+		bench_randomize (leff_free_set);
+		bench_randomize (leff_data_set);
+		bench_randomize (lamp_pwm_mask);
+		bench_randomize (bench_pwm_plane);
+		bench_compose_bytes (bench_byte_out);
+		bench_compose_words (bench_word_out);
+		if (memcmp (bench_byte_out, bench_word_out, sizeof (lamp_set)))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+
+/** Return the time of one byte-wise compose, in nanoseconds.  The
+barrier says that memory may have changed between iterations, so that
+nothing can be hoisted out of the loop. */
+static double bench_byte (unsigned int count)
+{
+	unsigned int n;
+	double start = bench_now ();
+
+	for (n = 0; n < count; n++)
+	{
+		bench_compose_bytes (bench_byte_out);
+		__asm__ volatile ("" ::: "memory");
+	}
+	return (bench_now () - start) * 1e9 / count;
+}
+
+
+static double bench_word (unsigned int count)
+{
+	unsigned int n;
+	double start = bench_now ();
+
+	for (n = 0; n < count; n++)
+	{
+		bench_compose_words (bench_word_out);
+		__asm__ volatile ("" ::: "memory");
+	}
+	return (bench_now () - start) * 1e9 / count;
+}
+
+
+static double bench_leff (unsigned int count)
+{
+	unsigned int n;
+	double start;
+
+	lamp_set_zero (bench_leff_set);
+	bench_randomize (bench_leff_set);
+	memset (leff_free_set, 0xFF, NUM_LAMP_COLS);
+
+	start = bench_now ();
+	for (n = 0; n < count; n++)
+	{
+		if (lamp_set_can_be_added (leff_free_set, bench_leff_set))
+			lamp_set_subtract (leff_free_set, bench_leff_set);
+		lamp_set_add (leff_free_set, bench_leff_set);
+		__asm__ volatile ("" ::: "memory");
+	}
+	return (bench_now () - start) * 1e9 / count;
+}
+
+
+int main (int argc, char *argv[])
+{
+	unsigned int count = 10000000;
+
+	if (argc > 1)
+		count = strtoul (argv[1], NULL, 0);
+
+	if (!bench_check ())
+	{
+		fprintf (stderr, "lampbench: compose results differ\n");
+		exit (1);
+	}
+
+	printf ("%d lamps, %d words of %d bits\n", PINIO_NUM_LAMPS,
+		(int)LAMP_SET_WORDS, (int)sizeof (lamp_word_t) * 8);
+	printf ("%-8s %8.2f ns\n", "byte", bench_byte (count));
+	printf ("%-8s %8.2f ns\n", "word", bench_word (count));
+	printf ("%-8s %8.2f ns\n", "leff", bench_leff (count));
+	return 0;
+}
@@ -0,0 +1,3 @@
+/* lampbench with a 128-lamp matrix */
+#define PINIO_NUM_LAMPS 128
+#include "lampbench.c"
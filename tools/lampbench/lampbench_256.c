@@ -0,0 +1,3 @@
+/* lampbench with a 256-lamp matrix */
+#define PINIO_NUM_LAMPS 256
+#include "lampbench.c"
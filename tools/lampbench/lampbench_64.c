@@ -0,0 +1,3 @@
+/* lampbench with a 64-lamp matrix */
+#define PINIO_NUM_LAMPS 64
+#include "lampbench.c"
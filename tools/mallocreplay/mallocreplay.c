@@ -0,0 +1,196 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * mallocreplay : replay an allocation trace against the 6809 slab
+ * allocator.
+ *
+ * Usage: mallocreplay [<trace file>]
+ *
+ * The trace is the debug output of a game built with MALLOC_TRACE
+ * defined in cpu/m6809/malloc.c; other lines are ignored, so a whole
+ * debugger log can be given.  The lines of interest are:
+ *
+ *   mtrace malloc <size> <address>
+ *   mtrace free <address>
+ *
+ * Only these count.  The allocator's own complaints ("malloc <size>
+ * failed", "bad free <address>") look much the same, but a failed call
+ * never returned a block and a bad free never released one, so they are
+ * skipped; the replay finds such errors for itself.
+ *
+ * Each call is repeated on the same allocator code, built for the host
+ * with the slab sizes in include/system/malloc.h (override them with
+ * -DMALLOC_SLOTS_8=n and so on in TOOL_CFLAGS).  At the end, each size
+ * class's high-water mark and failures are printed, along with how many
+ * slots it would have needed if no request ever spilled into a larger
+ * class.  The exit status is 1 if the trace ran out of memory or freed
+ * something that was not allocated.
+ */
+
+#include <freewpc.h>
+#include <callset.h>
+#include <printf.h>
+
+/* Keep the allocator apart from the C library's */
+#define malloc slab_malloc
+#define free slab_free
+
+#include <system/malloc.h>
+#include "cpu/m6809/malloc.c"
+
+#undef malloc
+#undef free
+
+/** The most allocations that can be live at once */
+#define MAX_LIVE 256
+
+/** Maps an address in the trace to the one that the replay got */
+struct live
+{
+	unsigned int addr;
+	void *ptr;
+	U8 class;
+};
+
+struct live live[MAX_LIVE];
+unsigned int live_count;
+
+/** The current and peak number of live requests for each class,
+counted by the class the request asked for */
+unsigned int demand[MALLOC_CLASSES];
+unsigned int demand_peak[MALLOC_CLASSES];
+
+unsigned long line_no;
+unsigned long calls;
+
+
+static void report (void)
+{
+	U8 class;
+
+	printf ("%lu calls replayed\n", calls);
+	printf ("%5s %6s %5s %5s %5s %7s %7s\n",
+		"size", "slots", "used", "high", "fail", "allocs", "needed");
+	for (class = 0; class < MALLOC_CLASSES; class++)
+	{
+		struct malloc_stats *st = &malloc_stats[class];
+		printf ("%5d %6d %5d %5d %5d %7d %7u\n",
+			malloc_class_size (class), malloc_class_slots (class),
+			st->used, st->high_water, st->failures, st->allocs,
+			demand_peak[class]);
+	}
+}
+
+
+void fatal (U8 errcode)
+{
+	printf ("line %lu: fatal error %d\n", line_no, errcode);
+	report ();
+	exit (1);
+}
+
+
+static struct live *live_find (unsigned int addr)
+{
+	unsigned int n;
+	for (n = 0; n < live_count; n++)
+		if (live[n].addr == addr)
+			return &live[n];
+	return NULL;
+}
+
+
+static void replay_malloc (unsigned int size, unsigned int addr)
+{
+	struct live *l;
+
+	if (size > 64)
+	{
+		printf ("line %lu: malloc of %u bytes\n", line_no, size);
+		exit (1);
+	}
+	if (live_find (addr))
+	{
+		printf ("line %lu: %04X allocated twice\n", line_no, addr);
+		exit (1);
+	}
+	if (live_count == MAX_LIVE)
+	{
+		printf ("line %lu: too many live allocations\n", line_no);
+		exit (2);
+	}
+	l = &live[live_count++];
+	l->addr = addr;
+	l->class = malloc_class_for_size (size);
+	l->ptr = slab_malloc (size);
+	memset (l->ptr, 0xA5, size);
+
+	if (++demand[l->class] > demand_peak[l->class])
+		demand_peak[l->class] = demand[l->class];
+}
+
+
+static void replay_free (unsigned int addr)
+{
+	struct live *l = live_find (addr);
+
+	if (!l)
+	{
+		printf ("line %lu: free of %04X, which is not allocated\n", line_no, addr);
+		report ();
+		exit (1);
+	}
+	slab_free (l->ptr);
+	demand[l->class]--;
+	*l = live[--live_count];
+}
+
+
+int main (int argc, char *argv[])
+{
+	FILE *fp = stdin;
+	char line[256], *p;
+	unsigned int size, addr;
+
+	if (argc > 1 && !(fp = fopen (argv[1], "r")))
+	{
+		fprintf (stderr, "mallocreplay: cannot open %s\n", argv[1]);
+		return 2;
+	}
+
+	malloc_init ();
+	while (fgets (line, sizeof (line), fp))
+	{
+		line_no++;
+		if (!(p = strstr (line, "mtrace ")))
+			continue;
+		if (sscanf (p, "mtrace malloc %u %x", &size, &addr) == 2)
+			replay_malloc (size, addr);
+		else if (sscanf (p, "mtrace free %x", &addr) == 1)
+			replay_free (addr);
+		else
+			continue;
+		calls++;
+	}
+
+	report ();
+	return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * nvstress : crash the journaled protected memory code at random
+ * points and check that it always recovers to a consistent state.
+ *
+ * Usage: nvstress [<iterations>] [<directory>]
+ *        nvstress -b [<count>] [<directory>]
+ *
+ * Each iteration forks a child which updates protected memory the way
+ * the kernel does: it rewrites one 'file' area, stores the area's
+ * checksum in a table, and commits both.  The child dies either at a
+ * random step inside nvj_commit(), through the fault hook, or when the
+ * parent kills it with SIGKILL after a random delay.
+ *
+ * The parent then reopens the image, which replays or discards the
+ * journal, and checks that:
+ * - every area matches its checksum, as csum_area_check() would, so
+ *   nothing would be reset to factory defaults;
+ * - the last commit that the child reported as complete was kept.
+ *
+ * Killing a process does not lose data in the page cache, so this
+ * tests torn transactions, not lost writes after a power cut.
+ *
+ * With -b, it instead measures how many audit increments per second
+ * each way of updating protected memory can sustain: summing the whole
+ * area and committing it every time, as csum_area_update() does; adding
+ * the change to the checksum and committing only the dirty block; and
+ * doing that but committing once per BENCH_BATCH increments, as
+ * audit_increment() and the once-a-second csum_flush() do.  The same
+ * three are also timed without the journal, which is what they cost
+ * on a machine with battery-backed RAM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "cpu/native/nvjournal.c"
+
+#define NUM_AREAS 8
+#define AREA_SIZE 96
+
+/** The layout of the test's protected memory */
+struct nvram
+{
+	unsigned int seq;
+	unsigned char csum[NUM_AREAS];
+	unsigned char area[NUM_AREAS][AREA_SIZE];
+};
+
+struct nvram nvram;
+char image_file[256];
+char journal_file[256];
+
+/** The chance, out of 1000, of crashing at each fault point */
+#define FAULT_CHANCE 20
+
+int report_fd;
+unsigned long faults[NVJ_FAULT_APPLIED + 1];
+
+
+static unsigned char area_csum (unsigned int n)
+{
+	unsigned char csum = 0;
+	unsigned int i;
+	for (i = 0; i < AREA_SIZE; i++)
+		csum += nvram.area[n][i];
+	return csum;
+}
+
+
+static void child_fault (enum nvj_fault_point point)
+{
+	if (rand () % 1000 < FAULT_CHANCE)
+	{
+		/* Tell the parent where we died */
+		unsigned int msg = 0x80000000 | point;
+		write (report_fd, &msg, sizeof (msg));
+		_exit (0);
+	}
+}
+
+
+static void child (void)
+{
+	unsigned int n, i;
+
+	srand (getpid ());
+	if (nvj_open (image_file, journal_file, (unsigned char *)&nvram, sizeof (nvram)) < 0)
+		_exit (1);
+	nvj_fault_hook = child_fault;
+
+	/* What was recovered at startup counts as committed */
+	write (report_fd, &nvram.seq, sizeof (nvram.seq));
+
+	for (;;)
+	{
+		/* Rewrite one area completely and update its checksum */
+		n = rand () % NUM_AREAS;
+		for (i = 0; i < AREA_SIZE; i++)
+			nvram.area[n][i] = rand ();
+		nvram.csum[n] = area_csum (n);
+		nvram.seq++;
+
+		nvj_add ((unsigned char *)&nvram.area[n] - (unsigned char *)&nvram, AREA_SIZE);
+		nvj_add (0, sizeof (nvram.seq) + sizeof (nvram.csum));
+		if (nvj_commit () < 0)
+			_exit (1);
+		write (report_fd, &nvram.seq, sizeof (nvram.seq));
+	}
+}
+
+
+/**
+ * Reopen the image after a crash and check it.  Returns the number
+ * of errors found.
+ */
+static unsigned int check (unsigned int committed)
+{
+	unsigned int n, errors = 0;
+
+	memset (&nvram, 0, sizeof (nvram));
+	if (nvj_open (image_file, journal_file, (unsigned char *)&nvram, sizeof (nvram)) < 0)
+	{
+		fprintf (stderr, "nvstress: cannot reopen %s\n", image_file);
+		return 1;
+	}
+	for (n = 0; n < NUM_AREAS; n++)
+		if (area_csum (n) != nvram.csum[n])
+		{
+			fprintf (stderr, "nvstress: area %u checksum %02X, stored %02X\n",
+				n, area_csum (n), nvram.csum[n]);
+			errors++;
+		}
+	if (nvram.seq < committed || nvram.seq > committed + 1)
+	{
+		fprintf (stderr, "nvstress: recovered commit %u, last completed %u\n",
+			nvram.seq, committed);
+		errors++;
+	}
+	nvj_release ();
+	return errors;
+}
+
+
+/* These must match kernel/csum.c */
+#define BENCH_BLOCK_SIZE 32
+
+/** The number of increments committed together in batched mode */
+#define BENCH_BATCH 60
+
+enum bench_mode { BENCH_FULL, BENCH_DELTA, BENCH_BATCHED };
+
+
+static double bench_now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Increment COUNT random 16-bit audits in area 0 using MODE, and return
+ * the number of increments per second.  If JOURNAL is zero, the
+ * changes are not written anywhere.
+ */
+static double bench (enum bench_mode mode, unsigned int count, int journal)
+{
+	unsigned short *audits = (unsigned short *)nvram.area[0];
+	unsigned short *aud, old;
+	unsigned int n, offset, dirty = 0;
+	double start;
+
+	memset (&nvram, 0, sizeof (nvram));
+	if (journal && nvj_open (image_file, journal_file,
+		(unsigned char *)&nvram, sizeof (nvram)) < 0)
+	{
+		fprintf (stderr, "nvstress: cannot open %s\n", image_file);
+		exit (2);
+	}
+
+	srand (1);
+	start = bench_now ();
+	for (n = 0; n < count; n++)
+	{
+		aud = &audits[rand () % (AREA_SIZE / sizeof (*aud))];
+		old = *aud;
+		(*aud)++;
+		offset = (unsigned char *)aud - (unsigned char *)&nvram;
+
+		if (mode == BENCH_FULL)
+		{
+			nvram.csum[0] = area_csum (0);
+			if (journal)
+			{
+				nvj_add (offset - offset % sizeof (nvram.area[0]), AREA_SIZE);
+				nvj_add (0, sizeof (nvram.seq) + sizeof (nvram.csum));
+				nvj_commit ();
+			}
+			continue;
+		}
+
+		nvram.csum[0] += (*aud & 0xFF) - (old & 0xFF) + (*aud >> 8) - (old >> 8);
+		if (!journal)
+			continue;
+		nvj_add (offset - offset % BENCH_BLOCK_SIZE, BENCH_BLOCK_SIZE);
+		if (mode == BENCH_DELTA || ++dirty == BENCH_BATCH)
+		{
+			nvj_add (0, sizeof (nvram.seq) + sizeof (nvram.csum));
+			nvj_commit ();
+			dirty = 0;
+		}
+	}
+	if (journal && dirty)
+	{
+		nvj_add (0, sizeof (nvram.seq) + sizeof (nvram.csum));
+		nvj_commit ();
+	}
+	start = bench_now () - start;
+
+	if (area_csum (0) != nvram.csum[0])
+	{
+		fprintf (stderr, "nvstress: benchmark checksum mismatch\n");
+		exit (1);
+	}
+	if (journal)
+		nvj_close ();
+	return count / start;
+}
+
+
+static int bench_all (unsigned int count)
+{
+	static const char *names[] = { "full", "delta", "batched" };
+	enum bench_mode mode;
+
+	printf ("%-8s %14s %14s\n", "mode", "journal (/s)", "RAM only (/s)");
+	for (mode = BENCH_FULL; mode <= BENCH_BATCHED; mode++)
+	{
+		/* Without the journal, delta and batched are the same */
+		double ram = bench (mode, count * 1000, 0);
+		printf ("%-8s %14.0f %14.0f\n", names[mode], bench (mode, count, 1), ram);
+	}
+	unlink (image_file);
+	unlink (journal_file);
+	return 0;
+}
+
+
+int main (int argc, char *argv[])
+{
+	unsigned int iterations = 200;
+	const char *dir = "/tmp";
+	unsigned int iter, errors = 0, crashed = 0, msg, committed = 0;
+	int fds[2];
+	pid_t pid;
+	int benchmark = 0;
+
+	if (argc > 1 && !strcmp (argv[1], "-b"))
+	{
+		benchmark = 1;
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		iterations = strtoul (argv[1], NULL, 0);
+	if (argc > 2)
+		dir = argv[2];
+	sprintf (image_file, "%s/nvstress.nv", dir);
+	sprintf (journal_file, "%s/nvstress.jnl", dir);
+	unlink (image_file);
+	unlink (journal_file);
+	if (benchmark)
+		return bench_all (iterations);
+	srand (getpid ());
+
+	for (iter = 0; iter < iterations; iter++)
+	{
+		if (pipe (fds) < 0)
+			return 2;
+		pid = fork ();
+		if (pid == 0)
+		{
+			close (fds[0]);
+			report_fd = fds[1];
+			child ();
+		}
+		close (fds[1]);
+
+		/* Let the child run for a while, unless it crashes first */
+		usleep (rand () % 20000);
+		kill (pid, SIGKILL);
+		waitpid (pid, NULL, 0);
+
+		/* Find the last commit that completed, and where it died */
+		msg = 0;
+		while (read (fds[0], &msg, sizeof (msg)) == sizeof (msg))
+		{
+			if (msg & 0x80000000)
+			{
+				faults[msg & 0xFF]++;
+				msg = 0;
+			}
+			else
+				committed = msg;
+		}
+		close (fds[0]);
+
+		errors += check (committed);
+	}
+
+	for (msg = 0; msg <= NVJ_FAULT_APPLIED; msg++)
+		crashed += faults[msg];
+	printf ("%u iterations, %u crashed at a fault point, %u killed\n",
+		iterations, crashed, iterations - crashed);
+	printf ("faults: header %lu, data %lu, trailer %lu, synced %lu, apply %lu, applied %lu\n",
+		faults[NVJ_FAULT_HEADER], faults[NVJ_FAULT_DATA], faults[NVJ_FAULT_TRAILER],
+		faults[NVJ_FAULT_SYNCED], faults[NVJ_FAULT_APPLY], faults[NVJ_FAULT_APPLIED]);
+	printf ("journal replayed %lu times, discarded %lu times\n",
+		nvj_stats.recovered, nvj_stats.discarded);
+	printf ("%u errors\n", errors);
+	unlink (image_file);
+	unlink (journal_file);
+	return errors ? 1 : 0;
+}
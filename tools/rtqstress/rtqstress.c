@@ -0,0 +1,328 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * rtqstress : stress the task <-> realtime handoffs used by the native
+ * pthreads build.
+ *
+ * Usage: rtqstress [<seconds>]
+ *
+ * A realtime thread ticks at 10kHz, ten times faster than the real
+ * RTT, and plays the consumer side of three paths:
+ *
+ * - sound: several task threads write 2-byte commands into a generic
+ *   queue_t under rt_queue_lock(); the RTT drains one byte per tick, as
+ *   sound_write_rtt() does, and checks that the pairs arrive whole and
+ *   in order.
+ * - solenoid: a task publishes a pulse request with rt_store() on the
+ *   timer, as sol_req_start_specific() does; the RTT checks the payload
+ *   and counts the timer down to zero, as sol_req_rtt() does.
+ * - switch: task threads post switch toggles, as sim_switch_toggle()
+ *   does; the RTT applies them to a matrix which must end up equal to
+ *   the producers' shadow copy.
+ *
+ * This uses the real queue.h and irq.h.  It is built with
+ * -fsanitize=thread by default, so any missing ordering shows up as a
+ * ThreadSanitizer report as well as a failed check.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CONFIG_NATIVE
+#define CONFIG_PTHREADS
+
+typedef unsigned char U8;
+typedef unsigned short U16;
+typedef unsigned char bool;
+#define TRUE 1
+#define FALSE 0
+
+#include "include/system/irq.h"
+#include "include/queue.h"
+
+bool linux_irq_enable;
+bool linux_firq_enable;
+
+#define TICK_NSECS 100000	/* 10kHz */
+#define SOUND_PRODUCERS 3
+#define SWITCH_PRODUCERS 2
+#define QUEUE_LEN 8
+#define SWITCH_QUEUE_LEN 64
+#define NUM_SWITCHES 72
+
+static pthread_mutex_t rt_queue_mutex;
+
+void rt_queue_lock (void)
+{
+	pthread_mutex_lock (&rt_queue_mutex);
+}
+
+void rt_queue_unlock (void)
+{
+	pthread_mutex_unlock (&rt_queue_mutex);
+}
+
+
+struct {
+	queue_t header;
+	U8 elems[QUEUE_LEN];
+} sound_queue;
+
+struct {
+	queue_t header;
+	U8 elems[SWITCH_QUEUE_LEN];
+} switch_queue;
+
+U8 switch_matrix[NUM_SWITCHES / 8];
+U8 switch_shadow[NUM_SWITCHES / 8];
+
+U8 sol_timer;
+U8 sol_payload;
+U8 sol_payload_check;
+
+int running = 1;
+int rtt_running = 1;
+unsigned long errors;
+unsigned long ticks;
+unsigned long sound_cmds_sent[SOUND_PRODUCERS];
+unsigned long sound_cmds_recv[SOUND_PRODUCERS];
+unsigned long sol_pulses_started;
+unsigned long sol_pulses_done;
+unsigned long switch_posts;
+
+
+static void error (const char *msg, unsigned int a, unsigned int b)
+{
+	fprintf (stderr, "rtqstress: %s (%u, %u)\n", msg, a, b);
+	errors++;
+}
+
+
+static int still_running (int *flag)
+{
+	return __atomic_load_n (flag, __ATOMIC_ACQUIRE);
+}
+
+
+/** The consumer side, standing in for realtime_tick() */
+static void *rtt_thread (void *arg)
+{
+	struct timespec next;
+	U8 sound_hi = 0;
+	int sound_have_hi = 0;
+	U8 sound_next_seq[SOUND_PRODUCERS];
+	U8 timer;
+
+	memset (sound_next_seq, 0, sizeof (sound_next_seq));
+	clock_gettime (CLOCK_MONOTONIC, &next);
+	while (still_running (&rtt_running))
+	{
+		/* sound_write_rtt: one byte per tick */
+		if (!queue_empty_p (&sound_queue.header))
+		{
+			U8 b = queue_remove (&sound_queue.header, QUEUE_LEN);
+			if (!sound_have_hi)
+			{
+				if (!(b & 0x80) || (b & 0x7F) >= SOUND_PRODUCERS)
+					error ("sound: bad command byte", b, 0);
+				sound_hi = b & 0x7F;
+				sound_have_hi = 1;
+			}
+			else
+			{
+				if (b != sound_next_seq[sound_hi])
+					error ("sound: out of sequence", sound_hi, b);
+				sound_next_seq[sound_hi] = b + 1;
+				sound_cmds_recv[sound_hi]++;
+				sound_have_hi = 0;
+			}
+		}
+
+		/* sol_req_rtt */
+		timer = rt_load (sol_timer);
+		if (timer != 0)
+		{
+			if ((U8)~sol_payload != sol_payload_check)
+				error ("sol: torn request", sol_payload, sol_payload_check);
+			if (--timer == 0)
+				sol_pulses_done++;
+			rt_store (sol_timer, timer);
+		}
+
+		/* sim_switch_drain */
+		while (!queue_empty_p (&switch_queue.header))
+		{
+			U8 sw = queue_remove (&switch_queue.header, SWITCH_QUEUE_LEN);
+			if (sw >= NUM_SWITCHES)
+				error ("switch: bad number", sw, 0);
+			else
+				switch_matrix[sw / 8] ^= 1 << (sw % 8);
+		}
+
+		ticks++;
+		next.tv_nsec += TICK_NSECS;
+		if (next.tv_nsec >= 1000000000)
+		{
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	/* Drain whatever the producers left behind so the final
+	 * switch comparison is exact. */
+	while (!queue_empty_p (&switch_queue.header))
+	{
+		U8 sw = queue_remove (&switch_queue.header, SWITCH_QUEUE_LEN);
+		switch_matrix[sw / 8] ^= 1 << (sw % 8);
+	}
+	return NULL;
+}
+
+
+static void *sound_thread (void *arg)
+{
+	U8 id = (U8)(unsigned long)arg;
+	U8 seq = 0;
+
+	while (still_running (&running))
+	{
+		rt_queue_lock ();
+		if (queue_full_p (&sound_queue.header, QUEUE_LEN))
+		{
+			rt_queue_unlock ();
+			sched_yield ();
+			continue;
+		}
+		/* Both bytes must fit, or the pair could be split across
+		 * another producer's command. */
+		queue_insert (&sound_queue.header, QUEUE_LEN, 0x80 | id);
+		while (queue_full_p (&sound_queue.header, QUEUE_LEN))
+			sched_yield ();
+		queue_insert (&sound_queue.header, QUEUE_LEN, seq++);
+		rt_queue_unlock ();
+		sound_cmds_sent[id]++;
+	}
+	return NULL;
+}
+
+
+static void *sol_thread (void *arg)
+{
+	U8 n = 0;
+
+	while (still_running (&running))
+	{
+		if (rt_load (sol_timer) != 0)
+		{
+			sched_yield ();
+			continue;
+		}
+		n++;
+		sol_payload = n;
+		sol_payload_check = ~n;
+		rt_store (sol_timer, (n % 7) + 1);
+		sol_pulses_started++;
+	}
+	return NULL;
+}
+
+
+static void *switch_thread (void *arg)
+{
+	unsigned int seed = (unsigned int)(unsigned long)arg;
+
+	while (still_running (&running))
+	{
+		U8 sw = rand_r (&seed) % NUM_SWITCHES;
+		rt_queue_lock ();
+		if (!queue_full_p (&switch_queue.header, SWITCH_QUEUE_LEN))
+		{
+			switch_shadow[sw / 8] ^= 1 << (sw % 8);
+			queue_insert (&switch_queue.header, SWITCH_QUEUE_LEN, sw);
+			switch_posts++;
+		}
+		rt_queue_unlock ();
+		sched_yield ();
+	}
+	return NULL;
+}
+
+
+int main (int argc, char *argv[])
+{
+	pthread_t rtt, sol, sound[SOUND_PRODUCERS], sw[SWITCH_PRODUCERS];
+	pthread_mutexattr_t mutex_attr;
+	unsigned long sent = 0, recv = 0;
+	int secs = 5;
+	int i;
+
+	if (argc > 1)
+		secs = atoi (argv[1]);
+
+	pthread_mutexattr_init (&mutex_attr);
+	pthread_mutexattr_settype (&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init (&rt_queue_mutex, &mutex_attr);
+	queue_init (&sound_queue.header);
+	queue_init (&switch_queue.header);
+
+	pthread_create (&rtt, NULL, rtt_thread, NULL);
+	pthread_create (&sol, NULL, sol_thread, NULL);
+	for (i = 0; i < SOUND_PRODUCERS; i++)
+		pthread_create (&sound[i], NULL, sound_thread, (void *)(unsigned long)i);
+	for (i = 0; i < SWITCH_PRODUCERS; i++)
+		pthread_create (&sw[i], NULL, switch_thread, (void *)(unsigned long)(i + 1));
+
+	sleep (secs);
+	__atomic_store_n (&running, 0, __ATOMIC_RELEASE);
+
+	/* Producers first, so that the RTT sees everything they posted */
+	pthread_join (sol, NULL);
+	for (i = 0; i < SOUND_PRODUCERS; i++)
+		pthread_join (sound[i], NULL);
+	for (i = 0; i < SWITCH_PRODUCERS; i++)
+		pthread_join (sw[i], NULL);
+	__atomic_store_n (&rtt_running, 0, __ATOMIC_RELEASE);
+	pthread_join (rtt, NULL);
+
+	for (i = 0; i < SOUND_PRODUCERS; i++)
+	{
+		sent += sound_cmds_sent[i];
+		recv += sound_cmds_recv[i];
+	}
+	if (memcmp (switch_matrix, switch_shadow, sizeof (switch_matrix)))
+		error ("switch: matrix does not match shadow", 0, 0);
+	if (sent - recv > QUEUE_LEN / 2)
+		error ("sound: commands lost", sent, recv);
+
+	printf ("ticks %lu (%lu Hz)\n", ticks, ticks / secs);
+	printf ("sound commands sent %lu received %lu\n", sent, recv);
+	printf ("sol pulses started %lu finished %lu\n",
+		sol_pulses_started, sol_pulses_done);
+	printf ("switch toggles %lu\n", switch_posts);
+	printf ("%lu errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * simpool : a C API for running many simulated machines at once.
+ *
+ * The kernel and the simulator keep all of their state in globals, so
+ * each machine is a process of the native build, started with
+ * --instance and driven over a socket with the commands documented in
+ * sim/instance.c.  The operating system then gives every instance its
+ * own copy of the state and its own core; the caller needs no threads.
+ *
+ * A pool sends a command to all of its instances before waiting for
+ * any reply, so they all run at once and a step of the pool takes as
+ * long as its slowest machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "simpool.h"
+
+/** The descriptor that an instance reads its commands from */
+#define INSTANCE_FD 3
+
+/** If nonzero, an instance that takes longer than this many milliseconds
+to reply is killed, and treated as if it had exited */
+unsigned long sim_instance_timeout;
+
+
+/** Mark an instance as gone, and collect its exit status. */
+static void instance_dead (struct sim_instance *inst)
+{
+	if (inst->dead)
+		return;
+	inst->dead = 1;
+	close (inst->fd);
+	waitpid (inst->pid, &inst->status, 0);
+}
+
+
+/** Send one command line. */
+static int instance_send (struct sim_instance *inst, const char *cmd)
+{
+	size_t len = strlen (cmd);
+
+	if (inst->dead)
+		return -1;
+	if (send (inst->fd, cmd, len, MSG_NOSIGNAL) != len
+		|| (cmd[len-1] != '\n' && send (inst->fd, "\n", 1, MSG_NOSIGNAL) != 1))
+	{
+		instance_dead (inst);
+		return -1;
+	}
+	return 0;
+}
+
+
+/** Read one reply line, without the newline. */
+static int instance_recv (struct sim_instance *inst, char *reply, size_t len)
+{
+	char *nl;
+	ssize_t n;
+	size_t line_len;
+
+	while (!inst->dead)
+	{
+		nl = memchr (inst->buf, '\n', inst->buf_len);
+		if (nl)
+		{
+			line_len = nl - inst->buf;
+			if (reply && len)
+			{
+				size_t copy = line_len < len - 1 ? line_len : len - 1;
+				memcpy (reply, inst->buf, copy);
+				reply[copy] = '\0';
+			}
+			inst->buf_len -= line_len + 1;
+			memmove (inst->buf, nl + 1, inst->buf_len);
+			return 0;
+		}
+
+		if (inst->buf_len == sizeof (inst->buf))
+			inst->buf_len = 0;
+		if (sim_instance_timeout)
+		{
+			struct pollfd pfd = { .fd = inst->fd, .events = POLLIN };
+			if (poll (&pfd, 1, sim_instance_timeout) == 0)
+			{
+				inst->timed_out = 1;
+				kill (inst->pid, SIGKILL);
+			}
+		}
+		n = read (inst->fd, inst->buf + inst->buf_len,
+			sizeof (inst->buf) - inst->buf_len);
+		if (n <= 0)
+			instance_dead (inst);
+		else
+			inst->buf_len += n;
+	}
+	return -1;
+}
+
+
+/** Start a simulator process, without waiting for it to be ready. */
+static struct sim_instance *instance_spawn (const char *program,
+	const char *nvram_file, const char *log_file)
+{
+	struct sim_instance *inst;
+	int sv[2];
+	int fd;
+
+	if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+		return NULL;
+	inst = calloc (1, sizeof (*inst));
+	inst->fd = sv[0];
+
+	inst->pid = fork ();
+	if (inst->pid == 0)
+	{
+		/* dup2() onto itself would keep close-on-exec set */
+		if (sv[1] == INSTANCE_FD)
+			fcntl (sv[1], F_SETFD, 0);
+		else
+			dup2 (sv[1], INSTANCE_FD);
+
+		fd = open ("/dev/null", O_RDONLY);
+		dup2 (fd, 0);
+		fd = open (log_file ? log_file : "/dev/null",
+			O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		dup2 (fd, 1);
+		dup2 (fd, 2);
+
+		execl (program, program, "--instance", "3",
+			"--nvram", nvram_file, NULL);
+		_exit (127);
+	}
+	close (sv[1]);
+	if (inst->pid < 0)
+	{
+		close (sv[0]);
+		free (inst);
+		return NULL;
+	}
+	return inst;
+}
+
+
+/**
+ * Start a simulator.  PROGRAM is the native build to run.  It keeps its
+ * protected memory in NVRAM_FILE, which need not exist yet.  Its output
+ * goes to LOG_FILE, or nowhere if that is NULL.  Returns NULL if it did
+ * not start, or exited before it was ready.
+ */
+struct sim_instance *sim_instance_create (const char *program,
+	const char *nvram_file, const char *log_file)
+{
+	struct sim_instance *inst;
+
+	inst = instance_spawn (program, nvram_file, log_file);
+	if (inst && instance_recv (inst, NULL, 0) < 0)
+	{
+		free (inst);
+		return NULL;
+	}
+	return inst;
+}
+
+
+/**
+ * Run one command, and put its reply line in REPLY if that is not NULL.
+ * Returns -1 if the instance has exited.
+ */
+int sim_instance_command (struct sim_instance *inst, const char *cmd,
+	char *reply, size_t len)
+{
+	if (instance_send (inst, cmd) < 0)
+		return -1;
+	return instance_recv (inst, reply, len);
+}
+
+
+/** Run a script file.  Sleeps in the script let simulated time pass. */
+int sim_instance_load_script (struct sim_instance *inst, const char *file)
+{
+	char cmd[512];
+	snprintf (cmd, sizeof (cmd), "include %s", file);
+	return sim_instance_command (inst, cmd, NULL, 0);
+}
+
+
+/** Let at least MS milliseconds of simulated time pass. */
+int sim_instance_step (struct sim_instance *inst, unsigned long ms)
+{
+	char cmd[32], reply[32];
+
+	sprintf (cmd, "step %lu", ms);
+	if (sim_instance_command (inst, cmd, reply, sizeof (reply)) < 0)
+		return -1;
+	inst->time = strtoul (reply + 3, NULL, 10);
+	return 0;
+}
+
+
+/** Read the lamp matrix, one bit per lamp as in lamp_matrix.  Returns
+the number of bytes read. */
+int sim_instance_lamps (struct sim_instance *inst, unsigned char *lamps,
+	size_t len)
+{
+	char reply[256];
+	unsigned int n, val;
+
+	if (sim_instance_command (inst, "lamps", reply, sizeof (reply)) < 0)
+		return -1;
+	for (n = 0; n < len && sscanf (reply + n * 2, "%2x", &val) == 1; n++)
+		lamps[n] = val;
+	return n;
+}
+
+
+/** Read a player's score as a string of decimal digits. */
+int sim_instance_score (struct sim_instance *inst, unsigned int player,
+	char *digits, size_t len)
+{
+	char cmd[32];
+	sprintf (cmd, "score %u", player);
+	return sim_instance_command (inst, cmd, digits, len);
+}
+
+
+/**
+ * Stop an instance and free it.  Returns its exit status as given by
+ * waitpid(), so a fatal error shows up as a nonzero exit code.
+ */
+int sim_instance_destroy (struct sim_instance *inst)
+{
+	int status;
+
+	if (!inst->dead)
+	{
+		/* 'exit' saves protected memory; it does not reply */
+		instance_send (inst, "exit");
+		instance_recv (inst, NULL, 0);
+	}
+	status = inst->status;
+	free (inst);
+	return status;
+}
+
+
+/**
+ * Start an instance's protected memory afresh: remove FILE and any
+ * journal left by an instance that was killed, then copy TEMPLATE to it
+ * if one is given.  Returns zero on success.
+ */
+static int nvram_reset (const char *file, const char *template)
+{
+	char buf[4096], jnl[300];
+	ssize_t n;
+	int in, out, rc = 0;
+
+	snprintf (jnl, sizeof (jnl), "%s.jnl", file);
+	unlink (jnl);
+	unlink (file);
+	if (!template)
+		return 0;
+
+	in = open (template, O_RDONLY);
+	if (in < 0)
+		return -1;
+	out = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+	{
+		close (in);
+		return -1;
+	}
+	while ((n = read (in, buf, sizeof (buf))) > 0)
+		if (write (out, buf, n) != n)
+		{
+			rc = -1;
+			break;
+		}
+	if (n < 0)
+		rc = -1;
+	close (in);
+	if (close (out) < 0)
+		rc = -1;
+	return rc;
+}
+
+
+/**
+ * Start COUNT instances of PROGRAM.  Their protected memory and logs go
+ * in LOG_DIR as inst<n>.nv and inst<n>.log; if it is NULL, nothing is
+ * logged and the memory files go in /tmp.  Each starts from a copy of
+ * NVRAM_TEMPLATE, if given, or else from factory defaults.
+ */
+struct sim_pool *sim_pool_create (const char *program, unsigned int count,
+	const char *nvram_template, const char *log_dir)
+{
+	struct sim_pool *pool;
+	char nvram_file[256], log_file[256];
+	unsigned int n;
+	int failed = 0;
+
+	pool = calloc (1, sizeof (*pool));
+	pool->instances = calloc (count, sizeof (struct sim_instance *));
+	for (n = 0; n < count; n++)
+	{
+		if (log_dir)
+		{
+			snprintf (nvram_file, sizeof (nvram_file), "%s/inst%u.nv", log_dir, n);
+			snprintf (log_file, sizeof (log_file), "%s/inst%u.log", log_dir, n);
+		}
+		else
+		{
+			snprintf (nvram_file, sizeof (nvram_file), "/tmp/simpool-%d-%u.nv",
+				getpid (), n);
+			pool->temp_files = 1;
+		}
+		if (nvram_reset (nvram_file, nvram_template) < 0)
+			break;
+
+		pool->instances[n] = instance_spawn (program, nvram_file,
+			log_dir ? log_file : NULL);
+		if (!pool->instances[n])
+			break;
+		pool->count++;
+	}
+
+	/* They all initialize at once */
+	for (n = 0; n < pool->count; n++)
+		if (instance_recv (pool->instances[n], NULL, 0) < 0)
+			failed = 1;
+
+	if (failed || pool->count < count)
+	{
+		sim_pool_destroy (pool);
+		return NULL;
+	}
+	return pool;
+}
+
+
+/**
+ * Send a command to every instance that is still running, and wait for
+ * all of the replies.  Returns the number still running.
+ */
+unsigned int sim_pool_command (struct sim_pool *pool, const char *cmd)
+{
+	unsigned int n, alive = 0;
+
+	for (n = 0; n < pool->count; n++)
+		instance_send (pool->instances[n], cmd);
+	for (n = 0; n < pool->count; n++)
+		if (instance_recv (pool->instances[n], NULL, 0) == 0)
+			alive++;
+	return alive;
+}
+
+
+/** Step every instance by MS milliseconds at once.  Returns the number
+still running. */
+unsigned int sim_pool_step (struct sim_pool *pool, unsigned long ms)
+{
+	struct sim_instance *inst;
+	char cmd[32], reply[32];
+	unsigned int n, alive = 0;
+
+	sprintf (cmd, "step %lu", ms);
+	for (n = 0; n < pool->count; n++)
+		instance_send (pool->instances[n], cmd);
+	for (n = 0; n < pool->count; n++)
+	{
+		inst = pool->instances[n];
+		if (instance_recv (inst, reply, sizeof (reply)) == 0)
+		{
+			inst->time = strtoul (reply + 3, NULL, 10);
+			alive++;
+		}
+	}
+	return alive;
+}
+
+
+void sim_pool_destroy (struct sim_pool *pool)
+{
+	unsigned int n;
+
+	for (n = 0; n < pool->count; n++)
+		instance_send (pool->instances[n], "exit");
+	for (n = 0; n < pool->count; n++)
+		sim_instance_destroy (pool->instances[n]);
+	for (n = 0; pool->temp_files && n <= pool->count; n++)
+	{
+		char file[256];
+		sprintf (file, "/tmp/simpool-%d-%u.nv", getpid (), n);
+		unlink (file);
+		strcat (file, ".jnl");
+		unlink (file);
+	}
+	free (pool->instances);
+	free (pool);
+}
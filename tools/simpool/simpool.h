@@ -0,0 +1,87 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SIMPOOL_H
+#define _SIMPOOL_H
+
+/* This header only uses C types, so that any host program can link
+ * with libsimpool.a. */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** One running simulator.  Each instance is a separate process of the
+native build, started with --instance, so that it has its own copy of
+every global in the kernel and the simulator. */
+struct sim_instance
+{
+	pid_t pid;
+
+	/** Our end of the control channel */
+	int fd;
+
+	/** Bytes read from the channel that are not yet returned */
+	char buf[512];
+	size_t buf_len;
+
+	/** The simulated time after the last step, in milliseconds */
+	unsigned long time;
+
+	/** Nonzero once the process has exited */
+	int dead;
+
+	/** Its exit status, as returned by waitpid() */
+	int status;
+
+	/** Nonzero if it was killed for not replying in time */
+	int timed_out;
+};
+
+/** A set of instances that are stepped together */
+struct sim_pool
+{
+	struct sim_instance **instances;
+	unsigned int count;
+
+	/** Nonzero if the protected memory files are to be removed */
+	int temp_files;
+};
+
+extern unsigned long sim_instance_timeout;
+
+struct sim_instance *sim_instance_create (const char *program,
+	const char *nvram_file, const char *log_file);
+int sim_instance_command (struct sim_instance *inst, const char *cmd,
+	char *reply, size_t len);
+int sim_instance_load_script (struct sim_instance *inst, const char *file);
+int sim_instance_step (struct sim_instance *inst, unsigned long ms);
+int sim_instance_lamps (struct sim_instance *inst, unsigned char *lamps,
+	size_t len);
+int sim_instance_score (struct sim_instance *inst, unsigned int player,
+	char *digits, size_t len);
+int sim_instance_destroy (struct sim_instance *inst);
+
+struct sim_pool *sim_pool_create (const char *program, unsigned int count,
+	const char *nvram_template, const char *log_dir);
+unsigned int sim_pool_command (struct sim_pool *pool, const char *cmd);
+unsigned int sim_pool_step (struct sim_pool *pool, unsigned long ms);
+void sim_pool_destroy (struct sim_pool *pool);
+
+#endif /* _SIMPOOL_H */
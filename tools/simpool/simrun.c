@@ -0,0 +1,158 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * simrun : run a script on many simulated machines at once.
+ *
+ * Usage: simrun [-n <instances>] [-t <seconds>] [-s <script>]
+ *               [-m <nvram template>] [-d <log dir>] [-r <seed>] <program>
+ *
+ * PROGRAM is a native build.  It should use the green-thread task
+ * backend (CONFIG_GREEN), so that each machine runs as fast as it can
+ * instead of in real time.  Every instance runs SCRIPT, then the pool
+ * is stepped a second at a time until each has run for the given time.
+ * At the end, the simulated seconds per real second are printed, with
+ * each machine's player 1 score, lit lamp count, and exit status if it
+ * died.  The exit status is 1 if any machine died.
+ *
+ * Every machine starts with the same random seed, and so plays exactly
+ * the same as the others.  With -r, machine N is given the seed SEED+N
+ * before the script runs, so that each one plays differently.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "simpool.h"
+
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static unsigned int count_bits (const unsigned char *p, int len)
+{
+	unsigned int bits = 0;
+	while (len-- > 0)
+		bits += __builtin_popcount (*p++);
+	return bits;
+}
+
+
+int main (int argc, char *argv[])
+{
+	unsigned int instances = 4, seconds = 60;
+	const char *script = NULL, *nvram = NULL, *log_dir = NULL;
+	unsigned long seed = 0;
+	int seeded = 0;
+	struct sim_pool *pool;
+	struct sim_instance *inst;
+	unsigned char lamps[64];
+	char score[32];
+	unsigned int n, sec, alive, died = 0;
+	double start, elapsed;
+	int c, len;
+
+	while ((c = getopt (argc, argv, "n:t:s:m:d:r:")) != -1)
+	{
+		switch (c)
+		{
+			case 'n': instances = strtoul (optarg, NULL, 0); break;
+			case 't': seconds = strtoul (optarg, NULL, 0); break;
+			case 's': script = optarg; break;
+			case 'm': nvram = optarg; break;
+			case 'd': log_dir = optarg; break;
+			case 'r': seed = strtoul (optarg, NULL, 0); seeded = 1; break;
+			default: return 2;
+		}
+	}
+	if (optind >= argc)
+	{
+		fprintf (stderr, "usage: simrun [-n instances] [-t seconds] "
+			"[-s script] [-m nvram] [-d logdir] [-r seed] program\n");
+		return 2;
+	}
+
+	start = now ();
+	pool = sim_pool_create (argv[optind], instances, nvram, log_dir);
+	if (!pool)
+	{
+		fprintf (stderr, "simrun: could not start %u instances of %s\n",
+			instances, argv[optind]);
+		return 2;
+	}
+	printf ("%u instances ready in %.2fs\n", instances, now () - start);
+
+	start = now ();
+	if (seeded)
+	{
+		char cmd[64];
+		for (n = 0; n < pool->count; n++)
+		{
+			snprintf (cmd, sizeof (cmd), "seed %lu", seed + n);
+			sim_instance_command (pool->instances[n], cmd, NULL, 0);
+		}
+	}
+	if (script)
+	{
+		char cmd[512];
+		snprintf (cmd, sizeof (cmd), "include %s", script);
+		sim_pool_command (pool, cmd);
+	}
+	for (sec = 0; sec < seconds; sec++)
+	{
+		alive = 0;
+		for (n = 0; n < pool->count; n++)
+			if (!pool->instances[n]->dead && pool->instances[n]->time < (sec + 1) * 1000)
+				alive++;
+		if (alive)
+			sim_pool_step (pool, 1000);
+	}
+	elapsed = now () - start;
+
+	for (n = 0; n < pool->count; n++)
+	{
+		inst = pool->instances[n];
+		if (inst->dead)
+		{
+			printf ("%3u: died at %lums, exit %d\n", n, inst->time,
+				WIFEXITED (inst->status) ? WEXITSTATUS (inst->status) : -1);
+			died++;
+			continue;
+		}
+		len = sim_instance_lamps (inst, lamps, sizeof (lamps));
+		sim_instance_score (inst, 0, score, sizeof (score));
+		printf ("%3u: %lums, score %s, %u lamps on\n", n, inst->time, score,
+			count_bits (lamps, len));
+	}
+	printf ("%.1f simulated seconds per second (%u x %lus in %.2fs)\n",
+		instances * seconds / elapsed, instances,
+		(unsigned long)seconds, elapsed);
+
+	sim_pool_destroy (pool);
+	return died ? 1 : 0;
+}
@@ -0,0 +1,734 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * swfuzz : look for switch sequences that crash the game code.
+ *
+ * Usage: swfuzz [-j <workers>] [-o <dir>] [-p <preamble>] [-m <nvram>]
+ *               [-w <switches>] [-t <timeout ms>] [-n <execs>]
+ *               [-T <seconds>] <program>
+ *
+ * PROGRAM is a native build with CONFIG_FUZZ and CONFIG_GREEN, so that
+ * it records which branches it takes (see sim/coverage.c) and every run
+ * of the same input takes the same path.  Each test runs a new instance
+ * through tools/simpool: it starts from a copy of the NVRAM template,
+ * runs the PREAMBLE script (to start a game, say), then closes or
+ * toggles switches with pauses between them, and lets the machine run
+ * for another second.
+ *
+ * Inputs that reach branches or branch counts not seen before are kept
+ * in <dir>/corpus, and later mutated to make new inputs.  Each input is
+ * saved as a script, so any of them can be rerun by hand.  The workers
+ * run in parallel, and each one picks up what the others have saved.
+ *
+ * A test fails when the program takes a fatal error (its exit status is
+ * the error code), dies from a signal, takes a nonfatal error, or stops
+ * replying for the timeout.  The input is then cut down to the fewest
+ * switches and the shortest pauses that still fail the same way, and
+ * written to <dir>/crashes/<reason>.scr.  That script includes the
+ * preamble and can be replayed with
+ *
+ *   <program> --exec <dir>/crashes/<reason>.scr
+ *
+ * Only the first failure of each kind is kept.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../simpool/simpool.h"
+
+/** These must match sim/coverage.c */
+#define COVERAGE_MAP_SIZE 65536
+
+#define MAX_EVENTS 64
+
+/** The time to let the machine run after the last switch */
+#define SETTLE_MS 1000
+
+/** One switch change, and the time to wait after it */
+struct event
+{
+	unsigned char sw;
+	unsigned char toggle;
+	unsigned int delay;
+};
+
+struct input
+{
+	unsigned int len;
+	struct event ev[MAX_EVENTS];
+};
+
+/** The pauses that mutations choose from, in milliseconds */
+static const unsigned int delays[] = {
+	0, 16, 33, 100, 250, 500, 1000, 3000
+};
+
+static const char *program;
+static const char *out_dir = "swfuzz.out";
+static const char *preamble;
+static const char *nvram_template;
+static unsigned int num_switches = 72;
+static unsigned long max_execs;
+static unsigned long max_seconds;
+
+/* Per-worker state; each worker is its own process */
+static unsigned int worker;
+static unsigned char *trace_map;
+static unsigned char virgin_map[COVERAGE_MAP_SIZE];
+static char nvram_file[256];
+static unsigned long long rng_state;
+static unsigned long execs;
+static unsigned int crashes;
+
+static struct input **queue;
+static unsigned int queue_len;
+static unsigned int queue_max;
+
+static char **seen;
+static unsigned int seen_len;
+static unsigned int seen_max;
+static unsigned int saved;
+
+static volatile sig_atomic_t stop_requested;
+
+
+static void stop_handler (int sig)
+{
+	stop_requested = 1;
+}
+
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static unsigned int rnd (unsigned int limit)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (rng_state >> 16) % limit;
+}
+
+
+static void random_event (struct event *ev)
+{
+	ev->sw = rnd (num_switches);
+	ev->toggle = rnd (4) == 0;
+	ev->delay = delays[rnd (sizeof (delays) / sizeof (delays[0]))];
+}
+
+
+/** Copy the NVRAM template, so that every test starts the same way. */
+static int reset_nvram (void)
+{
+	char buf[4096], jnl[300];
+	ssize_t n;
+	int in, out;
+
+	snprintf (jnl, sizeof (jnl), "%s.jnl", nvram_file);
+	unlink (jnl);
+	unlink (nvram_file);
+	if (!nvram_template)
+		return 0;
+	in = open (nvram_template, O_RDONLY);
+	out = open (nvram_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (in < 0 || out < 0)
+		return -1;
+	while ((n = read (in, buf, sizeof (buf))) > 0)
+		if (write (out, buf, n) != n)
+			break;
+	close (in);
+	close (out);
+	return 0;
+}
+
+
+/**
+ * Run one test.  Returns nonzero if it failed, with the reason in SIG.
+ * If REPLAY is given, that script is run instead of the input.
+ */
+static int run_input (const struct input *in, const char *replay, char *sig)
+{
+	struct sim_instance *inst;
+	char cmd[300], reply[64];
+	unsigned int n, count = 0;
+	int last = 0, status;
+
+	memset (trace_map, 0, COVERAGE_MAP_SIZE);
+	if (reset_nvram () < 0)
+	{
+		fprintf (stderr, "swfuzz: cannot copy %s\n", nvram_template);
+		exit (2);
+	}
+	inst = sim_instance_create (program, nvram_file, NULL);
+	if (!inst)
+	{
+		fprintf (stderr, "swfuzz: %s did not start\n", program);
+		exit (2);
+	}
+	execs++;
+
+	if (replay)
+		sim_instance_load_script (inst, replay);
+	else
+	{
+		if (preamble)
+		{
+			sim_instance_load_script (inst, preamble);
+			if (inst->dead && WIFEXITED (inst->status) && !WEXITSTATUS (inst->status))
+			{
+				fprintf (stderr, "swfuzz: %s must not exit\n", preamble);
+				exit (2);
+			}
+		}
+		for (n = 0; n < in->len && !inst->dead; n++)
+		{
+			sprintf (cmd, "%s %u", in->ev[n].toggle ? "swtoggle" : "sw",
+				in->ev[n].sw);
+			sim_instance_command (inst, cmd, NULL, 0);
+			if (in->ev[n].delay)
+				sim_instance_step (inst, in->ev[n].delay);
+		}
+	}
+	sim_instance_step (inst, SETTLE_MS);
+	if (sim_instance_command (inst, "errors", reply, sizeof (reply)) == 0)
+		sscanf (reply, "%u %d", &count, &last);
+
+	n = inst->timed_out;
+	status = sim_instance_destroy (inst);
+	if (n)
+		strcpy (sig, "hang");
+	else if (WIFSIGNALED (status))
+		sprintf (sig, "signal-%d", WTERMSIG (status));
+	else if (WIFEXITED (status) && WEXITSTATUS (status))
+		sprintf (sig, "fatal-%d", WEXITSTATUS (status));
+	else if (count)
+		sprintf (sig, "nonfatal-%d", last);
+	else
+		return 0;
+	return 1;
+}
+
+
+/** Put each edge count in a bucket, as AFL does, so that a loop running
+one more time is not a new path but running twice as often is. */
+static unsigned char bucket (unsigned char count)
+{
+	if (count <= 3)
+		return count == 3 ? 4 : count;
+	else if (count <= 7)
+		return 8;
+	else if (count <= 15)
+		return 16;
+	else if (count <= 31)
+		return 32;
+	else if (count <= 127)
+		return 64;
+	else
+		return 128;
+}
+
+
+/** Returns nonzero if the last test reached something new, and adds
+what it reached to the virgin map. */
+static int has_new_bits (void)
+{
+	unsigned int n;
+	unsigned char b;
+	int found = 0;
+
+	for (n = 0; n < COVERAGE_MAP_SIZE; n++)
+	{
+		if (!trace_map[n])
+			continue;
+		b = bucket (trace_map[n]);
+		if (b & virgin_map[n])
+		{
+			virgin_map[n] &= ~b;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+
+static unsigned int count_edges (void)
+{
+	unsigned int n, edges = 0;
+	for (n = 0; n < COVERAGE_MAP_SIZE; n++)
+		if (virgin_map[n] != 0xFF)
+			edges++;
+	return edges;
+}
+
+
+/** Write an input as a script.  With FINAL, the script has a header,
+includes the preamble, and lets the machine settle at the end, so that
+it can be given to --exec on its own once 'exit' is added. */
+static void write_script (FILE *fp, const struct input *in, const char *sig,
+	int final)
+{
+	unsigned int n;
+
+	if (final)
+	{
+		fprintf (fp, "# swfuzz: %s with %u switch changes\n", sig, in->len);
+		fprintf (fp, "# Replay with: %s --exec <this file>\n", program);
+		if (nvram_template)
+			fprintf (fp, "# starting from a copy of %s\n", nvram_template);
+		if (preamble)
+			fprintf (fp, "include %s\n", preamble);
+	}
+	for (n = 0; n < in->len; n++)
+	{
+		fprintf (fp, "%s %u\n", in->ev[n].toggle ? "swtoggle" : "sw",
+			in->ev[n].sw);
+		if (in->ev[n].delay)
+			fprintf (fp, "sleep %u\n", in->ev[n].delay);
+	}
+	if (final)
+		fprintf (fp, "sleep %u\n", SETTLE_MS);
+}
+
+
+/** Read a script written by write_script() back into an input.  Lines
+that are not switches or pauses are ignored. */
+static int read_script (const char *file, struct input *in)
+{
+	FILE *fp;
+	char line[256];
+	unsigned int val;
+
+	fp = fopen (file, "r");
+	if (!fp)
+		return -1;
+	in->len = 0;
+	while (fgets (line, sizeof (line), fp) && in->len < MAX_EVENTS)
+	{
+		if (sscanf (line, "sw %u", &val) == 1 || sscanf (line, "swtoggle %u", &val) == 1)
+		{
+			in->ev[in->len].sw = val;
+			in->ev[in->len].toggle = line[2] == 't';
+			in->ev[in->len].delay = 0;
+			in->len++;
+		}
+		else if (sscanf (line, "sleep %u", &val) == 1 && in->len)
+			in->ev[in->len - 1].delay += val;
+	}
+	fclose (fp);
+	return 0;
+}
+
+
+static void queue_add (const struct input *in)
+{
+	if (queue_len == queue_max)
+	{
+		queue_max = queue_max ? queue_max * 2 : 64;
+		queue = realloc (queue, queue_max * sizeof (*queue));
+	}
+	queue[queue_len] = malloc (sizeof (*in));
+	*queue[queue_len++] = *in;
+}
+
+
+static void seen_add (const char *name)
+{
+	if (seen_len == seen_max)
+	{
+		seen_max = seen_max ? seen_max * 2 : 64;
+		seen = realloc (seen, seen_max * sizeof (*seen));
+	}
+	seen[seen_len++] = strdup (name);
+}
+
+
+static int seen_find (const char *name)
+{
+	unsigned int n;
+	for (n = 0; n < seen_len; n++)
+		if (!strcmp (seen[n], name))
+			return 1;
+	return 0;
+}
+
+
+/** Keep an input that found something new, and share it with the
+other workers. */
+static void corpus_save (const struct input *in)
+{
+	char name[64], path[512];
+	FILE *fp;
+
+	queue_add (in);
+	sprintf (name, "w%u-%u.scr", worker, saved++);
+	seen_add (name);
+	snprintf (path, sizeof (path), "%s/corpus/%s", out_dir, name);
+	fp = fopen (path, "w");
+	if (fp)
+	{
+		write_script (fp, in, NULL, 0);
+		fclose (fp);
+	}
+}
+
+
+/**
+ * Shrink an input that failed, keeping only what is needed to fail the
+ * same way.  Runs of switches are removed, halving the run length each
+ * time nothing more can be removed, and then each pause is shortened.
+ */
+static void minimize (struct input *in, const char *sig)
+{
+	struct input trial;
+	char trial_sig[64];
+	unsigned int chunk, pos, n;
+
+	for (chunk = in->len / 2; chunk >= 1; chunk /= 2)
+	{
+		pos = 0;
+		while (pos < in->len && !stop_requested)
+		{
+			trial = *in;
+			n = pos + chunk < in->len ? chunk : in->len - pos;
+			memmove (&trial.ev[pos], &trial.ev[pos + n],
+				(in->len - pos - n) * sizeof (struct event));
+			trial.len -= n;
+			if (run_input (&trial, NULL, trial_sig) && !strcmp (trial_sig, sig))
+				*in = trial;
+			else
+				pos += chunk;
+		}
+	}
+
+	for (pos = 0; pos < in->len && !stop_requested; pos++)
+	{
+		while (in->ev[pos].delay)
+		{
+			trial = *in;
+			trial.ev[pos].delay = trial.ev[pos].delay > 16 ? trial.ev[pos].delay / 2 : 0;
+			if (run_input (&trial, NULL, trial_sig) && !strcmp (trial_sig, sig))
+				*in = trial;
+			else
+				break;
+		}
+	}
+}
+
+
+/** Minimize a new kind of failure and write it out as a script. */
+static void crash_save (struct input *in, const char *sig)
+{
+	char path[512], tmp[512], replay_sig[64];
+	unsigned int before = in->len;
+	FILE *fp;
+
+	snprintf (path, sizeof (path), "%s/crashes/%s.scr", out_dir, sig);
+	if (access (path, F_OK) == 0)
+		return;
+
+	minimize (in, sig);
+
+	/* Check that the script itself fails, when run the way that
+	exec_script_file() would run it */
+	snprintf (tmp, sizeof (tmp), "%s/crashes/.w%u.scr", out_dir, worker);
+	fp = fopen (tmp, "w");
+	if (!fp)
+		return;
+	write_script (fp, in, sig, 1);
+	fclose (fp);
+	if (!run_input (NULL, tmp, replay_sig))
+		strcpy (replay_sig, "no failure");
+	if (strcmp (replay_sig, sig))
+		fprintf (stderr, "w%u: %s does not replay from a script (got %s)\n",
+			worker, sig, replay_sig);
+
+	/* Without this, --exec would leave the machine running */
+	fp = fopen (tmp, "a");
+	if (fp)
+	{
+		fprintf (fp, "exit\n");
+		fclose (fp);
+	}
+
+	/* Only the first worker to find this kind of failure keeps it */
+	if (link (tmp, path) == 0)
+	{
+		crashes++;
+		printf ("w%u: %s, %u switch changes cut to %u, in %s\n",
+			worker, sig, before, in->len, path);
+	}
+	unlink (tmp);
+}
+
+
+/** Run a test and keep it if it is interesting.  Returns nonzero if it
+found something new. */
+static int test_input (struct input *in, int save)
+{
+	char sig[64];
+
+	if (run_input (in, NULL, sig))
+	{
+		has_new_bits ();
+		crash_save (in, sig);
+		return 0;
+	}
+	if (!has_new_bits ())
+		return 0;
+	if (save)
+		corpus_save (in);
+	else
+		queue_add (in);
+	return 1;
+}
+
+
+/** Run any inputs that other workers have saved since the last time,
+keeping those that are new to this worker. */
+static void corpus_sync (void)
+{
+	char path[512];
+	struct input in;
+	struct dirent *de;
+	DIR *dir;
+
+	snprintf (path, sizeof (path), "%s/corpus", out_dir);
+	dir = opendir (path);
+	if (!dir)
+		return;
+	while ((de = readdir (dir)) && !stop_requested)
+	{
+		if (de->d_name[0] == '.' || seen_find (de->d_name))
+			continue;
+		seen_add (de->d_name);
+		snprintf (path, sizeof (path), "%s/corpus/%s", out_dir, de->d_name);
+		if (read_script (path, &in) == 0)
+			test_input (&in, 0);
+	}
+	closedir (dir);
+}
+
+
+static void mutate (struct input *in)
+{
+	const struct input *other;
+	unsigned int n, pos, count, stack = 1 + rnd (4);
+
+	while (stack-- > 0)
+	{
+		pos = in->len ? rnd (in->len) : 0;
+		switch (in->len ? rnd (7) : 0)
+		{
+			case 0: /* insert a new switch */
+				if (in->len == MAX_EVENTS)
+					break;
+				memmove (&in->ev[pos + 1], &in->ev[pos],
+					(in->len - pos) * sizeof (struct event));
+				random_event (&in->ev[pos]);
+				in->len++;
+				break;
+			case 1: /* remove one */
+				memmove (&in->ev[pos], &in->ev[pos + 1],
+					(in->len - pos - 1) * sizeof (struct event));
+				in->len--;
+				break;
+			case 2: /* change which switch */
+				in->ev[pos].sw = rnd (num_switches);
+				break;
+			case 3: /* close it instead of toggling, or the other way */
+				in->ev[pos].toggle ^= 1;
+				break;
+			case 4: /* change the pause after it */
+				in->ev[pos].delay = delays[rnd (sizeof (delays) / sizeof (delays[0]))];
+				break;
+			case 5: /* repeat a run of switches */
+				count = 1 + rnd (in->len - pos);
+				if (in->len + count > MAX_EVENTS)
+					break;
+				memmove (&in->ev[pos + count], &in->ev[pos],
+					(in->len - pos) * sizeof (struct event));
+				in->len += count;
+				break;
+			case 6: /* splice on the tail of another input */
+				other = queue[rnd (queue_len)];
+				if (!other->len)
+					break;
+				n = rnd (other->len);
+				count = other->len - n;
+				if (pos + count > MAX_EVENTS)
+					count = MAX_EVENTS - pos;
+				memcpy (&in->ev[pos], &other->ev[n], count * sizeof (struct event));
+				in->len = pos + count;
+				break;
+		}
+	}
+}
+
+
+static void worker_main (void)
+{
+	char path[512];
+	struct input in;
+	double start, last_report;
+	unsigned int n;
+	int fd;
+
+	signal (SIGINT, stop_handler);
+	signal (SIGTERM, stop_handler);
+	rng_state = ((unsigned long long)time (NULL) << 20) ^ getpid () ^ 0x9E3779B97F4A7C15ULL;
+	memset (virgin_map, 0xFF, sizeof (virgin_map));
+	snprintf (nvram_file, sizeof (nvram_file), "%s/.w%u.nv", out_dir, worker);
+
+	/* The program maps the same file, through FREEWPC_COVERAGE */
+	snprintf (path, sizeof (path), "%s/.w%u.cov", out_dir, worker);
+	fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate (fd, COVERAGE_MAP_SIZE) < 0)
+	{
+		perror (path);
+		exit (2);
+	}
+	trace_map = mmap (NULL, COVERAGE_MAP_SIZE, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close (fd);
+	if (trace_map == MAP_FAILED)
+		exit (2);
+	setenv ("FREEWPC_COVERAGE", path, 1);
+
+	/* Start from whatever is in the corpus, or from nothing at all */
+	in.len = 0;
+	test_input (&in, 0);
+	if (!queue_len)
+	{
+		/* A failure before any switch is closed is not worth fuzzing */
+		fprintf (stderr, "w%u: the empty input fails\n", worker);
+		exit (1);
+	}
+	corpus_sync ();
+	for (n = 0; n < 8; n++)
+	{
+		in.len = 1 + rnd (8);
+		for (fd = 0; fd < in.len; fd++)
+			random_event (&in.ev[fd]);
+		test_input (&in, 1);
+	}
+
+	start = last_report = now ();
+	while (!stop_requested)
+	{
+		if (max_execs && execs >= max_execs)
+			break;
+		if (max_seconds && now () - start >= max_seconds)
+			break;
+
+		in = *queue[rnd (queue_len)];
+		mutate (&in);
+		test_input (&in, 1);
+
+		if (now () - last_report >= 5.0)
+		{
+			corpus_sync ();
+			printf ("w%u: %lu execs, %.1f/s, %u paths, %u edges, %u crashes\n",
+				worker, execs, execs / (now () - start), queue_len,
+				count_edges (), crashes);
+			fflush (stdout);
+			last_report = now ();
+		}
+	}
+	printf ("w%u: done, %lu execs, %u paths, %u edges, %u crashes\n",
+		worker, execs, queue_len, count_edges (), crashes);
+	exit (0);
+}
+
+
+int main (int argc, char *argv[])
+{
+	unsigned int workers = 1, n;
+	char path[512];
+	pid_t pid;
+	int c;
+
+	sim_instance_timeout = 5000;
+	while ((c = getopt (argc, argv, "j:o:p:m:w:t:n:T:")) != -1)
+	{
+		switch (c)
+		{
+			case 'j': workers = strtoul (optarg, NULL, 0); break;
+			case 'o': out_dir = optarg; break;
+			case 'p': preamble = optarg; break;
+			case 'm': nvram_template = optarg; break;
+			case 'w': num_switches = strtoul (optarg, NULL, 0); break;
+			case 't': sim_instance_timeout = strtoul (optarg, NULL, 0); break;
+			case 'n': max_execs = strtoul (optarg, NULL, 0); break;
+			case 'T': max_seconds = strtoul (optarg, NULL, 0); break;
+			default: return 2;
+		}
+	}
+	if (optind >= argc || !workers || !num_switches || num_switches > 256)
+	{
+		fprintf (stderr, "usage: swfuzz [-j workers] [-o dir] [-p preamble] "
+			"[-m nvram] [-w switches] [-t timeout] [-n execs] [-T seconds] "
+			"program\n");
+		return 2;
+	}
+	program = argv[optind];
+
+	mkdir (out_dir, 0755);
+	snprintf (path, sizeof (path), "%s/corpus", out_dir);
+	mkdir (path, 0755);
+	snprintf (path, sizeof (path), "%s/crashes", out_dir);
+	mkdir (path, 0755);
+
+	setvbuf (stdout, NULL, _IOLBF, 0);
+	for (n = 0; n < workers; n++)
+	{
+		pid = fork ();
+		if (pid == 0)
+		{
+			worker = n;
+			worker_main ();
+		}
+		else if (pid < 0)
+		{
+			perror ("fork");
+			break;
+		}
+	}
+
+	signal (SIGINT, SIG_IGN);
+	while (wait (NULL) > 0)
+		;
+	return 0;
+}
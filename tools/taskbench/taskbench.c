@@ -0,0 +1,199 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * taskbench : measure the cost of the native task backends.
+ *
+ * Usage: taskbench_green [<count>]
+ *        taskbench_pthread [<count>]
+ *        taskbench_pth [<count>]
+ *
+ * Each program is this file built with one of cpu/native/task_*.c, as
+ * selected by the small taskbench_*.c that includes it.  It times:
+ *
+ * - create: COUNT tasks that exit at once, started BENCH_BATCH at a
+ *   time, the way a burst of switch handlers or deffs would be;
+ * - sleep: BENCH_BATCH tasks that each call task_sleep(0) COUNT times.
+ *
+ * and prints the operations per second.  The shared task table in
+ * ntask.c is left out, so this is only the backend's own cost.
+ *
+ * With the green threads, there is no real time to wait for: the
+ * dispatcher's idle hook just advances the system clock, so the sleep
+ * test counts the switches and list operations of a tick.  The other
+ * backends really sleep, as they do in the simulator.
+ */
+
+#include <stdarg.h>
+#include <time.h>
+
+/* The group IDs that the backends treat specially.  A game gets these
+from the generated gendefine_gid.h. */
+#define GID_FIRST_TASK 1
+#define GID_LINUX_REALTIME 2
+#define GID_LINUX_INTERFACE 3
+#define GID_BENCH 4
+
+#if defined(CONFIG_GREEN)
+#include "cpu/native/task_green.c"
+#elif defined(CONFIG_PTHREADS)
+#include "cpu/native/task_pthread.c"
+#elif defined(CONFIG_PTH)
+#include "cpu/native/task_pth.c"
+#endif
+
+#ifndef linux_irq_multiplier
+int linux_irq_multiplier = 1;
+#endif
+
+/** The number of tasks alive at once in each test */
+#define BENCH_BATCH 32
+
+U16 sys_time;
+bool task_dispatching_ok;
+aux_task_data_t task_data_table[NUM_TASKS];
+
+unsigned int bench_count;
+unsigned int bench_done;
+unsigned int bench_live;
+
+
+void fatal (U8 errcode)
+{
+	fprintf (stderr, "taskbench: fatal error %d\n", errcode);
+	exit (1);
+}
+
+
+void print_log (const char *format, ...)
+{
+	va_list ap;
+	va_start (ap, format);
+	vfprintf (stderr, format, ap);
+	va_end (ap);
+}
+
+
+void realtime_idle (void)
+{
+	sys_time++;
+}
+
+
+/* Only count the tasks, since the real table is not part of the test.
+A pthread may exit before its creator has returned, so this can go
+below zero for a moment. */
+task_pid_t aux_task_create (task_pid_t pid, task_gid_t gid)
+{
+	__atomic_add_fetch (&bench_live, 1, __ATOMIC_RELAXED);
+	return pid;
+}
+
+
+void aux_task_delete (task_pid_t pid)
+{
+	__atomic_sub_fetch (&bench_live, 1, __ATOMIC_RELAXED);
+}
+
+
+void ntask_init (void)
+{
+}
+
+
+static double bench_now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** Wait for WANT of the tasks just started to finish. */
+static void bench_wait (unsigned int want)
+{
+	while (__atomic_load_n (&bench_done, __ATOMIC_ACQUIRE) < want)
+		task_yield ();
+}
+
+
+static void bench_exit_task (void)
+{
+	__atomic_add_fetch (&bench_done, 1, __ATOMIC_RELEASE);
+	task_exit ();
+}
+
+
+static void bench_sleep_task (void)
+{
+	unsigned int n;
+	for (n = 0; n < bench_count; n++)
+		task_sleep (0);
+	__atomic_add_fetch (&bench_done, 1, __ATOMIC_RELEASE);
+	task_exit ();
+}
+
+
+/** Return the number of tasks created and exited per second. */
+static double bench_create (unsigned int count)
+{
+	unsigned int n, i;
+	double start;
+
+	bench_done = 0;
+	start = bench_now ();
+	for (n = 0; n < count; n += BENCH_BATCH)
+	{
+		for (i = 0; i < BENCH_BATCH; i++)
+			task_create_gid (GID_BENCH, bench_exit_task);
+		bench_wait (n + BENCH_BATCH);
+	}
+	return n / (bench_now () - start);
+}
+
+
+/** Return the number of sleeps per second. */
+static double bench_sleep (unsigned int count)
+{
+	unsigned int i;
+	double start;
+
+	bench_done = 0;
+	bench_count = count;
+	start = bench_now ();
+	for (i = 0; i < BENCH_BATCH; i++)
+		task_create_gid (GID_BENCH, bench_sleep_task);
+	bench_wait (BENCH_BATCH);
+	return (double)count * BENCH_BATCH / (bench_now () - start);
+}
+
+
+int main (int argc, char *argv[])
+{
+	unsigned int count = 20000;
+
+	if (argc > 1)
+		count = strtoul (argv[1], NULL, 0);
+
+	task_init ();
+	printf ("%-8s %12.0f /s\n", "create", bench_create (count));
+	printf ("%-8s %12.0f /s\n", "sleep", bench_sleep (count / BENCH_BATCH));
+	return 0;
+}
@@ -0,0 +1,3 @@
+/* taskbench with the green threads task backend */
+#define CONFIG_GREEN
+#include "taskbench.c"
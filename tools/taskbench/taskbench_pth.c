@@ -0,0 +1,3 @@
+/* taskbench with the GNU Pth task backend */
+#define CONFIG_PTH
+#include "taskbench.c"
@@ -0,0 +1,3 @@
+/* taskbench with the pthreads task backend */
+#define CONFIG_PTHREADS
+#include "taskbench.c"
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2012 by Brian Dominy <brian@oddchange.com>
+ *
+ * This file is part of FreeWPC.
+ *
+ * FreeWPC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FreeWPC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with FreeWPC; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * trace2json : convert a binary trace dump, as written by trace_dump()
+ * in a native build with CONFIG_TRACE, into the Chrome trace event
+ * format.  The output can be loaded into chrome://tracing or
+ * ui.perfetto.dev.
+ *
+ * Usage: trace2json <trace.bin> [<output.json>]
+ *
+ * Events which have a natural start and end (deffs, leffs, flashers,
+ * pulsed coils, task sleeps) are shown as duration slices on their
+ * own rows.  Everything else is an instant event on the row of the
+ * task group that logged it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* These must match include/log.h */
+#define TRACE_MAGIC 0x52545746
+#define TRACE_VERSION 1
+
+struct trace_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t count;
+	uint32_t dropped;
+};
+
+struct trace_record
+{
+	uint32_t usecs;
+	uint16_t module_event;
+	uint16_t arg;
+	uint16_t gid;
+	uint16_t reserved;
+};
+
+#define MOD_DEFF 0
+#define MOD_LAMP 1
+#define MOD_TASK 3
+#define MOD_SWITCH 4
+#define MOD_SOL 9
+#define MOD_CALLSET 10
+
+const char *module_names[16] = {
+	"Deff", "Lamp", "Sound", "Task", "Sw", "Triac", "Game", "Sys",
+	"Pricing", "Sol", "Callset",
+};
+
+/* Synthetic thread IDs for the rows that are not task groups.
+Task groups use their GID directly, which is always < 256. */
+#define TID_DEFF 1000
+#define TID_LEFF 1001
+#define TID_PULSE 1002
+#define TID_FLASHER 1003
+
+/** An open slice, waiting for its end event */
+struct slice
+{
+	int open;
+	uint32_t start;
+	uint16_t arg;
+};
+
+struct slice deff_slice;
+struct slice leff_slice[256];
+struct slice pulse_slice;
+struct slice flasher_slice[256];
+struct slice sleep_slice[65536];
+
+FILE *ofp;
+int first_event = 1;
+
+
+void emit_prefix (void)
+{
+	if (!first_event)
+		fprintf (ofp, ",\n");
+	first_event = 0;
+}
+
+
+void emit_complete (const char *name, unsigned int arg,
+	unsigned int tid, uint32_t start, uint32_t end)
+{
+	emit_prefix ();
+	fprintf (ofp, "{\"name\":\"%s %u\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,"
+		"\"ts\":%u,\"dur\":%u}", name, arg, tid, start, end - start);
+}
+
+
+void emit_instant (const char *name, unsigned int event, unsigned int arg,
+	unsigned int tid, uint32_t ts)
+{
+	emit_prefix ();
+	fprintf (ofp, "{\"name\":\"%s.%u %u\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,"
+		"\"tid\":%u,\"ts\":%u}", name, event, arg, tid, ts);
+}
+
+
+void emit_thread_name (unsigned int tid, const char *name)
+{
+	emit_prefix ();
+	fprintf (ofp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+		"\"tid\":%u,\"args\":{\"name\":\"%s\"}}", tid, name);
+}
+
+
+void slice_begin (struct slice *s, const char *name, unsigned int tid,
+	uint16_t arg, uint32_t ts)
+{
+	/* A new start on a row that is already open (for example, a deff
+	preempting another) ends the previous slice. */
+	if (s->open)
+		emit_complete (name, s->arg, tid, s->start, ts);
+	s->open = 1;
+	s->start = ts;
+	s->arg = arg;
+}
+
+
+void slice_end (struct slice *s, const char *name, unsigned int tid,
+	uint32_t ts)
+{
+	if (s->open)
+	{
+		emit_complete (name, s->arg, tid, s->start, ts);
+		s->open = 0;
+	}
+}
+
+
+void convert (const struct trace_record *rec)
+{
+	unsigned int module = rec->module_event >> 8;
+	unsigned int event = rec->module_event & 0xFF;
+	const char *name = (module < 16 && module_names[module]) ?
+		module_names[module] : "?";
+
+	switch (module)
+	{
+		case MOD_DEFF:
+			if (event == 0 || event == 4) /* start, restart */
+				slice_begin (&deff_slice, "deff", TID_DEFF, rec->arg, rec->usecs);
+			else if (event == 1 || event == 2) /* stop, exit */
+				slice_end (&deff_slice, "deff", TID_DEFF, rec->usecs);
+			return;
+
+		case MOD_LAMP:
+			if (event == 0)
+			{
+				slice_begin (&leff_slice[rec->arg & 0xFF], "leff", TID_LEFF,
+					rec->arg, rec->usecs);
+				return;
+			}
+			else if (event == 1 || event == 2)
+			{
+				slice_end (&leff_slice[rec->arg & 0xFF], "leff", TID_LEFF,
+					rec->usecs);
+				return;
+			}
+			break;
+
+		case MOD_SOL:
+			switch (event)
+			{
+				case 0:
+					slice_begin (&flasher_slice[rec->arg & 0xFF], "flasher",
+						TID_FLASHER, rec->arg, rec->usecs);
+					return;
+				case 1:
+					slice_end (&flasher_slice[rec->arg & 0xFF], "flasher",
+						TID_FLASHER, rec->usecs);
+					return;
+				case 8:
+					slice_begin (&pulse_slice, "sol", TID_PULSE, rec->arg,
+						rec->usecs);
+					return;
+				case 9:
+					slice_end (&pulse_slice, "sol", TID_PULSE, rec->usecs);
+					return;
+			}
+			break;
+
+		case MOD_TASK:
+			if (event == 6)
+			{
+				slice_begin (&sleep_slice[rec->gid], "sleep", rec->gid,
+					rec->arg, rec->usecs);
+				return;
+			}
+			else if (event == 7)
+			{
+				slice_end (&sleep_slice[rec->gid], "sleep", rec->gid,
+					rec->usecs);
+				return;
+			}
+			break;
+	}
+
+	emit_instant (name, event, rec->arg, rec->gid, rec->usecs);
+}
+
+
+int main (int argc, char *argv[])
+{
+	struct trace_header hdr;
+	struct trace_record rec;
+	FILE *ifp;
+	uint32_t n;
+
+	if (argc < 2)
+	{
+		fprintf (stderr, "usage: trace2json <trace.bin> [<output.json>]\n");
+		exit (1);
+	}
+
+	ifp = fopen (argv[1], "rb");
+	if (!ifp)
+	{
+		fprintf (stderr, "error: cannot open %s\n", argv[1]);
+		exit (1);
+	}
+
+	if (fread (&hdr, sizeof (hdr), 1, ifp) != 1
+		|| hdr.magic != TRACE_MAGIC
+		|| hdr.version != TRACE_VERSION
+		|| hdr.record_size != sizeof (struct trace_record))
+	{
+		fprintf (stderr, "error: %s is not a version %d trace file\n",
+			argv[1], TRACE_VERSION);
+		exit (1);
+	}
+
+	ofp = (argc > 2) ? fopen (argv[2], "w") : stdout;
+	if (!ofp)
+	{
+		fprintf (stderr, "error: cannot open %s\n", argv[2]);
+		exit (1);
+	}
+
+	fprintf (ofp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	emit_thread_name (TID_DEFF, "deff");
+	emit_thread_name (TID_LEFF, "leff");
+	emit_thread_name (TID_PULSE, "pulsed coils");
+	emit_thread_name (TID_FLASHER, "flashers");
+
+	for (n = 0; n < hdr.count; n++)
+	{
+		if (fread (&rec, sizeof (rec), 1, ifp) != 1)
+		{
+			fprintf (stderr, "warning: trace truncated after %u records\n", n);
+			break;
+		}
+		convert (&rec);
+	}
+
+	fprintf (ofp, "\n],\"otherData\":{\"dropped\":%u}}\n", hdr.dropped);
+	fclose (ifp);
+	if (ofp != stdout)
+		fclose (ofp);
+	return 0;
+}